@@ -142,6 +142,9 @@ main()
    // in custom-sorted order.
    splinter_data_cfg.key_compare = custom_key_compare;
 
+   // The default key_normalize follows the memcmp order, not ours.
+   splinter_data_cfg.key_normalize = NULL;
+
    // Basic configuration of a SplinterDB instance
    splinterdb_config splinterdb_cfg;
    configure_splinter_instance(&splinterdb_cfg,
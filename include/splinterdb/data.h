@@ -109,6 +109,22 @@ typedef int (*key_compare_fn)(const data_config *cfg, slice key1, slice key2);
 
 typedef uint32 (*key_hash_fn)(const void *input, size_t length, uint32 seed);
 
+// Returns the length of the prefix of key that names the group it belongs
+// to, e.g. the tenant id of a "tenant_id|object_id" key.
+//
+// The keys sharing a prefix must be contiguous in key order, and the prefix
+// itself must sort at or before all of them. Applied to a prefix, it must
+// return the full length of the prefix.
+typedef uint64 (*key_prefix_fn)(const data_config *cfg, slice key);
+
+// Returns a fixed-width image of a prefix of key which preserves the order
+// of key_compare: if key1 < key2, then key_normalize(key1) <=
+// key_normalize(key2). For a lexicographic order, this is the first 8 bytes
+// of the key read as a big-endian integer, padded with zeroes.
+//
+// Keys with distinct images are ordered without calling key_compare.
+typedef uint64 (*key_normalize_fn)(const data_config *cfg, slice key);
+
 // Given two messages, old_message and new_message, merge them
 // and return the result in new_message.
 //
@@ -132,6 +148,20 @@ typedef int (*merge_tuple_final_fn)(const data_config *cfg,
                                     slice              key,
                                     merge_accumulator *oldest_message);
 
+// Called by compactions on each key they write, with its merged message and
+// the height of the trunk node being compacted, which is 0 for leaves.
+// Messages are INSERTs or UPDATEs: deletes are not passed.
+//
+// To rewrite the message, change msg. To drop the key, set the class of msg
+// to MESSAGE_TYPE_DELETE: the key then reads as deleted, and the delete
+// itself is discarded once it reaches a leaf.
+//
+// Returns 0 on success.  Non-zero indicates an internal error.
+typedef int (*compaction_filter_fn)(const data_config *cfg,
+                                    slice              key,    // IN
+                                    uint64             height, // IN
+                                    merge_accumulator *msg);   // IN/OUT
+
 typedef void (*key_to_str_fn)(const data_config *cfg,
                               slice              key,
                               char              *str,
@@ -149,7 +179,9 @@ typedef void (*message_to_str_fn)(const data_config *cfg,
  * The application needs to tell SplinterDB some things about keys and values:
  *
  *  1. The sorting order of keys - defined by the key_compare function
- *  2. How to hash keys - defined by the key_hash function
+ *  2. How to hash keys - defined by the key_hash function, and optionally
+ *     which prefix of a key to hash - defined by the key_prefix function
+ *     and an order-preserving image of keys - defined by key_normalize
  *  3. How to merge update messages - defined by the pair of merge_tuples* fns.
  *  4. How to convert between messages and values (encode and decode functions)
  *  4. Few other debugging aids on how-to print & diagnose messages.
@@ -164,10 +196,38 @@ struct data_config {
 
    key_compare_fn key_compare;
    key_hash_fn    key_hash;
+   /* key_prefix may be NULL. If set, the filters of the tree are keyed on
+      key prefixes rather than whole keys, so that prefix scans can skip the
+      branches that hold no key with their prefix. This makes the filters
+      less selective for point lookups of keys that share a prefix.
+
+      The filters can then no longer estimate how many distinct keys a part
+      of the tree holds, so space reclamation, which compacts the parts
+      holding many stale versions of keys, is turned off. Stale versions are
+      only dropped by the compactions that flushes trigger.
+
+      Whether key_prefix is set is recorded on disk, and a database can only
+      be opened with the same setting. The function itself must not change
+      over the life of the database. */
+   key_prefix_fn key_prefix;
+   /* key_normalize may be NULL. If set, searches of the pivots of trunk
+      nodes compare the normalized images of keys, and only call
+      key_compare on keys whose images are equal.
+
+      It must preserve the order of key_compare, so a caller that overrides
+      key_compare in a config set up by default_data_config_init() must
+      also clear key_normalize, or set its own. The default one only
+      normalizes keys for the default key_compare, and otherwise maps every
+      key to the same image, which is correct but slower than NULL. */
+   key_normalize_fn key_normalize;
    /* The merge functions may be NULL, in which case
       splinterdb_update() is not allowed. */
    merge_tuple_fn       merge_tuples;
    merge_tuple_final_fn merge_tuples_final;
+   /* compaction_filter may be NULL. If set, it lets the application expire
+      or rewrite tuples as compactions rewrite them, e.g. to drop values
+      past a TTL without writing deletes for them. */
+   compaction_filter_fn compaction_filter;
    key_to_str_fn        key_to_string;
    message_to_str_fn    message_to_string;
 };
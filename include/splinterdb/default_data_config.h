@@ -6,6 +6,9 @@
 //
 // This data_config does not support blind mutation operations, except
 // plain overwrites of values.
+//
+// Callers that override key_compare must also clear (or replace)
+// key_normalize, whose images follow the memcmp order, see data.h.
 
 #ifndef _SPLINTERDB_DEFAULT_DATA_CONFIG_H_
 #define _SPLINTERDB_DEFAULT_DATA_CONFIG_H_
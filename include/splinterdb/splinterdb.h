@@ -74,6 +74,34 @@ typedef struct splinterdb_config {
    _Bool       cache_use_stats;
    const char *cache_logfile;
 
+   // With cache_scan_resistant, the pages read by compactions and iterators
+   // only evict the pages in the first cache_probation_percent of the cache
+   // (default 25), a fixed range of its entries, rather than the pages point
+   // lookups reuse elsewhere. Pages in that range are evicted by scans too,
+   // unless lookups have read them again since the cache's clock last
+   // passed them.
+   _Bool  cache_scan_resistant;
+   uint64 cache_probation_percent;
+
+   // Minimum shares of the cache, in percent, kept for trunk nodes, filters
+   // and branch (B-tree) pages, adding up to at most 75. The pages of a kind
+   // within its share are only evicted once no other page can be, and never
+   // with cache_pin_reserved. The default, 0, reserves nothing.
+   uint64 cache_trunk_reserve_percent;
+   uint64 cache_filter_reserve_percent;
+   uint64 cache_branch_reserve_percent;
+   _Bool  cache_pin_reserved;
+
+   // With cache_huge_pages, the cache asks for huge pages for its pages and
+   // metadata: explicit ones (MAP_HUGETLB, from vm.nr_hugepages) if there
+   // are enough, else transparent ones. See splinterdb_stats for what it got.
+   _Bool cache_huge_pages;
+
+   // Background I/O limit, see splinterdb_set_compaction_io_limit().
+   // 0 for unlimited, which is the default.
+   uint64 compaction_io_bytes_per_sec;
+   uint64 compaction_io_target_read_latency_ns;
+
    // task system
    // Background threads configuration:
    //
@@ -89,6 +117,12 @@ typedef struct splinterdb_config {
    uint64 num_memtable_bg_threads;
    uint64 num_normal_bg_threads;
 
+   // The most threads registered at a time, counting the background threads
+   // and the thread which created or opened the splinterdb. Per-thread state
+   // is allocated for this many threads, so memory grows with it. The
+   // default of 0 means 64; it can be at most 4096.
+   uint64 max_threads;
+
    // btree
    uint64 btree_rough_count_height;
 
@@ -99,6 +133,21 @@ typedef struct splinterdb_config {
    // log
    _Bool use_log;
 
+   // With log_sync, splinterdb_insert() and the other updates return only
+   // once their log entry is durable. Concurrent updates share the write and
+   // fdatasync of the log pages: the thread doing them for a group waits up
+   // to log_sync_max_delay_us for other updates in progress to join.
+   _Bool  log_sync;
+   uint64 log_sync_max_delay_us;
+
+   // Once the log has grown to log_checkpoint_size bytes, the update which
+   // finds it so checkpoints, which truncates the log and lets disk space
+   // freed since the last checkpoint be reused. The checkpoint writes back
+   // every dirty page of the cache, so that update takes long; other
+   // updates go on meanwhile. The default is 1 GiB; UINT64_MAX leaves
+   // checkpoints to splinterdb_open() and bulk loads.
+   uint64 log_checkpoint_size;
+
    // splinter
    uint64 memtable_capacity;
    uint64 fanout;
@@ -145,6 +194,23 @@ typedef struct splinterdb_config {
    // work to be performed on foreground threads, increasing tail
    // latencies.
    uint64 queue_scale_percent;
+
+   // When memtable incorporations or compactions fall behind, updates are
+   // delayed in proportion to how close they are to stalling, by up to
+   // write_throttle_max_delay_us each. A write batch is delayed in
+   // proportion to its number of ops, but also by no more than that. This
+   // slows updates down gradually instead of blocking them for a whole
+   // memtable incorporation. The default is 1000; disable_write_throttle
+   // turns throttling off.
+   uint64 write_throttle_max_delay_us;
+   _Bool  disable_write_throttle;
+
+   // Compactions of large bundles are split into up to
+   // max_compaction_subranges key sub-ranges, which are merged concurrently
+   // on the normal background threads. The default of 0 uses one sub-range
+   // per normal background thread, so parallel compaction is ON by default
+   // whenever num_normal_bg_threads > 1; set 1 to turn splitting off.
+   uint64 max_compaction_subranges;
 } splinterdb_config;
 
 // Opaque handle to an opened instance of SplinterDB
@@ -172,12 +238,60 @@ splinterdb_create(const splinterdb_config *cfg, splinterdb **kvs);
 int
 splinterdb_open(const splinterdb_config *cfg, splinterdb **kvs);
 
-// Close a splinterdb
+// Close a splinterdb or a keyspace
 //
-// This will flush all data to disk and release all resources
+// This will flush all data to disk and release all resources. Every keyspace
+// of a splinterdb must be closed before the splinterdb itself.
 void
 splinterdb_close(splinterdb **kvs);
 
+/*
+ * Keyspaces
+ *
+ * A keyspace is a separately named tree of keys within a splinterdb, with
+ * its own data_config and memtables. All the keyspaces of a splinterdb share
+ * its cache, disk space and background threads, so tables that would not fit
+ * in memory as separate splinterdbs may fit as keyspaces of one.
+ *
+ * A keyspace is used through a splinterdb handle of its own, with all the
+ * other splinterdb functions, and closed with splinterdb_close(). The
+ * splinterdb created or opened by splinterdb_create() or splinterdb_open()
+ * is itself the default keyspace, which has no name.
+ *
+ * Threads registered with a splinterdb may use all its keyspaces. The
+ * config options of the splinterdb, such as use_log and memtable_capacity,
+ * apply to each keyspace.
+ *
+ * Each keyspace has a log of its own, but since they share disk space, a
+ * checkpoint checkpoints all open keyspaces together, whichever one's log
+ * grew to log_checkpoint_size. After a crash, splinterdb_open() keeps the
+ * logs of all keyspaces, and each keyspace replays its own once opened.
+ */
+#define SPLINTERDB_MAX_KEYSPACES            (28)
+#define SPLINTERDB_MAX_KEYSPACE_NAME_LENGTH (63)
+
+// Create a new keyspace named name in kvs
+//
+// Fails with EEXIST if kvs already has a keyspace of that name.
+// data_cfg must live at least as long as the returned keyspace.
+int
+splinterdb_keyspace_create(splinterdb  *kvs,      // IN
+                           const char  *name,     // IN
+                           data_config *data_cfg, // IN
+                           splinterdb **keyspace  // OUT
+);
+
+// Open the existing keyspace named name in kvs
+//
+// Fails with ENOENT if there is no such keyspace, and with EAGAIN if it is
+// already open. data_cfg must be the one the keyspace was created with.
+int
+splinterdb_keyspace_open(splinterdb  *kvs,      // IN
+                         const char  *name,     // IN
+                         data_config *data_cfg, // IN
+                         splinterdb **keyspace  // OUT
+);
+
 // Register the current thread so that it can be used with splinterdb.
 // This causes scratch space to be allocated for the thread.
 //
@@ -191,7 +305,8 @@ splinterdb_close(splinterdb **kvs);
 // splinterdb_close will use scratch space, so the thread that calls it must
 // have been registered (or implicitly registered by being the initial thread).
 //
-// Note: There is currently a limit of MAX_THREADS registered at a given time
+// Note: There is a limit of splinterdb_config.max_threads registered at a
+// given time, beyond which this fails.
 void
 splinterdb_register_thread(splinterdb *kvs);
 
@@ -216,10 +331,96 @@ splinterdb_delete(const splinterdb *kvsb, slice key);
 int
 splinterdb_update(const splinterdb *kvsb, slice key, slice delta);
 
+// Delete every key in [start_key, end_key). Writes made after this returns
+// are not affected; concurrent lookups and writes to the range may see it
+// partly deleted.
+//
+// The range delete is recorded as a single tombstone for the keys already
+// flushed from the in-memory table, plus a point delete for each key of the
+// range still in it, so its cost grows with the recently written part of the
+// range. It is logged, and recovered after a crash, as one unit.
+//
+// Returns EINVAL if start_key does not sort before end_key. A range delete
+// stays pending until compactions have dropped the keys it covers. At most 32
+// can be pending, in a table of 2048 bytes where each takes 12 bytes plus the
+// lengths of its keys, so one whose keys add up to more than 2036 bytes
+// returns ENOSPC. When the table is full, this compacts the ranges of the
+// pending range deletes and waits for them to stop pending, and returns
+// ENOSPC only if that does not make room.
+int
+splinterdb_delete_range(const splinterdb *kvsb, slice start_key, slice end_key);
+
+// Write batches
+//
+// A write batch applies a group of inserts, updates and deletes as a unit:
+// either all of them are applied or, if any key or value is invalid, none
+// are. All operations of a batch are placed in the same memtable, so they
+// are always flushed into the tree together, and they are logged as one
+// unit, which recovery from a crash replays whole or not at all.
+//
+// Returns EIO if the batch was applied but could not be logged. It is then
+// lost whole if the process crashes before the database is closed.
+//
+// Operations on the same key are applied in array order, so the last one
+// wins (or, for updates, is merged last).
+//
+// Concurrent lookups and iterators may see part of a batch while it is being
+// applied.
+
+typedef enum {
+   SPLINTERDB_WRITE_INSERT,
+   SPLINTERDB_WRITE_UPDATE,
+   SPLINTERDB_WRITE_DELETE,
+} splinterdb_write_op_type;
+
+typedef struct {
+   splinterdb_write_op_type type;
+   slice                    key;
+   slice                    value; // value or delta; ignored for deletes
+} splinterdb_write_op;
+
+// Apply num_ops operations atomically
+//
+// Relies on data_config->merge_tuples if the batch contains updates
+int
+splinterdb_write_batch(const splinterdb          *kvs,    // IN
+                       const splinterdb_write_op  ops[],  // IN
+                       uint64                     num_ops // IN
+);
+
+// Bulk load
+//
+// A bulk load fills an empty database from tuples in strictly increasing key
+// order. The tuples are packed straight into the leaves of a new tree, so
+// each is written once, instead of going through the memtable and the
+// flushes and compactions that follow inserts.
+//
+// The source sets *key and *value to the next tuple and returns TRUE, or
+// returns FALSE once there are none left. The slices must stay valid until
+// the next call.
+typedef _Bool (*splinterdb_bulk_load_source)(void  *arg,
+                                             slice *key,
+                                             slice *value);
+
+// Load every tuple of the source as an insert.
+//
+// Returns EINVAL, having loaded nothing, if the database is not empty, or if
+// a key is out of order or a key or value is too large. The loaded data is
+// not logged; it is checkpointed, and so durable, once this returns. Must not
+// be called concurrently with other operations.
+int
+splinterdb_bulk_load(const splinterdb           *kvs,
+                     splinterdb_bulk_load_source source,
+                     void                       *arg);
+
 // Lookups
 
 // Size of opaque data required to hold a lookup result
-#define SPLINTERDB_LOOKUP_BUFSIZE (6 * sizeof(void *))
+//
+// This grew from 6 to 16 words when zero-copy results were added, which
+// changed the size of splinterdb_lookup_result: code built against an older
+// splinterdb.h must be recompiled.
+#define SPLINTERDB_LOOKUP_BUFSIZE (16 * sizeof(void *))
 
 // A lookup result is stored and parsed from here
 //
@@ -253,6 +454,27 @@ splinterdb_lookup_result_init(const splinterdb         *kvs,        // IN
                               char                     *buffer      // IN
 );
 
+// Initialize a lookup result object which reads values in place
+//
+// When a value was written once with splinterdb_insert and has since been
+// flushed out of the memtable, splinterdb_lookup and splinterdb_snapshot_lookup
+// do not copy it. Instead, the result pins the cache page containing the
+// value, and splinterdb_lookup_result_value returns a slice pointing into that
+// page. Every other value is copied as usual, into memory managed by the
+// library, and so is this one when too many pages are pinned already.
+//
+// The value slice remains valid until the next lookup using result, or until
+// result is deinit'ed, which both unpin the page. Results must be deinit'ed
+// before kvs is closed. Async and batch lookups always copy the value.
+//
+// The pinned page cannot be evicted, and the disk space of a compacted branch
+// is only reclaimed once the results pinning its pages are done with them. So
+// do not hold onto a result longer than needed.
+void
+splinterdb_lookup_result_init_zero_copy(const splinterdb         *kvs,   // IN
+                                        splinterdb_lookup_result *result // OUT
+);
+
 // Release any resources used by result
 //
 // This will never free a buffer passed to splinterdb_lookup_result_init
@@ -281,6 +503,74 @@ splinterdb_lookup(const splinterdb         *kvs,   // IN
                   splinterdb_lookup_result *result // IN/OUT
 );
 
+// Lookup the messages for a batch of keys
+//
+// results[i] receives the result for keys[i], and each must have first been
+// initialized using splinterdb_lookup_result_init
+//
+// The lookups are kept in flight together on the calling thread, using the
+// async lookup API below, so that their cache misses overlap instead of being
+// waited for one at a time. Returns once every lookup in the batch has
+// completed. Other async lookups of the calling thread may complete meanwhile.
+int
+splinterdb_lookup_batch(const splinterdb         *kvs,       // IN
+                        const slice               keys[],    // IN
+                        splinterdb_lookup_result  results[], // IN/OUT
+                        uint64                    num_keys   // IN
+);
+
+// Async lookups
+//
+// An async lookup lets a single thread keep many lookups in flight without
+// blocking on IO. The caller owns all the state of a lookup: the context,
+// the key and the result, so no memory is allocated per lookup.
+//
+// Sample application code:
+//
+//    splinterdb_lookup_async_start(kvs, &ctxt, key, &result, on_done, arg);
+//    ...
+//    // From the event loop of the same thread:
+//    splinterdb_poll(kvs);
+//
+// A lookup is complete when its callback has been invoked. Until then, the
+// context, key and result must stay valid and must not be modified.
+
+// Size of opaque data required to hold an async lookup context
+#define SPLINTERDB_LOOKUP_ASYNC_CTXT_SIZE (48 * sizeof(void *))
+
+typedef struct {
+   char opaque[SPLINTERDB_LOOKUP_ASYNC_CTXT_SIZE];
+} __attribute__((__aligned__(8))) splinterdb_lookup_async_ctxt;
+
+// Invoked on the thread that started the lookup, once it completes.
+// The context may be reused as soon as this is called.
+typedef void (*splinterdb_lookup_async_cb)(splinterdb_lookup_async_ctxt *ctxt,
+                                           splinterdb_lookup_result *result,
+                                           void                     *arg);
+
+// Start an async lookup of the message for a given key
+//
+// result must have first been initialized using splinterdb_lookup_result_init
+//
+// If the lookup can be answered without IO, cb is invoked before this
+// function returns. Otherwise, it is invoked from a later call to
+// splinterdb_poll() on this same thread.
+int
+splinterdb_lookup_async_start(const splinterdb             *kvs,    // IN
+                              splinterdb_lookup_async_ctxt *ctxt,   // IN/OUT
+                              slice                         key,    // IN
+                              splinterdb_lookup_result     *result, // IN/OUT
+                              splinterdb_lookup_async_cb    cb,     // IN
+                              void                         *cb_arg  // IN
+);
+
+// Make progress on the async lookups started by the calling thread
+//
+// Never blocks. Invokes the callback of every lookup that completes, and
+// returns the number of such lookups.
+uint64
+splinterdb_poll(const splinterdb *kvs);
+
 
 /*
 Iterator API (range query)
@@ -345,6 +635,32 @@ splinterdb_iterator_init(const splinterdb     *kvs,      // IN
                          slice                 start_key // IN
 );
 
+// Initialize a new iterator over [start_key, end_key)
+//
+// If start_key is NULL_SLICE, the iterator will start before the minimum key.
+// If end_key is NULL_SLICE, the range is unbounded above, as with
+// splinterdb_iterator_init(). Otherwise, the iterator becomes invalid when
+// it reaches end_key, and branches and leaves of the tree that hold no keys
+// below end_key are never read. Prefer this for short scans.
+int
+splinterdb_iterator_init_range(const splinterdb     *kvs,       // IN
+                               splinterdb_iterator **iter,      // OUT
+                               slice                 start_key, // IN
+                               slice                 end_key    // IN
+);
+
+// Initialize a new iterator over the keys with the given prefix
+//
+// Requires data_config->key_prefix, and prefix must be a whole prefix, i.e.
+// key_prefix(prefix) must be its length. The iterator starts at the first
+// key with the prefix and becomes invalid at the first key past it. Branches
+// whose filters rule out the prefix are never read.
+int
+splinterdb_iterator_init_prefix(const splinterdb     *kvs,   // IN
+                                splinterdb_iterator **iter,  // OUT
+                                slice                 prefix // IN
+);
+
 // Deinitialize an iterator
 //
 // Failing to do this may cause hangs.
@@ -398,12 +714,169 @@ splinterdb_iterator_get_current(splinterdb_iterator *iter, // IN
                                 slice               *value // OUT
 );
 
+// Return only part of each value from now on
+//
+// Once this is called, get_current() sets *value to bytes
+// [offset, offset + length) of the current value, clipped to the end of the
+// value, instead of the whole value. Neither this nor the full value is
+// copied.
+void
+splinterdb_iterator_project_value(splinterdb_iterator *iter,   // IN/OUT
+                                  uint64               offset, // IN
+                                  uint64               length  // IN
+);
+
+// Return keys only from now on
+//
+// Once this is called, get_current() sets *value to NULL_SLICE. Keys whose
+// latest message is a delete are still skipped.
+void
+splinterdb_iterator_keys_only(splinterdb_iterator *iter); // IN/OUT
+
 // Returns an error encountered from iteration, or 0 if successful.
 //
 // End-of-range is not an error
 int
 splinterdb_iterator_status(const splinterdb_iterator *iter);
 
+/*
+ * Snapshots
+ *
+ * A snapshot is a consistent, read-only view of the database as of the call
+ * to splinterdb_snapshot_create(). Writes made afterwards are not visible
+ * through it, however long it is kept, and ingest carries on at full speed
+ * meanwhile.
+ *
+ * Creating a snapshot pushes the current memtable into the tree, then takes a
+ * reference on every branch of the tree as it stands, so compaction cannot
+ * reclaim them. No data is copied, but the space of branches that compaction
+ * has since replaced is only reclaimed once the snapshot is released.
+ *
+ * This makes creating a snapshot expensive, and it is meant for long scans
+ * or backups rather than for each read:
+ *  - The current memtable is flushed however little it holds, and the call
+ *    waits until it and every earlier memtable are incorporated. Each flush
+ *    adds a small branch to the root, which later compactions must merge.
+ *  - Every node of the tree is visited, to take its references. Writes,
+ *    flushes and compactions carry on meanwhile, but the space they free is
+ *    only reclaimed once the visit is done.
+ *
+ * At most 64 snapshots can be live at once; beyond that,
+ * splinterdb_snapshot_create() returns ENOSPC. It returns ENOTSUP when
+ * reclaim_threshold is set, as space reclamation rewrites nodes in place.
+ */
+typedef struct splinterdb_snapshot splinterdb_snapshot;
+
+int
+splinterdb_snapshot_create(splinterdb           *kvs,     // IN
+                           splinterdb_snapshot **snapshot // OUT
+);
+
+// Every iterator over the snapshot must be deinitialized first
+void
+splinterdb_snapshot_release(splinterdb *kvs, splinterdb_snapshot *snapshot);
+
+// Lookup the message for a given key as of the snapshot
+//
+// result must have first been initialized using splinterdb_lookup_result_init
+int
+splinterdb_snapshot_lookup(const splinterdb          *kvs,      // IN
+                           const splinterdb_snapshot *snapshot, // IN
+                           slice                      key,      // IN
+                           splinterdb_lookup_result  *result    // IN/OUT
+);
+
+// Initialize an iterator over [start_key, end_key) as of the snapshot
+//
+// Either key may be NULL_SLICE, see splinterdb_iterator_init_range().
+int
+splinterdb_snapshot_iterator_init(const splinterdb          *kvs,       // IN
+                                  const splinterdb_snapshot *snapshot,  // IN
+                                  splinterdb_iterator      **iter,      // OUT
+                                  slice                      start_key, // IN
+                                  slice                      end_key    // IN
+);
+
+/*
+ * Parallel Scans
+ *
+ * An iterator scans on a single thread. To scan a range on several, split it
+ * into partitions with splinterdb_scan_partitions_create(), then have
+ * registered threads call splinterdb_scan_partition() for each partition.
+ * The partitions are disjoint, cover the range in key order, and can be
+ * scanned concurrently and in any order.
+ *
+ * Partition boundaries are chosen among the pivot keys of the tree, so that
+ * each partition holds about the same amount of data. There may be fewer
+ * partitions than requested when the range holds little data.
+ *
+ * Each partition scan sees the database as an iterator would, as of when
+ * that scan starts; use a snapshot iterator instead for a consistent view.
+ */
+typedef struct splinterdb_scan_partitions splinterdb_scan_partitions;
+
+// Splits [start_key, end_key) into at most max_partitions partitions
+//
+// Either key may be NULL_SLICE, see splinterdb_iterator_init_range().
+int
+splinterdb_scan_partitions_create(
+   const splinterdb            *kvs,            // IN
+   slice                        start_key,      // IN
+   slice                        end_key,        // IN
+   uint64                       max_partitions, // IN
+   splinterdb_scan_partitions **partitions      // OUT
+);
+
+uint64
+splinterdb_scan_partitions_count(const splinterdb_scan_partitions *partitions);
+
+// Called on each key and value of a partition, in order. key and value are
+// only valid during the call. A non-zero return stops the scan.
+typedef int (*splinterdb_scan_fn)(uint64 partition, // IN
+                                  slice  key,       // IN
+                                  slice  value,     // IN
+                                  void  *arg        // IN
+);
+
+// Scans partition number partition, calling scan_fn on each of its keys
+//
+// Returns the first non-zero return of scan_fn, or an error encountered
+// while iterating, or 0.
+int
+splinterdb_scan_partition(const splinterdb                 *kvs,        // IN
+                          const splinterdb_scan_partitions *partitions, // IN
+                          uint64                            partition,  // IN
+                          splinterdb_scan_fn                scan_fn,    // IN
+                          void                             *arg         // IN
+);
+
+void
+splinterdb_scan_partitions_destroy(const splinterdb           *kvs,
+                                   splinterdb_scan_partitions *partitions);
+
+/*
+ * Background I/O Limit
+ *
+ * Limits the disk reads and writes of compactions and filter builds to
+ * bytes_per_sec, so that they leave device bandwidth to lookups, or lifts
+ * the limit if bytes_per_sec is 0. Compactions and filter builds that run on
+ * foreground threads are limited too. They are delayed between tasks rather
+ * than at each I/O, so that they never wait holding locks, and the limit
+ * holds on average over a few tasks.
+ *
+ * If target_read_latency_ns is not 0, the limit is tuned automatically: it
+ * is lowered while the average latency of the page reads done by other
+ * threads is above target_read_latency_ns, and raised back up to
+ * bytes_per_sec while it is below.
+ *
+ * The limit may be changed at any time, and is shared with all the keyspaces
+ * of the database.
+ */
+void
+splinterdb_set_compaction_io_limit(const splinterdb *kvs,
+                                   uint64            bytes_per_sec,
+                                   uint64            target_read_latency_ns);
+
 /*
  * Statistics Printing
  *
@@ -422,4 +895,143 @@ splinterdb_stats_print_lookup(const splinterdb *kvs);
 void
 splinterdb_stats_reset(splinterdb *kvs);
 
+/*
+ * Statistics Snapshot
+ *
+ * splinterdb_stats_get() sums the per-thread counters of SplinterDB into a
+ * splinterdb_stats. It does not stop other threads, so it is cheap enough to
+ * call periodically, but counters updated while it runs may or may not be
+ * included. It must not be called concurrently with splinterdb_stats_reset().
+ *
+ * Except for the current task queue lengths, background I/O limit and pages
+ * cached, the counters are only kept if the use_stats config option is set,
+ * and are zero otherwise.
+ *
+ * Later versions of the struct only add fields at its end, and bump
+ * SPLINTERDB_STATS_VERSION. Callers must set size to sizeof(splinterdb_stats)
+ * before the call, and only that many bytes are written, so a caller built
+ * against an older header gets the fields it knows about and nothing past
+ * them. On return, version is the library's SPLINTERDB_STATS_VERSION and size
+ * is the number of bytes written. Returns EINVAL if size does not cover the
+ * version and size fields.
+ */
+#define SPLINTERDB_STATS_VERSION 7
+
+// Latency percentiles are upper bounds of the histogram buckets they fall in
+typedef struct splinterdb_latency_stats {
+   uint64 count;
+   uint64 min_ns;
+   uint64 mean_ns;
+   uint64 p50_ns;
+   uint64 p90_ns;
+   uint64 p99_ns;
+   uint64 p999_ns;
+   uint64 max_ns;
+} splinterdb_latency_stats;
+
+typedef struct splinterdb_task_stats {
+   uint64 num_waiting;   // tasks queued now
+   uint64 num_executing; // tasks running now
+   uint64 num_enqueued;
+   uint64 num_bg_executed; // by background threads
+   uint64 num_fg_executed; // by foreground threads
+   uint64 queue_wait_time_ns;
+   uint64 max_queue_wait_time_ns;
+   uint64 max_runtime_ns;
+} splinterdb_task_stats;
+
+typedef enum {
+   SPLINTERDB_MEMORY_PAGES,                  // base pages
+   SPLINTERDB_MEMORY_TRANSPARENT_HUGE_PAGES, // madvise(MADV_HUGEPAGE)
+   SPLINTERDB_MEMORY_HUGE_PAGES,             // MAP_HUGETLB
+} splinterdb_memory_backing;
+
+typedef struct splinterdb_cache_stats {
+   uint64 hits;
+   uint64 misses;
+   uint64 probationary_reads; // by compactions and iterators
+} splinterdb_cache_stats;
+
+typedef struct splinterdb_stats {
+   uint32 version; // OUT: SPLINTERDB_STATS_VERSION
+   uint32 size;    // IN: sizeof(splinterdb_stats), OUT: bytes written
+
+   // operations
+   uint64                   insertions;
+   uint64                   updates;
+   uint64                   deletions;
+   uint64                   lookups_found;
+   uint64                   lookups_not_found;
+   splinterdb_latency_stats insert_latency;
+   splinterdb_latency_stats update_latency;
+   splinterdb_latency_stats delete_latency;
+
+   // trunk
+   uint64 memtable_flushes;
+   uint64 flushes;
+   uint64 compactions;
+   uint64 compaction_tuples;
+   uint64 compaction_time_ns;
+   uint64 leaf_splits;
+   uint64 index_splits;
+   uint64 filters_built;
+   uint64 filter_lookups;
+   uint64 filter_false_positives;
+   uint64 branch_lookups;
+   uint64 space_reclamations;
+   uint64 tuples_reclaimed;
+   uint64 discarded_deletes;
+
+   // cache
+   uint64 cache_hits;
+   uint64 cache_misses;
+   uint64 cache_miss_time_ns;
+   uint64 prefetches_issued;
+   uint64 writebacks_issued;
+   uint64 syncs_issued;
+
+   // I/O
+   uint64 pages_read;
+   uint64 pages_written;
+   uint64 bytes_read;
+   uint64 bytes_written;
+
+   // task system
+   splinterdb_task_stats memtable_tasks;
+   splinterdb_task_stats normal_tasks;
+
+   // background I/O limit, since version 2
+   uint64 compaction_io_bytes_per_sec; // in effect now, 0 if unlimited
+   uint64 compaction_io_throttle_time_ns;
+
+   // write throttling, since version 3
+   uint64 write_throttles;        // updates delayed
+   uint64 write_throttle_time_ns; // measured time they slept
+   uint64 write_stalls;           // updates that waited for a memtable
+   uint64 write_stall_time_ns;
+
+   // compactions split into sub-ranges, since version 4
+   uint64 parallel_compactions;
+   uint64 compaction_subranges;
+
+   // cache by kind of page, since version 5
+   splinterdb_cache_stats trunk_cache;
+   splinterdb_cache_stats branch_cache;
+   splinterdb_cache_stats filter_cache;
+
+   // pages in the cache now, by kind, since version 6
+   uint64 trunk_pages_cached;
+   uint64 branch_pages_cached;
+   uint64 filter_pages_cached;
+
+   // memory backing the cache, since version 7; transparent huge pages only
+   // if the kernel lets them back it and, where faulted in, they map part of it
+   splinterdb_memory_backing cache_pages_backing;
+   splinterdb_memory_backing cache_refcount_backing; // ref and pin counts
+   splinterdb_memory_backing cache_lookup_backing;
+} splinterdb_stats;
+
+int
+splinterdb_stats_get(const splinterdb *kvs, splinterdb_stats *stats);
+
 #endif // _SPLINTERDB_H_
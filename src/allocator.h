@@ -121,6 +121,9 @@ typedef allocator_config *(*allocator_get_config_fn)(allocator *al);
 typedef platform_status (*alloc_fn)(allocator *al,
                                     uint64    *addr,
                                     page_type  type);
+typedef platform_status (*alloc_at_fn)(allocator *al,
+                                       uint64     addr,
+                                       page_type  type);
 
 typedef uint8 (*dec_ref_fn)(allocator *al, uint64 addr, page_type type);
 typedef uint8 (*generic_ref_fn)(allocator *al, uint64 addr);
@@ -135,6 +138,8 @@ typedef void (*remove_super_addr_fn)(allocator *al, allocator_root_id spl_id);
 typedef uint64 (*get_size_fn)(allocator *al);
 typedef uint64 (*base_addr_fn)(const allocator *al, uint64 addr);
 
+typedef platform_status (*checkpoint_fn)(allocator *al);
+
 typedef void (*print_fn)(allocator *al);
 typedef void (*assert_fn)(allocator *al);
 
@@ -145,6 +150,7 @@ typedef void (*assert_fn)(allocator *al);
 typedef struct allocator_ops {
    allocator_get_config_fn get_config;
    alloc_fn                alloc;
+   alloc_at_fn             alloc_at;
 
    generic_ref_fn inc_ref;
    dec_ref_fn     dec_ref;
@@ -159,6 +165,8 @@ typedef struct allocator_ops {
    get_size_fn  get_capacity;
    base_addr_fn extent_base_addr;
 
+   checkpoint_fn checkpoint;
+
    assert_fn assert_noleaks;
 
    print_fn print_stats;
@@ -182,6 +190,16 @@ allocator_alloc(allocator *al, uint64 *addr, page_type type)
    return al->ops->alloc(al, addr, type);
 }
 
+/*
+ * Allocates the extent at addr, which must be free. This is used during
+ * recovery, to take back extents whose allocation was never persisted.
+ */
+static inline platform_status
+allocator_alloc_at(allocator *al, uint64 addr, page_type type)
+{
+   return al->ops->alloc_at(al, addr, type);
+}
+
 static inline uint8
 allocator_inc_ref(allocator *al, uint64 addr)
 {
@@ -233,6 +251,18 @@ allocator_get_capacity(allocator *al)
    return al->ops->get_capacity(al);
 }
 
+/*
+ * Persists the current ref counts as a checkpoint. Extents the checkpoint, or
+ * the one before it, references are not handed out again until the next
+ * checkpoint, even if they are freed, so the state either describes stays
+ * intact on disk until the super block naming the new one is written.
+ */
+static inline platform_status
+allocator_checkpoint(allocator *al)
+{
+   return al->ops->checkpoint(al);
+}
+
 static inline void
 allocator_assert_noleaks(allocator *al)
 {
@@ -1184,11 +1184,12 @@ btree_root_to_meta_addr(const btree_config *cfg,
  * Creating and destroying B-trees.
  *----------------------------------------------------------
  */
-uint64
-btree_create(cache              *cc,
-             const btree_config *cfg,
-             mini_allocator     *mini,
-             page_type           type)
+static uint64
+btree_create_with_batches(cache              *cc,
+                          const btree_config *cfg,
+                          mini_allocator     *mini,
+                          page_type           type,
+                          uint64              num_batches)
 {
    // get a free node for the root
    // we don't use the next_addr arr for this, since the root doesn't
@@ -1226,13 +1227,22 @@ btree_create(cache              *cc,
              cfg->data_cfg,
              root.addr + btree_page_size(cfg),
              0,
-             BTREE_MAX_HEIGHT,
+             num_batches,
              type,
              type == PAGE_TYPE_BRANCH);
 
    return root.addr;
 }
 
+uint64
+btree_create(cache              *cc,
+             const btree_config *cfg,
+             mini_allocator     *mini,
+             page_type           type)
+{
+   return btree_create_with_batches(cc, cfg, mini, type, BTREE_MAX_HEIGHT);
+}
+
 void
 btree_inc_ref_range(cache              *cc,
                     const btree_config *cfg,
@@ -2102,8 +2112,11 @@ btree_lookup_node(cache             *cc,             // IN
    return STATUS_OK;
 }
 
-
-static inline void
+/*
+ * Looks target up in the btree. If found, *msg points into node, which is
+ * left referenced and must be released with btree_node_unget.
+ */
+void
 btree_lookup_with_ref(cache        *cc,        // IN
                       btree_config *cfg,       // IN
                       uint64        root_addr, // IN
@@ -3012,7 +3025,7 @@ btree_pack_node_init_hdr(const btree_config *cfg,
 }
 
 static inline void
-btree_pack_setup_start(btree_pack_req *req)
+btree_pack_setup_start(btree_pack_req *req, uint64 num_batches)
 {
    req->height = 0;
    ZERO_ARRAY(req->edge);
@@ -3020,9 +3033,12 @@ btree_pack_setup_start(btree_pack_req *req)
    ZERO_ARRAY(req->num_edges);
 
    // we create a root here, but we won't build it with the rest
-   // of the tree, we'll copy into it at the end
-   req->root_addr =
-      btree_create(req->cc, req->cfg, &req->mini, PAGE_TYPE_BRANCH);
+   // of the tree, we'll copy into it at the end (runs pack their leaves into
+   // the tree of their output request instead)
+   if (req->out == NULL) {
+      req->root_addr = btree_create_with_batches(
+         req->cc, req->cfg, &req->mini, PAGE_TYPE_BRANCH, num_batches);
+   }
 
    req->num_tuples    = 0;
    req->key_bytes     = 0;
@@ -3050,8 +3066,42 @@ btree_pack_get_current_node_stats(btree_pack_req *req, uint64 height)
 static inline btree_node *
 btree_pack_create_next_node(btree_pack_req *req, uint64 height, key pivot);
 
+/*
+ * Add an index entry for the child with the given pivot to the node being
+ * packed at height. Creates the node if necessary.
+ */
+static inline void
+btree_pack_add_index_entry(btree_pack_req   *req,
+                           uint64            height,
+                           key               pivot,
+                           uint64            child_addr,
+                           btree_pivot_stats child_stats)
+{
+   btree_node *parent = btree_pack_get_current_node(req, height);
+
+   if (!parent
+       || !btree_set_index_entry(req->cfg,
+                                 parent->hdr,
+                                 btree_num_entries(parent->hdr),
+                                 pivot,
+                                 child_addr,
+                                 child_stats))
+   {
+      btree_pack_create_next_node(req, height, pivot);
+      parent         = btree_pack_get_current_node(req, height);
+      bool32 success = btree_set_index_entry(
+         req->cfg, parent->hdr, 0, pivot, child_addr, child_stats);
+      platform_assert(success);
+   }
+
+   btree_accumulate_pivot_stats(btree_pack_get_current_node_stats(req, height),
+                                child_stats);
+}
+
 /*
  * Add the specified node to its parent. Creates a parent if necessary.
+ *
+ * Runs record their leaves instead, see btree_pack_runs_finish().
  */
 static inline void
 btree_pack_link_node(btree_pack_req *req,
@@ -3068,26 +3118,15 @@ btree_pack_link_node(btree_pack_req *req,
    btree_node_unclaim(req->cc, req->cfg, edge);
    // Cannot fully unlock edge yet because the key "pivot" may point into it.
 
-   btree_node *parent = btree_pack_get_current_node(req, height + 1);
-
-   if (!parent
-       || !btree_set_index_entry(req->cfg,
-                                 parent->hdr,
-                                 btree_num_entries(parent->hdr),
-                                 pivot,
-                                 edge->addr,
-                                 *edge_stats))
-   {
-      btree_pack_create_next_node(req, height + 1, pivot);
-      parent         = btree_pack_get_current_node(req, height + 1);
-      bool32 success = btree_set_index_entry(
-         req->cfg, parent->hdr, 0, pivot, edge->addr, *edge_stats);
-      platform_assert(success);
+   if (req->out == NULL) {
+      btree_pack_add_index_entry(
+         req, height + 1, pivot, edge->addr, *edge_stats);
+   } else {
+      debug_assert(height == 0);
+      btree_pack_leaf leaf = {.addr = edge->addr, .stats = *edge_stats};
+      writable_buffer_append(&req->leaves, sizeof(leaf), &leaf);
    }
 
-   btree_accumulate_pivot_stats(
-      btree_pack_get_current_node_stats(req, height + 1), *edge_stats);
-
    btree_node_unget(req->cc, req->cfg, edge);
    memset(edge_stats, 0, sizeof(*edge_stats));
 }
@@ -3108,9 +3147,10 @@ btree_pack_create_next_node(btree_pack_req *req, uint64 height, key pivot)
 {
    btree_node new_node;
    uint64     node_next_extent;
+   // runs allocate their leaves from their own batch of the output tree
    btree_alloc(req->cc,
-               &req->mini,
-               height,
+               req->out == NULL ? &req->mini : &req->out->mini,
+               req->out == NULL ? height : req->batch,
                pivot,
                &node_next_extent,
                PAGE_TYPE_BRANCH,
@@ -3168,8 +3208,14 @@ btree_pack_loop(btree_pack_req *req,       // IN/OUT
 
    if (req->hash) {
       platform_assert(req->num_tuples < req->max_tuples);
-      req->fingerprint_arr[req->num_tuples] =
-         req->hash(key_data(tuple_key), key_length(tuple_key), req->seed);
+      key    filter_key = data_key_filter_key(req->cfg->data_cfg, tuple_key);
+      uint32 fp =
+         req->hash(key_data(filter_key), key_length(filter_key), req->seed);
+      if (req->out == NULL) {
+         req->fingerprint_arr[req->num_tuples] = fp;
+      } else {
+         writable_buffer_append(&req->fingerprints, sizeof(fp), &fp);
+      }
    }
 
    req->num_tuples++;
@@ -3188,6 +3234,12 @@ btree_pack_post_loop(btree_pack_req *req, key last_key)
    // loop into the btree_create root
    btree_node root;
 
+   // runs leave the rest of the tree to btree_pack_runs_finish()
+   if (req->out != NULL) {
+      btree_pack_link_extent(req, 0, 0);
+      return;
+   }
+
    // if output tree is empty, deallocate any preallocated extents
    if (req->num_tuples == 0) {
       mini_destroy_unused(&req->mini);
@@ -3231,11 +3283,14 @@ btree_pack_abort(btree_pack_req *req)
       }
    }
 
-   btree_dec_ref_range(req->cc,
-                       req->cfg,
-                       req->root_addr,
-                       NEGATIVE_INFINITY_KEY,
-                       POSITIVE_INFINITY_KEY);
+   // the leaves of runs are released with the tree of their output request
+   if (req->out == NULL) {
+      btree_dec_ref_range(req->cc,
+                          req->cfg,
+                          req->root_addr,
+                          NEGATIVE_INFINITY_KEY,
+                          POSITIVE_INFINITY_KEY);
+   }
 }
 
 /*
@@ -3252,7 +3307,7 @@ btree_pack_abort(btree_pack_req *req)
 platform_status
 btree_pack(btree_pack_req *req)
 {
-   btree_pack_setup_start(req);
+   btree_pack_setup_start(req, BTREE_MAX_HEIGHT);
 
    key     tuple_key = NEGATIVE_INFINITY_KEY;
    message data;
@@ -3287,6 +3342,167 @@ btree_pack(btree_pack_req *req)
    return STATUS_OK;
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * btree_pack_runs_* --
+ *
+ *      Packs a btree from runs packed concurrently, see btree.h.
+ *-----------------------------------------------------------------------------
+ */
+void
+btree_pack_runs_start(btree_pack_req *req, uint64 num_runs)
+{
+   platform_assert(0 < num_runs && num_runs <= BTREE_PACK_MAX_RUNS);
+   btree_pack_setup_start(req, BTREE_MAX_HEIGHT + num_runs - 1);
+}
+
+void
+btree_pack_run_init(btree_pack_req  *run,
+                    btree_pack_req  *req,
+                    uint64           run_no,
+                    iterator        *itor,
+                    platform_heap_id hid)
+{
+   debug_assert(run_no + BTREE_MAX_HEIGHT - 1 < req->mini.num_batches);
+   memset(run, 0, sizeof(*run));
+   run->cc         = req->cc;
+   run->cfg        = req->cfg;
+   run->itor       = itor;
+   run->max_tuples = req->max_tuples;
+   run->hash       = req->hash;
+   run->seed       = req->seed;
+   run->out        = req;
+   // the first run takes the leaf batch of the tree, the others extra ones
+   run->batch = run_no == 0 ? 0 : BTREE_MAX_HEIGHT + run_no - 1;
+   writable_buffer_init(&run->leaves, hid);
+   writable_buffer_init(&run->fingerprints, hid);
+}
+
+void
+btree_pack_run_deinit(btree_pack_req *run)
+{
+   writable_buffer_deinit(&run->leaves);
+   writable_buffer_deinit(&run->fingerprints);
+}
+
+/*
+ * Links the last leaf of the previous run, which the caller holds, to the
+ * first leaf of the next one, as btree_pack_create_next_node() and
+ * btree_pack_link_extent() link the leaves of a single pack.
+ */
+static void
+btree_pack_link_runs(btree_pack_req *req,
+                     btree_pack_req *prev_run,
+                     btree_node     *last_leaf,
+                     btree_node     *first_leaf)
+{
+   cache           *cc         = req->cc;
+   btree_config    *cfg        = req->cfg;
+   btree_pack_leaf *leaves     = writable_buffer_data(&prev_run->leaves);
+   uint64           num_leaves = writable_buffer_length(&prev_run->leaves)
+                       / sizeof(btree_pack_leaf);
+   debug_assert(0 < num_leaves);
+   debug_assert(leaves[num_leaves - 1].addr == last_leaf->addr);
+
+   uint64 last_addr = last_leaf->addr;
+   for (uint64 i = num_leaves - 1;
+        i-- > 0 && btree_addrs_share_extent(cc, leaves[i].addr, last_addr);)
+   {
+      btree_node leaf = {.addr = leaves[i].addr};
+      btree_node_get(cc, cfg, &leaf, PAGE_TYPE_BRANCH);
+      debug_only bool32 success = btree_node_claim(cc, cfg, &leaf);
+      debug_assert(success);
+      btree_node_lock(cc, cfg, &leaf);
+      leaf.hdr->next_extent_addr = first_leaf->addr;
+      btree_node_full_unlock(cc, cfg, &leaf);
+   }
+
+   btree_node *ends[] = {last_leaf, first_leaf};
+   for (uint64 i = 0; i < ARRAY_SIZE(ends); i++) {
+      debug_only bool32 success = btree_node_claim(cc, cfg, ends[i]);
+      debug_assert(success);
+      btree_node_lock(cc, cfg, ends[i]);
+   }
+   last_leaf->hdr->next_extent_addr = first_leaf->addr;
+   last_leaf->hdr->next_addr        = first_leaf->addr;
+   first_leaf->hdr->prev_addr       = last_leaf->addr;
+   for (uint64 i = 0; i < ARRAY_SIZE(ends); i++) {
+      btree_node_unlock(cc, cfg, ends[i]);
+      btree_node_unclaim(cc, cfg, ends[i]);
+   }
+}
+
+platform_status
+btree_pack_runs_finish(btree_pack_req *req,
+                       btree_pack_req *runs,
+                       uint64          num_runs)
+{
+   cache          *cc        = req->cc;
+   btree_config   *cfg       = req->cfg;
+   btree_pack_req *prev_run  = NULL;
+   btree_node      last_leaf = {0};
+
+   for (uint64 run_no = 0; run_no < num_runs; run_no++) {
+      btree_pack_req *run = &runs[run_no];
+      if (req->max_tuples - req->num_tuples < run->num_tuples) {
+         platform_error_log("%s(): req->num_tuples=%lu exceeded output size "
+                            "limit, req->max_tuples=%lu\n",
+                            __func__,
+                            req->num_tuples + run->num_tuples,
+                            req->max_tuples);
+         if (prev_run != NULL) {
+            btree_node_unget(cc, cfg, &last_leaf);
+         }
+         btree_pack_abort(req);
+         return STATUS_LIMIT_EXCEEDED;
+      }
+      if (req->hash && run->num_tuples != 0) {
+         memmove(&req->fingerprint_arr[req->num_tuples],
+                 writable_buffer_data(&run->fingerprints),
+                 run->num_tuples * sizeof(uint32));
+      }
+      req->num_tuples += run->num_tuples;
+      req->key_bytes += run->key_bytes;
+      req->message_bytes += run->message_bytes;
+
+      btree_pack_leaf *leaves = writable_buffer_data(&run->leaves);
+      uint64           num_leaves =
+         writable_buffer_length(&run->leaves) / sizeof(btree_pack_leaf);
+      for (uint64 i = 0; i < num_leaves; i++) {
+         btree_node leaf = {.addr = leaves[i].addr};
+         btree_node_get(cc, cfg, &leaf, PAGE_TYPE_BRANCH);
+         if (i == 0 && prev_run != NULL) {
+            btree_pack_link_runs(req, prev_run, &last_leaf, &leaf);
+         }
+         key pivot = btree_get_tuple_key(cfg, leaf.hdr, 0);
+         btree_pack_add_index_entry(req, 1, pivot, leaf.addr, leaves[i].stats);
+         if (prev_run != NULL) {
+            btree_node_unget(cc, cfg, &last_leaf);
+         }
+         last_leaf = leaf;
+         prev_run  = run;
+      }
+   }
+
+   key last_key = NEGATIVE_INFINITY_KEY;
+   if (prev_run != NULL) {
+      last_key = btree_get_tuple_key(
+         cfg, last_leaf.hdr, btree_num_entries(last_leaf.hdr) - 1);
+   }
+   btree_pack_post_loop(req, last_key);
+   if (prev_run != NULL) {
+      btree_node_unget(cc, cfg, &last_leaf);
+   }
+   platform_assert(IMPLIES(req->num_tuples == 0, req->root_addr == 0));
+   return STATUS_OK;
+}
+
+void
+btree_pack_runs_abort(btree_pack_req *req)
+{
+   btree_pack_abort(req);
+}
+
 /*
  * Returns the number of kv pairs (k,v ) w/ k < key.  Also returns
  * the total size of all such keys and messages.
@@ -3338,6 +3554,41 @@ btree_count_in_range(cache             *cc,
    }
 }
 
+/*
+ * Returns FALSE if the btree holds no tuple in [min_key, max_key). Only the
+ * path to the leaf of min_key is read and nothing is left referenced, so it
+ * is much cheaper than opening an iterator to find out. A range starting
+ * past the last tuple of that leaf is assumed to hold tuples.
+ */
+bool32
+btree_may_have_tuples_in_range(cache        *cc,
+                               btree_config *cfg,
+                               uint64        root_addr,
+                               page_type     type,
+                               key           min_key,
+                               key           max_key)
+{
+   btree_node leaf;
+
+   debug_assert(!key_is_null(min_key) && !key_is_null(max_key));
+
+   btree_lookup_node(cc, cfg, root_addr, min_key, 0, type, &leaf, NULL);
+   bool32 found;
+   int64  idx = btree_find_tuple(cfg, leaf.hdr, min_key, &found);
+   if (!found) {
+      idx++;
+   }
+   bool32 may_have_tuples = TRUE;
+   if (idx < btree_num_entries(leaf.hdr)) {
+      key first_key   = btree_get_tuple_key(cfg, leaf.hdr, idx);
+      may_have_tuples = btree_key_compare(cfg, first_key, max_key) < 0;
+   } else if (leaf.hdr->next_addr == 0) {
+      may_have_tuples = FALSE;
+   }
+   btree_node_unget(cc, cfg, &leaf);
+   return may_have_tuples;
+}
+
 /*
  * btree_count_in_range_by_iterator perform
  * btree_count_in_range using an iterator instead of by
@@ -28,12 +28,20 @@
 #define BTREE_MAX_HEIGHT (8)
 
 /*
- * Mini-allocator uses separate batches for each height of the BTree.
- * Therefore, the max # of mini-batches that the mini-allocator can track
- * is limited by the max height of the BTree.
+ * Max number of runs a BTree can be packed from in parallel, see
+ * btree_pack_runs_start().
  */
-_Static_assert(BTREE_MAX_HEIGHT == MINI_MAX_BATCHES,
-               "BTREE_MAX_HEIGHT has to be == MINI_MAX_BATCHES");
+#define BTREE_PACK_MAX_RUNS (8)
+
+/*
+ * Mini-allocator uses separate batches for each height of the BTree, and
+ * packing from parallel runs uses one more for the leaves of each run after
+ * the first. Therefore, the max # of mini-batches that the mini-allocator can
+ * track limits the max height of the BTree and the number of runs.
+ */
+_Static_assert(BTREE_MAX_HEIGHT + BTREE_PACK_MAX_RUNS - 1 <= MINI_MAX_BATCHES,
+               "BTREE_MAX_HEIGHT + BTREE_PACK_MAX_RUNS - 1 has to be <= "
+               "MINI_MAX_BATCHES");
 
 /*
  * Acceptable upper-bound on amount of space to waste when deciding whether
@@ -163,6 +171,12 @@ typedef struct btree_pack_req {
 
    mini_allocator mini;
 
+   // packing a run of leaves into the tree of another request
+   struct btree_pack_req *out;    // request packing the output tree
+   uint64                 batch;  // mini batch of the leaves of the run
+   writable_buffer        leaves; // btree_pack_leaf of each leaf of the run
+   writable_buffer        fingerprints; // uint32 hash of each key of the run
+
    // output of the compaction
    uint64 root_addr;     // root address of the output tree
    uint64 num_tuples;    // no. of tuples in the output tree
@@ -170,6 +184,12 @@ typedef struct btree_pack_req {
    uint64 message_bytes; // total size of msgs in tuples of the output tree
 } btree_pack_req;
 
+// A leaf packed by a run, which btree_pack_runs_finish() links into the tree
+typedef struct btree_pack_leaf {
+   uint64            addr;
+   btree_pivot_stats stats;
+} btree_pack_leaf;
+
 struct btree_async_ctxt;
 typedef void (*btree_async_cb)(struct btree_async_ctxt *ctxt);
 
@@ -277,6 +297,16 @@ btree_lookup(cache             *cc,
              key                target,
              merge_accumulator *result);
 
+void
+btree_lookup_with_ref(cache        *cc,
+                      btree_config *cfg,
+                      uint64        root_addr,
+                      page_type     type,
+                      key           target,
+                      btree_node   *node,
+                      message      *msg,
+                      bool32       *found);
+
 static inline bool32
 btree_found(merge_accumulator *result)
 {
@@ -369,6 +399,45 @@ btree_pack_req_deinit(btree_pack_req *req, platform_heap_id hid)
 platform_status
 btree_pack(btree_pack_req *req);
 
+/*
+ * Packing a tree from runs of tuples with disjoint, increasing key ranges,
+ * which are packed concurrently:
+ *
+ *    btree_pack_req_init(&req, ...);    // itor is unused
+ *    btree_pack_runs_start(&req, num_runs);
+ *    // for each run, possibly on another thread
+ *    btree_pack_run_init(&runs[i], &req, i, itor_i, hid);
+ *    rc_i = btree_pack(&runs[i]);
+ *    // once all runs are packed
+ *    rc = btree_pack_runs_finish(&req, runs, num_runs); // or _abort(&req)
+ *    btree_pack_run_deinit(&runs[i]);
+ *
+ * Each run packs its leaves from its own batch of the mini allocator of the
+ * output tree, then btree_pack_runs_finish() links them, and builds the index
+ * nodes above them. The output is the same as packing all the runs in
+ * order, except that the leaves of a run start a new extent.
+ */
+void
+btree_pack_runs_start(btree_pack_req *req, uint64 num_runs);
+
+void
+btree_pack_run_init(btree_pack_req  *run,
+                    btree_pack_req  *req,
+                    uint64           run_no,
+                    iterator        *itor,
+                    platform_heap_id hid);
+
+void
+btree_pack_run_deinit(btree_pack_req *run);
+
+platform_status
+btree_pack_runs_finish(btree_pack_req *req,
+                       btree_pack_req *runs,
+                       uint64          num_runs);
+
+void
+btree_pack_runs_abort(btree_pack_req *req);
+
 void
 btree_count_in_range(cache             *cc,
                      btree_config      *cfg,
@@ -377,6 +446,14 @@ btree_count_in_range(cache             *cc,
                      key                max_key,
                      btree_pivot_stats *stats);
 
+bool32
+btree_may_have_tuples_in_range(cache        *cc,
+                               btree_config *cfg,
+                               uint64        root_addr,
+                               page_type     type,
+                               key           min_key,
+                               key           max_key);
+
 void
 btree_count_in_range_by_iterator(cache             *cc,
                                  btree_config      *cfg,
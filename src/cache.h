@@ -33,8 +33,11 @@ typedef struct cache_stats {
    uint64 page_writes[NUM_PAGE_TYPES];
    uint64 page_reads[NUM_PAGE_TYPES];
    uint64 prefetches_issued[NUM_PAGE_TYPES];
+   uint64 probationary_reads[NUM_PAGE_TYPES];
+   uint64 pages_cached[NUM_PAGE_TYPES]; // now, not summed over threads
    uint64 writes_issued;
    uint64 syncs_issued;
+   uint64 io_throttle_time_ns;
 } PLATFORM_CACHELINE_ALIGNED cache_stats;
 
 /*
@@ -49,7 +52,7 @@ typedef struct cache_stats {
 
 /*
  * The Maximum ref count on a single page that a thread is allowed to
- * have. The sum of all threads' ref counts is MAX_THREADS times this.
+ * have. The sum of all threads' ref counts is max_threads times this.
  * See cache_get_read_ref() below.
  */
 #define MAX_READ_REFCOUNT UINT16_MAX
@@ -151,6 +154,7 @@ typedef void (*page_sync_fn)(cache       *cc,
                              page_handle *page,
                              bool32       is_blocking,
                              page_type    type);
+typedef void (*page_write_fn)(cache *cc, page_handle *page, page_type type);
 typedef void (*extent_sync_fn)(cache  *cc,
                                uint64  addr,
                                uint64 *pages_outstanding);
@@ -159,10 +163,18 @@ typedef int (*evict_fn)(cache *cc, bool32 ignore_pinned);
 typedef void (*assert_ungot_fn)(cache *cc, uint64 addr);
 typedef void (*validate_page_fn)(cache *cc, page_handle *page, uint64 addr);
 typedef void (*io_stats_fn)(cache *cc, uint64 *read_bytes, uint64 *write_bytes);
+typedef void (*get_stats_fn)(cache *cc, cache_stats *global);
 typedef uint32 (*count_dirty_fn)(cache *cc);
 typedef uint16 (*page_get_read_ref_fn)(cache *cc, page_handle *page);
 typedef bool32 (*cache_present_fn)(cache *cc, page_handle *page);
 typedef void (*enable_sync_get_fn)(cache *cc, bool32 enabled);
+typedef bool32 (*throttle_io_fn)(cache *cc, bool32 enabled);
+typedef void (*io_limit_wait_fn)(cache *cc);
+typedef bool32 (*read_probationary_fn)(cache *cc, bool32 enabled);
+typedef void (*set_io_limit_fn)(cache *cc,
+                                uint64 bytes_per_sec,
+                                uint64 target_read_latency_ns);
+typedef uint64 (*get_io_limit_fn)(cache *cc);
 typedef allocator *(*get_allocator_fn)(const cache *cc);
 typedef cache_config *(*cache_config_fn)(const cache *cc);
 typedef void (*cache_print_fn)(platform_log_handle *log_handle, cache *cc);
@@ -188,8 +200,11 @@ typedef struct cache_ops {
    page_generic_fn      page_pin;
    page_generic_fn      page_unpin;
    page_sync_fn         page_sync;
+   page_write_fn        page_write;
    extent_sync_fn       extent_sync;
+   cache_generic_fn     write_back;
    cache_generic_fn     flush;
+   cache_generic_fn     sync;
    evict_fn             evict;
    cache_generic_fn     cleanup;
    assert_ungot_fn      assert_ungot;
@@ -199,10 +214,16 @@ typedef struct cache_ops {
    cache_print_fn       print;
    cache_print_fn       print_stats;
    io_stats_fn          io_stats;
+   get_stats_fn         get_stats;
    cache_generic_fn     reset_stats;
    count_dirty_fn       count_dirty;
    page_get_read_ref_fn page_get_read_ref;
    enable_sync_get_fn   enable_sync_get;
+   throttle_io_fn       throttle_io;
+   io_limit_wait_fn     io_limit_wait;
+   read_probationary_fn read_probationary;
+   set_io_limit_fn      set_io_limit;
+   get_io_limit_fn      get_io_limit;
    get_allocator_fn     get_allocator;
    cache_config_fn      get_config;
 } cache_ops;
@@ -472,6 +493,8 @@ cache_mark_dirty(cache *cc, page_handle *page)
  *
  * This is a performance optimization used by memtable, where the caller knows
  * this page will be needed again very soon.
+ *
+ * The caller must hold the page write locked, or read locked.
  *----------------------------------------------------------------------
  */
 static inline void
@@ -517,6 +540,26 @@ cache_page_sync(cache       *cc,
    return cc->ops->page_sync(cc, page, is_blocking, type);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * cache_page_write
+ *
+ * Synchronously writes the current contents of the page to disk, without
+ * changing its state in the cache, so it stays dirty. A clean page is already
+ * on disk and is not written.
+ *
+ * Unlike cache_page_sync, the page may be in writeback, claimed or locked.
+ * Some thread must hold a read lock on the page, and its contents must not
+ * change until this returns. Used by the log to make its pages durable
+ * together with cache_sync.
+ *-----------------------------------------------------------------------------
+ */
+static inline void
+cache_page_write(cache *cc, page_handle *page, page_type type)
+{
+   cc->ops->page_write(cc, page, type);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * cache_extent_sync
@@ -543,6 +586,22 @@ cache_extent_sync(cache *cc, uint64 addr, uint64 *pages_outstanding)
    cc->ops->extent_sync(cc, addr, pages_outstanding);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * cache_write_back
+ *
+ * Writes back the dirty pages in the cache and waits for the writes.
+ *
+ * Unlike cache_flush, other threads may keep using the cache, and pages which
+ * are claimed or locked are skipped, so they stay dirty.
+ *-----------------------------------------------------------------------------
+ */
+static inline void
+cache_write_back(cache *cc)
+{
+   cc->ops->write_back(cc);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * cache_flush
@@ -558,6 +617,20 @@ cache_flush(cache *cc)
    cc->ops->flush(cc);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * cache_sync
+ *
+ * Makes every write to disk which has completed durable. Writebacks still in
+ * flight are not waited for.
+ *-----------------------------------------------------------------------------
+ */
+static inline void
+cache_sync(cache *cc)
+{
+   cc->ops->sync(cc);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * cache_evict
@@ -684,6 +757,21 @@ cache_io_stats(cache *cc, uint64 *read_bytes, uint64 *write_bytes)
    return cc->ops->io_stats(cc, read_bytes, write_bytes);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * cache_get_stats
+ *
+ * Analysis facility.
+ * Adds the statistics of all threads into global. Threads may keep updating
+ * their counters meanwhile.
+ *-----------------------------------------------------------------------------
+ */
+static inline void
+cache_get_stats(cache *cc, cache_stats *global)
+{
+   return cc->ops->get_stats(cc, global);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * cache_validate_page
@@ -758,6 +846,94 @@ cache_enable_sync_get(cache *cc, bool32 enabled)
    cc->ops->enable_sync_get(cc, enabled);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * cache_throttle_io
+ *
+ * Marks the I/O of the calling thread as background I/O, which is charged to
+ * the limit set by cache_set_io_limit(). This covers the pages it reads and
+ * prefetches, the extents it syncs, and the writeback it issues while
+ * looking for free pages. The I/O itself is never delayed, as the thread may
+ * hold locks; it pays for it in cache_io_limit_wait().
+ *
+ * Returns the previous setting, so that callers can nest.
+ *-----------------------------------------------------------------------------
+ */
+static inline bool32
+cache_throttle_io(cache *cc, bool32 enabled)
+{
+   return cc->ops->throttle_io(cc, enabled);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * cache_io_limit_wait
+ *
+ * If the I/O of the calling thread is background I/O, sleeps until the limit
+ * covers the background I/O charged so far. Callers must hold no locks, e.g.
+ * background tasks call it before each unit of work.
+ *-----------------------------------------------------------------------------
+ */
+static inline void
+cache_io_limit_wait(cache *cc)
+{
+   cc->ops->io_limit_wait(cc);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * cache_read_probationary
+ *
+ * Marks the reads of the calling thread as probationary, for those, such as
+ * compactions and scans, which are unlikely to be repeated soon. A cache
+ * with a scan-resistant policy loads such pages into, and evicts them from,
+ * a part of the cache set aside for them, so they do not evict the pages
+ * point lookups reuse elsewhere. Other caches ignore it.
+ *
+ * Returns the previous setting, so that callers can nest.
+ *-----------------------------------------------------------------------------
+ */
+static inline bool32
+cache_read_probationary(cache *cc, bool32 enabled)
+{
+   return cc->ops->read_probationary(cc, enabled);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * cache_set_io_limit
+ *
+ * Limits background I/O to bytes_per_sec, or lifts the limit if it is 0.
+ *
+ * If target_read_latency_ns is not 0, the limit is tuned to keep the average
+ * latency of the reads of other threads below it, never exceeding
+ * bytes_per_sec.
+ *
+ * May be called at any time.
+ *-----------------------------------------------------------------------------
+ */
+static inline void
+cache_set_io_limit(cache *cc,
+                   uint64 bytes_per_sec,
+                   uint64 target_read_latency_ns)
+{
+   cc->ops->set_io_limit(cc, bytes_per_sec, target_read_latency_ns);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * cache_get_io_limit
+ *
+ * Returns the background I/O limit in effect, in bytes per second, or 0 if
+ * there is none.
+ *-----------------------------------------------------------------------------
+ */
+static inline uint64
+cache_get_io_limit(cache *cc)
+{
+   return cc->ops->get_io_limit(cc);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * cache_allocator
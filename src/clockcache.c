@@ -31,6 +31,17 @@
 #define CC_UNMAPPED_ENTRY UINT32_MAX
 #define CC_UNMAPPED_ADDR  UINT64_MAX
 
+// Fibonacci hashing multiplier (2^64 / golden ratio) for the lookup table
+#define CC_LOOKUP_HASH_MULTIPLIER 0x9E3779B97F4A7C15UL
+#define CC_HUGE_PAGE_SIZE         (2 * MiB)
+
+static const char *const clockcache_backing_str[] = {
+   "base pages", "transparent huge pages", "huge pages"};
+
+_Static_assert(ARRAY_SIZE(clockcache_backing_str)
+                  == NUM_PLATFORM_BUFFER_BACKINGS,
+               "clockcache_backing_str[] is incorrectly sized");
+
 // Number of entries to clean/evict/get_free in a per-thread batch
 #define CC_ENTRIES_PER_BATCH 64
 
@@ -40,6 +51,13 @@
 /* number of events to poll for during clockcache_wait */
 #define CC_DEFAULT_MAX_IO_EVENTS 32
 
+// Background I/O limiting: at most this much unused budget is saved up
+#define CC_IO_LIMIT_BURST_NS (100 * MILLION)
+
+// How often and how far down the background I/O limit is auto-tuned
+#define CC_IO_LIMIT_TUNE_INTERVAL_NS (100 * MILLION)
+#define CC_IO_LIMIT_MIN_RATE         (MiB_TO_B(1))
+
 /*
  *-----------------------------------------------------------------------------
  * Clockcache Operations Logging and Address Tracing
@@ -185,12 +203,21 @@ clockcache_page_sync(clockcache  *cc,
                      bool32       is_blocking,
                      page_type    type);
 
+void
+clockcache_page_write(clockcache *cc, page_handle *page, page_type type);
+
 void
 clockcache_extent_sync(clockcache *cc, uint64 addr, uint64 *pages_outstanding);
 
+void
+clockcache_write_back(clockcache *cc);
+
 void
 clockcache_flush(clockcache *cc);
 
+void
+clockcache_sync(clockcache *cc);
+
 int
 clockcache_evict_all(clockcache *cc, bool32 ignore_pinned);
 
@@ -221,6 +248,9 @@ clockcache_print_stats(platform_log_handle *log_handle, clockcache *cc);
 void
 clockcache_io_stats(clockcache *cc, uint64 *read_bytes, uint64 *write_bytes);
 
+void
+clockcache_get_stats(clockcache *cc, cache_stats *global);
+
 void
 clockcache_reset_stats(clockcache *cc);
 
@@ -236,6 +266,23 @@ clockcache_present(clockcache *cc, page_handle *page);
 static void
 clockcache_enable_sync_get(clockcache *cc, bool32 enabled);
 
+static bool32
+clockcache_throttle_io(clockcache *cc, bool32 enabled);
+
+static void
+clockcache_io_limit_wait(clockcache *cc);
+
+static bool32
+clockcache_read_probationary(clockcache *cc, bool32 enabled);
+
+static void
+clockcache_set_io_limit(clockcache *cc,
+                        uint64      bytes_per_sec,
+                        uint64      target_read_latency_ns);
+
+static uint64
+clockcache_get_io_limit(clockcache *cc);
+
 static allocator *
 clockcache_get_allocator(const clockcache *cc);
 
@@ -385,6 +432,13 @@ clockcache_page_sync_virtual(cache       *c,
    clockcache_page_sync(cc, page, is_blocking, type);
 }
 
+void
+clockcache_page_write_virtual(cache *c, page_handle *page, page_type type)
+{
+   clockcache *cc = (clockcache *)c;
+   clockcache_page_write(cc, page, type);
+}
+
 void
 clockcache_extent_sync_virtual(cache *c, uint64 addr, uint64 *pages_outstanding)
 {
@@ -392,6 +446,13 @@ clockcache_extent_sync_virtual(cache *c, uint64 addr, uint64 *pages_outstanding)
    clockcache_extent_sync(cc, addr, pages_outstanding);
 }
 
+void
+clockcache_write_back_virtual(cache *c)
+{
+   clockcache *cc = (clockcache *)c;
+   clockcache_write_back(cc);
+}
+
 void
 clockcache_flush_virtual(cache *c)
 {
@@ -399,6 +460,13 @@ clockcache_flush_virtual(cache *c)
    clockcache_flush(cc);
 }
 
+void
+clockcache_sync_virtual(cache *c)
+{
+   clockcache *cc = (clockcache *)c;
+   clockcache_sync(cc);
+}
+
 int
 clockcache_evict_all_virtual(cache *c, bool32 ignore_pinned)
 {
@@ -455,6 +523,13 @@ clockcache_io_stats_virtual(cache *c, uint64 *read_bytes, uint64 *write_bytes)
    clockcache_io_stats(cc, read_bytes, write_bytes);
 }
 
+void
+clockcache_get_stats_virtual(cache *c, cache_stats *global)
+{
+   clockcache *cc = (clockcache *)c;
+   clockcache_get_stats(cc, global);
+}
+
 void
 clockcache_reset_stats_virtual(cache *c)
 {
@@ -490,6 +565,43 @@ clockcache_enable_sync_get_virtual(cache *c, bool32 enabled)
    clockcache_enable_sync_get(cc, enabled);
 }
 
+bool32
+clockcache_throttle_io_virtual(cache *c, bool32 enabled)
+{
+   clockcache *cc = (clockcache *)c;
+   return clockcache_throttle_io(cc, enabled);
+}
+
+void
+clockcache_io_limit_wait_virtual(cache *c)
+{
+   clockcache *cc = (clockcache *)c;
+   clockcache_io_limit_wait(cc);
+}
+
+bool32
+clockcache_read_probationary_virtual(cache *c, bool32 enabled)
+{
+   clockcache *cc = (clockcache *)c;
+   return clockcache_read_probationary(cc, enabled);
+}
+
+void
+clockcache_set_io_limit_virtual(cache *c,
+                                uint64 bytes_per_sec,
+                                uint64 target_read_latency_ns)
+{
+   clockcache *cc = (clockcache *)c;
+   clockcache_set_io_limit(cc, bytes_per_sec, target_read_latency_ns);
+}
+
+uint64
+clockcache_get_io_limit_virtual(cache *c)
+{
+   clockcache *cc = (clockcache *)c;
+   return clockcache_get_io_limit(cc);
+}
+
 allocator *
 clockcache_get_allocator_virtual(const cache *c)
 {
@@ -520,8 +632,11 @@ static cache_ops clockcache_ops = {
    .page_pin          = clockcache_pin_virtual,
    .page_unpin        = clockcache_unpin_virtual,
    .page_sync         = clockcache_page_sync_virtual,
+   .page_write        = clockcache_page_write_virtual,
    .extent_sync       = clockcache_extent_sync_virtual,
+   .write_back        = clockcache_write_back_virtual,
    .flush             = clockcache_flush_virtual,
+   .sync              = clockcache_sync_virtual,
    .evict             = clockcache_evict_all_virtual,
    .cleanup           = clockcache_wait_virtual,
    .assert_ungot      = clockcache_assert_ungot_virtual,
@@ -529,12 +644,18 @@ static cache_ops clockcache_ops = {
    .print             = clockcache_print_virtual,
    .print_stats       = clockcache_print_stats_virtual,
    .io_stats          = clockcache_io_stats_virtual,
+   .get_stats         = clockcache_get_stats_virtual,
    .reset_stats       = clockcache_reset_stats_virtual,
    .validate_page     = clockcache_validate_page_virtual,
    .count_dirty       = clockcache_count_dirty_virtual,
    .page_get_read_ref = clockcache_get_read_ref_virtual,
    .cache_present     = clockcache_present_virtual,
    .enable_sync_get   = clockcache_enable_sync_get_virtual,
+   .throttle_io       = clockcache_throttle_io_virtual,
+   .io_limit_wait     = clockcache_io_limit_wait_virtual,
+   .read_probationary = clockcache_read_probationary_virtual,
+   .set_io_limit      = clockcache_set_io_limit_virtual,
+   .get_io_limit      = clockcache_get_io_limit_virtual,
    .get_allocator     = clockcache_get_allocator_virtual,
    .get_config        = clockcache_get_config_virtual,
 };
@@ -592,6 +713,9 @@ static cache_ops clockcache_ops = {
 // loading for read
 #define CC_READ_LOADING_STATUS (0 | CC_ACCESSED | CC_CLEAN | CC_LOADING)
 
+// loading for a probationary read (unaccessed)
+#define CC_PROBATION_LOADING_STATUS (0 | CC_CLEAN | CC_LOADING)
+
 /*
  *-----------------------------------------------------------------------------
  * Clock cache Functions
@@ -658,7 +782,7 @@ clockcache_record_backtrace(clockcache *cc, uint32 entry_number)
 
    myEntry->history[myhistindex].status   = myEntry->status;
    myEntry->history[myhistindex].refcount = 0;
-   for (threadid i = 0; i < MAX_THREADS; i++) {
+   for (threadid i = 0; i < CC_RC_WIDTH; i++) {
       myEntry->history[myhistindex].refcount +=
          cc->refcount[i * cc->cfg->page_capacity + entry_number];
    }
@@ -700,11 +824,161 @@ clockcache_divide_by_page_size(const clockcache *cc, uint64 addr)
    return addr >> cc->cfg->log_page_size;
 }
 
+/*
+ * Allocates the zeroed lookup table. With huge pages, it is aligned and
+ * padded to them, so that they can back it, and cc->lookup_backing is lowered
+ * to the backing it gets.
+ */
+static void *
+clockcache_lookup_alloc(clockcache *cc, size_t size)
+{
+   size_t align = PLATFORM_CACHELINE_SIZE;
+   if (cc->cfg->use_huge_pages) {
+      align = CC_HUGE_PAGE_SIZE;
+      size += platform_align_bytes_reqd(align, size);
+   }
+   char *table = TYPED_ALIGNED_MALLOC(cc->heap_id, align, table, size);
+   if (table == NULL) {
+      return NULL;
+   }
+
+   // advise before zeroing, so that the pages are faulted in as advised; the
+   // shared memory heap only aligns to cachelines
+   bool32 advised = cc->cfg->use_huge_pages
+                    && (uint64)table % CC_HUGE_PAGE_SIZE == 0
+                    && platform_advise_huge_pages(table, size);
+   memset(table, 0, size);
+   if (!cc->cfg->use_huge_pages) {
+      return table;
+   }
+
+   platform_buffer_backing backing = PLATFORM_BUFFER_PAGES;
+   if (advised) {
+      backing = platform_huge_pages_backing(table);
+   }
+   uint32 old_backing;
+   while ((old_backing = cc->lookup_backing) > backing
+          && !__sync_bool_compare_and_swap(
+             &cc->lookup_backing, old_backing, backing))
+   {
+   }
+   return table;
+}
+
+/*
+ * cc->lookup is a hash table of 1 << cc->lookup_log_buckets buckets, at least
+ * as many as there are entries. Each bucket chains the entries mapping the
+ * addresses which hash to it through cc->lookup_node, so the table is sized
+ * by the cache capacity rather than by the disk.
+ *
+ * A bucket's seq is odd while a thread changes its chain, which reserves and
+ * clears take turns to do. Lookups only read: they retry if seq changed while
+ * they walked the chain, e.g. because an entry on it moved to another chain.
+ */
+static inline clockcache_lookup_bucket *
+clockcache_lookup_bucket_of(const clockcache *cc, uint64 addr)
+{
+   uint64 lookup_no = clockcache_divide_by_page_size(cc, addr);
+   uint64 hash      = lookup_no * CC_LOOKUP_HASH_MULTIPLIER;
+   return &cc->lookup[hash >> (64 - cc->lookup_log_buckets)];
+}
+
+static inline void
+clockcache_lookup_bucket_lock(clockcache_lookup_bucket *bucket)
+{
+   uint32 seq;
+   while ((seq = bucket->seq) % 2 != 0
+          || !__sync_bool_compare_and_swap(&bucket->seq, seq, seq + 1))
+   {
+      platform_pause();
+   }
+}
+
+static inline void
+clockcache_lookup_bucket_unlock(clockcache_lookup_bucket *bucket)
+{
+   __sync_fetch_and_add(&bucket->seq, 1);
+}
+
+/*
+ * Returns the entry on the chain of bucket which maps addr, or
+ * CC_UNMAPPED_ENTRY. Unless the caller has locked the bucket, the result only
+ * holds if its seq is unchanged afterwards.
+ */
+static inline uint32
+clockcache_lookup_chain(const clockcache               *cc,
+                        const clockcache_lookup_bucket *bucket,
+                        uint64                          addr)
+{
+   uint32 entry_number = bucket->head;
+   for (uint32 i = 0;
+        entry_number != CC_UNMAPPED_ENTRY && i < cc->cfg->page_capacity;
+        i++)
+   {
+      const clockcache_lookup_node *node = &cc->lookup_node[entry_number];
+      if (node->addr == addr) {
+         return entry_number;
+      }
+      entry_number = node->next;
+   }
+   return CC_UNMAPPED_ENTRY;
+}
+
+/*
+ * Maps addr to entry_number if addr is unmapped. Returns FALSE if another
+ * thread has mapped it, e.g. because it is loading the page.
+ */
+static bool32
+clockcache_lookup_reserve(clockcache *cc, uint64 addr, uint32 entry_number)
+{
+   clockcache_lookup_bucket *bucket = clockcache_lookup_bucket_of(cc, addr);
+   clockcache_lookup_node   *node   = &cc->lookup_node[entry_number];
+
+   clockcache_lookup_bucket_lock(bucket);
+   bool32 reserved =
+      clockcache_lookup_chain(cc, bucket, addr) == CC_UNMAPPED_ENTRY;
+   if (reserved) {
+      node->addr   = addr;
+      node->next   = bucket->head;
+      bucket->head = entry_number;
+   }
+   clockcache_lookup_bucket_unlock(bucket);
+   return reserved;
+}
+
+/*
+ * Unmaps addr, which must be mapped. The entry keeps its next, so that
+ * lookups walking past it reach the rest of the chain.
+ */
+static void
+clockcache_lookup_clear(clockcache *cc, uint64 addr)
+{
+   clockcache_lookup_bucket *bucket = clockcache_lookup_bucket_of(cc, addr);
+
+   clockcache_lookup_bucket_lock(bucket);
+   volatile uint32 *link = &bucket->head;
+   while (*link != CC_UNMAPPED_ENTRY && cc->lookup_node[*link].addr != addr) {
+      link = &cc->lookup_node[*link].next;
+   }
+   debug_assert(*link != CC_UNMAPPED_ENTRY);
+   *link = cc->lookup_node[*link].next;
+   clockcache_lookup_bucket_unlock(bucket);
+}
+
 static inline uint32
 clockcache_lookup(const clockcache *cc, uint64 addr)
 {
-   uint64 lookup_no    = clockcache_divide_by_page_size(cc, addr);
-   uint32 entry_number = cc->lookup[lookup_no];
+   const clockcache_lookup_bucket *bucket =
+      clockcache_lookup_bucket_of(cc, addr);
+   uint32 seq;
+   uint32 entry_number;
+
+   do {
+      while ((seq = bucket->seq) % 2 != 0) {
+         platform_pause();
+      }
+      entry_number = clockcache_lookup_chain(cc, bucket, addr);
+   } while (bucket->seq != seq);
 
    debug_assert(((entry_number < cc->cfg->page_capacity)
                  || (entry_number == CC_UNMAPPED_ENTRY)),
@@ -885,7 +1159,7 @@ clockcache_assert_no_refs(clockcache *cc)
 {
    threadid        i;
    volatile uint32 j;
-   for (i = 0; i < MAX_THREADS; i++) {
+   for (i = 0; i < CC_RC_WIDTH; i++) {
       for (j = 0; j < cc->cfg->page_capacity; j++) {
          if (clockcache_get_ref(cc, j, i) != 0) {
             clockcache_get_ref(cc, j, i);
@@ -900,7 +1174,7 @@ clockcache_assert_no_refs_and_pins(clockcache *cc)
 {
    threadid i;
    uint32   j;
-   for (i = 0; i < MAX_THREADS; i++) {
+   for (i = 0; i < CC_RC_WIDTH; i++) {
       for (j = 0; j < cc->cfg->page_capacity; j++) {
          platform_assert(clockcache_get_ref(cc, j, i) == 0);
       }
@@ -945,6 +1219,57 @@ typedef enum {
    GET_RC_FLUSHING,
 } get_rc;
 
+/*
+ *----------------------------------------------------------------------
+ * clockcache_read_is_probationary --
+ *
+ *      Whether the pages read by the thread are admitted as probationary,
+ *      see CLOCKCACHE_POLICY_SCAN_RESISTANT. Such reads neither load pages
+ *      with their access bit set nor set it on hits.
+ *----------------------------------------------------------------------
+ */
+static inline bool32
+clockcache_read_is_probationary(clockcache *cc, threadid tid)
+{
+   return cc->cfg->policy == CLOCKCACHE_POLICY_SCAN_RESISTANT
+          && cc->per_thread[tid].read_probationary;
+}
+
+/*
+ *----------------------------------------------------------------------
+ * clockcache_count_page --
+ *
+ *      Counts a page of the given type into or out of the cache, for
+ *      reservations and stats. Callers hold the write lock or the loading
+ *      claim of the entry.
+ *----------------------------------------------------------------------
+ */
+static inline void
+clockcache_count_page(clockcache *cc, page_type type, bool32 mapped)
+{
+   if (mapped) {
+      __sync_fetch_and_add(&cc->pages_cached[type], 1);
+   } else {
+      __sync_fetch_and_sub(&cc->pages_cached[type], 1);
+   }
+}
+
+/*
+ *----------------------------------------------------------------------
+ * clockcache_is_reserved --
+ *
+ *      Whether the clock should pass over a page of the given type, because
+ *      its type holds no more than its reservation, see
+ *      CC_MAX_RESERVED_PERCENT.
+ *----------------------------------------------------------------------
+ */
+static inline bool32
+clockcache_is_reserved(clockcache *cc, page_type type, bool32 is_urgent)
+{
+   return (!is_urgent || cc->cfg->pin_reserved)
+          && cc->pages_cached[type] <= cc->reserved_pages[type];
+}
+
 /*
  *----------------------------------------------------------------------
  * clockcache_try_get_read
@@ -961,6 +1286,7 @@ static get_rc
 clockcache_try_get_read(clockcache *cc, uint32 entry_number, bool32 set_access)
 {
    const threadid tid = platform_get_tid();
+   set_access         = set_access && !clockcache_read_is_probationary(cc, tid);
 
    // first check if write lock is held
    uint32 cc_writing = clockcache_test_flag(cc, entry_number, CC_WRITELOCKED);
@@ -1297,6 +1623,168 @@ clockcache_write_callback(void           *metadata,
    }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * background I/O limiting
+ *
+ *----------------------------------------------------------------------
+ */
+
+/*
+ *----------------------------------------------------------------------
+ * clockcache_io_limit_tune --
+ *
+ *      Auto-tunes the background I/O limit, with the limiter lock held.
+ *
+ *      Every CC_IO_LIMIT_TUNE_INTERVAL_NS, the rate is cut by a quarter if
+ *      foreground reads are slower than the target, and is otherwise raised
+ *      by a sixteenth of the maximum. The moving average of the read latency
+ *      is halved each time, so that it decays when there are no reads.
+ *----------------------------------------------------------------------
+ */
+static void
+clockcache_io_limit_tune(clockcache_io_limiter *lim, timestamp now)
+{
+   if (lim->target_read_latency_ns == 0
+       || now - lim->last_tune < CC_IO_LIMIT_TUNE_INTERVAL_NS)
+   {
+      return;
+   }
+   lim->last_tune = now;
+
+   uint64 min_rate = MIN(CC_IO_LIMIT_MIN_RATE, lim->max_bytes_per_sec);
+   if (lim->read_latency_ns > lim->target_read_latency_ns) {
+      lim->bytes_per_sec -= lim->bytes_per_sec / 4;
+      lim->bytes_per_sec = MAX(lim->bytes_per_sec, min_rate);
+   } else {
+      lim->bytes_per_sec += lim->max_bytes_per_sec / 16;
+      lim->bytes_per_sec = MIN(lim->bytes_per_sec, lim->max_bytes_per_sec);
+   }
+   lim->read_latency_ns /= 2;
+}
+
+/*
+ *----------------------------------------------------------------------
+ * clockcache_io_limit_refill --
+ *
+ *      Auto-tunes the background I/O limit and refills its budget for the
+ *      time since the last refill, with the limiter lock held. Returns the
+ *      limit, or 0 if there is none.
+ *
+ *      last_refill is ahead of now while a thread sleeps off debt, see
+ *      clockcache_io_limit_wait(), as that time has been paid for already.
+ *----------------------------------------------------------------------
+ */
+static uint64
+clockcache_io_limit_refill(clockcache_io_limiter *lim, timestamp now)
+{
+   clockcache_io_limit_tune(lim, now);
+   uint64 rate = lim->bytes_per_sec;
+   if (rate == 0 || now <= lim->last_refill) {
+      return rate;
+   }
+   // Refill in microseconds, so that the products cannot overflow
+   uint64 elapsed_ns = MIN(now - lim->last_refill, CC_IO_LIMIT_BURST_NS);
+   int64  refill     = NSEC_TO_USEC(elapsed_ns) * rate / MILLION;
+   int64  burst      = NSEC_TO_USEC(CC_IO_LIMIT_BURST_NS) * rate / MILLION;
+   lim->last_refill  = now;
+   lim->tokens       = MIN(lim->tokens + refill, burst);
+   return rate;
+}
+
+/*
+ *----------------------------------------------------------------------
+ * clockcache_io_limit_charge --
+ *
+ *      Takes bytes from the background I/O budget if the calling thread is
+ *      throttled. It never sleeps, as the caller may hold page locks or
+ *      batch locks: the debt is slept off in clockcache_io_limit_wait().
+ *----------------------------------------------------------------------
+ */
+static void
+clockcache_io_limit_charge(clockcache *cc, uint64 bytes)
+{
+   const threadid         tid = platform_get_tid();
+   clockcache_io_limiter *lim = &cc->io_limiter;
+
+   if (!cc->per_thread[tid].throttle_io || lim->bytes_per_sec == 0) {
+      return;
+   }
+
+   platform_spin_lock(&lim->lock);
+   if (clockcache_io_limit_refill(lim, platform_get_timestamp()) != 0) {
+      lim->tokens -= (int64)bytes;
+   }
+   platform_spin_unlock(&lim->lock);
+}
+
+/*
+ *----------------------------------------------------------------------
+ * clockcache_io_limit_wait --
+ *
+ *      Sleeps until the background I/O budget is out of debt, if the calling
+ *      thread is throttled. Must be called holding no locks.
+ *
+ *      The debt is turned into time by moving last_refill ahead by as long
+ *      as the limit takes to pay it, so that threads waiting together sleep
+ *      until all of their debt is paid rather than each paying all of it.
+ *----------------------------------------------------------------------
+ */
+static void
+clockcache_io_limit_wait(clockcache *cc)
+{
+   const threadid         tid = platform_get_tid();
+   clockcache_io_limiter *lim = &cc->io_limiter;
+
+   if (!cc->per_thread[tid].throttle_io || lim->bytes_per_sec == 0) {
+      return;
+   }
+
+   platform_spin_lock(&lim->lock);
+   timestamp now     = platform_get_timestamp();
+   uint64    rate    = clockcache_io_limit_refill(lim, now);
+   uint64    wait_ns = 0;
+   if (rate != 0) {
+      if (lim->tokens < 0) {
+         // Divide first, so that a large debt cannot overflow the product
+         uint64 debt      = -lim->tokens;
+         uint64 debt_ns   = debt / rate * SEC_TO_NSEC(1)
+                          + debt % rate * SEC_TO_NSEC(1) / rate;
+         lim->tokens      = 0;
+         lim->last_refill = MAX(now, lim->last_refill) + debt_ns;
+      }
+      if (lim->last_refill > now) {
+         wait_ns = lim->last_refill - now;
+      }
+   }
+   platform_spin_unlock(&lim->lock);
+
+   if (wait_ns != 0) {
+      platform_sleep_ns(wait_ns);
+      if (cc->cfg->use_stats) {
+         cc->stats[tid].io_throttle_time_ns += wait_ns;
+      }
+   }
+}
+
+/*
+ *----------------------------------------------------------------------
+ * clockcache_io_limit_record_read --
+ *
+ *      Feeds the latency of a foreground page read into the moving average
+ *      the background I/O limit is tuned with. The update races with other
+ *      readers, which only makes the average a little noisier.
+ *----------------------------------------------------------------------
+ */
+static inline void
+clockcache_io_limit_record_read(clockcache *cc, uint64 latency_ns)
+{
+   clockcache_io_limiter *lim     = &cc->io_limiter;
+   uint64                 average = lim->read_latency_ns;
+   lim->read_latency_ns           = average - average / 8 + latency_ns / 8;
+}
+
 /*
  *----------------------------------------------------------------------
  * clockcache_batch_start_writeback --
@@ -1323,7 +1811,7 @@ clockcache_batch_start_writeback(clockcache *cc, uint64 batch, bool32 is_urgent)
 
    clockcache_entry *entry, *next_entry;
 
-   debug_assert((tid < MAX_THREADS), "Invalid tid=%lu\n", tid);
+   debug_assert((tid < cc->cfg->max_threads), "Invalid tid=%lu\n", tid);
    debug_assert(cc != NULL);
    debug_assert(batch < cc->cfg->page_capacity / CC_ENTRIES_PER_BATCH);
 
@@ -1381,6 +1869,8 @@ clockcache_batch_start_writeback(clockcache *cc, uint64 batch, bool32 is_urgent)
             clockcache_divide_by_page_size(cc, end_addr - first_addr);
          req->bytes = clockcache_multiply_by_page_size(cc, req_count);
 
+         clockcache_io_limit_charge(cc, req->bytes);
+
          if (cc->cfg->use_stats) {
             cc->stats[tid].page_writes[entry->type] += req_count;
             cc->stats[tid].writes_issued++;
@@ -1419,11 +1909,19 @@ clockcache_batch_start_writeback(clockcache *cc, uint64 batch, bool32 is_urgent)
  *----------------------------------------------------------------------
  * clockcache_try_evict
  *
- *      Attempts to evict the page if it is evictable
+ *      Attempts to evict the page if it is evictable. With spare_reserved,
+ *      pages within their reservation are not evictable, see
+ *      clockcache_is_reserved. With spare_accessed, accessed pages keep
+ *      their access bit, so that they stay cached until the main clock hand
+ *      clears it.
  *----------------------------------------------------------------------
  */
 static void
-clockcache_try_evict(clockcache *cc, uint32 entry_number)
+clockcache_try_evict(clockcache *cc,
+                     uint32      entry_number,
+                     bool32      spare_reserved,
+                     bool32      spare_accessed,
+                     bool32      is_urgent)
 {
    clockcache_entry *entry = clockcache_get_entry(cc, entry_number);
    const threadid    tid   = platform_get_tid();
@@ -1431,7 +1929,8 @@ clockcache_try_evict(clockcache *cc, uint32 entry_number)
    /* store status for testing, then clear CC_ACCESSED */
    uint32 status = entry->status;
    /* T&T&S */
-   if (clockcache_test_flag(cc, entry_number, CC_ACCESSED)) {
+   if (!spare_accessed && clockcache_test_flag(cc, entry_number, CC_ACCESSED))
+   {
       clockcache_clear_flag(cc, entry_number, CC_ACCESSED);
    }
 
@@ -1444,7 +1943,9 @@ clockcache_try_evict(clockcache *cc, uint32 entry_number)
     */
    if (status != CC_EVICTABLE_STATUS
        || clockcache_get_ref(cc, entry_number, tid)
-       || clockcache_get_pin(cc, entry_number))
+       || clockcache_get_pin(cc, entry_number)
+       || (spare_reserved
+           && clockcache_is_reserved(cc, entry->type, is_urgent)))
    {
       goto out;
    }
@@ -1495,9 +1996,9 @@ clockcache_try_evict(clockcache *cc, uint32 entry_number)
    /* 5. clear lookup, disk addr */
    uint64 addr = entry->page.disk_addr;
    if (addr != CC_UNMAPPED_ADDR) {
-      uint64 lookup_no      = clockcache_divide_by_page_size(cc, addr);
-      cc->lookup[lookup_no] = CC_UNMAPPED_ENTRY;
+      clockcache_lookup_clear(cc, addr);
       entry->page.disk_addr = CC_UNMAPPED_ADDR;
+      clockcache_count_page(cc, entry->type, FALSE);
    }
    debug_only uint32 debug_status =
       clockcache_test_flag(cc, entry_number, CC_WRITELOCKED | CC_CLAIMED);
@@ -1527,11 +2028,16 @@ out:
  *----------------------------------------------------------------------
  * clockcache_evict_batch --
  *
- *      Evicts all evictable pages in the batch.
+ *      Evicts all evictable pages in the batch, passing over reserved ones if
+ *      spare_reserved is set, and accessed ones if spare_accessed is set.
  *----------------------------------------------------------------------
  */
 void
-clockcache_evict_batch(clockcache *cc, uint32 batch)
+clockcache_evict_batch(clockcache *cc,
+                       uint32      batch,
+                       bool32      spare_reserved,
+                       bool32      spare_accessed,
+                       bool32      is_urgent)
 {
    debug_assert(cc != NULL);
    debug_assert(batch < cc->cfg->page_capacity / CC_ENTRIES_PER_BATCH);
@@ -1547,7 +2053,8 @@ clockcache_evict_batch(clockcache *cc, uint32 batch)
                   end_entry_no - 1);
 
    for (uint32 entry_no = start_entry_no; entry_no < end_entry_no; entry_no++) {
-      clockcache_try_evict(cc, entry_no);
+      clockcache_try_evict(
+         cc, entry_no, spare_reserved, spare_accessed, is_urgent);
    }
 }
 
@@ -1558,15 +2065,22 @@ clockcache_evict_batch(clockcache *cc, uint32 batch)
  *      Moves the clock hand forward cleaning and evicting a batch. Cleans
  *      "accessed" pages if is_urgent is set, for example when get_free_page
  *      has cycled through the cache already.
+ *
+ *      If probation is set, moves the hand of the probationary segment
+ *      instead, unless all of its batches are busy.
  *----------------------------------------------------------------------
  */
 void
-clockcache_move_hand(clockcache *cc, bool32 is_urgent)
+clockcache_move_hand(clockcache *cc, bool32 is_urgent, bool32 probation)
 {
    const threadid   tid = platform_get_tid();
    volatile bool32 *evict_batch_busy;
    volatile bool32 *clean_batch_busy;
    uint64           cleaner_hand;
+   volatile uint32 *hand        = &cc->evict_hand;
+   uint64           num_batches = cc->cfg->batch_capacity;
+   uint64           cleaner_gap = cc->cleaner_gap;
+   uint64           num_tries   = 0;
 
    /* move the hand a batch forward */
    uint64            evict_hand = cc->per_thread[tid].free_hand;
@@ -1576,12 +2090,22 @@ clockcache_move_hand(clockcache *cc, bool32 is_urgent)
       was_busy = __sync_bool_compare_and_swap(evict_batch_busy, TRUE, FALSE);
       debug_assert(was_busy);
    }
+   if (probation) {
+      hand        = &cc->probation_hand;
+      num_batches = cc->probation_batches;
+      cleaner_gap = cc->probation_cleaner_gap;
+   }
    do {
-      evict_hand =
-         __sync_add_and_fetch(&cc->evict_hand, 1) % cc->cfg->batch_capacity;
+      if (hand == &cc->probation_hand && num_tries++ == num_batches) {
+         // other threads hold all the probationary batches
+         hand        = &cc->evict_hand;
+         num_batches = cc->cfg->batch_capacity;
+         cleaner_gap = cc->cleaner_gap;
+      }
+      evict_hand       = __sync_add_and_fetch(hand, 1) % num_batches;
       evict_batch_busy = &cc->batch_busy[evict_hand];
       // clean the batch ahead
-      cleaner_hand = (evict_hand + cc->cleaner_gap) % cc->cfg->batch_capacity;
+      cleaner_hand     = (evict_hand + cleaner_gap) % num_batches;
       clean_batch_busy = &cc->batch_busy[cleaner_hand];
       if (__sync_bool_compare_and_swap(clean_batch_busy, FALSE, TRUE)) {
          clockcache_batch_start_writeback(cc, cleaner_hand, is_urgent);
@@ -1590,7 +2114,12 @@ clockcache_move_hand(clockcache *cc, bool32 is_urgent)
       }
    } while (!__sync_bool_compare_and_swap(evict_batch_busy, FALSE, TRUE));
 
-   clockcache_evict_batch(cc, evict_hand % cc->cfg->batch_capacity);
+   // the probationary hand spares the pages which have been read again
+   clockcache_evict_batch(cc,
+                          evict_hand % cc->cfg->batch_capacity,
+                          TRUE,
+                          hand == &cc->probation_hand,
+                          is_urgent);
    cc->per_thread[tid].free_hand = evict_hand % cc->cfg->batch_capacity;
 }
 
@@ -1600,13 +2129,17 @@ clockcache_move_hand(clockcache *cc, bool32 is_urgent)
  * clockcache_get_free_page --
  *
  *      returns a free page with given status and ref count.
+ *
+ *      If probation is set, it first evicts only within the probationary
+ *      segment.
  *----------------------------------------------------------------------
  */
 uint32
 clockcache_get_free_page(clockcache *cc,
                          uint32      status,
                          bool32      refcount,
-                         bool32      blocking)
+                         bool32      blocking,
+                         bool32      probation)
 {
    uint32            entry_no;
    uint64            num_passes = 0;
@@ -1614,10 +2147,13 @@ clockcache_get_free_page(clockcache *cc,
    uint64            max_hand   = cc->per_thread[tid].free_hand;
    clockcache_entry *entry;
    timestamp         wait_start;
+   // two sweeps of the probationary segment, so that the second can evict
+   // the pages its cleaner hand wrote back in the first
+   uint64 probation_moves = probation ? 2 * cc->probation_batches : 0;
 
-   debug_assert((tid < MAX_THREADS), "Invalid tid=%lu\n", tid);
+   debug_assert((tid < cc->cfg->max_threads), "Invalid tid=%lu\n", tid);
    if (cc->per_thread[tid].free_hand == CC_UNMAPPED_ENTRY) {
-      clockcache_move_hand(cc, FALSE);
+      clockcache_move_hand(cc, FALSE, probation);
    }
 
    /*
@@ -1645,7 +2181,14 @@ clockcache_get_free_page(clockcache *cc,
          }
       }
 
-      clockcache_move_hand(cc, num_passes != 0);
+      if (probation_moves != 0) {
+         // the passes over the whole cache only start after these
+         probation_moves--;
+         clockcache_move_hand(cc, FALSE, TRUE);
+         max_hand = cc->per_thread[tid].free_hand;
+         continue;
+      }
+      clockcache_move_hand(cc, num_passes != 0, FALSE);
       if (cc->per_thread[tid].free_hand < max_hand) {
          num_passes++;
          /*
@@ -1676,22 +2219,18 @@ clockcache_get_free_page(clockcache *cc,
 }
 /*
  *-----------------------------------------------------------------------------
- * clockcache_flush --
- *
- *      Issues writeback for all page in the cache.
+ * clockcache_write_back --
  *
- *      Asserts that there are no pins, read locks, claims or write locks.
+ *      Writes back every page in the cache which is dirty and not claimed or
+ *      locked, and waits for the writes to complete.
  *-----------------------------------------------------------------------------
  */
 void
-clockcache_flush(clockcache *cc)
+clockcache_write_back(clockcache *cc)
 {
    // make sure all aio is complete first
    io_wait_all(cc->io);
 
-   // there can be no references or pins or things won't flush
-   // clockcache_assert_no_locks_held(cc); // take out for performance
-
    // clean all the pages
    for (uint32 flush_hand = 0;
         flush_hand < cc->cfg->page_capacity / CC_ENTRIES_PER_BATCH;
@@ -1702,10 +2241,42 @@ clockcache_flush(clockcache *cc)
 
    // make sure all aio is complete again
    io_wait_all(cc->io);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * clockcache_flush --
+ *
+ *      Issues writeback for all page in the cache.
+ *
+ *      Asserts that there are no pins, read locks, claims or write locks.
+ *-----------------------------------------------------------------------------
+ */
+void
+clockcache_flush(clockcache *cc)
+{
+   // there can be no references or pins or things won't flush
+   // clockcache_assert_no_locks_held(cc); // take out for performance
+
+   clockcache_write_back(cc);
 
    debug_assert(clockcache_assert_clean(cc));
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * clockcache_sync --
+ *
+ *      Makes the completed writes durable.
+ *-----------------------------------------------------------------------------
+ */
+void
+clockcache_sync(clockcache *cc)
+{
+   platform_status status = io_sync(cc->io);
+   platform_assert_status_ok(status);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * clockcache_evict_all --
@@ -1726,9 +2297,9 @@ clockcache_evict_all(clockcache *cc, bool32 ignore_pinned_pages)
 
    // evict all the pages
    for (evict_hand = 0; evict_hand < cc->cfg->batch_capacity; evict_hand++) {
-      clockcache_evict_batch(cc, evict_hand);
+      clockcache_evict_batch(cc, evict_hand, FALSE, FALSE, TRUE);
       // Do it again for access bits
-      clockcache_evict_batch(cc, evict_hand);
+      clockcache_evict_batch(cc, evict_hand, FALSE, FALSE, TRUE);
    }
 
    for (i = 0; i < cc->cfg->page_capacity; i++) {
@@ -1766,11 +2337,40 @@ clockcache_config_init(clockcache_config *cache_cfg,
    cache_cfg->log_page_size = 63 - __builtin_clzll(io_cfg->page_size);
    cache_cfg->page_capacity = capacity / io_cfg->page_size;
    cache_cfg->use_stats     = use_stats;
+   cache_cfg->max_threads   = io_cfg->max_threads;
+
+   cache_cfg->policy            = CLOCKCACHE_POLICY_CLOCK;
+   cache_cfg->probation_percent = CC_DEFAULT_PROBATION_PERCENT;
 
    rc = snprintf(cache_cfg->logfile, MAX_STRING_LENGTH, "%s", cache_logfile);
    platform_assert(rc < MAX_STRING_LENGTH);
 }
 
+/*
+ * Validates the reservations of cfg, see CC_MAX_RESERVED_PERCENT.
+ */
+bool32
+clockcache_config_reservations_valid(const clockcache_config *cfg)
+{
+   uint64 total_percent = 0;
+   for (page_type type = 0; type < NUM_PAGE_TYPES; type++) {
+      if (cfg->reserve_percent[type] > CC_MAX_RESERVED_PERCENT) {
+         return FALSE;
+      }
+      total_percent += cfg->reserve_percent[type];
+   }
+   return total_percent <= CC_MAX_RESERVED_PERCENT;
+}
+
+static platform_status
+clockcache_buffer_init(clockcache *cc, buffer_handle *bh, size_t length)
+{
+   if (cc->cfg->use_huge_pages) {
+      return platform_buffer_init_huge_pages(bh, length);
+   }
+   return platform_buffer_init(bh, length);
+}
+
 platform_status
 clockcache_init(clockcache        *cc,   // OUT
                 clockcache_config *cfg,  // IN
@@ -1789,8 +2389,6 @@ clockcache_init(clockcache        *cc,   // OUT
    cc->cfg       = cfg;
    cc->super.ops = &clockcache_ops;
 
-   uint64 allocator_page_capacity =
-      clockcache_divide_by_page_size(cc, allocator_get_capacity(al));
    uint64 debug_capacity =
       clockcache_multiply_by_page_size(cc, cc->cfg->page_capacity);
    cc->cfg->batch_capacity = cc->cfg->page_capacity / CC_ENTRIES_PER_BATCH;
@@ -1805,6 +2403,25 @@ clockcache_init(clockcache        *cc,   // OUT
 
    cc->cleaner_gap = CC_CLEANER_GAP;
 
+   platform_assert(0 < cc->cfg->probation_percent
+                      && cc->cfg->probation_percent <= 100,
+                   "probation_percent=%lu\n",
+                   cc->cfg->probation_percent);
+   cc->probation_batches =
+      MAX(1, cc->cfg->batch_capacity * cc->cfg->probation_percent / 100);
+   // the same share of the segment as cleaner_gap is of the cache, at most
+   // half of it, so that it isn't a multiple of the segment
+   cc->probation_cleaner_gap =
+      cc->cleaner_gap * cc->probation_batches / cc->cfg->batch_capacity;
+   cc->probation_cleaner_gap =
+      MAX(1, MIN(cc->probation_cleaner_gap, cc->probation_batches / 2));
+
+   platform_assert(clockcache_config_reservations_valid(cc->cfg));
+   for (page_type type = 0; type < NUM_PAGE_TYPES; type++) {
+      cc->reserved_pages[type] =
+         cc->cfg->page_capacity * cc->cfg->reserve_percent[type] / 100;
+   }
+
 #if defined(CC_LOG) || defined(ADDR_TRACING)
    cc->logfile = platform_open_log_file(cfg->logfile, "w");
 #else
@@ -1817,14 +2434,35 @@ clockcache_init(clockcache        *cc,   // OUT
    cc->io      = io;
    cc->heap_id = hid;
 
-   /* lookup maps addrs to entries, entry contains the entries themselves */
+   /*
+    * lookup maps addrs to entries, entry contains the entries themselves.
+    * lookup has a bucket per entry or more, and lookup_node links each entry
+    * into the chain of the bucket of the addr it maps.
+    */
+   cc->lookup_log_buckets = 1;
+   while ((1UL << cc->lookup_log_buckets) < cc->cfg->page_capacity) {
+      cc->lookup_log_buckets++;
+   }
+   uint64 lookup_buckets = 1UL << cc->lookup_log_buckets;
+   cc->lookup_backing    = cc->cfg->use_huge_pages
+                              ? PLATFORM_BUFFER_TRANSPARENT_HUGE_PAGES
+                              : PLATFORM_BUFFER_PAGES;
    cc->lookup =
-      TYPED_ARRAY_MALLOC(cc->heap_id, cc->lookup, allocator_page_capacity);
+      clockcache_lookup_alloc(cc, lookup_buckets * sizeof(*cc->lookup));
    if (!cc->lookup) {
       goto alloc_error;
    }
-   for (i = 0; i < allocator_page_capacity; i++) {
-      cc->lookup[i] = CC_UNMAPPED_ENTRY;
+   for (uint64 bucket_no = 0; bucket_no < lookup_buckets; bucket_no++) {
+      cc->lookup[bucket_no].head = CC_UNMAPPED_ENTRY;
+   }
+   cc->lookup_node =
+      TYPED_ARRAY_MALLOC(cc->heap_id, cc->lookup_node, cc->cfg->page_capacity);
+   if (!cc->lookup_node) {
+      goto alloc_error;
+   }
+   for (uint64 entry_no = 0; entry_no < cc->cfg->page_capacity; entry_no++) {
+      cc->lookup_node[entry_no].addr = CC_UNMAPPED_ADDR;
+      cc->lookup_node[entry_no].next = CC_UNMAPPED_ENTRY;
    }
 
    cc->entry =
@@ -1836,7 +2474,7 @@ clockcache_init(clockcache        *cc,   // OUT
    platform_status rc = STATUS_NO_MEMORY;
 
    /* data must be aligned because of O_DIRECT */
-   rc = platform_buffer_init(&cc->bh, cc->cfg->capacity);
+   rc = clockcache_buffer_init(cc, &cc->bh, cc->cfg->capacity);
    if (!SUCCESS(rc)) {
       goto alloc_error;
    }
@@ -1850,29 +2488,36 @@ clockcache_init(clockcache        *cc,   // OUT
       cc->entry[i].status         = CC_FREE_STATUS;
    }
 
-   /* Entry per-thread ref counts */
+   /* Entry per-thread ref counts, followed by separate ref counts for pins */
    size_t refcount_size = cc->cfg->page_capacity * CC_RC_WIDTH * sizeof(uint8);
+   size_t pincount_size = cc->cfg->page_capacity * sizeof(uint8);
 
-   rc = platform_buffer_init(&cc->rc_bh, refcount_size);
+   rc = clockcache_buffer_init(cc, &cc->rc_bh, refcount_size + pincount_size);
    if (!SUCCESS(rc)) {
       goto alloc_error;
    }
    cc->refcount = platform_buffer_getaddr(&cc->rc_bh);
-
-   /* Separate ref counts for pins */
-   cc->pincount =
-      TYPED_ARRAY_ZALLOC(cc->heap_id, cc->pincount, cc->cfg->page_capacity);
-   if (!cc->pincount) {
-      goto alloc_error;
-   }
+   cc->pincount = cc->refcount + refcount_size;
 
    /* The hands and associated page */
    cc->free_hand  = 0;
    cc->evict_hand = 1;
-   for (thr_i = 0; thr_i < MAX_THREADS; thr_i++) {
+   cc->per_thread =
+      TYPED_ARRAY_ZALLOC(cc->heap_id, cc->per_thread, cc->cfg->max_threads);
+   if (!cc->per_thread) {
+      goto alloc_error;
+   }
+   for (thr_i = 0; thr_i < cc->cfg->max_threads; thr_i++) {
       cc->per_thread[thr_i].free_hand       = CC_UNMAPPED_ENTRY;
       cc->per_thread[thr_i].enable_sync_get = TRUE;
    }
+   rc = platform_spinlock_init(&cc->io_limiter.lock, mid, cc->heap_id);
+   if (!SUCCESS(rc)) {
+      goto alloc_error;
+   }
+   clockcache_set_io_limit(cc,
+                           cfg->io_limit_bytes_per_sec,
+                           cfg->io_limit_target_read_latency_ns);
    cc->batch_busy =
       TYPED_ARRAY_ZALLOC(cc->heap_id,
                          cc->batch_busy,
@@ -1880,6 +2525,10 @@ clockcache_init(clockcache        *cc,   // OUT
    if (!cc->batch_busy) {
       goto alloc_error;
    }
+   cc->stats = TYPED_ARRAY_ZALLOC(cc->heap_id, cc->stats, cc->cfg->max_threads);
+   if (!cc->stats) {
+      goto alloc_error;
+   }
 
    return STATUS_OK;
 
@@ -1909,6 +2558,9 @@ clockcache_deinit(clockcache *cc) // IN/OUT
    if (cc->lookup) {
       platform_free(cc->heap_id, cc->lookup);
    }
+   if (cc->lookup_node) {
+      platform_free(cc->heap_id, cc->lookup_node);
+   }
    if (cc->entry) {
       platform_free(cc->heap_id, cc->entry);
    }
@@ -1927,14 +2579,19 @@ clockcache_deinit(clockcache *cc) // IN/OUT
       rc = platform_buffer_deinit(&cc->rc_bh);
       debug_assert(SUCCESS(rc), "rc=%s", platform_status_to_string(rc));
       cc->refcount = NULL;
+      cc->pincount = NULL;
    }
 
-   if (cc->pincount) {
-      platform_free_volatile(cc->heap_id, cc->pincount);
-   }
    if (cc->batch_busy) {
       platform_free_volatile(cc->heap_id, cc->batch_busy);
    }
+   if (cc->per_thread) {
+      platform_free_volatile(cc->heap_id, cc->per_thread);
+   }
+   if (cc->stats) {
+      platform_free(cc->heap_id, cc->stats);
+   }
+   platform_spinlock_destroy(&cc->io_limiter.lock);
 }
 
 /*
@@ -1950,13 +2607,15 @@ clockcache_alloc(clockcache *cc, uint64 addr, page_type type)
 {
    uint32            entry_no = clockcache_get_free_page(cc,
                                               CC_ALLOC_STATUS,
-                                              TRUE,  // refcount
-                                              TRUE); // blocking
+                                              TRUE,   // refcount
+                                              TRUE,   // blocking
+                                              FALSE); // probation
    clockcache_entry *entry    = &cc->entry[entry_no];
    entry->page.disk_addr      = addr;
    entry->type                = type;
-   uint64 lookup_no = clockcache_divide_by_page_size(cc, entry->page.disk_addr);
-   cc->lookup[lookup_no] = entry_no;
+   bool32 reserved = clockcache_lookup_reserve(cc, addr, entry_no);
+   platform_assert(reserved, "addr=%lu is already cached\n", addr);
+   clockcache_count_page(cc, type, TRUE);
 
    clockcache_log(entry->page.disk_addr,
                   entry_no,
@@ -2039,10 +2698,10 @@ clockcache_try_page_discard(clockcache *cc, uint64 addr)
       clockcache_get_write(cc, entry_number);
 
       /* 5. clear lookup and disk addr; set status to CC_FREE_STATUS */
-      uint64 lookup_no      = clockcache_divide_by_page_size(cc, addr);
-      cc->lookup[lookup_no] = CC_UNMAPPED_ENTRY;
+      clockcache_lookup_clear(cc, addr);
       debug_assert(entry->page.disk_addr == addr);
       entry->page.disk_addr = CC_UNMAPPED_ADDR;
+      clockcache_count_page(cc, entry->type, FALSE);
 
       /* 6. set status to CC_FREE_STATUS (clears claim and write lock) */
       entry->status = CC_FREE_STATUS;
@@ -2103,7 +2762,6 @@ clockcache_get_internal(clockcache   *cc,       // IN
    debug_assert(
       ((addr % page_size) == 0), "addr=%lu, page_size=%lu\n", addr, page_size);
    uint32            entry_number = CC_UNMAPPED_ENTRY;
-   uint64            lookup_no    = clockcache_divide_by_page_size(cc, addr);
    debug_only uint64 base_addr =
       allocator_config_extent_base_addr(allocator_get_config(cc->al), addr);
    const threadid    tid = platform_get_tid();
@@ -2204,18 +2862,22 @@ clockcache_get_internal(clockcache   *cc,       // IN
     * If a matching entry was not found, evict a page and load the requested
     * page from disk.
     */
+   clockcache_io_limit_charge(cc, page_size);
+   bool32 probation = clockcache_read_is_probationary(cc, tid);
+   uint32 loading_status =
+      probation ? CC_PROBATION_LOADING_STATUS : CC_READ_LOADING_STATUS;
+
    entry_number = clockcache_get_free_page(cc,
-                                           CC_READ_LOADING_STATUS,
-                                           TRUE,  // refcount
-                                           TRUE); // blocking
+                                           loading_status,
+                                           TRUE, // refcount
+                                           TRUE, // blocking
+                                           probation);
    entry        = clockcache_get_entry(cc, entry_number);
    /*
     * If someone else is loading the page and has reserved the lookup, let them
     * do it.
     */
-   if (!__sync_bool_compare_and_swap(
-          &cc->lookup[lookup_no], CC_UNMAPPED_ENTRY, entry_number))
-   {
+   if (!clockcache_lookup_reserve(cc, addr, entry_number)) {
       clockcache_dec_ref(cc, entry_number, tid);
       entry->status = CC_FREE_STATUS;
       clockcache_log(addr,
@@ -2228,18 +2890,26 @@ clockcache_get_internal(clockcache   *cc,       // IN
 
    /* Set up the page */
    entry->page.disk_addr = addr;
-   if (cc->cfg->use_stats) {
+   entry->type           = type;
+   clockcache_count_page(cc, type, TRUE);
+   bool32 record_read = cc->io_limiter.target_read_latency_ns != 0
+                        && !cc->per_thread[tid].throttle_io;
+   if (cc->cfg->use_stats || record_read) {
       start = platform_get_timestamp();
    }
 
    status = io_read(cc->io, entry->page.data, page_size, addr);
    platform_assert_status_ok(status);
 
+   if (record_read) {
+      clockcache_io_limit_record_read(cc, platform_timestamp_elapsed(start));
+   }
    if (cc->cfg->use_stats) {
       elapsed = platform_timestamp_elapsed(start);
       cc->stats[tid].cache_misses[type]++;
       cc->stats[tid].page_reads[type]++;
       cc->stats[tid].cache_miss_time_ns[type] += elapsed;
+      cc->stats[tid].probationary_reads[type] += probation;
    }
 
    clockcache_log(addr,
@@ -2367,7 +3037,6 @@ clockcache_get_async(clockcache       *cc,   // IN
    debug_assert(addr % clockcache_page_size(cc) == 0);
    debug_assert((cache *)cc == ctxt->cc);
    uint32            entry_number = CC_UNMAPPED_ENTRY;
-   uint64            lookup_no    = clockcache_divide_by_page_size(cc, addr);
    debug_only uint64 base_addr =
       allocator_config_extent_base_addr(allocator_get_config(cc->al), addr);
    const threadid    tid = platform_get_tid();
@@ -2423,10 +3092,15 @@ clockcache_get_async(clockcache       *cc,   // IN
     * If a matching entry was not found, evict a page and load the requested
     * page from disk.
     */
+   bool32 probation = clockcache_read_is_probationary(cc, tid);
+   uint32 loading_status =
+      probation ? CC_PROBATION_LOADING_STATUS : CC_READ_LOADING_STATUS;
+
    entry_number = clockcache_get_free_page(cc,
-                                           CC_READ_LOADING_STATUS,
-                                           TRUE,   // refcount
-                                           FALSE); // !blocking
+                                           loading_status,
+                                           TRUE,  // refcount
+                                           FALSE, // !blocking
+                                           probation);
    if (entry_number == CC_UNMAPPED_ENTRY) {
       return async_locked;
    }
@@ -2436,9 +3110,7 @@ clockcache_get_async(clockcache       *cc,   // IN
     * If someone else is loading the page and has reserved the lookup, let them
     * do it.
     */
-   if (!__sync_bool_compare_and_swap(
-          &cc->lookup[lookup_no], CC_UNMAPPED_ENTRY, entry_number))
-   {
+   if (!clockcache_lookup_reserve(cc, addr, entry_number)) {
       /*
        * This is rare but when it happens, we could burn CPU retrying
        * the get operation until an IO is complete.
@@ -2456,14 +3128,16 @@ clockcache_get_async(clockcache       *cc,   // IN
    /* Set up the page */
    entry->page.disk_addr = addr;
    entry->type           = type;
+   clockcache_count_page(cc, type, TRUE);
    if (cc->cfg->use_stats) {
       ctxt->stats.issue_ts = platform_get_timestamp();
    }
 
    io_async_req *req = io_get_async_req(cc->io, FALSE);
    if (req == NULL) {
-      cc->lookup[lookup_no] = CC_UNMAPPED_ENTRY;
+      clockcache_lookup_clear(cc, addr);
       entry->page.disk_addr = CC_UNMAPPED_ADDR;
+      clockcache_count_page(cc, type, FALSE);
       entry->status         = CC_FREE_STATUS;
       clockcache_dec_ref(cc, entry_number, tid);
       clockcache_log(addr,
@@ -2483,6 +3157,7 @@ clockcache_get_async(clockcache       *cc,   // IN
 
    if (cc->cfg->use_stats) {
       cc->stats[tid].cache_misses[type]++;
+      cc->stats[tid].probationary_reads[type] += probation;
    }
 
    return async_io_started;
@@ -2518,7 +3193,9 @@ clockcache_unget(clockcache *cc, page_handle *page)
    clockcache_record_backtrace(cc, entry_number);
 
    // T&T&S reduces contention
-   if (!clockcache_test_flag(cc, entry_number, CC_ACCESSED)) {
+   if (!clockcache_read_is_probationary(cc, tid)
+       && !clockcache_test_flag(cc, entry_number, CC_ACCESSED))
+   {
       clockcache_set_flag(cc, entry_number, CC_ACCESSED);
    }
 
@@ -2647,7 +3324,9 @@ clockcache_mark_dirty(clockcache *cc, page_handle *page)
  *      Functionally equivalent to an anonymous read lock. Implemented using a
  *      special ref count.
  *
- *      A write lock must be held while pinning to avoid a race with eviction.
+ *      A write lock, or a read lock of this thread, must be held while
+ *      pinning to avoid a race with eviction: the evictor only checks the pin
+ *      count once it has the write lock.
  *----------------------------------------------------------------------
  */
 void
@@ -2655,7 +3334,8 @@ clockcache_pin(clockcache *cc, page_handle *page)
 {
    debug_only clockcache_entry *entry = clockcache_page_to_entry(cc, page);
    uint32 entry_number = clockcache_page_to_entry_number(cc, page);
-   debug_assert(clockcache_test_flag(cc, entry_number, CC_WRITELOCKED));
+   debug_assert(clockcache_test_flag(cc, entry_number, CC_WRITELOCKED)
+                || clockcache_get_ref(cc, entry_number, platform_get_tid()));
    clockcache_inc_pin(cc, entry_number);
 
    clockcache_log(entry->page.disk_addr,
@@ -2737,6 +3417,32 @@ clockcache_page_sync(clockcache  *cc,
    }
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * clockcache_page_write --
+ *
+ *      Synchronously writes the page, leaving its status as it is, so a dirty
+ *      page stays dirty and is written back again later.
+ *-----------------------------------------------------------------------------
+ */
+void
+clockcache_page_write(clockcache *cc, page_handle *page, page_type type)
+{
+   uint32 entry_number = clockcache_page_to_entry_number(cc, page);
+   if (clockcache_test_flag(cc, entry_number, CC_CLEAN)) {
+      // its contents are already on disk
+      return;
+   }
+
+   if (cc->cfg->use_stats) {
+      cc->stats[platform_get_tid()].page_writes[type]++;
+   }
+
+   platform_status status =
+      io_write(cc->io, page->data, clockcache_page_size(cc), page->disk_addr);
+   platform_assert_status_ok(status);
+}
+
 /*
  *----------------------------------------------------------------------
  * clockcache_sync_callback --
@@ -2816,7 +3522,8 @@ clockcache_extent_sync(clockcache *cc, uint64 addr, uint64 *pages_outstanding)
          if (req_count != 0) {
             __sync_fetch_and_add(pages_outstanding, req_count);
             io_req->bytes = clockcache_multiply_by_page_size(cc, req_count);
-            status        = io_write_async(
+            clockcache_io_limit_charge(cc, io_req->bytes);
+            status = io_write_async(
                cc->io, io_req, clockcache_sync_callback, req_count, req_addr);
             platform_assert_status_ok(status);
             req_count = 0;
@@ -2825,6 +3532,8 @@ clockcache_extent_sync(clockcache *cc, uint64 addr, uint64 *pages_outstanding)
    }
    if (req_count != 0) {
       __sync_fetch_and_add(pages_outstanding, req_count);
+      clockcache_io_limit_charge(
+         cc, clockcache_multiply_by_page_size(cc, req_count));
       status = io_write_async(
          cc->io, io_req, clockcache_sync_callback, req_count, req_addr);
       platform_assert_status_ok(status);
@@ -2903,6 +3612,7 @@ clockcache_prefetch(clockcache *cc, uint64 base_addr, page_type type)
    uint64        pages_in_req     = 0;
    uint64        req_start_addr   = CC_UNMAPPED_ADDR;
    threadid      tid              = platform_get_tid();
+   bool32        probation        = clockcache_read_is_probationary(cc, tid);
 
    debug_assert(base_addr % clockcache_extent_size(cc) == 0);
 
@@ -2925,6 +3635,7 @@ clockcache_prefetch(clockcache *cc, uint64 base_addr, page_type type)
             // in cache, issue IO req if started
             if (pages_in_req != 0) {
                req->bytes = clockcache_multiply_by_page_size(cc, pages_in_req);
+               clockcache_io_limit_charge(cc, req->bytes);
                platform_status rc = io_read_async(cc->io,
                                                   req,
                                                   clockcache_prefetch_callback,
@@ -2943,15 +3654,19 @@ clockcache_prefetch(clockcache *cc, uint64 base_addr, page_type type)
          case GET_RC_EVICTED:
          {
             // need to prefetch
+            // read-ahead keeps its access bit, so that it lasts until used,
+            // except in the probationary segment, whose hand spares it
             uint32 free_entry_no = clockcache_get_free_page(
-               cc, CC_READ_LOADING_STATUS, FALSE, TRUE);
+               cc,
+               probation ? CC_PROBATION_LOADING_STATUS : CC_READ_LOADING_STATUS,
+               FALSE,
+               TRUE,
+               probation);
             clockcache_entry *entry = &cc->entry[free_entry_no];
             entry->page.disk_addr   = addr;
             entry->type             = type;
-            uint64 lookup_no        = clockcache_divide_by_page_size(cc, addr);
-            if (__sync_bool_compare_and_swap(
-                   &cc->lookup[lookup_no], CC_UNMAPPED_ENTRY, free_entry_no))
-            {
+            if (clockcache_lookup_reserve(cc, addr, free_entry_no)) {
+               clockcache_count_page(cc, type, TRUE);
                if (pages_in_req == 0) {
                   debug_assert(req_start_addr == CC_UNMAPPED_ADDR);
                   // start a new IO req
@@ -2962,6 +3677,9 @@ clockcache_prefetch(clockcache *cc, uint64 base_addr, page_type type)
                   req_start_addr               = addr;
                }
                iovec[pages_in_req++].iov_base = entry->page.data;
+               if (cc->cfg->use_stats) {
+                  cc->stats[tid].probationary_reads[type] += probation;
+               }
                clockcache_log(addr,
                               entry_no,
                               "prefetch (load): entry %u addr %lu\n",
@@ -2984,7 +3702,8 @@ clockcache_prefetch(clockcache *cc, uint64 base_addr, page_type type)
    }
    // issue IO req if started
    if (pages_in_req != 0) {
-      req->bytes         = clockcache_multiply_by_page_size(cc, pages_in_req);
+      req->bytes = clockcache_multiply_by_page_size(cc, pages_in_req);
+      clockcache_io_limit_charge(cc, req->bytes);
       platform_status rc = io_read_async(cc->io,
                                          req,
                                          clockcache_prefetch_callback,
@@ -3070,7 +3789,7 @@ clockcache_io_stats(clockcache *cc, uint64 *read_bytes, uint64 *write_bytes)
 
    uint64 read_pages  = 0;
    uint64 write_pages = 0;
-   for (uint64 i = 0; i < MAX_THREADS; i++) {
+   for (uint64 i = 0; i < cc->cfg->max_threads; i++) {
       for (page_type type = 0; type < NUM_PAGE_TYPES; type++) {
          write_pages += cc->stats[i].page_writes[type];
          read_pages += cc->stats[i].page_reads[type];
@@ -3081,10 +3800,39 @@ clockcache_io_stats(clockcache *cc, uint64 *read_bytes, uint64 *write_bytes)
    *read_bytes  = read_pages * 4 * KiB;
 }
 
+void
+clockcache_get_stats(clockcache *cc, cache_stats *global)
+{
+   for (page_type type = 0; type < NUM_PAGE_TYPES; type++) {
+      global->pages_cached[type] = cc->pages_cached[type];
+   }
+
+   if (!cc->cfg->use_stats) {
+      return;
+   }
+
+   for (uint64 i = 0; i < cc->cfg->max_threads; i++) {
+      for (page_type type = 0; type < NUM_PAGE_TYPES; type++) {
+         global->cache_hits[type] += cc->stats[i].cache_hits[type];
+         global->cache_misses[type] += cc->stats[i].cache_misses[type];
+         global->cache_miss_time_ns[type] +=
+            cc->stats[i].cache_miss_time_ns[type];
+         global->page_writes[type] += cc->stats[i].page_writes[type];
+         global->page_reads[type] += cc->stats[i].page_reads[type];
+         global->prefetches_issued[type] +=
+            cc->stats[i].prefetches_issued[type];
+         global->probationary_reads[type] +=
+            cc->stats[i].probationary_reads[type];
+      }
+      global->writes_issued += cc->stats[i].writes_issued;
+      global->syncs_issued += cc->stats[i].syncs_issued;
+      global->io_throttle_time_ns += cc->stats[i].io_throttle_time_ns;
+   }
+}
+
 void
 clockcache_print_stats(platform_log_handle *log_handle, clockcache *cc)
 {
-   uint64      i;
    page_type   type;
    cache_stats global_stats;
 
@@ -3092,22 +3840,11 @@ clockcache_print_stats(platform_log_handle *log_handle, clockcache *cc)
       return;
    }
 
-   uint64 page_writes = 0;
    ZERO_CONTENTS(&global_stats);
-   for (i = 0; i < MAX_THREADS; i++) {
-      for (type = 0; type < NUM_PAGE_TYPES; type++) {
-         global_stats.cache_hits[type] += cc->stats[i].cache_hits[type];
-         global_stats.cache_misses[type] += cc->stats[i].cache_misses[type];
-         global_stats.cache_miss_time_ns[type] +=
-            cc->stats[i].cache_miss_time_ns[type];
-         global_stats.page_writes[type] += cc->stats[i].page_writes[type];
-         page_writes += cc->stats[i].page_writes[type];
-         global_stats.page_reads[type] += cc->stats[i].page_reads[type];
-         global_stats.prefetches_issued[type] +=
-            cc->stats[i].prefetches_issued[type];
-      }
-      global_stats.writes_issued += cc->stats[i].writes_issued;
-      global_stats.syncs_issued += cc->stats[i].syncs_issued;
+   clockcache_get_stats(cc, &global_stats);
+   uint64 page_writes = 0;
+   for (type = 0; type < NUM_PAGE_TYPES; type++) {
+      page_writes += global_stats.page_writes[type];
    }
 
    fraction miss_time[NUM_PAGE_TYPES];
@@ -3153,6 +3890,20 @@ clockcache_print_stats(platform_log_handle *log_handle, clockcache *cc)
                 FRACTION_ARGS(miss_time[PAGE_TYPE_FILTER]),
                 FRACTION_ARGS(miss_time[PAGE_TYPE_LOG]),
                 FRACTION_ARGS(miss_time[PAGE_TYPE_SUPERBLOCK]));
+   platform_log(log_handle, "probation reads | %10lu | %10lu | %10lu | %10lu | %10lu | %10lu |\n",
+         global_stats.probationary_reads[PAGE_TYPE_TRUNK],
+         global_stats.probationary_reads[PAGE_TYPE_BRANCH],
+         global_stats.probationary_reads[PAGE_TYPE_MEMTABLE],
+         global_stats.probationary_reads[PAGE_TYPE_FILTER],
+         global_stats.probationary_reads[PAGE_TYPE_LOG],
+         global_stats.probationary_reads[PAGE_TYPE_SUPERBLOCK]);
+   platform_log(log_handle, "pages cached    | %10lu | %10lu | %10lu | %10lu | %10lu | %10lu |\n",
+         global_stats.pages_cached[PAGE_TYPE_TRUNK],
+         global_stats.pages_cached[PAGE_TYPE_BRANCH],
+         global_stats.pages_cached[PAGE_TYPE_MEMTABLE],
+         global_stats.pages_cached[PAGE_TYPE_FILTER],
+         global_stats.pages_cached[PAGE_TYPE_LOG],
+         global_stats.pages_cached[PAGE_TYPE_SUPERBLOCK]);
    platform_log(log_handle, "pages written   | %10lu | %10lu | %10lu | %10lu | %10lu | %10lu |\n",
          global_stats.page_writes[PAGE_TYPE_TRUNK],
          global_stats.page_writes[PAGE_TYPE_BRANCH],
@@ -3180,6 +3931,10 @@ clockcache_print_stats(platform_log_handle *log_handle, clockcache *cc)
    platform_log(log_handle, "-----------------------------------------------------------------------------------------------\n");
    platform_log(log_handle, "avg write pgs: "FRACTION_FMT(9,2)"\n",
                 FRACTION_ARGS(avg_write_pages));
+   platform_log(log_handle, "backed by: %s (pages), %s (ref counts), %s (lookup)\n",
+                clockcache_backing_str[cc->bh.backing],
+                clockcache_backing_str[cc->rc_bh.backing],
+                clockcache_backing_str[cc->lookup_backing]);
    // clang-format on
 
    allocator_print_stats(cc->al);
@@ -3190,7 +3945,7 @@ clockcache_reset_stats(clockcache *cc)
 {
    uint64 i;
 
-   for (i = 0; i < MAX_THREADS; i++) {
+   for (i = 0; i < cc->cfg->max_threads; i++) {
       cache_stats *stats = &cc->stats[i];
 
       memset(stats->cache_hits, 0, sizeof(stats->cache_hits));
@@ -3247,6 +4002,48 @@ clockcache_enable_sync_get(clockcache *cc, bool32 enabled)
    cc->per_thread[platform_get_tid()].enable_sync_get = enabled;
 }
 
+static bool32
+clockcache_throttle_io(clockcache *cc, bool32 enabled)
+{
+   threadid tid                    = platform_get_tid();
+   bool32   was_enabled            = cc->per_thread[tid].throttle_io;
+   cc->per_thread[tid].throttle_io = enabled;
+   return was_enabled;
+}
+
+static bool32
+clockcache_read_probationary(clockcache *cc, bool32 enabled)
+{
+   threadid tid         = platform_get_tid();
+   bool32   was_enabled = cc->per_thread[tid].read_probationary;
+
+   cc->per_thread[tid].read_probationary = enabled;
+   return was_enabled;
+}
+
+static void
+clockcache_set_io_limit(clockcache *cc,
+                        uint64      bytes_per_sec,
+                        uint64      target_read_latency_ns)
+{
+   clockcache_io_limiter *lim = &cc->io_limiter;
+   platform_spin_lock(&lim->lock);
+   lim->bytes_per_sec          = bytes_per_sec;
+   lim->max_bytes_per_sec      = bytes_per_sec;
+   lim->target_read_latency_ns = target_read_latency_ns;
+   lim->tokens                 = 0;
+   lim->last_refill            = platform_get_timestamp();
+   lim->last_tune              = lim->last_refill;
+   lim->read_latency_ns        = 0;
+   platform_spin_unlock(&lim->lock);
+}
+
+static uint64
+clockcache_get_io_limit(clockcache *cc)
+{
+   return cc->io_limiter.bytes_per_sec;
+}
+
 static allocator *
 clockcache_get_allocator(const clockcache *cc)
 {
@@ -22,6 +22,43 @@
 /* how distributed the rw locks are */
 #define CC_RC_WIDTH 4
 
+/*
+ * Replacement policies:
+ *
+ * CLOCKCACHE_POLICY_CLOCK: a single clock over all the pages.
+ *
+ * CLOCKCACHE_POLICY_SCAN_RESISTANT: pages read by probationary threads, see
+ * cache_read_probationary(), are loaded without their access bit and find
+ * free entries with a second clock hand. That hand only sweeps the
+ * probationary segment, the fixed range of entries in the first
+ * probation_percent of the cache, so a compaction or a scan evicts only
+ * within it and the pages outside it stay cached. A page read again by a
+ * thread which is not probationary gets its access bit back, as under CLOCK.
+ *
+ * The segment is a range of positions, not a queue that pages move out of:
+ * a page stays in the entry it was loaded into, by either hand. The second
+ * hand spares the pages with their access bit, so pages there which lookups
+ * read again stay cached through scans until the main hand clears it, but
+ * the others are evicted by scans, hot or not. When the segment has nothing
+ * left to evict, probationary reads fall back to the main hand.
+ */
+typedef enum clockcache_policy {
+   CLOCKCACHE_POLICY_CLOCK = 0,
+   CLOCKCACHE_POLICY_SCAN_RESISTANT,
+} clockcache_policy;
+
+#define CC_DEFAULT_PROBATION_PERCENT 25
+
+/*
+ * Reservations: reserve_percent[type] of the cache is kept for pages of that
+ * type. The clock passes over them while their type holds no more than its
+ * share, until get_free_page has gone around the cache without finding a
+ * free page. With pin_reserved, the clock always passes over them. The
+ * shares add up to at most CC_MAX_RESERVED_PERCENT, so that the other pages
+ * always have room.
+ */
+#define CC_MAX_RESERVED_PERCENT 75
+
 /*
  * Configuration struct to setup the clock cache sub-system.
  */
@@ -31,6 +68,22 @@ typedef struct clockcache_config {
    uint64       capacity;
    bool32       use_stats;
    char         logfile[MAX_STRING_LENGTH];
+   uint64       max_threads; // sizes the per-thread state, see MAX_THREADS
+
+   // initial background I/O limit, see cache_set_io_limit()
+   uint64 io_limit_bytes_per_sec;
+   uint64 io_limit_target_read_latency_ns;
+
+   // replacement policy, see clockcache_policy
+   clockcache_policy policy;
+   uint64            probation_percent;
+
+   // per page type, see CC_MAX_RESERVED_PERCENT
+   uint64 reserve_percent[NUM_PAGE_TYPES];
+   bool32 pin_reserved;
+
+   // back the pages, ref counts and lookup table by huge pages if possible
+   bool32 use_huge_pages;
 
    // computed
    uint64 log_page_size;
@@ -44,6 +97,16 @@ typedef struct clockcache_config {
 typedef struct clockcache       clockcache;
 typedef struct clockcache_entry clockcache_entry;
 
+/*
+ * Per-thread clock state, padded to a cacheline.
+ */
+typedef struct clockcache_thread_state {
+   volatile uint32 free_hand;
+   bool32          enable_sync_get;
+   bool32          throttle_io;
+   bool32          read_probationary;
+} PLATFORM_CACHELINE_ALIGNED clockcache_thread_state;
+
 #ifdef RECORD_ACQUISITION_STACKS
 
 // Provide a small number of backtrace history records.
@@ -77,19 +140,64 @@ struct clockcache_entry {
 #endif
 };
 
+/*
+ *-----------------------------------------------------------------------------
+ * clockcache_io_limiter --
+ *
+ *     Token bucket limiting background I/O, counted in bytes. A thread takes
+ *     the tokens for its I/O even if there are not enough, and sleeps off the
+ *     debt later, once it holds no locks, so the limiter lock is only held
+ *     to do the arithmetic.
+ *
+ *     When auto-tuning, bytes_per_sec moves between CC_IO_LIMIT_MIN_RATE
+ *     and max_bytes_per_sec depending on the moving average of the latency
+ *     of foreground page reads.
+ *-----------------------------------------------------------------------------
+ */
+typedef struct clockcache_io_limiter {
+   platform_spinlock lock;
+   uint64            bytes_per_sec; // 0 means unlimited
+   uint64            max_bytes_per_sec;
+   uint64            target_read_latency_ns; // 0 disables auto-tuning
+   int64             tokens;
+   timestamp         last_refill;
+   timestamp         last_tune;
+   volatile uint64   read_latency_ns; // moving average
+} clockcache_io_limiter;
+
+/*
+ * A bucket of the cache lookup table: the head of a chain of entries, and a
+ * sequence number which is odd while a thread changes the chain.
+ */
+typedef struct clockcache_lookup_bucket {
+   volatile uint32 seq;
+   volatile uint32 head;
+} clockcache_lookup_bucket;
+
+/*
+ * Where an entry is in the lookup table: the address it maps and the next
+ * entry on its bucket's chain.
+ */
+typedef struct clockcache_lookup_node {
+   volatile uint64 addr;
+   volatile uint32 next;
+} clockcache_lookup_node;
+
 /*
  *----------------------------------------------------------------------
  * clockcache -- A multi-threaded cache using a clock algorithm for eviction
  *
- *      Pages are indexed by a direct mapping, cc->lookup, which is an array.
- *      For a given address, cc->lookup[addr / page_size] returns an
- *      entry_number which can be used to access the metadata and data of the
- *      page.
+ *      Pages are indexed by a hash table, cc->lookup, sized by the number
+ *      of entries rather than by the disk. Each bucket chains the entries
+ *      whose address hashes to it, and looking an address up returns an
+ *      entry_number which can be used to access the metadata and data of
+ *      the page. Lookups take no lock and write nothing; they only retry
+ *      when the chain they walked changed under them.
  *
  *      Each page in the cache has an entry cc->entry[entry_number] with:
  *         --status: flags, e.g. free, write locked, flushing, etc.
  *         --page: disk address and pointer to the page data
- *         --type: used for stats
+ *         --type: used for stats and reservations
  *
  *      Each page has a distributed ref count, accessed by
  *      clockcache_[get,inc,dec]_ref(cc, entry_number, tid) and stored in
@@ -114,14 +222,20 @@ struct clockcache {
    allocator         *al;
    io_handle         *io;
 
-   uint32              *lookup;
+   // 1 << lookup_log_buckets buckets, chaining entries through lookup_node
+   clockcache_lookup_bucket *lookup;
+   clockcache_lookup_node   *lookup_node; // one per entry
+   uint64                    lookup_log_buckets;
+   volatile uint32           lookup_backing; // platform_buffer_backing
+
    clockcache_entry    *entry;
    buffer_handle        bh;   // actual memory for pages
    char                *data; // convenience pointer for bh
    platform_log_handle *logfile;
    platform_heap_id     heap_id;
 
-   // Distributed locks (the write bit is in the status uint32 of the entry)
+   // Distributed locks (the write bit is in the status uint32 of the entry),
+   // pincount follows refcount in rc_bh
    buffer_handle   rc_bh;
    volatile uint8 *refcount;
    volatile uint8 *pincount;
@@ -132,13 +246,25 @@ struct clockcache {
    volatile bool32 *batch_busy;
    uint64           cleaner_gap;
 
-   volatile struct {
-      volatile uint32 free_hand;
-      bool32          enable_sync_get;
-   } PLATFORM_CACHELINE_ALIGNED per_thread[MAX_THREADS];
+   // Hand of the first probation_batches batches, the probationary segment
+   // of CLOCKCACHE_POLICY_SCAN_RESISTANT, which cleans probation_cleaner_gap
+   // batches ahead of it
+   volatile uint32 probation_hand;
+   uint64          probation_batches;
+   uint64          probation_cleaner_gap;
 
-   // Stats
-   cache_stats stats[MAX_THREADS];
+   // Reservations from cfg->reserve_percent, and the pages of each type in
+   // the cache, counted as entries are mapped and unmapped
+   uint64          reserved_pages[NUM_PAGE_TYPES];
+   volatile uint64 pages_cached[NUM_PAGE_TYPES];
+
+   // by thread ID, cfg->max_threads of them
+   volatile clockcache_thread_state *per_thread;
+
+   clockcache_io_limiter io_limiter;
+
+   // Stats, by thread ID, cfg->max_threads of them
+   cache_stats *stats;
 };
 
 
@@ -155,6 +281,9 @@ clockcache_config_init(clockcache_config *cache_config,
                        const char        *cache_logfile,
                        uint64             use_stats);
 
+bool32
+clockcache_config_reservations_valid(const clockcache_config *cfg);
+
 platform_status
 clockcache_init(clockcache        *cc,   // OUT
                 clockcache_config *cfg,  // IN
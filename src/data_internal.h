@@ -547,6 +547,37 @@ merge_accumulator_is_null(const merge_accumulator *ma)
  * them here.
  */
 
+/*
+ * Returns the part of tuple_key that routing filters are keyed on: its prefix
+ * if the data_config has a prefix extractor, otherwise the whole key.
+ */
+static inline key
+data_key_filter_key(const data_config *cfg, key tuple_key)
+{
+   if (cfg->key_prefix == NULL || !key_is_user_key(tuple_key)) {
+      return tuple_key;
+   }
+   uint64 prefix_length = cfg->key_prefix(cfg, key_slice(tuple_key));
+   debug_assert(prefix_length <= key_length(tuple_key));
+   return key_create(prefix_length, key_data(tuple_key));
+}
+
+/*
+ * Returns the normalized image of k, see key_normalize_fn. Infinite keys map
+ * to the extreme images, which user keys may share.
+ */
+static inline uint64
+data_key_normalize(const data_config *cfg, key k)
+{
+   debug_assert(cfg->key_normalize != NULL);
+   if (key_is_negative_infinity(k)) {
+      return 0;
+   } else if (key_is_positive_infinity(k)) {
+      return UINT64_MAX;
+   }
+   return cfg->key_normalize(cfg, key_slice(k));
+}
+
 static inline int
 data_key_compare(const data_config *cfg, key key1, key key2)
 {
@@ -606,6 +637,23 @@ data_merge_tuples_final(const data_config *cfg,
    return result;
 }
 
+static inline int
+data_compaction_filter(const data_config *cfg,
+                       key                tuple_key,
+                       uint64             height,
+                       merge_accumulator *msg)
+{
+   debug_assert(key_is_user_key(tuple_key));
+   debug_assert(merge_accumulator_message_class(msg) != MESSAGE_TYPE_DELETE);
+
+   int result =
+      cfg->compaction_filter(cfg, tuple_key.user_slice, height, msg);
+   if (merge_accumulator_message_class(msg) == MESSAGE_TYPE_DELETE) {
+      merge_accumulator_resize(msg, 0);
+   }
+   return result;
+}
+
 static inline void
 data_key_to_string(const data_config *cfg, key k, char *str, size_t size)
 {
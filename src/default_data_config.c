@@ -29,6 +29,29 @@ key_compare(const data_config *cfg, slice key1, slice key2)
    return slice_lex_cmp(key1, key2);
 }
 
+/*
+ * The first 8 bytes of the key as a big-endian integer, which orders keys
+ * as memcmp() does, except for ties.
+ *
+ * This only preserves the order of the key_compare above. A caller that
+ * overrides key_compare but leaves key_normalize set gets the same image
+ * for every key, so that all searches fall back to its key_compare.
+ */
+static uint64
+key_normalize(const data_config *cfg, slice key)
+{
+   if (cfg->key_compare != key_compare) {
+      return 0;
+   }
+
+   const uint8 *data   = slice_data(key);
+   uint64       length = MIN(slice_length(key), sizeof(uint64));
+   uint64       image  = 0;
+   for (uint64 i = 0; i < sizeof(uint64); i++) {
+      image = (image << 8) | (i < length ? data[i] : 0);
+   }
+   return image;
+}
 
 static void
 key_to_string(const data_config *cfg, slice key, char *str, size_t max_len)
@@ -59,6 +82,7 @@ default_data_config_init(const size_t max_key_size, // IN
       .max_key_size       = max_key_size,
       .key_compare        = key_compare,
       .key_hash           = platform_hash32,
+      .key_normalize      = key_normalize,
       .merge_tuples       = NULL,
       .merge_tuples_final = NULL,
       .key_to_string      = key_to_string,
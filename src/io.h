@@ -25,6 +25,7 @@ typedef struct io_config {
    char   filename[MAX_STRING_LENGTH];
    int    flags;
    uint32 perms;
+   uint64 max_threads; // threads registered at a time, see MAX_THREADS
 
    // computed
    uint64 async_max_pages;
@@ -56,6 +57,7 @@ typedef platform_status (*io_write_async_fn)(io_handle     *io,
                                              io_callback_fn callback,
                                              uint64         count,
                                              uint64         addr);
+typedef platform_status (*io_sync_fn)(io_handle *io);
 typedef void (*io_cleanup_fn)(io_handle *io, uint64 count);
 typedef void (*io_wait_all_fn)(io_handle *io);
 typedef void (*io_register_thread_fn)(io_handle *io);
@@ -75,6 +77,7 @@ typedef struct io_ops {
    io_get_metadata_fn        get_metadata;
    io_read_async_fn          read_async;
    io_write_async_fn         write_async;
+   io_sync_fn                sync;
    io_cleanup_fn             cleanup;
    io_wait_all_fn            wait_all;
    io_register_thread_fn     register_thread;
@@ -146,6 +149,13 @@ io_write_async(io_handle     *io,
    return io->ops->write_async(io, req, callback, count, addr);
 }
 
+// Makes all completed writes durable
+static inline platform_status
+io_sync(io_handle *io)
+{
+   return io->ops->sync(io);
+}
+
 static inline void
 io_cleanup(io_handle *io, uint64 count)
 {
@@ -215,6 +225,7 @@ io_config_init(io_config  *io_cfg,
    io_cfg->perms             = perms;
    io_cfg->async_queue_size  = async_queue_depth;
    io_cfg->kernel_queue_size = async_queue_depth;
+   io_cfg->max_threads       = DEFAULT_MAX_THREADS;
 
    // computed values
    io_cfg->async_max_pages = extent_size / page_size;
@@ -18,20 +18,40 @@ typedef struct log_handle   log_handle;
 typedef struct log_iterator log_iterator;
 typedef struct log_config   log_config;
 
-typedef int (*log_write_fn)(log_handle *log,
-                            key         tuple_key,
-                            message     data,
-                            uint64      generation);
+/*
+ * What a log entry records. The entries written as one batch carry its
+ * nonzero batch number and are followed by a LOG_ENTRY_BATCH_END entry with
+ * the same number. Replay drops the entries of a batch without one, so that
+ * a batch is recovered whole or not at all.
+ */
+typedef enum log_entry_type {
+   LOG_ENTRY_MESSAGE = 0,  // a message inserted into a memtable
+   LOG_ENTRY_RANGE_DELETE, // delete keys from the key to the message's data
+   LOG_ENTRY_BATCH_END,    // every other entry of the batch was written
+} log_entry_type;
+
+#define LOG_NO_BATCH (0)
+
+typedef int (*log_write_fn)(log_handle    *log,
+                            log_entry_type type,
+                            uint64         batch,
+                            key            tuple_key,
+                            message        data,
+                            uint64         generation);
+typedef void (*log_sync_fn)(log_handle *log);
 typedef void (*log_release_fn)(log_handle *log);
 typedef uint64 (*log_addr_fn)(log_handle *log);
 typedef uint64 (*log_magic_fn)(log_handle *log);
+typedef uint64 (*log_size_fn)(log_handle *log);
 
 typedef struct log_ops {
    log_write_fn   write;
+   log_sync_fn    sync;
    log_release_fn release;
    log_addr_fn    addr;
    log_addr_fn    meta_addr;
    log_magic_fn   magic;
+   log_size_fn    size;
 } log_ops;
 
 // to sub-class log, make a log_handle your first field
@@ -42,7 +62,30 @@ struct log_handle {
 static inline int
 log_write(log_handle *log, key tuple_key, message data, uint64 generation)
 {
-   return log->ops->write(log, tuple_key, data, generation);
+   return log->ops->write(
+      log, LOG_ENTRY_MESSAGE, LOG_NO_BATCH, tuple_key, data, generation);
+}
+
+static inline int
+log_write_entry(log_handle    *log,
+                log_entry_type type,
+                uint64         batch,
+                key            tuple_key,
+                message        data,
+                uint64         generation)
+{
+   return log->ops->write(log, type, batch, tuple_key, data, generation);
+}
+
+/*
+ * Returns once the entries this thread has written are durable, if the log
+ * was configured to sync. Otherwise they become durable when the log pages
+ * are written back, and this does nothing.
+ */
+static inline void
+log_sync(log_handle *log)
+{
+   log->ops->sync(log);
 }
 
 static inline void
@@ -69,5 +112,12 @@ log_magic(log_handle *log)
    return log->ops->magic(log);
 }
 
+// Returns the bytes of disk space the log has taken so far
+static inline uint64
+log_size(log_handle *log)
+{
+   return log->ops->size(log);
+}
+
 log_handle *
 log_create(cache *cc, log_config *cfg, platform_heap_id hid);
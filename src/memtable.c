@@ -31,6 +31,30 @@ memtable_is_empty(memtable_context *ctxt)
    return ctxt->is_empty;
 }
 
+/*
+ * Returns roughly how many extents inserts can still fill before they have
+ * to wait for a memtable to be incorporated: the room left in the current
+ * memtable plus that of the ready memtables after it. Reads the memtable
+ * states without locks, so it is only an estimate.
+ */
+uint64
+memtable_insert_headroom(memtable_context *ctxt)
+{
+   uint64    max_extents = ctxt->cfg.max_extents_per_memtable;
+   uint64    generation  = ctxt->generation;
+   memtable *current_mt  = &ctxt->mt[generation % ctxt->cfg.max_memtables];
+   uint64    used        = mini_num_extents(&current_mt->mini);
+   uint64    headroom    = used < max_extents ? max_extents - used : 0;
+   for (uint64 i = 1; i < ctxt->cfg.max_memtables; i++) {
+      memtable *mt = &ctxt->mt[(generation + i) % ctxt->cfg.max_memtables];
+      if (mt->state != MEMTABLE_STATE_READY) {
+         break;
+      }
+      headroom += max_extents;
+   }
+   return headroom;
+}
+
 static inline void
 memtable_mark_empty(memtable_context *ctxt)
 {
@@ -113,6 +137,56 @@ memtable_unblock_lookups(memtable_context *ctxt)
    platform_batch_rwlock_full_unlock(ctxt->rwlock, MEMTABLE_LOOKUP_LOCK_IDX);
 }
 
+void
+memtable_block_inserts(memtable_context *ctxt)
+{
+   memtable_begin_raw_rotation(ctxt);
+}
+
+void
+memtable_unblock_inserts(memtable_context *ctxt)
+{
+   memtable_end_raw_rotation(ctxt);
+}
+
+
+/*
+ * Finalizes current_mt, moves inserts on to the next generation and hands the
+ * finalized memtable to the process callback. The caller must have begun an
+ * insert rotation; this ends it and the caller's insert.
+ */
+static void
+memtable_finalize_and_rotate(memtable_context *ctxt,
+                             uint64            current_generation,
+                             memtable         *current_mt)
+{
+   memtable_transition(
+      current_mt, MEMTABLE_STATE_READY, MEMTABLE_STATE_FINALIZED);
+
+   // Safe to increment non-atomically because we have a lock on
+   // the insert lock
+   ctxt->generation++;
+   platform_assert(ctxt->generation - ctxt->generation_retired
+                      <= ctxt->cfg.max_memtables,
+                   "ctxt->generation: %lu, "
+                   "ctxt->generation_retired: %lu, "
+                   "current_generation: %lu\n",
+                   ctxt->generation,
+                   ctxt->generation_retired,
+                   current_generation);
+   platform_assert(current_generation + 1 == ctxt->generation,
+                   "ctxt->generation: %lu, "
+                   "ctxt->generation_retired: %lu, "
+                   "current_generation: %lu\n",
+                   ctxt->generation,
+                   ctxt->generation_retired,
+                   current_generation);
+
+   memtable_mark_empty(ctxt);
+   memtable_end_insert_rotation(ctxt);
+   memtable_end_insert(ctxt);
+   memtable_process(ctxt, current_generation);
+}
 
 platform_status
 memtable_maybe_rotate_and_begin_insert(memtable_context *ctxt,
@@ -146,32 +220,7 @@ memtable_maybe_rotate_and_begin_insert(memtable_context *ctxt,
 
          if (memtable_try_begin_insert_rotation(ctxt)) {
             // We successfully got the lock, so we do the finalization
-            memtable_transition(
-               current_mt, MEMTABLE_STATE_READY, MEMTABLE_STATE_FINALIZED);
-
-            // Safe to increment non-atomically because we have a lock on
-            // the insert lock
-            ctxt->generation++;
-            platform_assert(ctxt->generation - ctxt->generation_retired
-                               <= ctxt->cfg.max_memtables,
-                            "ctxt->generation: %lu, "
-                            "ctxt->generation_retired: %lu, "
-                            "current_generation: %lu\n",
-                            ctxt->generation,
-                            ctxt->generation_retired,
-                            current_generation);
-            platform_assert(current_generation + 1 == ctxt->generation,
-                            "ctxt->generation: %lu, "
-                            "ctxt->generation_retired: %lu, "
-                            "current_generation: %lu\n",
-                            ctxt->generation,
-                            ctxt->generation_retired,
-                            current_generation);
-
-            memtable_mark_empty(ctxt);
-            memtable_end_insert_rotation(ctxt);
-            memtable_end_insert(ctxt);
-            memtable_process(ctxt, current_generation);
+            memtable_finalize_and_rotate(ctxt, current_generation, current_mt);
          } else {
             memtable_end_insert(ctxt);
             platform_sleep_ns(wait);
@@ -184,6 +233,46 @@ memtable_maybe_rotate_and_begin_insert(memtable_context *ctxt,
    }
 }
 
+/*
+ * Finalizes the current memtable, if it holds any tuples, without waiting for
+ * it to fill. On success, every tuple inserted before the call lives in a
+ * finalized memtable with generation less than *generation. Returns
+ * STATUS_BUSY if the next memtable is not ready yet.
+ */
+platform_status
+memtable_rotate(memtable_context *ctxt, uint64 *generation)
+{
+   uint64 wait = 100;
+   while (TRUE) {
+      memtable_begin_insert(ctxt);
+      uint64    current_generation = ctxt->generation;
+      uint64    current_mt_no = current_generation % ctxt->cfg.max_memtables;
+      memtable *current_mt    = &ctxt->mt[current_mt_no];
+      if (memtable_is_empty(ctxt)) {
+         *generation = current_generation;
+         memtable_end_insert(ctxt);
+         return STATUS_OK;
+      }
+
+      uint64    next_generation = current_generation + 1;
+      uint64    next_mt_no      = next_generation % ctxt->cfg.max_memtables;
+      memtable *next_mt         = &ctxt->mt[next_mt_no];
+      if (next_mt->state != MEMTABLE_STATE_READY) {
+         memtable_end_insert(ctxt);
+         return STATUS_BUSY;
+      }
+
+      if (memtable_try_begin_insert_rotation(ctxt)) {
+         memtable_finalize_and_rotate(ctxt, current_generation, current_mt);
+         *generation = next_generation;
+         return STATUS_OK;
+      }
+      memtable_end_insert(ctxt);
+      platform_sleep_ns(wait);
+      wait = wait > 2048 ? wait : 2 * wait;
+   }
+}
+
 /*
  *-----------------------------------------------------------------------------
  * Increments the distributed tuple counter.  Must hold a read lock on
@@ -218,6 +307,7 @@ memtable_insert(memtable_context *ctxt,
 {
    const threadid tid = platform_get_tid();
    bool32         was_unique;
+   debug_assert(tid < ctxt->cfg.max_threads, "tid=%lu", tid);
 
    platform_status rc = btree_insert(ctxt->cc,
                                      ctxt->cfg.btree_cfg,
@@ -315,7 +405,11 @@ memtable_context_create(platform_heap_id hid,
    platform_mutex_init(
       &ctxt->incorporation_mutex, platform_get_module_id(), hid);
    ctxt->rwlock = TYPED_MALLOC(hid, ctxt->rwlock);
-   platform_batch_rwlock_init(ctxt->rwlock);
+   platform_status rc =
+      platform_batch_rwlock_init(ctxt->rwlock, cfg->max_threads, hid);
+   platform_assert_status_ok(rc);
+   ctxt->scratch = TYPED_ARRAY_ZALLOC(hid, ctxt->scratch, cfg->max_threads);
+   platform_assert(ctxt->scratch != NULL);
 
    for (uint64 mt_no = 0; mt_no < cfg->max_memtables; mt_no++) {
       uint64 generation = mt_no;
@@ -343,7 +437,9 @@ memtable_context_destroy(platform_heap_id hid, memtable_context *ctxt)
    }
 
    platform_mutex_destroy(&ctxt->incorporation_mutex);
+   platform_batch_rwlock_deinit(ctxt->rwlock, hid);
    platform_free(hid, ctxt->rwlock);
+   platform_free(hid, ctxt->scratch);
 
    platform_free(hid, ctxt);
 }
@@ -357,6 +453,7 @@ memtable_config_init(memtable_config *cfg,
    ZERO_CONTENTS(cfg);
    cfg->btree_cfg     = btree_cfg;
    cfg->max_memtables = max_memtables;
+   cfg->max_threads   = DEFAULT_MAX_THREADS;
    cfg->max_extents_per_memtable =
       MEMTABLE_SPACE_OVERHEAD_FACTOR * memtable_capacity
       / cache_config_extent_size(btree_cfg->cache_cfg);
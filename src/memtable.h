@@ -104,6 +104,7 @@ typedef void (*process_fn)(void *arg, uint64 generation);
 typedef struct memtable_config {
    uint64        max_extents_per_memtable;
    uint64        max_memtables;
+   uint64        max_threads; // threads inserting at a time
    btree_config *btree_cfg;
 } memtable_config;
 
@@ -133,8 +134,8 @@ typedef struct memtable_context {
 
    bool32 is_empty;
 
-   // Effectively thread local, no locking at all:
-   btree_scratch scratch[MAX_THREADS];
+   // Effectively thread local, no locking at all, by thread ID:
+   btree_scratch *scratch;
 
    memtable mt[];
 } memtable_context;
@@ -158,6 +159,16 @@ memtable_block_lookups(memtable_context *ctxt);
 void
 memtable_unblock_lookups(memtable_context *ctxt);
 
+/*
+ * Waits for the inserts holding the insert lock and keeps new ones out until
+ * unblocked, without rotating.
+ */
+void
+memtable_block_inserts(memtable_context *ctxt);
+
+void
+memtable_unblock_inserts(memtable_context *ctxt);
+
 platform_status
 memtable_insert(memtable_context *ctxt,
                 memtable         *mt,
@@ -172,6 +183,9 @@ memtable_dec_ref_maybe_recycle(memtable_context *ctxt, memtable *mt);
 uint64
 memtable_force_finalize(memtable_context *ctxt);
 
+platform_status
+memtable_rotate(memtable_context *ctxt, uint64 *generation);
+
 void
 memtable_init(memtable *mt, cache *cc, memtable_config *cfg, uint64 generation);
 
@@ -277,6 +291,9 @@ memtable_ok_to_lookup_compacted(memtable *mt)
 bool32
 memtable_is_empty(memtable_context *mt_ctxt);
 
+uint64
+memtable_insert_headroom(memtable_context *ctxt);
+
 static inline bool32
 memtable_verify(cache *cc, memtable *mt)
 {
@@ -32,6 +32,19 @@ merge_next(iterator *itor);
 platform_status
 merge_prev(iterator *itor);
 
+static platform_status
+merge_iterator_create_internal(platform_heap_id          hid,
+                               data_config              *cfg,
+                               int                       num_trees,
+                               iterator                **itor_arr,
+                               const uint64             *itor_generation,
+                               uint64                    num_range_deletes,
+                               const merge_range_delete *range_deletes,
+                               merge_behavior            merge_mode,
+                               bool32                    filter_tuples,
+                               uint64                    filter_height,
+                               merge_iterator          **out_itor);
+
 static iterator_ops merge_ops = {
    .curr     = merge_curr,
    .can_prev = merge_can_prev,
@@ -129,6 +142,58 @@ set_curr_ordered_iterator(const data_config *cfg, ordered_iterator *itor)
    debug_assert(key_is_user_key(itor->curr_key));
 }
 
+/*
+ * Returns TRUE if a range delete newer than itor's input covers itor's
+ * current key.
+ */
+static inline bool32
+merge_is_range_deleted(const merge_iterator   *merge_itor,
+                       const ordered_iterator *itor)
+{
+   const data_config *cfg = merge_itor->cfg;
+   for (uint64 i = 0; i < merge_itor->num_range_deletes; i++) {
+      const merge_range_delete *range_delete = &merge_itor->range_deletes[i];
+      if (itor->generation >= range_delete->generation) {
+         continue;
+      }
+      if (data_key_compare(cfg, range_delete->start, itor->curr_key) <= 0
+          && data_key_compare(cfg, itor->curr_key, range_delete->end) < 0)
+      {
+         return TRUE;
+      }
+   }
+   return FALSE;
+}
+
+/*
+ * Steps itor, in the direction of the merge, past any tuples hidden by range
+ * deletes. itor may be exhausted afterwards.
+ */
+static platform_status
+merge_skip_range_deleted(merge_iterator *merge_itor, ordered_iterator *itor)
+{
+   if (merge_itor->num_range_deletes == 0) {
+      return STATUS_OK;
+   }
+   while (iterator_can_curr(itor->itor)) {
+      set_curr_ordered_iterator(merge_itor->cfg, itor);
+      if (!merge_is_range_deleted(merge_itor, itor)) {
+         break;
+      }
+      merge_itor->discarded_range_deleted++;
+      platform_status rc;
+      if (merge_itor->forwards) {
+         rc = iterator_next(itor->itor);
+      } else {
+         rc = iterator_prev(itor->itor);
+      }
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+   }
+   return STATUS_OK;
+}
+
 static inline void
 debug_assert_message_type_valid(debug_only merge_iterator *merge_itor)
 {
@@ -180,6 +245,10 @@ advance_and_resort_min_ritor(merge_iterator *merge_itor)
    } else {
       rc = iterator_prev(merge_itor->ordered_iterators[0]->itor);
    }
+   if (SUCCESS(rc)) {
+      rc = merge_skip_range_deleted(merge_itor,
+                                    merge_itor->ordered_iterators[0]);
+   }
 
    if (!SUCCESS(rc)) {
       return rc;
@@ -242,6 +311,36 @@ out:
    return STATUS_OK;
 }
 
+/*
+ * When the newest copy of the current key is definitive, the older copies
+ * have nothing to contribute. Steps the iterators of the older copies past
+ * the key without merging them. The iterator of the newest copy stays put, so
+ * curr_data can keep pointing at its tuple rather than at a copy in the merge
+ * buffer.
+ */
+static platform_status
+merge_skip_older_copies(merge_iterator *merge_itor)
+{
+   ordered_iterator **itors  = merge_itor->ordered_iterators;
+   ordered_iterator  *newest = itors[0];
+   do {
+      // Move the next older copy to the front, for
+      // advance_and_resort_min_ritor to step past the key
+      itors[0]                 = itors[1];
+      itors[1]                 = newest;
+      newest->next_key_equal   = itors[0]->next_key_equal;
+      itors[0]->next_key_equal = TRUE;
+
+      platform_status rc = advance_and_resort_min_ritor(merge_itor);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+      debug_assert(itors[0] == newest);
+   } while (newest->next_key_equal);
+
+   return STATUS_OK;
+}
+
 /*
  * In the case where the two minimum iterators of the merge iterator have equal
  * keys, resolve_equal_keys will merge the data as necessary
@@ -255,6 +354,10 @@ merge_resolve_equal_keys(merge_iterator *merge_itor)
    debug_assert(key_equals(merge_itor->curr_key,
                            merge_itor->ordered_iterators[0]->curr_key));
 
+   if (message_is_definitive(merge_itor->curr_data)) {
+      return merge_skip_older_copies(merge_itor);
+   }
+
    data_config *cfg = merge_itor->cfg;
 
 #if SPLINTER_DEBUG
@@ -317,6 +420,9 @@ merge_resolve_equal_keys(merge_iterator *merge_itor)
  * if merge_itor->finalize_updates:
  *    resolves MESSAGE_TYPE_UPDATE messages into
  *       MESSAGE_TYPE_INSERT or MESSAGE_TYPE_DELETE messages
+ * if merge_itor->filter_tuples:
+ *    passes other messages through the compaction filter, which may turn
+ *    them into MESSAGE_TYPE_DELETE messages
  * if merge_itor->delete_mode == dont_emit_deletes:
  *    discards MESSAGE_TYPE_DELETE messages
  * return True if it discarded a MESSAGE_TYPE_DELETE message
@@ -347,6 +453,30 @@ merge_finalize_updates_and_discard_deletes(merge_iterator *merge_itor,
          merge_accumulator_to_message(&merge_itor->merge_buffer);
       class = message_class(merge_itor->curr_data);
    }
+   if (class != MESSAGE_TYPE_DELETE && merge_itor->filter_tuples) {
+      if (message_data(merge_itor->curr_data)
+          != merge_accumulator_data(&merge_itor->merge_buffer))
+      {
+         bool32 success = merge_accumulator_copy_message(
+            &merge_itor->merge_buffer, merge_itor->curr_data);
+         if (!success) {
+            return STATUS_NO_MEMORY;
+         }
+      }
+      if (data_compaction_filter(cfg,
+                                 merge_itor->curr_key,
+                                 merge_itor->filter_height,
+                                 &merge_itor->merge_buffer))
+      {
+         return STATUS_NO_MEMORY;
+      }
+      merge_itor->curr_data =
+         merge_accumulator_to_message(&merge_itor->merge_buffer);
+      class = message_class(merge_itor->curr_data);
+      if (class == MESSAGE_TYPE_DELETE) {
+         merge_itor->filtered_tuples++;
+      }
+   }
    if (class == MESSAGE_TYPE_DELETE && !merge_itor->emit_deletes) {
       merge_itor->discarded_deletes++;
       *discarded = TRUE;
@@ -425,6 +555,12 @@ setup_ordered_iterators(merge_iterator *merge_itor)
    merge_itor->num_remaining = merge_itor->num_trees;
    int i                     = 0;
    while (i < merge_itor->num_remaining) {
+      rc = merge_skip_range_deleted(merge_itor,
+                                    merge_itor->ordered_iterators[i]);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+
       // determine if the merge itor can go prev/next based upon ordered_itors
       if (iterator_can_prev(merge_itor->ordered_iterators[i]->itor)) {
          merge_itor->can_prev = TRUE;
@@ -524,6 +660,99 @@ merge_iterator_create(platform_heap_id hid,
                       iterator       **itor_arr,
                       merge_behavior   merge_mode,
                       merge_iterator **out_itor)
+{
+   return merge_iterator_create_with_range_deletes(
+      hid, cfg, num_trees, itor_arr, NULL, 0, NULL, merge_mode, out_itor);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * merge_iterator_create_with_range_deletes --
+ *
+ *      Like merge_iterator_create, but tuples from itor_arr[i] covered by one
+ *      of range_deletes newer than itor_generation[i] are skipped. Both
+ *      arrays must outlive the merge iterator.
+ *
+ * Results:
+ *      0 if successful, error otherwise
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+merge_iterator_create_with_range_deletes(
+   platform_heap_id          hid,
+   data_config              *cfg,
+   int                       num_trees,
+   iterator                **itor_arr,
+   const uint64             *itor_generation,
+   uint64                    num_range_deletes,
+   const merge_range_delete *range_deletes,
+   merge_behavior            merge_mode,
+   merge_iterator          **out_itor)
+{
+   return merge_iterator_create_internal(hid,
+                                         cfg,
+                                         num_trees,
+                                         itor_arr,
+                                         itor_generation,
+                                         num_range_deletes,
+                                         range_deletes,
+                                         merge_mode,
+                                         FALSE,
+                                         0,
+                                         out_itor);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * merge_iterator_create_for_compaction --
+ *
+ *      Like merge_iterator_create_with_range_deletes, for a compaction of a
+ *      trunk node at height height. If cfg has a compaction filter, merged
+ *      tuples are passed through it.
+ *
+ * Results:
+ *      0 if successful, error otherwise
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+merge_iterator_create_for_compaction(
+   platform_heap_id          hid,
+   data_config              *cfg,
+   int                       num_trees,
+   iterator                **itor_arr,
+   const uint64             *itor_generation,
+   uint64                    num_range_deletes,
+   const merge_range_delete *range_deletes,
+   merge_behavior            merge_mode,
+   uint64                    height,
+   merge_iterator          **out_itor)
+{
+   debug_assert(merge_mode != MERGE_RAW);
+   return merge_iterator_create_internal(hid,
+                                         cfg,
+                                         num_trees,
+                                         itor_arr,
+                                         itor_generation,
+                                         num_range_deletes,
+                                         range_deletes,
+                                         merge_mode,
+                                         cfg->compaction_filter != NULL,
+                                         height,
+                                         out_itor);
+}
+
+static platform_status
+merge_iterator_create_internal(platform_heap_id          hid,
+                               data_config              *cfg,
+                               int                       num_trees,
+                               iterator                **itor_arr,
+                               const uint64             *itor_generation,
+                               uint64                    num_range_deletes,
+                               const merge_range_delete *range_deletes,
+                               merge_behavior            merge_mode,
+                               bool32                    filter_tuples,
+                               uint64                    filter_height,
+                               merge_iterator          **out_itor)
 {
    int             i;
    platform_status rc = STATUS_OK;
@@ -559,16 +788,27 @@ merge_iterator_create(platform_heap_id hid,
    merge_itor->merge_messages   = merge_mode != MERGE_RAW;
    merge_itor->finalize_updates = merge_mode == MERGE_FULL;
    merge_itor->emit_deletes     = merge_mode != MERGE_FULL;
+   merge_itor->filter_tuples    = filter_tuples;
+   merge_itor->filter_height    = filter_height;
 
    merge_itor->cfg      = cfg;
    merge_itor->curr_key = NULL_KEY;
    merge_itor->forwards = TRUE;
 
+   debug_assert(num_range_deletes == 0 || itor_generation != NULL);
+   merge_itor->num_range_deletes = num_range_deletes;
+   merge_itor->range_deletes     = range_deletes;
+
    // index -1 initializes the pad variable
    for (i = -1; i < num_trees; i++) {
+      uint64 generation = 0;
+      if (i != -1 && num_range_deletes != 0) {
+         generation = itor_generation[i];
+      }
       merge_itor->ordered_iterator_stored[i] = (ordered_iterator){
          .seq            = i,
          .itor           = i == -1 ? NULL : itor_arr[i],
+         .generation     = generation,
          .curr_key       = NULL_KEY,
          .curr_data      = NULL_MESSAGE,
          .next_key_equal = FALSE,
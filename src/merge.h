@@ -19,11 +19,24 @@
 typedef struct ordered_iterator {
    iterator *itor;
    int       seq;
+   uint64    generation; // see merge_range_delete
    key       curr_key;
    message   curr_data;
    bool32    next_key_equal;
 } ordered_iterator;
 
+/*
+ * A range delete hides every tuple with a key in [start, end) that comes from
+ * an input iterator whose generation is less than the range delete's. Inputs
+ * hide such tuples as if they were not there, so they are neither merged nor
+ * emitted, whatever the merge mode.
+ */
+typedef struct merge_range_delete {
+   key    start;
+   key    end;
+   uint64 generation;
+} merge_range_delete;
+
 /*
  * Merge iterators support 3 modes:
  *
@@ -62,6 +75,8 @@ typedef struct merge_iterator {
    bool32       merge_messages;
    bool32       finalize_updates;
    bool32       emit_deletes;
+   bool32       filter_tuples; // pass tuples through cfg->compaction_filter
+   uint64       filter_height; // height passed to the compaction filter
    bool32       can_prev;
    bool32       can_next;
    int          num_remaining; // number of ritors not at end
@@ -78,8 +93,14 @@ typedef struct merge_iterator {
    ordered_iterator *ordered_iterators_pad;
    ordered_iterator *ordered_iterators[MAX_MERGE_ARITY];
 
+   // Range deletes applied to the inputs, owned by the caller
+   uint64                    num_range_deletes;
+   const merge_range_delete *range_deletes;
+
    // Stats
    uint64 discarded_deletes;
+   uint64 discarded_range_deleted;
+   uint64 filtered_tuples; // turned into deletes by the compaction filter
 
    // space for merging data together
    merge_accumulator merge_buffer;
@@ -101,6 +122,31 @@ merge_iterator_create(platform_heap_id hid,
                       merge_behavior   merge_mode,
                       merge_iterator **out_itor);
 
+platform_status
+merge_iterator_create_with_range_deletes(
+   platform_heap_id          hid,
+   data_config              *cfg,
+   int                       num_trees,
+   iterator                **itor_arr,
+   const uint64             *itor_generation,
+   uint64                    num_range_deletes,
+   const merge_range_delete *range_deletes,
+   merge_behavior            merge_mode,
+   merge_iterator          **out_itor);
+
+platform_status
+merge_iterator_create_for_compaction(
+   platform_heap_id          hid,
+   data_config              *cfg,
+   int                       num_trees,
+   iterator                **itor_arr,
+   const uint64             *itor_generation,
+   uint64                    num_range_deletes,
+   const merge_range_delete *range_deletes,
+   merge_behavior            merge_mode,
+   uint64                    height,
+   merge_iterator          **out_itor);
+
 platform_status
 merge_iterator_destroy(platform_heap_id hid, merge_iterator **merge_itor);
 
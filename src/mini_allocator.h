@@ -26,9 +26,10 @@
  * batches, so that pages from each batch are contiguous within extents. This
  * facilitates, for example, packing successive BTree leaves contiguously into
  * extents. This batch-size is somewhat of an artificial limit to manage this
- * contiguity.
+ * contiguity. Packing a BTree from parallel runs uses a batch per height, plus
+ * one for the leaves of each run after the first.
  */
-#define MINI_MAX_BATCHES 8
+#define MINI_MAX_BATCHES 16
 
 /*
  * mini_allocator: Mini-allocator context.
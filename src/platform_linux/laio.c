@@ -58,6 +58,9 @@ laio_write_async(io_handle     *ioh,
                  uint64         count,
                  uint64         addr);
 
+static platform_status
+laio_sync(io_handle *ioh);
+
 static void
 laio_cleanup(io_handle *ioh, uint64 count);
 
@@ -84,6 +87,7 @@ static io_ops laio_ops = {
    .get_metadata      = laio_get_metadata,
    .read_async        = laio_read_async,
    .write_async       = laio_write_async,
+   .sync              = laio_sync,
    .cleanup           = laio_cleanup,
    .wait_all          = laio_wait_all,
    .register_thread   = laio_register_thread,
@@ -117,7 +121,7 @@ get_ctx_idx(laio_handle *io)
 
    lock_ctx(io);
 
-   for (int i = 0; i < MAX_THREADS; i++) {
+   for (int i = 0; i < io->cfg->max_threads; i++) {
       if (io->ctx[i].pid == pid) {
          io->ctx[i].thread_count++;
          unlock_ctx(io);
@@ -125,7 +129,7 @@ get_ctx_idx(laio_handle *io)
       }
    }
 
-   for (int i = 0; i < MAX_THREADS; i++) {
+   for (int i = 0; i < io->cfg->max_threads; i++) {
       if (io->ctx[i].pid == 0) {
          int status = io_setup(io->cfg->kernel_queue_size, &io->ctx[i].ctx);
          if (status != 0) {
@@ -149,6 +153,20 @@ get_ctx_idx(laio_handle *io)
    return INVALID_TID;
 }
 
+static void
+laio_free_thread_state(laio_handle *io)
+{
+   if (io->ctx != NULL) {
+      platform_free(io->heap_id, io->ctx);
+   }
+   if (io->ctx_idx != NULL) {
+      platform_free(io->heap_id, io->ctx_idx);
+   }
+   if (io->req_hand != NULL) {
+      platform_free(io->heap_id, io->req_hand);
+   }
+}
+
 /*
  * Given an IO configuration, validate it. Allocate memory for various
  * sub-structures and allocate the SplinterDB device. Initialize the IO
@@ -174,6 +192,14 @@ io_handle_init(laio_handle *io, io_config *cfg, platform_heap_id hid)
    io->cfg       = cfg;
    io->heap_id   = hid;
 
+   io->ctx      = TYPED_ARRAY_ZALLOC(hid, io->ctx, cfg->max_threads);
+   io->ctx_idx  = TYPED_ARRAY_ZALLOC(hid, io->ctx_idx, cfg->max_threads);
+   io->req_hand = TYPED_ARRAY_ZALLOC(hid, io->req_hand, cfg->max_threads);
+   if (io->ctx == NULL || io->ctx_idx == NULL || io->req_hand == NULL) {
+      laio_free_thread_state(io);
+      return STATUS_NO_MEMORY;
+   }
+
    bool32 is_create = ((cfg->flags & O_CREAT) != 0);
    if (is_create) {
       io->fd = open(cfg->filename, cfg->flags, cfg->perms);
@@ -242,7 +268,7 @@ io_handle_deinit(laio_handle *io)
 {
    int status;
 
-   for (int i = 0; i < MAX_THREADS; i++) {
+   for (int i = 0; i < io->cfg->max_threads; i++) {
       if (io->ctx[i].pid != 0) {
          platform_error_log("ERROR: io_handle_deinit(): IO context for PID=%d"
                             " is still active.\n",
@@ -260,6 +286,7 @@ io_handle_deinit(laio_handle *io)
    platform_assert(status == 0);
 
    platform_free(io->heap_id, io->req);
+   laio_free_thread_state(io);
 }
 
 /*
@@ -296,6 +323,23 @@ laio_write(io_handle *ioh, void *buf, uint64 bytes, uint64 addr)
    return STATUS_IO_ERROR;
 }
 
+/*
+ * laio_sync() - Basically a wrapper around fdatasync().
+ */
+static platform_status
+laio_sync(io_handle *ioh)
+{
+   laio_handle *io;
+   int          ret;
+
+   io  = (laio_handle *)ioh;
+   ret = fdatasync(io->fd);
+   if (ret == 0) {
+      return STATUS_OK;
+   }
+   return STATUS_IO_ERROR;
+}
+
 /*
  * Return a ptr to the k'th Async IO request structure, accounting
  * for a nested array of 'async_max_pages' pages of IO vector structures
@@ -324,9 +368,10 @@ laio_get_async_req(io_handle *ioh, bool32 blocking)
    io_async_req *req;
 
    const threadid tid = platform_get_tid();
-   platform_assert(tid < MAX_THREADS, "Invalid tid=%lu", tid);
+   platform_assert(tid < io->cfg->max_threads, "Invalid tid=%lu", tid);
    uint64 ctx_idx = io->ctx_idx[tid];
-   platform_assert(ctx_idx < MAX_THREADS, "Invalid ctx_idx=%lu", ctx_idx);
+   platform_assert(
+      ctx_idx < io->cfg->max_threads, "Invalid ctx_idx=%lu", ctx_idx);
 
    while (1) {
       if (io->req_hand[tid] % LAIO_HAND_BATCH_SIZE == 0) {
@@ -377,9 +422,10 @@ laio_get_thread_context(io_handle *ioh)
 {
    laio_handle *io  = (laio_handle *)ioh;
    threadid     tid = platform_get_tid();
-   platform_assert(tid < MAX_THREADS, "Invalid tid=%lu", tid);
-   platform_assert(
-      io->ctx_idx[tid] < MAX_THREADS, "Invalid ctx_idx=%lu", io->ctx_idx[tid]);
+   platform_assert(tid < io->cfg->max_threads, "Invalid tid=%lu", tid);
+   platform_assert(io->ctx_idx[tid] < io->cfg->max_threads,
+                   "Invalid ctx_idx=%lu",
+                   io->ctx_idx[tid]);
    return &io->ctx[io->ctx_idx[tid]];
 }
 
@@ -387,8 +433,9 @@ static io_process_context *
 laio_get_req_context(io_handle *ioh, io_async_req *req)
 {
    laio_handle *io = (laio_handle *)ioh;
-   platform_assert(
-      req->ctx_idx < MAX_THREADS, "Invalid ctx_idx=%lu", req->ctx_idx);
+   platform_assert(req->ctx_idx < io->cfg->max_threads,
+                   "Invalid ctx_idx=%lu",
+                   req->ctx_idx);
    return &io->ctx[req->ctx_idx];
 }
 
@@ -504,9 +551,10 @@ laio_cleanup(io_handle *ioh, uint64 count)
    int             status;
 
    threadid tid = platform_get_tid();
-   platform_assert(tid < MAX_THREADS, "Invalid tid=%lu", tid);
-   platform_assert(
-      io->ctx_idx[tid] < MAX_THREADS, "Invalid ctx_idx=%lu", io->ctx_idx[tid]);
+   platform_assert(tid < io->cfg->max_threads, "Invalid tid=%lu", tid);
+   platform_assert(io->ctx_idx[tid] < io->cfg->max_threads,
+                   "Invalid ctx_idx=%lu",
+                   io->ctx_idx[tid]);
    io_process_context *pctx = &io->ctx[io->ctx_idx[tid]];
 
    // Check for completion of up to 'count' events, one event at a time.
@@ -549,7 +597,7 @@ laio_wait_all(io_handle *ioh)
    uint64       i;
 
    io = (laio_handle *)ioh;
-   for (i = 0; i < MAX_THREADS; i++) {
+   for (i = 0; i < io->cfg->max_threads; i++) {
       if (io->ctx[i].pid == getpid()) {
          io_cleanup(ioh, 0);
       } else {
@@ -637,5 +685,12 @@ laio_config_valid(io_config *cfg)
          cfg->extent_size);
       return STATUS_BAD_PARAM;
    }
+   if (cfg->max_threads == 0 || MAX_THREADS < cfg->max_threads) {
+      platform_error_log("Max threads, %lu, is an invalid IO configuration,"
+                         " it must be in [1, %d].\n",
+                         cfg->max_threads,
+                         MAX_THREADS);
+      return STATUS_BAD_PARAM;
+   }
    return STATUS_OK;
 }
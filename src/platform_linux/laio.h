@@ -55,17 +55,17 @@ typedef struct io_process_context {
  * Async IO context structure handle:
  */
 typedef struct laio_handle {
-   io_handle          super;
-   io_config         *cfg;
-   int                ctx_lock;
-   io_process_context ctx[MAX_THREADS];
-   uint64             ctx_idx[MAX_THREADS];
-   io_async_req      *req; // Ptr to allocated array of async req structs
-   uint64             max_batches_nonblocking_get;
-   uint64             req_hand_base;
-   uint64             req_hand[MAX_THREADS];
-   platform_heap_id   heap_id;
-   int                fd; // File descriptor to Splinter device/file.
+   io_handle           super;
+   io_config          *cfg;
+   int                 ctx_lock;
+   io_process_context *ctx;     // one per process, cfg->max_threads of them
+   uint64             *ctx_idx; // by thread ID, cfg->max_threads of them
+   io_async_req       *req; // Ptr to allocated array of async req structs
+   uint64              max_batches_nonblocking_get;
+   uint64              req_hand_base;
+   uint64             *req_hand; // by thread ID, cfg->max_threads of them
+   platform_heap_id    heap_id;
+   int                 fd; // File descriptor to Splinter device/file.
 } laio_handle;
 
 platform_status
@@ -11,6 +11,15 @@ __thread threadid xxxtid = INVALID_TID;
 bool32 platform_use_hugetlb = FALSE;
 bool32 platform_use_mlock   = FALSE;
 
+// Huge page sizes for MAP_HUGETLB, the default one if the headers are too old
+#ifdef MAP_HUGE_SHIFT
+#   define PLATFORM_MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#   define PLATFORM_MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#else
+#   define PLATFORM_MAP_HUGE_2MB 0
+#   define PLATFORM_MAP_HUGE_1GB 0
+#endif
+
 // By default, platform_default_log() messages are sent to /dev/null
 // and platform_error_log() messages go to stderr (see below).
 //
@@ -139,7 +148,9 @@ platform_buffer_init(buffer_handle *bh, size_t length)
          goto error;
       }
    }
-   bh->length = length;
+   bh->length  = length;
+   bh->backing = platform_use_hugetlb ? PLATFORM_BUFFER_HUGE_PAGES
+                                      : PLATFORM_BUFFER_PAGES;
    return STATUS_OK;
 
 error:
@@ -148,6 +159,150 @@ error:
    return rc;
 }
 
+/*
+ * platform_buffer_init_huge_pages() - Like platform_buffer_init(), but backs
+ * the buffer with huge pages if it can: explicit ones (MAP_HUGETLB), 1 GiB
+ * ones if length is a multiple of that and 2 MiB ones otherwise, else
+ * transparent ones (MADV_HUGEPAGE). bh->backing tells which it got.
+ *
+ * Explicit huge pages come from the pool reserved in vm.nr_hugepages, and
+ * are neither swapped nor counted against mlock limits.
+ */
+platform_status
+platform_buffer_init_huge_pages(buffer_handle *bh, size_t length)
+{
+   int prot  = PROT_READ | PROT_WRITE;
+   int flags = MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB;
+
+   if (length % GiB == 0) {
+      bh->addr = mmap(NULL, length, prot, flags | PLATFORM_MAP_HUGE_1GB, -1, 0);
+      if (bh->addr != MAP_FAILED) {
+         bh->length  = length;
+         bh->backing = PLATFORM_BUFFER_HUGE_PAGES;
+         return STATUS_OK;
+      }
+   }
+
+   // munmap() of a MAP_HUGETLB mapping wants whole huge pages
+   size_t huge_length = length + platform_align_bytes_reqd(2 * MiB, length);
+   bh->addr =
+      mmap(NULL, huge_length, prot, flags | PLATFORM_MAP_HUGE_2MB, -1, 0);
+   if (bh->addr != MAP_FAILED) {
+      bh->length  = huge_length;
+      bh->backing = PLATFORM_BUFFER_HUGE_PAGES;
+      return STATUS_OK;
+   }
+
+   platform_status rc = platform_buffer_init(bh, length);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   if (bh->backing != PLATFORM_BUFFER_HUGE_PAGES
+       && platform_advise_huge_pages(bh->addr, length))
+   {
+      bh->backing = platform_huge_pages_backing(bh->addr);
+   }
+   return STATUS_OK;
+}
+
+/*
+ * platform_advise_huge_pages() - Asks for the page-aligned range at addr to
+ * be backed by transparent huge pages. Returns whether the kernel took the
+ * advice, which doesn't mean that it will follow it, see
+ * platform_huge_pages_backing().
+ */
+bool32
+platform_advise_huge_pages(void *addr, size_t length)
+{
+   return madvise(addr, length, MADV_HUGEPAGE) == 0;
+}
+
+/*
+ * Whether the transparent huge page policy in file, e.g.
+ * "always [madvise] never", selects one of the bracketed options.
+ */
+static bool32
+platform_thp_policy_is(const char *file, const char *const *options)
+{
+   char  policy[128];
+   FILE *f = fopen(file, "r");
+   if (f == NULL) {
+      return FALSE;
+   }
+   bool32 read = fgets(policy, sizeof(policy), f) != NULL;
+   fclose(f);
+   for (uint64 i = 0; read && options[i] != NULL; i++) {
+      if (strstr(policy, options[i]) != NULL) {
+         return TRUE;
+      }
+   }
+   return FALSE;
+}
+
+/*
+ * platform_huge_pages_backing() - Returns the backing of the mapping at addr,
+ * which was advised to use transparent huge pages: those only if the kernel
+ * lets it use them, per its policy for anonymous or shared memory and, where
+ * reported, the THPeligible flag of the mapping, and if, once some of it has
+ * been faulted in, huge pages map part of it. Returns PLATFORM_BUFFER_PAGES
+ * when it can't tell.
+ */
+platform_buffer_backing
+platform_huge_pages_backing(void *addr)
+{
+   static const char *const anon_policies[]  = {"[always]", "[madvise]", NULL};
+   static const char *const shmem_policies[] = {
+      "[always]", "[within_size]", "[advise]", "[force]", NULL};
+
+   FILE *smaps = fopen("/proc/self/smaps", "r");
+   if (smaps == NULL) {
+      return PLATFORM_BUFFER_PAGES;
+   }
+
+   // the fields of the mapping holding addr, which follow its header line
+   char          line[1024];
+   bool32        found    = FALSE;
+   bool32        shmem    = FALSE;
+   int           eligible = -1;
+   unsigned long rss_kb   = 0;
+   unsigned long huge_kb  = 0;
+   while (fgets(line, sizeof(line), smaps) != NULL) {
+      unsigned long start, end, inode, kb;
+      if (sscanf(line, "%lx-%lx %*s %*x %*x:%*x %lu", &start, &end, &inode)
+          == 3)
+      {
+         if (found) {
+            break;
+         }
+         found = start <= (uintptr_t)addr && (uintptr_t)addr < end;
+         shmem = inode != 0;
+      } else if (!found) {
+         continue;
+      } else if (sscanf(line, "Rss: %lu kB", &kb) == 1) {
+         rss_kb = kb;
+      } else if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1
+                 || sscanf(line, "ShmemPmdMapped: %lu kB", &kb) == 1)
+      {
+         huge_kb += kb;
+      } else {
+         sscanf(line, "THPeligible: %d", &eligible);
+      }
+   }
+   fclose(smaps);
+
+   bool32 allowed =
+      found
+      && platform_thp_policy_is(
+         shmem ? "/sys/kernel/mm/transparent_hugepage/shmem_enabled"
+               : "/sys/kernel/mm/transparent_hugepage/enabled",
+         shmem ? shmem_policies : anon_policies)
+      && eligible != 0;
+   if (!allowed || (rss_kb != 0 && huge_kb == 0)) {
+      return PLATFORM_BUFFER_PAGES;
+   }
+   return PLATFORM_BUFFER_TRANSPARENT_HUGE_PAGES;
+}
+
 void *
 platform_buffer_getaddr(const buffer_handle *bh)
 {
@@ -293,10 +448,27 @@ platform_spinlock_destroy(platform_spinlock *lock)
  *-----------------------------------------------------------------------------
  */
 
-void
-platform_batch_rwlock_init(platform_batch_rwlock *lock)
+platform_status
+platform_batch_rwlock_init(platform_batch_rwlock *lock,
+                           uint64                 max_threads,
+                           platform_heap_id       heap_id)
 {
    ZERO_CONTENTS(lock);
+   lock->read_counter =
+      TYPED_ARRAY_ZALLOC(heap_id, lock->read_counter, max_threads);
+   if (lock->read_counter == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+   lock->max_threads = max_threads;
+   return STATUS_OK;
+}
+
+void
+platform_batch_rwlock_deinit(platform_batch_rwlock *lock,
+                             platform_heap_id       heap_id)
+{
+   platform_free_volatile(heap_id, lock->read_counter);
+   lock->max_threads = 0;
 }
 
 /*
@@ -320,7 +492,7 @@ platform_batch_rwlock_lock(platform_batch_rwlock *lock, uint64 lock_idx)
                 "platform_batch_rwlock_lock: Attempt to lock a locked page.\n");
 
    uint64 wait = 1;
-   for (uint64 i = 0; i < MAX_THREADS; i++) {
+   for (uint64 i = 0; i < lock->max_threads; i++) {
       while (lock->read_counter[i][lock_idx] != 0) {
          platform_sleep_ns(wait);
          wait = wait > 2048 ? wait : 2 * wait;
@@ -401,6 +573,7 @@ void
 platform_batch_rwlock_get(platform_batch_rwlock *lock, uint64 lock_idx)
 {
    threadid tid = platform_get_tid();
+   debug_assert(tid < lock->max_threads, "tid=%lu", tid);
    while (1) {
       uint64 wait = 1;
       while (lock->write_lock[lock_idx].lock) {
@@ -535,7 +708,7 @@ platform_histo_create(platform_heap_id       heap_id,
 {
    platform_histo_handle hh;
    hh = TYPED_MANUAL_MALLOC(
-      heap_id, hh, sizeof(hh) + num_buckets * sizeof(hh->count[0]));
+      heap_id, hh, sizeof(*hh) + num_buckets * sizeof(hh->count[0]));
    if (!hh) {
       return STATUS_NO_MEMORY;
    }
@@ -64,14 +64,15 @@ typedef int32 bool32;
 #define ARRAY_SIZE(x) ASSERT_EXPR(IS_ARRAY(x), (sizeof(x) / sizeof((x)[0])))
 
 /*
- * MAX_THREADS is used primarily for convenience, where allocations made on a
- * per-thread basis create an array with MAX_THREADS items, e.g. the
- * trunk_stats field in trunk_handle. The task subsystem also uses a 64-bit
- * bit-array to track thread IDs in use. This could be changed relatively
- * easily if needed.
+ * Per-thread state, e.g. the trunk_stats of a trunk_handle, is allocated for
+ * max_threads threads, the limit on the number of threads registered with a
+ * task system at a time. It is configured at runtime and defaults to
+ * DEFAULT_MAX_THREADS. MAX_THREADS bounds max_threads, and so thread IDs, but
+ * sizes nothing.
  */
-#define MAX_THREADS (64)
-#define INVALID_TID (MAX_THREADS)
+#define DEFAULT_MAX_THREADS (64)
+#define MAX_THREADS         (4096)
+#define INVALID_TID         (MAX_THREADS)
 
 #define HASH_SEED (42)
 
@@ -680,6 +681,15 @@ platform_heap_id_to_shmaddr(platform_heap_id hid);
 platform_status
 platform_buffer_init(buffer_handle *bh, size_t length);
 
+platform_status
+platform_buffer_init_huge_pages(buffer_handle *bh, size_t length);
+
+bool32
+platform_advise_huge_pages(void *addr, size_t length);
+
+platform_buffer_backing
+platform_huge_pages_backing(void *addr);
+
 void *
 platform_buffer_getaddr(const buffer_handle *bh);
 
@@ -694,6 +704,15 @@ platform_mutex_init(platform_mutex    *mu,
 platform_status
 platform_mutex_destroy(platform_mutex *mu);
 
+platform_status
+platform_batch_rwlock_init(platform_batch_rwlock *lock,
+                           uint64                 max_threads,
+                           platform_heap_id       heap_id);
+
+void
+platform_batch_rwlock_deinit(platform_batch_rwlock *lock,
+                             platform_heap_id       heap_id);
+
 platform_status
 platform_spinlock_init(platform_spinlock *lock,
                        platform_module_id module_id,
@@ -29,6 +29,7 @@ typedef typeof(EINVAL) internal_platform_status;
 #define STATUS_BAD_PARAM      CONST_STATUS(EINVAL)
 #define STATUS_INVALID_STATE  CONST_STATUS(EINVAL)
 #define STATUS_NOT_FOUND      CONST_STATUS(ENOENT)
+#define STATUS_EXISTS         CONST_STATUS(EEXIST)
 #define STATUS_IO_ERROR       CONST_STATUS(EIO)
 #define STATUS_NOTSUP         CONST_STATUS(ENOTSUP)
 #define STATUS_TEST_FAILED    CONST_STATUS(-1)
@@ -90,12 +91,14 @@ typedef struct {
 
 typedef struct {
    platform_claimlock write_lock[PLATFORM_CACHELINE_SIZE / 2];
-   volatile uint8     read_counter[MAX_THREADS][PLATFORM_CACHELINE_SIZE / 2];
+   // one row of read counters per thread, max_threads rows
+   volatile uint8 (*read_counter)[PLATFORM_CACHELINE_SIZE / 2];
+   uint64 max_threads;
 } PLATFORM_CACHELINE_ALIGNED platform_batch_rwlock;
 
-_Static_assert(sizeof(platform_batch_rwlock)
-                  == PLATFORM_CACHELINE_SIZE * (MAX_THREADS / 2 + 1),
-               "Missized platform_batch_rwlock\n");
+_Static_assert(sizeof(platform_claimlock) * PLATFORM_CACHELINE_SIZE / 2
+                  == PLATFORM_CACHELINE_SIZE,
+               "Missized platform_batch_rwlock write locks\n");
 
 
 /*
@@ -109,9 +112,10 @@ _Static_assert(sizeof(platform_batch_rwlock)
  * is unchanged, i.e. the caller still holds a read lock.
  */
 
-
-void
-platform_batch_rwlock_init(platform_batch_rwlock *lock);
+/*
+ * platform_batch_rwlock_init() and platform_batch_rwlock_deinit() are declared
+ * in platform.h, as they allocate the read counters.
+ */
 
 /* no lock -> shared lock */
 void
@@ -152,10 +156,19 @@ void
 platform_batch_rwlock_full_unlock(platform_batch_rwlock *lock, uint64 lock_idx);
 
 
+// Memory backing a buffer, from least to most preferred
+typedef enum platform_buffer_backing {
+   PLATFORM_BUFFER_PAGES = 0,              // base pages
+   PLATFORM_BUFFER_TRANSPARENT_HUGE_PAGES, // madvise(MADV_HUGEPAGE)
+   PLATFORM_BUFFER_HUGE_PAGES,             // MAP_HUGETLB
+   NUM_PLATFORM_BUFFER_BACKINGS,
+} platform_buffer_backing;
+
 // Buffer handle
 typedef struct {
-   void  *addr;
-   size_t length;
+   void                   *addr;
+   size_t                  length;
+   platform_buffer_backing backing;
 } buffer_handle;
 
 // iohandle for laio
@@ -71,10 +71,10 @@ typedef struct shm_large_frag_info {
 
 /*
  * In the worst case we may have all threads performing activities that need
- * such large memory fragments. We track up to twice the # of configured
+ * such large memory fragments. We track up to twice the default # of
  * threads, which is still a small array to search.
  */
-#define SHM_NUM_LARGE_FRAGS (MAX_THREADS * 2)
+#define SHM_NUM_LARGE_FRAGS (DEFAULT_MAX_THREADS * 2)
 
 /*
  * ------------------------------------------------------------------------
@@ -62,6 +62,16 @@ rc_allocator_alloc_virtual(allocator *a, uint64 *addr, page_type type)
    return rc_allocator_alloc(al, addr, type);
 }
 
+platform_status
+rc_allocator_alloc_at(rc_allocator *al, uint64 addr, page_type type);
+
+platform_status
+rc_allocator_alloc_at_virtual(allocator *a, uint64 addr, page_type type)
+{
+   rc_allocator *al = (rc_allocator *)a;
+   return rc_allocator_alloc_at(al, addr, type);
+}
+
 uint8
 rc_allocator_inc_ref(rc_allocator *al, uint64 addr);
 
@@ -150,6 +160,16 @@ rc_allocator_get_capacity_virtual(allocator *a)
    return rc_allocator_get_capacity(al);
 }
 
+platform_status
+rc_allocator_checkpoint(rc_allocator *al);
+
+platform_status
+rc_allocator_checkpoint_virtual(allocator *a)
+{
+   rc_allocator *al = (rc_allocator *)a;
+   return rc_allocator_checkpoint(al);
+}
+
 void
 rc_allocator_assert_noleaks(rc_allocator *al);
 
@@ -183,6 +203,7 @@ rc_allocator_print_allocated_virtual(allocator *a)
 const static allocator_ops rc_allocator_ops = {
    .get_config        = rc_allocator_get_config_virtual,
    .alloc             = rc_allocator_alloc_virtual,
+   .alloc_at          = rc_allocator_alloc_at_virtual,
    .inc_ref           = rc_allocator_inc_ref_virtual,
    .dec_ref           = rc_allocator_dec_ref_virtual,
    .get_ref           = rc_allocator_get_ref_virtual,
@@ -191,6 +212,7 @@ const static allocator_ops rc_allocator_ops = {
    .remove_super_addr = rc_allocator_remove_super_addr_virtual,
    .in_use            = rc_allocator_in_use_virtual,
    .get_capacity      = rc_allocator_get_capacity_virtual,
+   .checkpoint        = rc_allocator_checkpoint_virtual,
    .assert_noleaks    = rc_allocator_assert_noleaks_virtual,
    .print_stats       = rc_allocator_print_stats_virtual,
    .print_allocated   = rc_allocator_print_allocated_virtual,
@@ -387,6 +409,12 @@ rc_allocator_deinit(rc_allocator *al)
 {
    platform_buffer_deinit(&al->bh);
    al->ref_count = NULL;
+   if (al->checkpoint_ref_count != NULL) {
+      platform_free(al->heap_id, al->checkpoint_ref_count);
+   }
+   if (al->last_checkpoint_ref_count != NULL) {
+      platform_free(al->heap_id, al->last_checkpoint_ref_count);
+   }
    platform_mutex_destroy(&al->lock);
    platform_free(al->heap_id, al->meta_page);
 }
@@ -473,20 +501,80 @@ rc_allocator_mount(rc_allocator      *al,
 }
 
 
+static platform_status
+rc_allocator_write_ref_counts(rc_allocator *al, uint8 *ref_count)
+{
+   uint32 io_size =
+      ROUNDUP(al->cfg->extent_capacity, al->cfg->io_cfg->page_size);
+   return io_write(al->io, ref_count, io_size, al->cfg->io_cfg->extent_size);
+}
+
 void
 rc_allocator_unmount(rc_allocator *al)
 {
    platform_status status;
 
    // persist the ref counts upon unmount.
-   uint32 io_size =
-      ROUNDUP(al->cfg->extent_capacity, al->cfg->io_cfg->page_size);
-   status =
-      io_write(al->io, al->ref_count, io_size, al->cfg->io_cfg->extent_size);
+   status = rc_allocator_write_ref_counts(al, al->ref_count);
    platform_assert_status_ok(status);
    rc_allocator_deinit(al);
 }
 
+/*
+ *----------------------------------------------------------------------
+ * rc_allocator_checkpoint --
+ *
+ *      Persist the ref counts of a checkpoint, where mount will find them.
+ *      Until the next checkpoint, rc_allocator_alloc skips every extent
+ *      referenced by it, so that extents freed in the meantime keep their
+ *      checkpointed contents on disk.
+ *
+ *      The super block naming the new checkpoint is written after this
+ *      returns, so until the next checkpoint the extents of the previous
+ *      one are kept as well, and the ref counts persisted are the maximum
+ *      of both. A mount after a crash in between then finds whichever
+ *      checkpoint its super block names intact, at the cost of leaking the
+ *      extents only the other one referenced.
+ *
+ *      Allocations racing with the copy may or may not be included in it,
+ *      so callers must hold references to everything they checkpoint.
+ *----------------------------------------------------------------------
+ */
+platform_status
+rc_allocator_checkpoint(rc_allocator *al)
+{
+   if (al->checkpoint_ref_count == NULL) {
+      uint64 size = ROUNDUP(al->cfg->extent_capacity * sizeof(uint8),
+                            al->cfg->io_cfg->page_size);
+      al->checkpoint_ref_count =
+         TYPED_ALIGNED_ZALLOC(al->heap_id,
+                              al->cfg->io_cfg->page_size,
+                              al->checkpoint_ref_count,
+                              size);
+      al->last_checkpoint_ref_count =
+         TYPED_ARRAY_ZALLOC(al->heap_id,
+                            al->last_checkpoint_ref_count,
+                            al->cfg->extent_capacity);
+      if (al->checkpoint_ref_count == NULL
+          || al->last_checkpoint_ref_count == NULL)
+      {
+         if (al->checkpoint_ref_count != NULL) {
+            platform_free(al->heap_id, al->checkpoint_ref_count);
+         }
+         if (al->last_checkpoint_ref_count != NULL) {
+            platform_free(al->heap_id, al->last_checkpoint_ref_count);
+         }
+         return STATUS_NO_MEMORY;
+      }
+   }
+   for (uint64 i = 0; i < al->cfg->extent_capacity; i++) {
+      uint8 ref_count = al->ref_count[i];
+      al->checkpoint_ref_count[i] =
+         MAX(al->last_checkpoint_ref_count[i], ref_count);
+      al->last_checkpoint_ref_count[i] = ref_count;
+   }
+   return rc_allocator_write_ref_counts(al, al->checkpoint_ref_count);
+}
 
 /*
  *----------------------------------------------------------------------
@@ -684,6 +772,19 @@ rc_allocator_get_config(rc_allocator *al)
    return al->cfg;
 }
 
+static inline void
+rc_allocator_record_alloc(rc_allocator *al, page_type type)
+{
+   int64 curr_allocated = __sync_add_and_fetch(&al->stats.curr_allocated, 1);
+   int64 max_allocated  = al->stats.max_allocated;
+   while (curr_allocated > max_allocated) {
+      __sync_bool_compare_and_swap(
+         &al->stats.max_allocated, max_allocated, curr_allocated);
+      max_allocated = al->stats.max_allocated;
+   }
+   __sync_add_and_fetch(&al->stats.extent_allocs[type], 1);
+}
+
 /*
  *----------------------------------------------------------------------
  * rc_allocator_alloc--
@@ -702,7 +803,10 @@ rc_allocator_alloc(rc_allocator *al,   // IN
 
    do {
       hand = __sync_fetch_and_add(&al->hand, 1) % al->cfg->extent_capacity;
-      if (al->ref_count[hand] == 0) {
+      if (al->ref_count[hand] == 0
+          && (al->checkpoint_ref_count == NULL
+              || al->checkpoint_ref_count[hand] == 0))
+      {
          extent_is_free =
             __sync_bool_compare_and_swap(&al->ref_count[hand], 0, 2);
       }
@@ -720,14 +824,7 @@ rc_allocator_alloc(rc_allocator *al,   // IN
          al->cfg->extent_capacity);
       return STATUS_NO_SPACE;
    }
-   int64 curr_allocated = __sync_add_and_fetch(&al->stats.curr_allocated, 1);
-   int64 max_allocated  = al->stats.max_allocated;
-   while (curr_allocated > max_allocated) {
-      __sync_bool_compare_and_swap(
-         &al->stats.max_allocated, max_allocated, curr_allocated);
-      max_allocated = al->stats.max_allocated;
-   }
-   __sync_add_and_fetch(&al->stats.extent_allocs[type], 1);
+   rc_allocator_record_alloc(al, type);
    *addr = hand * al->cfg->io_cfg->extent_size;
    if (SHOULD_TRACE(*addr)) {
       platform_default_log(
@@ -737,6 +834,36 @@ rc_allocator_alloc(rc_allocator *al,   // IN
    return STATUS_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ * rc_allocator_alloc_at --
+ *
+ *      Allocate the extent at addr, if it is free. Returns STATUS_BUSY
+ *      otherwise.
+ *----------------------------------------------------------------------
+ */
+platform_status
+rc_allocator_alloc_at(rc_allocator *al,   // IN
+                      uint64        addr, // IN
+                      page_type     type)     // IN
+{
+   debug_assert(rc_allocator_valid_extent_addr(al, addr));
+
+   uint64 extent_no = rc_allocator_extent_number(al, addr);
+   debug_assert(extent_no < al->cfg->extent_capacity);
+
+   if (!__sync_bool_compare_and_swap(&al->ref_count[extent_no], 0, 2)) {
+      return STATUS_BUSY;
+   }
+   rc_allocator_record_alloc(al, type);
+   if (SHOULD_TRACE(addr)) {
+      platform_default_log(
+         "rc_allocator_alloc_at %12lu (%s)\n", addr, page_type_str[type]);
+   }
+
+   return STATUS_OK;
+}
+
 /*
  *----------------------------------------------------------------------
  * rc_allocator_in_use --
@@ -60,6 +60,10 @@ typedef struct rc_allocator {
    allocator_config       *cfg;
    buffer_handle           bh;
    uint8                  *ref_count;
+   // ref counts as of the last two checkpoints, NULL before the first one
+   uint8                  *checkpoint_ref_count;
+   // ref counts as of the last checkpoint
+   uint8                  *last_checkpoint_ref_count;
    uint64                  hand;
    io_handle              *io;
    rc_allocator_meta_page *meta_page;
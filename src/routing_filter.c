@@ -838,6 +838,7 @@ routing_filter_lookup(cache          *cc,
    uint64  seed       = cfg->seed;
    uint64  index_size = cfg->index_size;
 
+   target    = data_key_filter_key(cfg->data_cfg, target);
    uint32 fp = hash(key_data(target), key_length(target), seed);
    fp >>= 32 - cfg->fingerprint_size;
    size_t value_size      = filter->value_size;
@@ -1010,7 +1011,9 @@ routing_filter_lookup_async(cache              *cc,
             hash_fn hash = cfg->hash;
             uint64  seed = cfg->seed;
 
-            uint32 fp = hash(key_data(target), key_length(target), seed);
+            key filter_key = data_key_filter_key(cfg->data_cfg, target);
+            uint32 fp =
+               hash(key_data(filter_key), key_length(filter_key), seed);
             fp >>= 32 - cfg->fingerprint_size;
             size_t value_size = filter->value_size;
             uint32 log_num_buckets =
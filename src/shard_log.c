@@ -22,19 +22,33 @@
 static uint64 shard_log_magic_idx = 0;
 
 int
-shard_log_write(log_handle *log, key tuple_key, message msg, uint64 generation);
+shard_log_write(log_handle    *log,
+                log_entry_type type,
+                uint64         batch,
+                key            tuple_key,
+                message        msg,
+                uint64         generation);
+void
+shard_log_sync(log_handle *log);
+void
+shard_log_release(log_handle *log);
 uint64
 shard_log_addr(log_handle *log);
 uint64
 shard_log_meta_addr(log_handle *log);
 uint64
 shard_log_magic(log_handle *log);
+uint64
+shard_log_size(log_handle *log);
 
 static log_ops shard_log_ops = {
    .write     = shard_log_write,
+   .sync      = shard_log_sync,
+   .release   = shard_log_release,
    .addr      = shard_log_addr,
    .meta_addr = shard_log_meta_addr,
    .magic     = shard_log_magic,
+   .size      = shard_log_size,
 };
 
 void
@@ -77,6 +91,7 @@ shard_log_checksum(shard_log_config *cfg, page_handle *page)
 static inline shard_log_thread_data *
 shard_log_get_thread_data(shard_log *log, threadid thr_id)
 {
+   debug_assert(thr_id < log->cfg->max_threads, "thr_id=%lu", thr_id);
    return &log->thread_data[thr_id];
 }
 
@@ -84,25 +99,55 @@ page_handle *
 shard_log_alloc(shard_log *log, uint64 *next_extent)
 {
    uint64 addr = mini_alloc(&log->mini, 0, NULL_KEY, next_extent);
+   __sync_fetch_and_add(&log->num_pages, 1);
    return cache_alloc(log->cc, addr, PAGE_TYPE_LOG);
 }
 
 platform_status
-shard_log_init(shard_log *log, cache *cc, shard_log_config *cfg)
+shard_log_init(shard_log        *log,
+               cache            *cc,
+               shard_log_config *cfg,
+               platform_heap_id  hid)
 {
    memset(log, 0, sizeof(shard_log));
    log->cc        = cc;
    log->cfg       = cfg;
+   log->heap_id   = hid;
    log->super.ops = &shard_log_ops;
 
-   uint64 magic_idx = __sync_fetch_and_add(&shard_log_magic_idx, 1);
-   log->magic = platform_checksum64(&magic_idx, sizeof(uint64), cfg->seed);
+   log->thread_data =
+      TYPED_ARRAY_ZALLOC(hid, log->thread_data, cfg->max_threads);
+   if (log->thread_data == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+
+   /*
+    * The magic tells this log's pages from stale ones left in its extents,
+    * including those of logs written by earlier runs, so it mixes in the
+    * time as well as a per-process counter.
+    */
+   uint64 magic_seed[2] = {__sync_fetch_and_add(&shard_log_magic_idx, 1),
+                           platform_get_real_time()};
+   log->magic = platform_checksum64(magic_seed, sizeof(magic_seed), cfg->seed);
 
    allocator      *al = cache_get_allocator(cc);
    platform_status rc = allocator_alloc(al, &log->meta_head, PAGE_TYPE_LOG);
    platform_assert_status_ok(rc);
 
-   for (threadid thr_i = 0; thr_i < MAX_THREADS; thr_i++) {
+   if (cfg->sync) {
+      shard_log_group_commit *gc = &log->group_commit;
+      gc->pending      = TYPED_ARRAY_ZALLOC(hid, gc->pending, cfg->max_threads);
+      gc->leader_pages =
+         TYPED_ARRAY_ZALLOC(hid, gc->leader_pages, cfg->max_threads);
+      platform_assert(gc->pending != NULL && gc->leader_pages != NULL);
+      rc = platform_condvar_init(&gc->cv, hid);
+      platform_assert_status_ok(rc);
+      rc = platform_mutex_init(&gc->alloc_lock, platform_get_module_id(), hid);
+      platform_assert_status_ok(rc);
+      gc->batch = 1;
+   }
+
+   for (threadid thr_i = 0; thr_i < cfg->max_threads; thr_i++) {
       shard_log_thread_data *thread_data =
          shard_log_get_thread_data(log, thr_i);
       thread_data->addr   = SHARD_UNMAPPED;
@@ -129,13 +174,23 @@ shard_log_zap(shard_log *log)
 {
    cache *cc = log->cc;
 
-   for (threadid i = 0; i < MAX_THREADS; i++) {
+   for (threadid i = 0; i < log->cfg->max_threads; i++) {
       shard_log_thread_data *thread_data = shard_log_get_thread_data(log, i);
       thread_data->addr                  = SHARD_UNMAPPED;
       thread_data->offset                = 0;
    }
 
+   mini_release(&log->mini, NULL_KEY);
    mini_unkeyed_dec_ref(cc, log->meta_head, PAGE_TYPE_LOG, FALSE);
+
+   if (log->cfg->sync) {
+      debug_assert(log->group_commit.num_pending == 0);
+      platform_condvar_destroy(&log->group_commit.cv);
+      platform_mutex_destroy(&log->group_commit.alloc_lock);
+      platform_free(log->heap_id, log->group_commit.pending);
+      platform_free(log->heap_id, log->group_commit.leader_pages);
+   }
+   platform_free(log->heap_id, log->thread_data);
 }
 
 /*
@@ -146,6 +201,8 @@ shard_log_zap(shard_log *log)
  */
 struct ONDISK log_entry {
    uint64       generation;
+   uint64       batch; // LOG_NO_BATCH unless written as part of a batch
+   uint8        type;  // log_entry_type
    ondisk_tuple tuple;
 };
 
@@ -196,6 +253,28 @@ log_entry_next(log_entry *le)
    return (log_entry *)((char *)le + sizeof_log_entry(le));
 }
 
+/*
+ * Terminates the entries of page, which end at offset, and checksums it, so
+ * that the page is valid as it is when written.
+ */
+static void
+shard_log_seal_page(shard_log_config *cfg, page_handle *page, uint64 offset)
+{
+   if (sizeof(log_entry) <= shard_log_page_size(cfg) - offset) {
+      log_entry *cursor  = (log_entry *)(page->data + offset);
+      cursor->generation = INVALID_GENERATION;
+   }
+   shard_log_hdr *hdr = (shard_log_hdr *)page->data;
+   hdr->checksum      = shard_log_checksum(cfg, page);
+}
+
+/*
+ * Recovery finds the extents of a log by following next_extent_addr from a
+ * valid page of each extent to the next, so an entry synced to an extent is
+ * only found if every earlier extent has a durable page. When the log
+ * syncs, allocations are serialized and the first page of each extent is
+ * made durable, empty, before a page is allocated after it.
+ */
 static int
 get_new_page_for_thread(shard_log             *log,
                         shard_log_thread_data *thread_data,
@@ -203,6 +282,10 @@ get_new_page_for_thread(shard_log             *log,
 {
    uint64 next_extent;
 
+   if (log->cfg->sync) {
+      platform_mutex_lock(&log->group_commit.alloc_lock);
+   }
+
    *page                 = shard_log_alloc(log, &next_extent);
    thread_data->addr     = (*page)->disk_addr;
    shard_log_hdr *hdr    = (shard_log_hdr *)(*page)->data;
@@ -210,11 +293,28 @@ get_new_page_for_thread(shard_log             *log,
    hdr->next_extent_addr = next_extent;
    hdr->num_entries      = 0;
    thread_data->offset   = sizeof(shard_log_hdr);
+
+   if (log->cfg->sync) {
+      allocator_config *al_cfg =
+         allocator_get_config(cache_get_allocator(log->cc));
+      uint64 addr = (*page)->disk_addr;
+      if (allocator_config_extent_base_addr(al_cfg, addr) == addr) {
+         shard_log_seal_page(log->cfg, *page, thread_data->offset);
+         cache_page_write(log->cc, *page, PAGE_TYPE_LOG);
+         cache_sync(log->cc);
+      }
+      platform_mutex_unlock(&log->group_commit.alloc_lock);
+   }
    return 0;
 }
 
 int
-shard_log_write(log_handle *logh, key tuple_key, message msg, uint64 generation)
+shard_log_write(log_handle    *logh,
+                log_entry_type type,
+                uint64         batch,
+                key            tuple_key,
+                message        msg,
+                uint64         generation)
 {
    debug_assert(key_is_user_key(tuple_key));
 
@@ -223,6 +323,13 @@ shard_log_write(log_handle *logh, key tuple_key, message msg, uint64 generation)
    shard_log_thread_data *thread_data =
       shard_log_get_thread_data(log, platform_get_tid());
 
+   // a leader holds its batch back for writers counted here
+   bool32 was_unsynced = thread_data->unsynced;
+   if (log->cfg->sync && !was_unsynced) {
+      __sync_fetch_and_add(&log->group_commit.num_writers, 1);
+      thread_data->unsynced = TRUE;
+   }
+
    page_handle *page;
    if (thread_data->addr == SHARD_UNMAPPED) {
       if (get_new_page_for_thread(log, thread_data, &page)) {
@@ -236,6 +343,8 @@ shard_log_write(log_handle *logh, key tuple_key, message msg, uint64 generation)
          wait = wait > 1024 ? wait : 2 * wait;
       }
       cache_lock(cc, page);
+      // it may have been written back since the last entry
+      cache_mark_dirty(cc, page);
    }
 
    shard_log_hdr *hdr    = (shard_log_hdr *)page->data;
@@ -246,10 +355,11 @@ shard_log_write(log_handle *logh, key tuple_key, message msg, uint64 generation)
                 <= shard_log_page_size(log->cfg) - sizeof(shard_log_hdr));
 
    if (free_space < new_entry_size) {
-      if (sizeof(log_entry) <= free_space) {
-         cursor->generation = INVALID_GENERATION;
+      shard_log_seal_page(log->cfg, page, thread_data->offset);
+      if (log->cfg->sync && was_unsynced) {
+         // holds entries which have not been synced; the next sync covers it
+         cache_page_write(cc, page, PAGE_TYPE_LOG);
       }
-      hdr->checksum = shard_log_checksum(log->cfg, page);
 
       cache_unlock(cc, page);
       cache_unclaim(cc, page);
@@ -264,6 +374,8 @@ shard_log_write(log_handle *logh, key tuple_key, message msg, uint64 generation)
    }
 
    cursor->generation = generation;
+   cursor->batch      = batch;
+   cursor->type       = type;
    copy_tuple_to_ondisk_tuple(&cursor->tuple, tuple_key, msg);
 
    hdr->num_entries++;
@@ -271,6 +383,10 @@ shard_log_write(log_handle *logh, key tuple_key, message msg, uint64 generation)
    thread_data->offset += new_entry_size;
    debug_assert(thread_data->offset <= shard_log_page_size(log->cfg));
 
+   if (log->cfg->sync) {
+      shard_log_seal_page(log->cfg, page, thread_data->offset);
+   }
+
    cache_unlock(cc, page);
    cache_unclaim(cc, page);
    cache_unget(cc, page);
@@ -278,6 +394,102 @@ shard_log_write(log_handle *logh, key tuple_key, message msg, uint64 generation)
    return 0;
 }
 
+/*
+ * Writes the pending batch of a log which syncs, and makes it durable. Before
+ * taking the batch, the leader waits up to sync_max_delay_ns for threads
+ * still writing entries to join it.
+ */
+static void
+shard_log_lead_batch(shard_log *log)
+{
+   shard_log_group_commit *gc    = &log->group_commit;
+   timestamp               start = platform_get_timestamp();
+   while (gc->num_writers != 0
+          && platform_timestamp_elapsed(start) < log->cfg->sync_max_delay_ns)
+   {
+      platform_yield();
+   }
+
+   // only the leader uses leader_pages
+   page_handle **pages = gc->leader_pages;
+   platform_condvar_lock(&gc->cv);
+   uint64 num_pages = gc->num_pending;
+   memmove(pages, gc->pending, num_pages * sizeof(pages[0]));
+   gc->num_pending = 0;
+   uint64 batch    = gc->batch++;
+   platform_condvar_unlock(&gc->cv);
+
+   for (uint64 i = 0; i < num_pages; i++) {
+      cache_page_write(log->cc, pages[i], PAGE_TYPE_LOG);
+   }
+   cache_sync(log->cc);
+
+   platform_condvar_lock(&gc->cv);
+   gc->durable_batch = batch;
+   gc->has_leader    = FALSE;
+   platform_condvar_broadcast(&gc->cv);
+   platform_condvar_unlock(&gc->cv);
+}
+
+/*
+ * Adds page to the pending batch and returns once a batch including it is
+ * durable, leading batches while none is in progress.
+ */
+static void
+shard_log_group_commit_page(shard_log *log, page_handle *page)
+{
+   shard_log_group_commit *gc = &log->group_commit;
+
+   platform_condvar_lock(&gc->cv);
+   debug_assert(gc->num_pending < log->cfg->max_threads);
+   gc->pending[gc->num_pending++] = page;
+   __sync_fetch_and_sub(&gc->num_writers, 1);
+   uint64 batch = gc->batch;
+   while (gc->durable_batch < batch) {
+      if (gc->has_leader) {
+         platform_condvar_wait(&gc->cv);
+         continue;
+      }
+      gc->has_leader = TRUE;
+      platform_condvar_unlock(&gc->cv);
+      shard_log_lead_batch(log);
+      platform_condvar_lock(&gc->cv);
+   }
+   platform_condvar_unlock(&gc->cv);
+}
+
+/*
+ * The page of this thread holds every entry it wrote since its last sync:
+ * entries on pages it filled in the meantime were written when it left them.
+ */
+void
+shard_log_sync(log_handle *logh)
+{
+   shard_log             *log = (shard_log *)logh;
+   shard_log_thread_data *thread_data =
+      shard_log_get_thread_data(log, platform_get_tid());
+
+   if (!log->cfg->sync || !thread_data->unsynced) {
+      return;
+   }
+   thread_data->unsynced = FALSE;
+
+   if (thread_data->addr == SHARD_UNMAPPED) {
+      __sync_fetch_and_sub(&log->group_commit.num_writers, 1);
+      return;
+   }
+   page_handle *page =
+      cache_get(log->cc, thread_data->addr, TRUE, PAGE_TYPE_LOG);
+   shard_log_group_commit_page(log, page);
+   cache_unget(log->cc, page);
+}
+
+void
+shard_log_release(log_handle *logh)
+{
+   shard_log_zap((shard_log *)logh);
+}
+
 uint64
 shard_log_addr(log_handle *logh)
 {
@@ -299,6 +511,13 @@ shard_log_magic(log_handle *logh)
    return log->magic;
 }
 
+uint64
+shard_log_size(log_handle *logh)
+{
+   shard_log *log = (shard_log *)logh;
+   return log->num_pages * shard_log_page_size(log->cfg);
+}
+
 bool32
 shard_log_valid(shard_log_config *cfg, page_handle *page, uint64 magic)
 {
@@ -320,7 +539,10 @@ shard_log_compare(const void *p1, const void *p2, void *unused)
 {
    log_entry **le1 = (log_entry **)p1;
    log_entry **le2 = (log_entry **)p2;
-   return (*le1)->generation - (*le2)->generation;
+   if ((*le1)->generation < (*le2)->generation) {
+      return -1;
+   }
+   return (*le1)->generation > (*le2)->generation;
 }
 
 log_handle *
@@ -328,11 +550,70 @@ log_create(cache *cc, log_config *lcfg, platform_heap_id hid)
 {
    shard_log_config *cfg  = (shard_log_config *)lcfg;
    shard_log        *slog = TYPED_MALLOC(hid, slog);
-   platform_status   rc   = shard_log_init(slog, cc, cfg);
+   platform_status   rc   = shard_log_init(slog, cc, cfg, hid);
    platform_assert(SUCCESS(rc));
    return (log_handle *)slog;
 }
 
+/*
+ * Makes the log extent at extent_addr readable through the cache. After a
+ * crash, the extents a log allocated since the last checkpoint are free in
+ * the recovered allocator, so they are allocated again here and belong to
+ * the log until it is zapped. Returns TRUE if the extent was taken back.
+ */
+static bool32
+shard_log_hold_extent(cache *cc, uint64 extent_addr)
+{
+   allocator *al = cache_get_allocator(cc);
+   if (allocator_get_refcount(al, extent_addr) != AL_FREE) {
+      return FALSE;
+   }
+   platform_status rc = allocator_alloc_at(al, extent_addr, PAGE_TYPE_LOG);
+   platform_assert_status_ok(rc);
+   return TRUE;
+}
+
+static void
+shard_log_free_extent(cache *cc, uint64 extent_addr)
+{
+   allocator *al  = cache_get_allocator(cc);
+   uint8      ref = allocator_dec_ref(al, extent_addr, PAGE_TYPE_LOG);
+   platform_assert(ref == AL_NO_REFS);
+   cache_extent_discard(cc, extent_addr, PAGE_TYPE_LOG);
+   ref = allocator_dec_ref(al, extent_addr, PAGE_TYPE_LOG);
+   platform_assert(ref == AL_FREE);
+}
+
+/*
+ * Counts the valid pages of the log extent at extent_addr and the entries on
+ * them, and returns the address of the extent which follows it, or 0 if no
+ * page is valid. A page a thread had not filled yet when the log was last
+ * written is not valid, but later pages of its extent still may be.
+ */
+static uint64
+shard_log_scan_extent(cache            *cc,
+                      shard_log_config *cfg,
+                      uint64            extent_addr,
+                      uint64            magic,
+                      uint64           *num_valid_pages, // IN/OUT
+                      uint64           *num_entries)               // IN/OUT
+{
+   uint64 next_extent_addr = 0;
+
+   cache_prefetch(cc, extent_addr, PAGE_TYPE_LOG);
+   for (uint64 i = 0; i < shard_log_pages_per_extent(cfg); i++) {
+      uint64       page_addr = extent_addr + i * shard_log_page_size(cfg);
+      page_handle *page      = cache_get(cc, page_addr, TRUE, PAGE_TYPE_LOG);
+      if (shard_log_valid(cfg, page, magic)) {
+         *num_valid_pages += 1;
+         *num_entries += ((shard_log_hdr *)page->data)->num_entries;
+         next_extent_addr = shard_log_next_extent_addr(cfg, page);
+      }
+      cache_unget(cc, page);
+   }
+   return next_extent_addr;
+}
+
 platform_status
 shard_log_iterator_init(cache              *cc,
                         shard_log_config   *cfg,
@@ -352,30 +633,30 @@ shard_log_iterator_init(cache              *cc,
    memset(itor, 0, sizeof(shard_log_iterator));
    itor->super.ops = &shard_log_iterator_ops;
    itor->cfg       = cfg;
-   allocator *al   = cache_get_allocator(cc);
+   itor->addr      = addr;
+   itor->magic     = magic;
 
    // traverse the log extents and calculate the required space
    extent_addr = addr;
-   while (extent_addr != 0 && allocator_get_refcount(al, extent_addr) > 0) {
-      cache_prefetch(cc, extent_addr, PAGE_TYPE_LOG);
-      next_extent_addr = 0;
-      for (i = 0; i < pages_per_extent; i++) {
-         page_addr = extent_addr + i * shard_log_page_size(cfg);
-         page      = cache_get(cc, page_addr, TRUE, PAGE_TYPE_LOG);
-         if (!shard_log_valid(cfg, page, magic)) {
-            cache_unget(cc, page);
-            goto finished_first_pass;
+   while (extent_addr != 0) {
+      bool32 taken_back = shard_log_hold_extent(cc, extent_addr);
+      next_extent_addr  = shard_log_scan_extent(
+         cc, cfg, extent_addr, magic, &num_valid_pages, &itor->num_entries);
+      if (next_extent_addr == 0) {
+         if (taken_back && extent_addr != addr) {
+            // allocated for the log, but never written
+            shard_log_free_extent(cc, extent_addr);
          }
-         num_valid_pages++;
-         itor->num_entries += ((shard_log_hdr *)page->data)->num_entries;
-         next_extent_addr = shard_log_next_extent_addr(cfg, page);
-         cache_unget(cc, page);
+         break;
       }
+      itor->num_extents++;
       extent_addr = next_extent_addr;
    }
 
-finished_first_pass:
-
+   if (itor->num_entries == 0) {
+      // nothing was logged since the last checkpoint
+      return STATUS_OK;
+   }
    itor->contents = TYPED_ARRAY_MALLOC(
       hid, itor->contents, num_valid_pages * shard_log_page_size(cfg));
    itor->entries = TYPED_ARRAY_MALLOC(hid, itor->entries, itor->num_entries);
@@ -384,7 +665,7 @@ finished_first_pass:
    log_entry *cursor    = (log_entry *)itor->contents;
    uint64     entry_idx = 0;
    extent_addr          = addr;
-   while (extent_addr != 0 && allocator_get_refcount(al, extent_addr) > 0) {
+   for (uint64 extent_no = 0; extent_no < itor->num_extents; extent_no++) {
       cache_prefetch(cc, extent_addr, PAGE_TYPE_LOG);
       next_extent_addr = 0;
       for (i = 0; i < pages_per_extent; i++) {
@@ -392,7 +673,7 @@ finished_first_pass:
          page      = cache_get(cc, page_addr, TRUE, PAGE_TYPE_LOG);
          if (!shard_log_valid(cfg, page, magic)) {
             cache_unget(cc, page);
-            goto finished_second_pass;
+            continue;
          }
          for (log_entry *le = first_log_entry(page->data);
               !terminal_log_entry(cfg, page->data, le);
@@ -413,7 +694,6 @@ finished_first_pass:
 
    // sort by generation
    log_entry *tmp;
-finished_second_pass:
    platform_sort_slow(itor->entries,
                       itor->num_entries,
                       sizeof(log_entry *),
@@ -427,8 +707,10 @@ finished_second_pass:
 void
 shard_log_iterator_deinit(platform_heap_id hid, shard_log_iterator *itor)
 {
-   platform_free(hid, itor->contents);
-   platform_free(hid, itor->entries);
+   if (itor->contents != NULL) {
+      platform_free(hid, itor->contents);
+      platform_free(hid, itor->entries);
+   }
 }
 
 void
@@ -439,6 +721,24 @@ shard_log_iterator_curr(iterator *itorh, key *curr_key, message *msg)
    *msg                     = log_entry_message(itor->entries[itor->pos]);
 }
 
+uint64
+shard_log_iterator_curr_generation(shard_log_iterator *itor)
+{
+   return itor->entries[itor->pos]->generation;
+}
+
+log_entry_type
+shard_log_iterator_curr_type(shard_log_iterator *itor)
+{
+   return itor->entries[itor->pos]->type;
+}
+
+uint64
+shard_log_iterator_curr_batch(shard_log_iterator *itor)
+{
+   return itor->entries[itor->pos]->batch;
+}
+
 bool32
 shard_log_iterator_can_prev(iterator *itorh)
 {
@@ -461,6 +761,67 @@ shard_log_iterator_next(iterator *itorh)
    return STATUS_OK;
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * shard_log_hold_recovered_meta --
+ *
+ *      Holds the metadata extent at meta_head of a log read back after a
+ *      crash for shard_log_zap_recovered. A log created after the last
+ *      checkpoint has it free in the recovered allocator.
+ *-----------------------------------------------------------------------------
+ */
+void
+shard_log_hold_recovered_meta(cache *cc, uint64 meta_head)
+{
+   allocator *al = cache_get_allocator(cc);
+   uint64     meta_base_addr =
+      allocator_config_extent_base_addr(allocator_get_config(al), meta_head);
+   if (shard_log_hold_extent(cc, meta_base_addr)) {
+      // and the mini allocator's own reference
+      uint8 ref = allocator_inc_ref(al, meta_base_addr);
+      platform_assert(ref == AL_ONE_REF + 1);
+   }
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * shard_log_zap_recovered --
+ *
+ *      Frees a log read back with shard_log_iterator_init after a crash: the
+ *      extents the iterator read, and the metadata extent at meta_head. Its
+ *      mini allocator cannot be used for this, since the metadata may not
+ *      have been written back before the crash.
+ *-----------------------------------------------------------------------------
+ */
+void
+shard_log_zap_recovered(cache *cc, shard_log_iterator *itor, uint64 meta_head)
+{
+   // the first extent belongs to the log even if nothing was written to it
+   uint64 extent_addr = itor->addr;
+   uint64 extent_no   = 0;
+   do {
+      uint64 num_valid_pages  = 0;
+      uint64 num_entries      = 0;
+      uint64 next_extent_addr = shard_log_scan_extent(cc,
+                                                      itor->cfg,
+                                                      extent_addr,
+                                                      itor->magic,
+                                                      &num_valid_pages,
+                                                      &num_entries);
+      shard_log_free_extent(cc, extent_addr);
+      extent_addr = next_extent_addr;
+      extent_no++;
+   } while (extent_no < itor->num_extents);
+
+   // drop the mini allocator's own reference before freeing the metadata
+   allocator *al = cache_get_allocator(cc);
+   uint64     meta_base_addr =
+      allocator_config_extent_base_addr(allocator_get_config(al), meta_head);
+   uint8 ref = allocator_dec_ref(al, meta_base_addr, PAGE_TYPE_LOG);
+   platform_assert(ref == AL_ONE_REF);
+   shard_log_free_extent(cc, meta_base_addr);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * shard_log_config_init --
@@ -471,12 +832,17 @@ shard_log_iterator_next(iterator *itorh)
 void
 shard_log_config_init(shard_log_config *log_cfg,
                       cache_config     *cache_cfg,
-                      data_config      *data_cfg)
+                      data_config      *data_cfg,
+                      bool32            sync,
+                      uint64            sync_max_delay_ns)
 {
    ZERO_CONTENTS(log_cfg);
-   log_cfg->cache_cfg = cache_cfg;
-   log_cfg->data_cfg  = data_cfg;
-   log_cfg->seed      = HASH_SEED;
+   log_cfg->cache_cfg         = cache_cfg;
+   log_cfg->data_cfg          = data_cfg;
+   log_cfg->seed              = HASH_SEED;
+   log_cfg->sync              = sync;
+   log_cfg->sync_max_delay_ns = sync_max_delay_ns;
+   log_cfg->max_threads       = DEFAULT_MAX_THREADS;
 }
 
 void
@@ -22,26 +22,51 @@ typedef struct shard_log_config {
    cache_config *cache_cfg;
    data_config  *data_cfg;
    uint64        seed;
+   bool32        sync;              // log_sync waits for durability
+   uint64        sync_max_delay_ns; // how long a leader waits for writers
+   uint64        max_threads;       // threads appending at a time
    // data config of point message tree
 } shard_log_config;
 
 typedef struct shard_log_thread_data {
    uint64 addr;
    uint64 offset;
+   bool32 unsynced; // written since the last log_sync
 } PLATFORM_CACHELINE_ALIGNED shard_log_thread_data;
 
+/*
+ * Group commit state of a log configured to sync. A thread waiting for its
+ * page to become durable adds it to the pending batch. One waiting thread at
+ * a time leads: it takes the batch, writes its pages, syncs once and wakes
+ * the threads of the batch.
+ */
+typedef struct shard_log_group_commit {
+   platform_condvar cv;
+   page_handle    **pending;      // pages of the next batch
+   page_handle    **leader_pages; // the batch being written by its leader
+   uint64           num_pending;
+   uint64           batch;         // number of the next batch
+   uint64           durable_batch; // number of the last durable batch
+   bool32           has_leader;
+   uint64           num_writers; // threads writing entries they will sync
+   platform_mutex   alloc_lock;  // see shard_log_alloc
+} shard_log_group_commit;
+
 /*
  * Sharded log context structure.
  */
 typedef struct shard_log {
-   log_handle            super; // handle to log I/O ops abstraction.
-   cache                *cc;
-   shard_log_config     *cfg;
-   shard_log_thread_data thread_data[MAX_THREADS];
-   mini_allocator        mini;
-   uint64                addr;
-   uint64                meta_head;
-   uint64                magic;
+   log_handle             super; // handle to log I/O ops abstraction.
+   cache                 *cc;
+   shard_log_config      *cfg;
+   platform_heap_id       heap_id;
+   shard_log_thread_data *thread_data; // by thread ID, cfg->max_threads
+   mini_allocator         mini;
+   uint64                 addr;
+   uint64                 meta_head;
+   uint64                 magic;
+   uint64                 num_pages; // allocated so far
+   shard_log_group_commit group_commit;
 } shard_log;
 
 typedef struct log_entry log_entry;
@@ -49,6 +74,9 @@ typedef struct log_entry log_entry;
 typedef struct shard_log_iterator {
    iterator          super;
    shard_log_config *cfg;
+   uint64            addr;
+   uint64            magic;
+   uint64            num_extents; // extents with valid pages
    char             *contents;
    log_entry       **entries;
    uint64            num_entries;
@@ -69,7 +97,10 @@ typedef struct ONDISK shard_log_hdr {
 } shard_log_hdr;
 
 platform_status
-shard_log_init(shard_log *log, cache *cc, shard_log_config *cfg);
+shard_log_init(shard_log        *log,
+               cache            *cc,
+               shard_log_config *cfg,
+               platform_heap_id  hid);
 
 void
 shard_log_zap(shard_log *log);
@@ -85,9 +116,26 @@ shard_log_iterator_init(cache              *cc,
 void
 shard_log_iterator_deinit(platform_heap_id hid, shard_log_iterator *itor);
 
+uint64
+shard_log_iterator_curr_generation(shard_log_iterator *itor);
+
+log_entry_type
+shard_log_iterator_curr_type(shard_log_iterator *itor);
+
+uint64
+shard_log_iterator_curr_batch(shard_log_iterator *itor);
+
+void
+shard_log_hold_recovered_meta(cache *cc, uint64 meta_head);
+
+void
+shard_log_zap_recovered(cache *cc, shard_log_iterator *itor, uint64 meta_head);
+
 void
 shard_log_config_init(shard_log_config *log_cfg,
                       cache_config     *cache_cfg,
-                      data_config      *data_cfg);
+                      data_config      *data_cfg,
+                      bool32            sync,
+                      uint64            sync_max_delay_ns);
 void
 shard_log_print(shard_log *log);
@@ -31,13 +31,31 @@ const char *BUILD_VERSION = "splinterdb_build_version " GIT_VERSION;
 static void
 splinterdb_close_print_stats(splinterdb *kvs);
 
+static void
+splinterdb_keyspace_close(splinterdb *keyspace);
+
+static platform_status
+splinterdb_hold_keyspace_logs(splinterdb *kvs);
+
 const char *
 splinterdb_get_version()
 {
    return BUILD_VERSION;
 }
 
+struct _splinterdb_lookup_async_ctxt;
+
+typedef struct splinterdb_async_ready_list {
+   struct _splinterdb_lookup_async_ctxt *head;
+} PLATFORM_CACHELINE_ALIGNED splinterdb_async_ready_list;
+
+/*
+ * A keyspace is a splinterdb with its own trunk, which uses the task system,
+ * io handle, allocator and cache of its parent. Only the parent's own copies
+ * of those are initialized.
+ */
 typedef struct splinterdb {
+   struct splinterdb *parent; // NULL unless this is a keyspace
    task_system       *task_sys;
    io_config          io_cfg;
    platform_io_handle io_handle;
@@ -53,8 +71,44 @@ typedef struct splinterdb {
    platform_heap_id   heap_id;
    data_config       *data_cfg;
    bool               we_created_heap;
+   splinterdb_config  cfg; // with defaults set; its pointers are not used
+
+   // Open keyspaces, by catalog slot
+   platform_mutex     keyspaces_lock;
+   struct splinterdb *keyspaces[SPLINTERDB_MAX_KEYSPACES];
+
+   // The trunks of all keyspaces checkpoint the allocator together
+   trunk_checkpoint_group checkpoint_group;
+
+   // Per-thread lists of async lookups ready to be re-driven
+   splinterdb_async_ready_list *async_ready;
 } splinterdb;
 
+/*
+ * The default keyspace is the trunk with root id SPLINTERDB_DEFAULT_ROOT_ID.
+ * The keyspace in slot i of the catalog is the trunk with root id
+ * SPLINTERDB_FIRST_KEYSPACE_ROOT_ID + i. The catalog is a single page, the
+ * super block of root id SPLINTERDB_CATALOG_ROOT_ID, which is only written
+ * once the first keyspace is created.
+ */
+#define SPLINTERDB_DEFAULT_ROOT_ID        (1)
+#define SPLINTERDB_CATALOG_ROOT_ID        (2)
+#define SPLINTERDB_FIRST_KEYSPACE_ROOT_ID (3)
+
+_Static_assert(SPLINTERDB_FIRST_KEYSPACE_ROOT_ID - 1 + SPLINTERDB_MAX_KEYSPACES
+                  <= RC_ALLOCATOR_MAX_ROOT_IDS,
+               "Every keyspace needs a super block of its own");
+
+/* Some randomly chosen catalog checksum seed. */
+#define SPLINTERDB_CATALOG_CSUM_SEED (43)
+
+typedef struct ONDISK splinterdb_catalog {
+   // Names of the keyspaces, empty for free slots
+   char names[SPLINTERDB_MAX_KEYSPACES]
+             [SPLINTERDB_MAX_KEYSPACE_NAME_LENGTH + 1];
+   checksum128 checksum;
+} splinterdb_catalog;
+
 
 /*
  * Extract errno.h -style status int from a platform_status
@@ -99,6 +153,13 @@ splinterdb_config_set_defaults(splinterdb_config *cfg)
       cfg->filter_remainder_size = 4;
    }
 
+   if (!cfg->log_sync_max_delay_us) {
+      cfg->log_sync_max_delay_us = 100;
+   }
+   if (!cfg->log_checkpoint_size) {
+      cfg->log_checkpoint_size = GiB_TO_B(1);
+   }
+
    if (!cfg->memtable_capacity) {
       cfg->memtable_capacity = MiB_TO_B(24);
    }
@@ -111,6 +172,15 @@ splinterdb_config_set_defaults(splinterdb_config *cfg)
    if (!cfg->reclaim_threshold) {
       cfg->reclaim_threshold = UINT64_MAX;
    }
+   if (!cfg->write_throttle_max_delay_us) {
+      cfg->write_throttle_max_delay_us = 1000;
+   }
+   if (!cfg->max_threads) {
+      cfg->max_threads = DEFAULT_MAX_THREADS;
+   }
+   if (!cfg->cache_probation_percent) {
+      cfg->cache_probation_percent = CC_DEFAULT_PROBATION_PERCENT;
+   }
 }
 
 static platform_status
@@ -125,6 +195,55 @@ splinterdb_validate_app_data_config(const data_config *cfg)
    return STATUS_OK;
 }
 
+/*
+ * Initializes the log and trunk configs of kvs from kvs->cfg, for the keys
+ * and messages of kvs->data_cfg.
+ */
+static platform_status
+splinterdb_init_trunk_config(splinterdb *kvs) // IN/OUT
+{
+   const splinterdb_config *cfg = &kvs->cfg;
+
+   shard_log_config_init(&kvs->log_cfg,
+                         &kvs->cache_cfg.super,
+                         kvs->data_cfg,
+                         cfg->log_sync,
+                         cfg->log_sync_max_delay_us * 1000);
+   kvs->log_cfg.max_threads = cfg->max_threads;
+
+   platform_status rc = trunk_config_init(&kvs->trunk_cfg,
+                                          &kvs->cache_cfg.super,
+                                          kvs->data_cfg,
+                                          (log_config *)&kvs->log_cfg,
+                                          cfg->memtable_capacity,
+                                          cfg->fanout,
+                                          cfg->max_branches_per_node,
+                                          cfg->btree_rough_count_height,
+                                          cfg->filter_remainder_size,
+                                          cfg->filter_index_size,
+                                          cfg->reclaim_threshold,
+                                          cfg->queue_scale_percent,
+                                          cfg->use_log,
+                                          cfg->use_stats,
+                                          FALSE,
+                                          Platform_default_log_handle);
+   if (SUCCESS(rc) && !cfg->disable_write_throttle) {
+      kvs->trunk_cfg.write_throttle_max_delay_ns =
+         cfg->write_throttle_max_delay_us * 1000;
+   }
+   if (SUCCESS(rc)) {
+      kvs->trunk_cfg.mt_cfg.max_threads  = cfg->max_threads;
+      kvs->trunk_cfg.checkpoint_log_size = cfg->log_checkpoint_size;
+      kvs->trunk_cfg.checkpoint_group =
+         kvs->parent == NULL ? &kvs->checkpoint_group
+                             : &kvs->parent->checkpoint_group;
+      kvs->trunk_cfg.max_compaction_subranges =
+         cfg->max_compaction_subranges ? cfg->max_compaction_subranges
+                                       : cfg->num_normal_bg_threads;
+   }
+   return rc;
+}
+
 /*
  *-----------------------------------------------------------------------------
  * splinterdb_init_config --
@@ -162,6 +281,18 @@ splinterdb_init_config(const splinterdb_config *kvs_cfg, // IN
       return STATUS_BAD_PARAM;
    }
 
+   if (kvs_cfg->log_sync && !kvs_cfg->use_log) {
+      platform_error_log("Expect use_log to be set with log_sync.\n");
+      return STATUS_BAD_PARAM;
+   }
+
+   if (kvs_cfg->cache_probation_percent > 100) {
+      platform_error_log("Expect cache_probation_percent to be at most 100,"
+                         " not %lu.\n",
+                         kvs_cfg->cache_probation_percent);
+      return STATUS_BAD_PARAM;
+   }
+
    // mutable local config block, where we can set defaults
    splinterdb_config cfg = {0};
    memcpy(&cfg, kvs_cfg, sizeof(cfg));
@@ -174,6 +305,7 @@ splinterdb_init_config(const splinterdb_config *kvs_cfg, // IN
                   cfg.io_perms,
                   cfg.io_async_queue_depth,
                   cfg.filename);
+   kvs->io_cfg.max_threads = cfg.max_threads;
 
    // Validate IO-configuration parameters
    rc = laio_config_valid(&kvs->io_cfg);
@@ -188,40 +320,43 @@ splinterdb_init_config(const splinterdb_config *kvs_cfg, // IN
                           cfg.cache_size,
                           cfg.cache_logfile,
                           cfg.use_stats);
-
-   shard_log_config_init(&kvs->log_cfg, &kvs->cache_cfg.super, kvs->data_cfg);
+   kvs->cache_cfg.io_limit_bytes_per_sec = cfg.compaction_io_bytes_per_sec;
+   kvs->cache_cfg.io_limit_target_read_latency_ns =
+      cfg.compaction_io_target_read_latency_ns;
+   if (cfg.cache_scan_resistant) {
+      kvs->cache_cfg.policy = CLOCKCACHE_POLICY_SCAN_RESISTANT;
+   }
+   kvs->cache_cfg.probation_percent = cfg.cache_probation_percent;
+   kvs->cache_cfg.reserve_percent[PAGE_TYPE_TRUNK] =
+      cfg.cache_trunk_reserve_percent;
+   kvs->cache_cfg.reserve_percent[PAGE_TYPE_FILTER] =
+      cfg.cache_filter_reserve_percent;
+   kvs->cache_cfg.reserve_percent[PAGE_TYPE_BRANCH] =
+      cfg.cache_branch_reserve_percent;
+   kvs->cache_cfg.pin_reserved = cfg.cache_pin_reserved;
+   if (!clockcache_config_reservations_valid(&kvs->cache_cfg)) {
+      platform_error_log("Expect the cache reservations to add up to at most"
+                         " %d percent.\n",
+                         CC_MAX_RESERVED_PERCENT);
+      return STATUS_BAD_PARAM;
+   }
+   kvs->cache_cfg.use_huge_pages = cfg.cache_huge_pages;
 
    uint64 num_bg_threads[NUM_TASK_TYPES] = {0};
    num_bg_threads[TASK_TYPE_MEMTABLE]    = kvs_cfg->num_memtable_bg_threads;
    num_bg_threads[TASK_TYPE_NORMAL]      = kvs_cfg->num_normal_bg_threads;
 
-   rc = task_system_config_init(
-      &kvs->task_cfg, cfg.use_stats, num_bg_threads, trunk_get_scratch_size());
-   if (!SUCCESS(rc)) {
-      return rc;
-   }
-
-   rc = trunk_config_init(&kvs->trunk_cfg,
-                          &kvs->cache_cfg.super,
-                          kvs->data_cfg,
-                          (log_config *)&kvs->log_cfg,
-                          cfg.memtable_capacity,
-                          cfg.fanout,
-                          cfg.max_branches_per_node,
-                          cfg.btree_rough_count_height,
-                          cfg.filter_remainder_size,
-                          cfg.filter_index_size,
-                          cfg.reclaim_threshold,
-                          cfg.queue_scale_percent,
-                          cfg.use_log,
-                          cfg.use_stats,
-                          FALSE,
-                          Platform_default_log_handle);
+   rc = task_system_config_init(&kvs->task_cfg,
+                                cfg.use_stats,
+                                num_bg_threads,
+                                trunk_get_scratch_size(),
+                                cfg.max_threads);
    if (!SUCCESS(rc)) {
       return rc;
    }
 
-   return STATUS_OK;
+   kvs->cfg = cfg;
+   return splinterdb_init_trunk_config(kvs);
 }
 
 
@@ -291,6 +426,13 @@ splinterdb_create_or_open(const splinterdb_config *kvs_cfg,      // IN
       platform_shm_set_splinterdb_handle(use_this_heap_id, (void *)kvs);
    }
 
+   kvs->async_ready = TYPED_ARRAY_ZALLOC(
+      kvs->heap_id, kvs->async_ready, kvs->cfg.max_threads);
+   if (kvs->async_ready == NULL) {
+      status = STATUS_NO_MEMORY;
+      goto deinit_kvhandle;
+   }
+
    status = io_handle_init(&kvs->io_handle, &kvs->io_cfg, kvs->heap_id);
    if (!SUCCESS(status)) {
       platform_error_log("Failed to initialize IO handle: %s\n",
@@ -340,14 +482,23 @@ splinterdb_create_or_open(const splinterdb_config *kvs_cfg,      // IN
       goto deinit_allocator;
    }
 
-   kvs->trunk_id = 1;
+   trunk_checkpoint_group_init(&kvs->checkpoint_group, kvs->heap_id);
+   if (open_existing) {
+      status = splinterdb_hold_keyspace_logs(kvs);
+      if (!SUCCESS(status)) {
+         goto deinit_checkpoint_group;
+      }
+   }
+
+   kvs->trunk_id = SPLINTERDB_DEFAULT_ROOT_ID;
    if (open_existing) {
-      kvs->spl = trunk_mount(&kvs->trunk_cfg,
-                             (allocator *)&kvs->allocator_handle,
-                             (cache *)&kvs->cache_handle,
-                             kvs->task_sys,
-                             kvs->trunk_id,
-                             kvs->heap_id);
+      status = trunk_mount(&kvs->trunk_cfg,
+                           (allocator *)&kvs->allocator_handle,
+                           (cache *)&kvs->cache_handle,
+                           kvs->task_sys,
+                           kvs->trunk_id,
+                           kvs->heap_id,
+                           &kvs->spl);
    } else {
       kvs->spl = trunk_create(&kvs->trunk_cfg,
                               (allocator *)&kvs->allocator_handle,
@@ -355,20 +506,22 @@ splinterdb_create_or_open(const splinterdb_config *kvs_cfg,      // IN
                               kvs->task_sys,
                               kvs->trunk_id,
                               kvs->heap_id);
+      // Return a generic 'something went wrong' error
+      status = kvs->spl == NULL ? STATUS_INVALID_STATE : STATUS_OK;
    }
-   if (kvs->spl == NULL) {
+   if (!SUCCESS(status)) {
       platform_error_log("Failed to %s SplinterDB instance.\n",
                          (open_existing ? "mount existing" : "initialize"));
-
-      // Return a generic 'something went wrong' error
-      status = STATUS_INVALID_STATE;
-      goto deinit_cache;
+      goto deinit_checkpoint_group;
    }
+   platform_mutex_init(
+      &kvs->keyspaces_lock, platform_get_module_id(), kvs->heap_id);
 
    *kvs_out = kvs;
    return platform_status_to_int(status);
 
-deinit_cache:
+deinit_checkpoint_group:
+   trunk_checkpoint_group_deinit(&kvs->checkpoint_group);
    clockcache_deinit(&kvs->cache_handle);
 deinit_allocator:
    rc_allocator_unmount(&kvs->allocator_handle);
@@ -377,6 +530,7 @@ deinit_system:
 deinit_iohandle:
    io_handle_deinit(&kvs->io_handle);
 io_handle_init_failed:
+   platform_free(kvs->heap_id, kvs->async_ready);
 deinit_kvhandle:
    // Depending on the place where a configuration / setup error lead
    // us to here via a 'goto', heap_id handle, if in use, may be in a
@@ -414,6 +568,292 @@ splinterdb_open(const splinterdb_config *cfg, // IN
    return splinterdb_create_or_open(cfg, kvs, TRUE);
 }
 
+/*
+ * Reads the catalog of kvs, which must hold keyspaces_lock. The catalog is
+ * empty until the first keyspace is created.
+ */
+static platform_status
+splinterdb_catalog_read(splinterdb         *kvs,    // IN
+                        splinterdb_catalog *catalog // OUT
+)
+{
+   cache          *cc = (cache *)&kvs->cache_handle;
+   uint64          addr;
+   platform_status rc = allocator_get_super_addr(
+      (allocator *)&kvs->allocator_handle, SPLINTERDB_CATALOG_ROOT_ID, &addr);
+   if (!SUCCESS(rc)) {
+      ZERO_CONTENTS(catalog);
+      return STATUS_OK;
+   }
+
+   page_handle *page = cache_get(cc, addr, TRUE, PAGE_TYPE_SUPERBLOCK);
+   memmove(catalog, page->data, sizeof(*catalog));
+   cache_unget(cc, page);
+   if (!platform_checksum_is_equal(
+          catalog->checksum,
+          platform_checksum128(catalog,
+                               sizeof(*catalog) - sizeof(checksum128),
+                               SPLINTERDB_CATALOG_CSUM_SEED)))
+   {
+      platform_error_log("Keyspace catalog checksum mismatch\n");
+      return STATUS_INVALID_STATE;
+   }
+   return STATUS_OK;
+}
+
+// Writes the catalog of kvs durably. kvs must hold keyspaces_lock.
+static platform_status
+splinterdb_catalog_write(splinterdb         *kvs,    // IN
+                         splinterdb_catalog *catalog // IN/OUT
+)
+{
+   allocator      *al = (allocator *)&kvs->allocator_handle;
+   cache          *cc = (cache *)&kvs->cache_handle;
+   uint64          addr;
+   platform_status rc =
+      allocator_get_super_addr(al, SPLINTERDB_CATALOG_ROOT_ID, &addr);
+   if (!SUCCESS(rc)) {
+      rc = allocator_alloc_super_addr(al, SPLINTERDB_CATALOG_ROOT_ID, &addr);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+   }
+
+   catalog->checksum =
+      platform_checksum128(catalog,
+                           sizeof(*catalog) - sizeof(checksum128),
+                           SPLINTERDB_CATALOG_CSUM_SEED);
+   page_handle *page = cache_get(cc, addr, TRUE, PAGE_TYPE_SUPERBLOCK);
+   uint64       wait = 1;
+   while (!cache_try_claim(cc, page)) {
+      platform_sleep_ns(wait);
+      wait *= 2;
+   }
+   cache_lock(cc, page);
+   memmove(page->data, catalog, sizeof(*catalog));
+   cache_mark_dirty(cc, page);
+   cache_unlock(cc, page);
+   cache_unclaim(cc, page);
+   cache_unget(cc, page);
+   cache_page_sync(cc, page, TRUE, PAGE_TYPE_SUPERBLOCK);
+   return STATUS_OK;
+}
+
+/*
+ * Holds the logs every keyspace left behind in a crash before the default
+ * keyspace allocates anything, see trunk_hold_recovered_logs. Each keyspace
+ * replays its logs once it is opened. No other thread uses kvs yet.
+ */
+static platform_status
+splinterdb_hold_keyspace_logs(splinterdb *kvs)
+{
+   splinterdb_catalog catalog;
+   platform_status    rc = splinterdb_catalog_read(kvs, &catalog);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   for (uint64 i = 0; i < SPLINTERDB_MAX_KEYSPACES; i++) {
+      if (catalog.names[i][0] != '\0') {
+         trunk_hold_recovered_logs(&kvs->trunk_cfg,
+                                   (allocator *)&kvs->allocator_handle,
+                                   (cache *)&kvs->cache_handle,
+                                   SPLINTERDB_FIRST_KEYSPACE_ROOT_ID + i,
+                                   kvs->heap_id);
+      }
+   }
+   return STATUS_OK;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_keyspace_create_or_open --
+ *
+ *      Creates or opens the keyspace named name of kvs. A keyspace is created
+ *      by creating its trunk, then recording its name in the catalog, so a
+ *      crash in between leaves no keyspace of that name; the root id of the
+ *      trunk created is then reused by the next keyspace created.
+ *
+ * Results:
+ *      errno.h -style status int.
+ *-----------------------------------------------------------------------------
+ */
+static int
+splinterdb_keyspace_create_or_open(splinterdb  *kvs,          // IN
+                                   const char  *name,         // IN
+                                   data_config *data_cfg,     // IN
+                                   splinterdb **keyspace_out, // OUT
+                                   bool32       open_existing // IN
+)
+{
+   uint64 name_length =
+      name == NULL
+         ? 0
+         : platform_strnlen(name, SPLINTERDB_MAX_KEYSPACE_NAME_LENGTH + 1);
+   if (kvs->parent != NULL || name_length == 0
+       || name_length > SPLINTERDB_MAX_KEYSPACE_NAME_LENGTH)
+   {
+      return platform_status_to_int(STATUS_BAD_PARAM);
+   }
+   platform_status rc = splinterdb_validate_app_data_config(data_cfg);
+   if (!SUCCESS(rc)) {
+      return platform_status_to_int(rc);
+   }
+
+   platform_mutex_lock(&kvs->keyspaces_lock);
+   splinterdb_catalog catalog;
+   splinterdb        *keyspace = NULL;
+   rc                          = splinterdb_catalog_read(kvs, &catalog);
+   if (!SUCCESS(rc)) {
+      goto out;
+   }
+
+   uint64 slot      = SPLINTERDB_MAX_KEYSPACES;
+   uint64 free_slot = SPLINTERDB_MAX_KEYSPACES;
+   for (uint64 i = 0; i < SPLINTERDB_MAX_KEYSPACES; i++) {
+      if (strncmp(catalog.names[i], name, sizeof(catalog.names[i])) == 0) {
+         slot = i;
+      }
+      if (catalog.names[i][0] == '\0'
+          && free_slot == SPLINTERDB_MAX_KEYSPACES)
+      {
+         free_slot = i;
+      }
+   }
+   if (open_existing && slot == SPLINTERDB_MAX_KEYSPACES) {
+      rc = STATUS_NOT_FOUND;
+   } else if (open_existing && kvs->keyspaces[slot] != NULL) {
+      rc = STATUS_BUSY;
+   } else if (!open_existing && slot != SPLINTERDB_MAX_KEYSPACES) {
+      rc = STATUS_EXISTS;
+   } else if (!open_existing && free_slot == SPLINTERDB_MAX_KEYSPACES) {
+      rc = STATUS_LIMIT_EXCEEDED;
+   }
+   if (!SUCCESS(rc)) {
+      goto out;
+   }
+   if (!open_existing) {
+      slot = free_slot;
+   }
+
+   keyspace = TYPED_ZALLOC(kvs->heap_id, keyspace);
+   if (keyspace == NULL) {
+      rc = STATUS_NO_MEMORY;
+      goto out;
+   }
+   keyspace->parent    = kvs;
+   keyspace->task_sys  = kvs->task_sys;
+   keyspace->heap_id   = kvs->heap_id;
+   keyspace->data_cfg  = data_cfg;
+   keyspace->cfg       = kvs->cfg;
+   keyspace->cache_cfg = kvs->cache_cfg;
+   keyspace->trunk_id  = SPLINTERDB_FIRST_KEYSPACE_ROOT_ID + slot;
+   rc                  = splinterdb_init_trunk_config(keyspace);
+   if (!SUCCESS(rc)) {
+      goto out;
+   }
+   keyspace->async_ready = TYPED_ARRAY_ZALLOC(
+      kvs->heap_id, keyspace->async_ready, kvs->cfg.max_threads);
+   if (keyspace->async_ready == NULL) {
+      rc = STATUS_NO_MEMORY;
+      goto out;
+   }
+
+   allocator *al = (allocator *)&kvs->allocator_handle;
+   cache     *cc = (cache *)&kvs->cache_handle;
+   if (open_existing) {
+      rc = trunk_mount(&keyspace->trunk_cfg,
+                       al,
+                       cc,
+                       kvs->task_sys,
+                       keyspace->trunk_id,
+                       kvs->heap_id,
+                       &keyspace->spl);
+   } else {
+      uint64 addr;
+      if (SUCCESS(allocator_get_super_addr(al, keyspace->trunk_id, &addr))) {
+         // left behind by a crash while creating a keyspace
+         allocator_remove_super_addr(al, keyspace->trunk_id);
+      }
+      keyspace->spl = trunk_create(&keyspace->trunk_cfg,
+                                   al,
+                                   cc,
+                                   kvs->task_sys,
+                                   keyspace->trunk_id,
+                                   kvs->heap_id);
+      rc = keyspace->spl == NULL ? STATUS_INVALID_STATE : STATUS_OK;
+   }
+   if (!SUCCESS(rc)) {
+      platform_error_log("Failed to %s keyspace '%s'.\n",
+                         (open_existing ? "mount existing" : "initialize"),
+                         name);
+      goto out;
+   }
+
+   if (!open_existing) {
+      // make the trunk durable before the catalog refers to it
+      rc = trunk_checkpoint(keyspace->spl);
+      if (SUCCESS(rc)) {
+         ZERO_ARRAY(catalog.names[slot]);
+         memmove(catalog.names[slot], name, name_length);
+         rc = splinterdb_catalog_write(kvs, &catalog);
+      }
+      if (!SUCCESS(rc)) {
+         trunk_destroy(keyspace->spl);
+         goto out;
+      }
+   }
+
+   kvs->keyspaces[slot] = keyspace;
+   *keyspace_out        = keyspace;
+
+out:
+   if (!SUCCESS(rc) && keyspace != NULL) {
+      if (keyspace->async_ready != NULL) {
+         platform_free(kvs->heap_id, keyspace->async_ready);
+      }
+      platform_free(kvs->heap_id, keyspace);
+   }
+   platform_mutex_unlock(&kvs->keyspaces_lock);
+   return platform_status_to_int(rc);
+}
+
+int
+splinterdb_keyspace_create(splinterdb  *kvs,      // IN
+                           const char  *name,     // IN
+                           data_config *data_cfg, // IN
+                           splinterdb **keyspace  // OUT
+)
+{
+   return splinterdb_keyspace_create_or_open(
+      kvs, name, data_cfg, keyspace, FALSE);
+}
+
+int
+splinterdb_keyspace_open(splinterdb  *kvs,      // IN
+                         const char  *name,     // IN
+                         data_config *data_cfg, // IN
+                         splinterdb **keyspace  // OUT
+)
+{
+   return splinterdb_keyspace_create_or_open(
+      kvs, name, data_cfg, keyspace, TRUE);
+}
+
+static void
+splinterdb_keyspace_close(splinterdb *keyspace)
+{
+   splinterdb *kvs = keyspace->parent;
+
+   platform_mutex_lock(&kvs->keyspaces_lock);
+   trunk_unmount(&keyspace->spl);
+   uint64 slot = keyspace->trunk_id - SPLINTERDB_FIRST_KEYSPACE_ROOT_ID;
+   kvs->keyspaces[slot] = NULL;
+   platform_mutex_unlock(&kvs->keyspaces_lock);
+
+   platform_free(kvs->heap_id, keyspace->async_ready);
+   platform_free(kvs->heap_id, keyspace);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * splinterdb_close --
@@ -434,6 +874,18 @@ splinterdb_close(splinterdb **kvs_in) // IN
    splinterdb *kvs = *kvs_in;
    platform_assert(kvs != NULL);
 
+   if (kvs->parent != NULL) {
+      splinterdb_keyspace_close(kvs);
+      *kvs_in = (splinterdb *)NULL;
+      return;
+   }
+   for (uint64 i = 0; i < SPLINTERDB_MAX_KEYSPACES; i++) {
+      platform_assert(kvs->keyspaces[i] == NULL,
+                      "Keyspace %lu is still open\n",
+                      i);
+   }
+   platform_mutex_destroy(&kvs->keyspaces_lock);
+
    // Print stats if shared memory is enabled.
    if (kvs->heap_id) {
       splinterdb_close_print_stats(kvs);
@@ -444,10 +896,12 @@ splinterdb_close(splinterdb **kvs_in) // IN
     * created or re-opened. Otherwise, asserts will trip.
     */
    trunk_unmount(&kvs->spl);
+   trunk_checkpoint_group_deinit(&kvs->checkpoint_group);
    clockcache_deinit(&kvs->cache_handle);
    rc_allocator_unmount(&kvs->allocator_handle);
    task_system_destroy(kvs->heap_id, &kvs->task_sys);
    io_handle_deinit(&kvs->io_handle);
+   platform_free(kvs->heap_id, kvs->async_ready);
 
    // Free resources carefully to avoid ASAN-test failures
    platform_heap_id heap_id         = kvs->heap_id;
@@ -470,7 +924,7 @@ splinterdb_close(splinterdb **kvs_in) // IN
  *      exactly once before using the splinterdb.
  *
  *      Notes:
- *      - The task system imposes a limit of MAX_THREADS live at any time
+ *      - The task system imposes a limit of cfg.max_threads live at any time
  *
  * Results:
  *      None.
@@ -557,6 +1011,160 @@ splinterdb_update(const splinterdb *kvsb, slice user_key, slice update)
    return splinterdb_insert_message(kvsb, user_key, msg);
 }
 
+int
+splinterdb_delete_range(const splinterdb *kvsb, slice start_key, slice end_key)
+{
+   platform_assert(kvsb != NULL);
+   platform_status status = trunk_delete_range(kvsb->spl,
+                                               key_create_from_slice(start_key),
+                                               key_create_from_slice(end_key));
+   return platform_status_to_int(status);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_write_batch --
+ *
+ *      Apply a batch of inserts, updates and deletes as a unit.
+ *
+ * Results:
+ *      0 on success, otherwise an errno. EINVAL if any op is invalid, in
+ *      which case none of the batch has been applied.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_write_batch(const splinterdb          *kvs,    // IN
+                       const splinterdb_write_op  ops[],  // IN
+                       uint64                     num_ops // IN
+)
+{
+   platform_assert(kvs != NULL);
+   if (num_ops == 0) {
+      return 0;
+   }
+
+   key     *keys;
+   message *msgs;
+   keys = TYPED_ARRAY_MALLOC(kvs->heap_id, keys, num_ops);
+   msgs = TYPED_ARRAY_MALLOC(kvs->heap_id, msgs, num_ops);
+   platform_status status = STATUS_OK;
+   if (keys == NULL || msgs == NULL) {
+      status = STATUS_NO_MEMORY;
+      goto out;
+   }
+
+   for (uint64 i = 0; i < num_ops; i++) {
+      keys[i] = key_create_from_slice(ops[i].key);
+      switch (ops[i].type) {
+         case SPLINTERDB_WRITE_INSERT:
+            msgs[i] = message_create(MESSAGE_TYPE_INSERT, ops[i].value);
+            break;
+         case SPLINTERDB_WRITE_UPDATE:
+            platform_assert(kvs->data_cfg->merge_tuples);
+            msgs[i] = message_create(MESSAGE_TYPE_UPDATE, ops[i].value);
+            break;
+         case SPLINTERDB_WRITE_DELETE:
+            msgs[i] = DELETE_MESSAGE;
+            break;
+         default:
+            status = STATUS_BAD_PARAM;
+            goto out;
+      }
+   }
+
+   status = trunk_insert_batch(kvs->spl, keys, msgs, num_ops);
+
+out:
+   if (keys != NULL) {
+      platform_free(kvs->heap_id, keys);
+   }
+   if (msgs != NULL) {
+      platform_free(kvs->heap_id, msgs);
+   }
+   return platform_status_to_int(status);
+}
+
+/*
+ * Iterator over the tuples of a bulk load source, as inserts.
+ */
+typedef struct splinterdb_bulk_load_iterator {
+   iterator                    super;
+   splinterdb_bulk_load_source source;
+   void                       *arg;
+   bool32                      valid;
+   slice                       key;
+   slice                       value;
+} splinterdb_bulk_load_iterator;
+
+static void
+splinterdb_bulk_load_iterator_curr(iterator *itor, key *curr_key, message *msg)
+{
+   splinterdb_bulk_load_iterator *bl_itor =
+      (splinterdb_bulk_load_iterator *)itor;
+   debug_assert(bl_itor->valid);
+   *curr_key = key_create_from_slice(bl_itor->key);
+   *msg      = message_create(MESSAGE_TYPE_INSERT, bl_itor->value);
+}
+
+static bool32
+splinterdb_bulk_load_iterator_valid(iterator *itor)
+{
+   splinterdb_bulk_load_iterator *bl_itor =
+      (splinterdb_bulk_load_iterator *)itor;
+   return bl_itor->valid;
+}
+
+static platform_status
+splinterdb_bulk_load_iterator_next(iterator *itor)
+{
+   splinterdb_bulk_load_iterator *bl_itor =
+      (splinterdb_bulk_load_iterator *)itor;
+   bl_itor->valid =
+      bl_itor->source(bl_itor->arg, &bl_itor->key, &bl_itor->value);
+   return STATUS_OK;
+}
+
+static const iterator_ops splinterdb_bulk_load_iterator_ops = {
+   .curr     = splinterdb_bulk_load_iterator_curr,
+   .can_prev = splinterdb_bulk_load_iterator_valid,
+   .can_next = splinterdb_bulk_load_iterator_valid,
+   .next     = splinterdb_bulk_load_iterator_next,
+};
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_bulk_load --
+ *
+ *      Load the tuples of source into an empty database.
+ *
+ * Results:
+ *      0 on success, otherwise an errno. EINVAL if the database is not empty
+ *      or a tuple is invalid, in which case nothing has been loaded.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_bulk_load(const splinterdb           *kvs,    // IN
+                     splinterdb_bulk_load_source source, // IN
+                     void                       *arg     // IN
+)
+{
+   platform_assert(kvs != NULL);
+   splinterdb_bulk_load_iterator itor = {
+      .super  = {.ops = &splinterdb_bulk_load_iterator_ops},
+      .source = source,
+      .arg    = arg,
+   };
+   itor.valid = source(arg, &itor.key, &itor.value);
+   platform_status status = trunk_bulk_load(kvs->spl, &itor.super);
+   return platform_status_to_int(status);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * _splinterdb_lookup_result structure --
@@ -564,6 +1172,8 @@ splinterdb_update(const splinterdb *kvsb, slice user_key, slice update)
  */
 typedef struct {
    merge_accumulator value;
+   bool32            zero_copy;
+   trunk_lookup_ref  ref; // held when the value is read in place
 } _splinterdb_lookup_result;
 
 _Static_assert(sizeof(_splinterdb_lookup_result)
@@ -588,12 +1198,45 @@ splinterdb_lookup_result_init(const splinterdb         *kvs,        // IN
                                       buffer,
                                       WRITABLE_BUFFER_NULL_LENGTH,
                                       MESSAGE_TYPE_INVALID);
+   _result->zero_copy = FALSE;
+   ZERO_CONTENTS(&_result->ref);
+}
+
+void
+splinterdb_lookup_result_init_zero_copy(const splinterdb         *kvs,   // IN
+                                        splinterdb_lookup_result *result // OUT
+)
+{
+   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
+   splinterdb_lookup_result_init(kvs, result, 0, NULL);
+   _result->zero_copy = TRUE;
+}
+
+/*
+ * Drops the page reference of a zero-copy result, if it holds one, so that
+ * the result can be reused.
+ */
+static void
+splinterdb_lookup_result_release(_splinterdb_lookup_result *_result)
+{
+   trunk_lookup_ref_release(&_result->ref);
+}
+
+/*
+ * The page reference to take for a lookup into _result, if any.
+ */
+static trunk_lookup_ref *
+splinterdb_lookup_result_ref(_splinterdb_lookup_result *_result)
+{
+   splinterdb_lookup_result_release(_result);
+   return _result->zero_copy ? &_result->ref : NULL;
 }
 
 void
 splinterdb_lookup_result_deinit(splinterdb_lookup_result *result) // IN
 {
    _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
+   splinterdb_lookup_result_release(_result);
    merge_accumulator_deinit(&_result->value);
 }
 
@@ -601,7 +1244,8 @@ _Bool
 splinterdb_lookup_found(const splinterdb_lookup_result *result) // IN
 {
    _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
-   return trunk_lookup_found(&_result->value);
+   return trunk_lookup_ref_held(&_result->ref)
+          || trunk_lookup_found(&_result->value);
 }
 
 int
@@ -614,7 +1258,11 @@ splinterdb_lookup_result_value(const splinterdb_lookup_result *result, // IN
       return EINVAL;
    }
 
-   *value = merge_accumulator_to_value(&_result->value);
+   if (trunk_lookup_ref_held(&_result->ref)) {
+      *value = message_slice(_result->ref.msg);
+   } else {
+      *value = merge_accumulator_to_value(&_result->value);
+   }
    return 0;
 }
 
@@ -648,15 +1296,299 @@ splinterdb_lookup(const splinterdb         *kvs, // IN
    key                        target  = key_create_from_slice(user_key);
 
    platform_assert(kvs != NULL);
-   status = trunk_lookup(kvs->spl, target, &_result->value);
+   status = trunk_lookup_with_ref(kvs->spl,
+                                  target,
+                                  &_result->value,
+                                  splinterdb_lookup_result_ref(_result));
    return platform_status_to_int(status);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * _splinterdb_lookup_async_ctxt structure --
+ *
+ *      Caller-owned state of one async lookup.
+ *
+ *      The IO completion callback of trunk_lookup_async() may run on whichever
+ *      thread reaps the completion, so it only pushes the context onto the
+ *      ready list of the thread which started the lookup. That thread then
+ *      re-drives the lookup from splinterdb_poll().
+ *-----------------------------------------------------------------------------
+ */
+typedef struct _splinterdb_lookup_async_ctxt {
+   trunk_async_ctxt                      ctxt;
+   const splinterdb                     *kvs;
+   slice                                 user_key;
+   splinterdb_lookup_result             *result;
+   splinterdb_lookup_async_cb            cb;
+   void                                 *cb_arg;
+   threadid                              tid;
+   struct _splinterdb_lookup_async_ctxt *next; // link in the ready list
+} _splinterdb_lookup_async_ctxt;
+
+_Static_assert(sizeof(_splinterdb_lookup_async_ctxt)
+                  <= sizeof(splinterdb_lookup_async_ctxt),
+               "sizeof(splinterdb_lookup_async_ctxt) is too small");
+
+_Static_assert(alignof(splinterdb_lookup_async_ctxt)
+                  == alignof(_splinterdb_lookup_async_ctxt),
+               "mismatched alignment for splinterdb_lookup_async_ctxt");
 
-struct splinterdb_iterator {
+/*
+ * Push a context onto the ready list of its owning thread. May be called from
+ * any thread.
+ */
+static void
+splinterdb_lookup_async_enqueue(_splinterdb_lookup_async_ctxt *_ctxt)
+{
+   splinterdb_async_ready_list    *ready = &_ctxt->kvs->async_ready[_ctxt->tid];
+   _splinterdb_lookup_async_ctxt *head;
+   do {
+      head        = ready->head;
+      _ctxt->next = head;
+   } while (!__sync_bool_compare_and_swap(&ready->head, head, _ctxt));
+}
+
+static void
+splinterdb_lookup_async_callback(trunk_async_ctxt *ctxt)
+{
+   _splinterdb_lookup_async_ctxt *_ctxt =
+      container_of(ctxt, _splinterdb_lookup_async_ctxt, ctxt);
+   splinterdb_lookup_async_enqueue(_ctxt);
+}
+
+/*
+ * Drive the lookup state machine as far as it can go without waiting.
+ *
+ * Returns TRUE if the lookup completed, in which case the caller's callback
+ * has been invoked and the context must no longer be touched.
+ */
+static bool32
+splinterdb_lookup_async_drive(_splinterdb_lookup_async_ctxt *_ctxt)
+{
+   _splinterdb_lookup_result *_result =
+      (_splinterdb_lookup_result *)_ctxt->result;
+   key                target = key_create_from_slice(_ctxt->user_key);
+   cache_async_result res    = trunk_lookup_async(
+      _ctxt->kvs->spl, target, &_result->value, &_ctxt->ctxt);
+   switch (res) {
+      case async_success:
+         _ctxt->cb((splinterdb_lookup_async_ctxt *)_ctxt,
+                   _ctxt->result,
+                   _ctxt->cb_arg);
+         return TRUE;
+      case async_locked:
+      case async_no_reqs:
+         // Retry on the next poll
+         splinterdb_lookup_async_enqueue(_ctxt);
+         return FALSE;
+      case async_io_started:
+         // The IO completion callback will put us on the ready list
+         return FALSE;
+      default:
+         platform_assert(0);
+   }
+   return FALSE;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_lookup_async_start --
+ *
+ *      Start an async lookup of a single tuple
+ *
+ *      If the lookup can be answered without IO, the callback is invoked
+ *      before this function returns. Otherwise, it is invoked from a later
+ *      call to splinterdb_poll() on this thread.
+ *
+ * Results:
+ *      0 on success, otherwise an error number.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_lookup_async_start(const splinterdb             *kvs,      // IN
+                              splinterdb_lookup_async_ctxt *ctxt,     // IN/OUT
+                              slice                         user_key, // IN
+                              splinterdb_lookup_result     *result,   // IN/OUT
+                              splinterdb_lookup_async_cb    cb,       // IN
+                              void                         *cb_arg    // IN
+)
+{
+   platform_assert(kvs != NULL);
+   platform_assert(cb != NULL);
+
+   if (slice_length(user_key) > trunk_max_key_size(kvs->spl)) {
+      return platform_status_to_int(STATUS_BAD_PARAM);
+   }
+
+   // async lookups always copy the value
+   splinterdb_lookup_result_release((_splinterdb_lookup_result *)result);
+
+   _splinterdb_lookup_async_ctxt *_ctxt = (_splinterdb_lookup_async_ctxt *)ctxt;
+   trunk_async_ctxt_init(&_ctxt->ctxt, splinterdb_lookup_async_callback);
+   _ctxt->kvs      = kvs;
+   _ctxt->user_key = user_key;
+   _ctxt->result   = result;
+   _ctxt->cb       = cb;
+   _ctxt->cb_arg   = cb_arg;
+   _ctxt->tid      = platform_get_tid();
+   _ctxt->next     = NULL;
+
+   splinterdb_lookup_async_drive(_ctxt);
+   return 0;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_poll --
+ *
+ *      Make progress on the async lookups started by this thread
+ *
+ *      Reaps completed IOs, then re-drives every lookup of this thread that
+ *      is ready to continue, invoking the callbacks of those that complete.
+ *
+ * Results:
+ *      The number of lookups completed.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+uint64
+splinterdb_poll(const splinterdb *kvs)
+{
+   platform_assert(kvs != NULL);
+
+   cache_cleanup(kvs->spl->cc);
+
+   splinterdb_async_ready_list   *ready = &kvs->async_ready[platform_get_tid()];
+   _splinterdb_lookup_async_ctxt *list =
+      __sync_lock_test_and_set(&ready->head, NULL);
+
+   // The list is LIFO; reverse it to re-drive lookups in arrival order
+   _splinterdb_lookup_async_ctxt *fifo = NULL;
+   while (list != NULL) {
+      _splinterdb_lookup_async_ctxt *next = list->next;
+      list->next                          = fifo;
+      fifo                                = list;
+      list                                = next;
+   }
+
+   uint64 num_completed = 0;
+   while (fifo != NULL) {
+      _splinterdb_lookup_async_ctxt *next = fifo->next;
+      if (splinterdb_lookup_async_drive(fifo)) {
+         num_completed++;
+      }
+      fifo = next;
+   }
+   return num_completed;
+}
+
+/*
+ * Max number of lookups that splinterdb_lookup_batch() keeps in flight at
+ * once. Larger batches are processed through a window of this size.
+ */
+#define SPLINTERDB_LOOKUP_BATCH_MAX_INFLIGHT 64
+
+typedef struct splinterdb_lookup_batch_state {
+   splinterdb_lookup_async_ctxt ctxt[SPLINTERDB_LOOKUP_BATCH_MAX_INFLIGHT];
+   uint64                       free_ctxt[SPLINTERDB_LOOKUP_BATCH_MAX_INFLIGHT];
+   uint64                       num_free;
+} splinterdb_lookup_batch_state;
+
+static void
+splinterdb_lookup_batch_callback(splinterdb_lookup_async_ctxt *ctxt,
+                                 splinterdb_lookup_result     *result,
+                                 void                         *arg)
+{
+   splinterdb_lookup_batch_state *state = (splinterdb_lookup_batch_state *)arg;
+   state->free_ctxt[state->num_free++]  = ctxt - state->ctxt;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_lookup_batch --
+ *
+ *      Lookup a batch of tuples, overlapping their IO
+ *
+ *      The batch is driven through the async lookup API. Lookups which miss
+ *      in the cache are parked while their IO is outstanding, and the next
+ *      key of the batch is started in the meantime.
+ *
+ *      results[i] must have been initialized via
+ *      splinterdb_lookup_result_init()
+ *
+ * Results:
+ *      0 on success (including keys not found), otherwise an error number.
+ *
+ * Side effects:
+ *      Completes any other async lookups outstanding on this thread.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_lookup_batch(const splinterdb         *kvs,       // IN
+                        const slice               keys[],    // IN
+                        splinterdb_lookup_result  results[], // IN/OUT
+                        uint64                    num_keys   // IN
+)
+{
+   platform_assert(kvs != NULL);
+   if (num_keys == 0) {
+      return 0;
+   }
+
+   splinterdb_lookup_batch_state *state =
+      TYPED_MALLOC(kvs->spl->heap_id, state);
+   if (state == NULL) {
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+   uint64 window   = MIN(num_keys, SPLINTERDB_LOOKUP_BATCH_MAX_INFLIGHT);
+   state->num_free = window;
+   for (uint64 i = 0; i < window; i++) {
+      state->free_ctxt[i] = i;
+   }
+
+   int    rc          = 0;
+   uint64 next_key_no = 0;
+   while (next_key_no < num_keys || state->num_free < window) {
+      while (rc == 0 && next_key_no < num_keys && state->num_free > 0) {
+         uint64 ctxt_no = state->free_ctxt[--state->num_free];
+         rc             = splinterdb_lookup_async_start(kvs,
+                                            &state->ctxt[ctxt_no],
+                                            keys[next_key_no],
+                                            &results[next_key_no],
+                                            splinterdb_lookup_batch_callback,
+                                            state);
+         if (rc != 0) {
+            // Let the lookups in flight drain before returning the error
+            state->num_free++;
+            break;
+         }
+         next_key_no++;
+      }
+      if (rc != 0 && state->num_free == window) {
+         break;
+      }
+      if (state->num_free < window) {
+         splinterdb_poll(kvs);
+      }
+   }
+
+   platform_free(kvs->spl->heap_id, state);
+   return rc;
+}
+
+
+struct splinterdb_iterator {
    trunk_range_iterator sri;
    platform_status      last_rc;
    const splinterdb    *parent;
+   uint64               value_offset; // value bytes returned by get_current
+   uint64               value_length;
 };
 
 int
@@ -664,32 +1596,47 @@ splinterdb_iterator_init(const splinterdb     *kvs,           // IN
                          splinterdb_iterator **iter,          // OUT
                          slice                 user_start_key // IN
 )
+{
+   return splinterdb_iterator_init_range(kvs, iter, user_start_key, NULL_SLICE);
+}
+
+/*
+ * Allocates an iterator over [start_key, end_key). If prefix is not NULL_KEY,
+ * the iterator only returns keys with that prefix. If snapshot is not NULL,
+ * it reads the snapshot instead of the live tree.
+ */
+static int
+splinterdb_iterator_create(const splinterdb     *kvs,        // IN
+                           splinterdb_iterator **iter,       // OUT
+                           key                   start_key,  // IN
+                           key                   end_key,    // IN
+                           uint64                num_tuples, // IN
+                           key                   prefix,     // IN
+                           const trunk_snapshot *snapshot    // IN
+)
 {
    splinterdb_iterator *it = TYPED_MALLOC(kvs->spl->heap_id, it);
    if (it == NULL) {
       platform_error_log("TYPED_MALLOC error\n");
       return platform_status_to_int(STATUS_NO_MEMORY);
    }
-   it->last_rc = STATUS_OK;
+   it->last_rc      = STATUS_OK;
+   it->value_offset = 0;
+   it->value_length = UINT64_MAX;
 
    trunk_range_iterator *range_itor = &(it->sri);
-   key                   start_key;
-
-   if (slice_is_null(user_start_key)) {
-      start_key = NEGATIVE_INFINITY_KEY;
-   } else {
-      start_key = key_create_from_slice(user_start_key);
-   }
 
    platform_status rc = trunk_range_iterator_init(kvs->spl,
                                                   range_itor,
                                                   NEGATIVE_INFINITY_KEY,
-                                                  POSITIVE_INFINITY_KEY,
+                                                  end_key,
                                                   start_key,
                                                   greater_than_or_equal,
-                                                  UINT64_MAX);
+                                                  num_tuples,
+                                                  prefix,
+                                                  snapshot);
    if (!SUCCESS(rc)) {
-      platform_free(kvs->spl->heap_id, *iter);
+      platform_free(kvs->spl->heap_id, it);
       return platform_status_to_int(rc);
    }
    it->parent = kvs;
@@ -698,6 +1645,76 @@ splinterdb_iterator_init(const splinterdb     *kvs,           // IN
    return EXIT_SUCCESS;
 }
 
+/*
+ * Allocates an iterator over [user_start_key, user_end_key), where either key
+ * may be NULL_SLICE for an unbounded end.
+ */
+static int
+splinterdb_iterator_create_range(const splinterdb     *kvs,            // IN
+                                 splinterdb_iterator **iter,           // OUT
+                                 slice                 user_start_key, // IN
+                                 slice                 user_end_key,   // IN
+                                 const trunk_snapshot *snapshot        // IN
+)
+{
+   key    start_key;
+   key    end_key;
+   uint64 num_tuples;
+
+   if (slice_is_null(user_start_key)) {
+      start_key = NEGATIVE_INFINITY_KEY;
+   } else {
+      start_key = key_create_from_slice(user_start_key);
+   }
+
+   /*
+    * Unbounded scans are assumed to be long and prefetch branch extents
+    * from the start. Bounded scans are usually short, so they only start
+    * prefetching once they have crossed enough tuples to be worth it.
+    */
+   if (slice_is_null(user_end_key)) {
+      end_key    = POSITIVE_INFINITY_KEY;
+      num_tuples = UINT64_MAX;
+   } else {
+      end_key    = key_create_from_slice(user_end_key);
+      num_tuples = 0;
+   }
+
+   return splinterdb_iterator_create(
+      kvs, iter, start_key, end_key, num_tuples, NULL_KEY, snapshot);
+}
+
+int
+splinterdb_iterator_init_range(const splinterdb     *kvs,            // IN
+                               splinterdb_iterator **iter,           // OUT
+                               slice                 user_start_key, // IN
+                               slice                 user_end_key    // IN
+)
+{
+   return splinterdb_iterator_create_range(
+      kvs, iter, user_start_key, user_end_key, NULL);
+}
+
+int
+splinterdb_iterator_init_prefix(const splinterdb     *kvs,        // IN
+                                splinterdb_iterator **iter,       // OUT
+                                slice                 user_prefix // IN
+)
+{
+   const data_config *data_cfg = kvs->data_cfg;
+   if (data_cfg->key_prefix == NULL || slice_is_null(user_prefix)
+       || data_cfg->key_prefix(data_cfg, user_prefix)
+             != slice_length(user_prefix))
+   {
+      return platform_status_to_int(STATUS_BAD_PARAM);
+   }
+
+   // Keys with the prefix sort at or after the prefix itself
+   key prefix = key_create_from_slice(user_prefix);
+   return splinterdb_iterator_create(
+      kvs, iter, prefix, POSITIVE_INFINITY_KEY, 0, prefix, NULL);
+}
+
 void
 splinterdb_iterator_deinit(splinterdb_iterator *iter)
 {
@@ -769,8 +1786,218 @@ splinterdb_iterator_get_current(splinterdb_iterator *iter,   // IN
    iterator *itor = &(iter->sri.super);
 
    iterator_curr(itor, &result_key, &msg);
-   *value  = message_slice(msg);
    *outkey = key_slice(result_key);
+   if (iter->value_length == 0) {
+      *value = NULL_SLICE;
+      return;
+   }
+
+   slice  full   = message_slice(msg);
+   uint64 offset = MIN(iter->value_offset, slice_length(full));
+   uint64 length = MIN(iter->value_length, slice_length(full) - offset);
+   *value = slice_create(length, (const char *)slice_data(full) + offset);
+}
+
+void
+splinterdb_iterator_project_value(splinterdb_iterator *iter,   // IN/OUT
+                                  uint64               offset, // IN
+                                  uint64               length  // IN
+)
+{
+   iter->value_offset = offset;
+   iter->value_length = length;
+}
+
+void
+splinterdb_iterator_keys_only(splinterdb_iterator *iter) // IN/OUT
+{
+   splinterdb_iterator_project_value(iter, 0, 0);
+}
+
+struct splinterdb_snapshot {
+   trunk_snapshot snapshot;
+};
+
+int
+splinterdb_snapshot_create(splinterdb           *kvs,     // IN
+                           splinterdb_snapshot **snapshot // OUT
+)
+{
+   splinterdb_snapshot *snap = TYPED_MALLOC(kvs->spl->heap_id, snap);
+   if (snap == NULL) {
+      platform_error_log("TYPED_MALLOC error\n");
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+
+   platform_status rc = trunk_snapshot_create(kvs->spl, &snap->snapshot);
+   if (!SUCCESS(rc)) {
+      platform_free(kvs->spl->heap_id, snap);
+      return platform_status_to_int(rc);
+   }
+
+   *snapshot = snap;
+   return EXIT_SUCCESS;
+}
+
+void
+splinterdb_snapshot_release(splinterdb *kvs, splinterdb_snapshot *snapshot)
+{
+   trunk_snapshot_release(kvs->spl, &snapshot->snapshot);
+   platform_free(kvs->spl->heap_id, snapshot);
+}
+
+int
+splinterdb_snapshot_lookup(const splinterdb          *kvs,      // IN
+                           const splinterdb_snapshot *snapshot, // IN
+                           slice                      user_key, // IN
+                           splinterdb_lookup_result  *result    // IN/OUT
+)
+{
+   platform_status            status;
+   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
+   key                        target  = key_create_from_slice(user_key);
+
+   platform_assert(kvs != NULL);
+   status = trunk_snapshot_lookup(kvs->spl,
+                                  &snapshot->snapshot,
+                                  target,
+                                  &_result->value,
+                                  splinterdb_lookup_result_ref(_result));
+   return platform_status_to_int(status);
+}
+
+int
+splinterdb_snapshot_iterator_init(const splinterdb          *kvs,       // IN
+                                  const splinterdb_snapshot *snapshot,  // IN
+                                  splinterdb_iterator      **iter,      // OUT
+                                  slice                      start_key, // IN
+                                  slice                      end_key    // IN
+)
+{
+   return splinterdb_iterator_create_range(
+      kvs, iter, start_key, end_key, &snapshot->snapshot);
+}
+
+/*
+ * bounds[i] and bounds[i + 1] delimit partition i. All max_partitions + 1
+ * buffers are initialized, though only num_partitions + 1 are used.
+ */
+struct splinterdb_scan_partitions {
+   uint64     num_partitions;
+   uint64     max_partitions;
+   key_buffer bounds[];
+};
+
+int
+splinterdb_scan_partitions_create(
+   const splinterdb            *kvs,            // IN
+   slice                        start_key,      // IN
+   slice                        end_key,        // IN
+   uint64                       max_partitions, // IN
+   splinterdb_scan_partitions **partitions      // OUT
+)
+{
+   if (max_partitions == 0) {
+      return platform_status_to_int(STATUS_BAD_PARAM);
+   }
+
+   splinterdb_scan_partitions *parts = TYPED_FLEXIBLE_STRUCT_MALLOC(
+      kvs->spl->heap_id, parts, bounds, max_partitions + 1);
+   if (parts == NULL) {
+      platform_error_log("TYPED_MALLOC error\n");
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+   parts->max_partitions = max_partitions;
+   for (uint64 i = 0; i <= max_partitions; i++) {
+      key_buffer_init(&parts->bounds[i], kvs->spl->heap_id);
+   }
+
+   key start = slice_is_null(start_key) ? NEGATIVE_INFINITY_KEY
+                                        : key_create_from_slice(start_key);
+   key end   = slice_is_null(end_key) ? POSITIVE_INFINITY_KEY
+                                      : key_create_from_slice(end_key);
+   platform_status rc = key_buffer_copy_key(&parts->bounds[0], start);
+   if (SUCCESS(rc)) {
+      rc = trunk_split_range(kvs->spl,
+                             start,
+                             end,
+                             max_partitions,
+                             &parts->bounds[1],
+                             &parts->num_partitions);
+   }
+   if (SUCCESS(rc)) {
+      rc = key_buffer_copy_key(&parts->bounds[parts->num_partitions], end);
+   }
+   if (!SUCCESS(rc)) {
+      splinterdb_scan_partitions_destroy(kvs, parts);
+      return platform_status_to_int(rc);
+   }
+
+   *partitions = parts;
+   return 0;
+}
+
+uint64
+splinterdb_scan_partitions_count(const splinterdb_scan_partitions *partitions)
+{
+   return partitions->num_partitions;
+}
+
+int
+splinterdb_scan_partition(const splinterdb                 *kvs,        // IN
+                          const splinterdb_scan_partitions *partitions, // IN
+                          uint64                            partition,  // IN
+                          splinterdb_scan_fn                scan_fn,    // IN
+                          void                             *arg         // IN
+)
+{
+   if (partition >= partitions->num_partitions) {
+      return platform_status_to_int(STATUS_BAD_PARAM);
+   }
+
+   // Partitions are large, so prefetch from the start as unbounded scans do
+   key_buffer          *bounds = (key_buffer *)partitions->bounds;
+   key                  start  = key_buffer_key(&bounds[partition]);
+   key                  end    = key_buffer_key(&bounds[partition + 1]);
+   splinterdb_iterator *it;
+   int                  rc = splinterdb_iterator_create(
+      kvs, &it, start, end, UINT64_MAX, NULL_KEY, NULL);
+   if (rc != 0) {
+      return rc;
+   }
+
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      slice key;
+      slice value;
+      splinterdb_iterator_get_current(it, &key, &value);
+      rc = scan_fn(partition, key, value, arg);
+      if (rc != 0) {
+         break;
+      }
+   }
+   if (rc == 0) {
+      rc = splinterdb_iterator_status(it);
+   }
+   splinterdb_iterator_deinit(it);
+   return rc;
+}
+
+void
+splinterdb_scan_partitions_destroy(const splinterdb           *kvs,
+                                   splinterdb_scan_partitions *partitions)
+{
+   for (uint64 i = 0; i <= partitions->max_partitions; i++) {
+      key_buffer_deinit(&partitions->bounds[i]);
+   }
+   platform_free(kvs->spl->heap_id, partitions);
+}
+
+void
+splinterdb_set_compaction_io_limit(const splinterdb *kvs,
+                                   uint64            bytes_per_sec,
+                                   uint64            target_read_latency_ns)
+{
+   cache_set_io_limit(kvs->spl->cc, bytes_per_sec, target_read_latency_ns);
 }
 
 void
@@ -791,6 +2018,221 @@ splinterdb_stats_reset(splinterdb *kvs)
    trunk_reset_stats(kvs->spl);
 }
 
+// Fills lat from histo, taking each percentile as its bucket's upper bound
+static void
+splinterdb_latency_stats_init(splinterdb_latency_stats *lat,  // OUT
+                              platform_histo_handle     histo // IN
+)
+{
+   ZERO_CONTENTS(lat);
+   if (histo->num == 0) {
+      return;
+   }
+   lat->count   = histo->num;
+   lat->min_ns  = histo->min;
+   lat->max_ns  = histo->max;
+   lat->mean_ns = histo->total / histo->num;
+
+   const uint64 permille[]   = {500, 900, 990, 999};
+   uint64      *percentile[] = {
+      &lat->p50_ns, &lat->p90_ns, &lat->p99_ns, &lat->p999_ns};
+   uint64 bucket = 0;
+   uint64 below  = 0; // count of the buckets before bucket
+   for (uint64 i = 0; i < ARRAY_SIZE(permille); i++) {
+      uint64 rank = (histo->num * permille[i] + 999) / 1000;
+      while (bucket < histo->num_buckets - 1
+             && below + histo->count[bucket] < rank)
+      {
+         below += histo->count[bucket];
+         bucket++;
+      }
+      uint64 bound   = bucket < histo->num_buckets - 1
+                          ? histo->bucket_limits[bucket]
+                          : histo->max;
+      *percentile[i] = MAX(lat->min_ns, MIN(bound, lat->max_ns));
+   }
+}
+
+static void
+splinterdb_task_stats_init(splinterdb_task_stats *out,  // OUT
+                           task_system           *ts,   // IN
+                           task_type              type) // IN
+{
+   task_stats global = {0};
+   task_get_stats(ts, type, &global);
+   out->num_waiting            = ts->group[type].current_waiting_tasks;
+   out->num_executing          = ts->group[type].current_executing_tasks;
+   out->num_enqueued           = global.total_tasks_enqueued;
+   out->num_bg_executed        = global.total_bg_task_executions;
+   out->num_fg_executed        = global.total_fg_task_executions;
+   out->queue_wait_time_ns     = global.total_queue_wait_time_ns;
+   out->max_queue_wait_time_ns = global.max_queue_wait_time_ns;
+   out->max_runtime_ns         = global.max_runtime_ns;
+}
+
+static void
+splinterdb_cache_stats_init(splinterdb_cache_stats *out,    // OUT
+                            const cache_stats      *cstats, // IN
+                            page_type               type)   // IN
+{
+   out->hits               = cstats->cache_hits[type];
+   out->misses             = cstats->cache_misses[type];
+   out->probationary_reads = cstats->probationary_reads[type];
+}
+
+static splinterdb_memory_backing
+splinterdb_memory_backing_of(platform_buffer_backing backing)
+{
+   switch (backing) {
+      case PLATFORM_BUFFER_HUGE_PAGES:
+         return SPLINTERDB_MEMORY_HUGE_PAGES;
+      case PLATFORM_BUFFER_TRANSPARENT_HUGE_PAGES:
+         return SPLINTERDB_MEMORY_TRANSPARENT_HUGE_PAGES;
+      default:
+         return SPLINTERDB_MEMORY_PAGES;
+   }
+}
+
+static int
+splinterdb_stats_collect(const splinterdb *kvs,   // IN
+                         splinterdb_stats *stats) // OUT
+{
+   trunk_handle *spl = kvs->spl;
+
+   ZERO_CONTENTS(stats);
+   stats->version = SPLINTERDB_STATS_VERSION;
+   stats->size    = sizeof(*stats);
+
+   splinterdb_task_stats_init(
+      &stats->memtable_tasks, kvs->task_sys, TASK_TYPE_MEMTABLE);
+   splinterdb_task_stats_init(
+      &stats->normal_tasks, kvs->task_sys, TASK_TYPE_NORMAL);
+   stats->compaction_io_bytes_per_sec = cache_get_io_limit(spl->cc);
+
+   cache_stats cstats;
+   ZERO_CONTENTS(&cstats);
+   cache_get_stats(spl->cc, &cstats);
+   stats->trunk_pages_cached  = cstats.pages_cached[PAGE_TYPE_TRUNK];
+   stats->branch_pages_cached = cstats.pages_cached[PAGE_TYPE_BRANCH];
+   stats->filter_pages_cached = cstats.pages_cached[PAGE_TYPE_FILTER];
+
+   stats->cache_pages_backing =
+      splinterdb_memory_backing_of(kvs->cache_handle.bh.backing);
+   stats->cache_refcount_backing =
+      splinterdb_memory_backing_of(kvs->cache_handle.rc_bh.backing);
+   stats->cache_lookup_backing =
+      splinterdb_memory_backing_of(kvs->cache_handle.lookup_backing);
+
+   if (!spl->cfg.use_stats) {
+      return 0;
+   }
+
+   trunk_stats *global = TYPED_ZALLOC(kvs->heap_id, global);
+   if (global == NULL) {
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+   platform_histo_handle *histos[] = {&global->insert_latency_histo,
+                                      &global->update_latency_histo,
+                                      &global->delete_latency_histo};
+   platform_histo_handle  model    = spl->stats[0].insert_latency_histo;
+   platform_status        rc       = STATUS_OK;
+   for (uint64 i = 0; i < ARRAY_SIZE(histos) && SUCCESS(rc); i++) {
+      rc = platform_histo_create(
+         kvs->heap_id, model->num_buckets, model->bucket_limits, histos[i]);
+   }
+   if (!SUCCESS(rc)) {
+      goto out;
+   }
+
+   trunk_get_stats(spl, global);
+   stats->insertions        = global->insertions;
+   stats->updates           = global->updates;
+   stats->deletions         = global->deletions;
+   stats->lookups_found     = global->lookups_found;
+   stats->lookups_not_found = global->lookups_not_found;
+   splinterdb_latency_stats_init(&stats->insert_latency,
+                                 global->insert_latency_histo);
+   splinterdb_latency_stats_init(&stats->update_latency,
+                                 global->update_latency_histo);
+   splinterdb_latency_stats_init(&stats->delete_latency,
+                                 global->delete_latency_histo);
+
+   stats->flushes = global->root_full_flushes + global->root_count_flushes;
+   stats->memtable_flushes   = global->memtable_flushes;
+   stats->compactions        = global->root_compactions;
+   stats->compaction_tuples  = global->root_compaction_tuples;
+   stats->compaction_time_ns = global->root_compaction_time_ns;
+   stats->leaf_splits        = global->leaf_splits;
+   stats->index_splits       = global->index_splits;
+   stats->filters_built      = global->root_filters_built;
+   stats->discarded_deletes  = global->discarded_deletes;
+
+   stats->write_throttles        = global->write_throttles;
+   stats->write_throttle_time_ns = global->write_throttle_time_ns;
+   stats->write_stalls           = global->write_stalls;
+   stats->write_stall_time_ns    = global->write_stall_time_ns;
+
+   for (uint64 h = 0; h < TRUNK_MAX_HEIGHT; h++) {
+      stats->flushes += global->full_flushes[h] + global->count_flushes[h];
+      stats->compactions += global->compactions[h];
+      stats->compaction_tuples += global->compaction_tuples[h];
+      stats->compaction_time_ns += global->compaction_time_ns[h];
+      stats->filters_built += global->filters_built[h];
+      stats->filter_lookups += global->filter_lookups[h];
+      stats->filter_false_positives += global->filter_false_positives[h];
+      stats->branch_lookups += global->branch_lookups[h];
+      stats->space_reclamations += global->space_recs[h];
+      stats->tuples_reclaimed += global->tuples_reclaimed[h];
+      stats->parallel_compactions += global->compactions_parallel[h];
+      stats->compaction_subranges += global->compaction_subranges[h];
+   }
+
+   for (page_type type = 0; type < NUM_PAGE_TYPES; type++) {
+      stats->cache_hits += cstats.cache_hits[type];
+      stats->cache_misses += cstats.cache_misses[type];
+      stats->cache_miss_time_ns += cstats.cache_miss_time_ns[type];
+      stats->prefetches_issued += cstats.prefetches_issued[type];
+      stats->pages_read += cstats.page_reads[type];
+      stats->pages_written += cstats.page_writes[type];
+   }
+   stats->writebacks_issued = cstats.writes_issued;
+   stats->syncs_issued      = cstats.syncs_issued;
+   stats->bytes_read        = stats->pages_read * cache_page_size(spl->cc);
+   stats->bytes_written     = stats->pages_written * cache_page_size(spl->cc);
+
+   stats->compaction_io_throttle_time_ns = cstats.io_throttle_time_ns;
+
+   splinterdb_cache_stats_init(&stats->trunk_cache, &cstats, PAGE_TYPE_TRUNK);
+   splinterdb_cache_stats_init(&stats->branch_cache, &cstats, PAGE_TYPE_BRANCH);
+   splinterdb_cache_stats_init(&stats->filter_cache, &cstats, PAGE_TYPE_FILTER);
+
+out:
+   for (uint64 i = 0; i < ARRAY_SIZE(histos); i++) {
+      if (*histos[i] != NULL) {
+         platform_histo_destroy(kvs->heap_id, histos[i]);
+      }
+   }
+   platform_free(kvs->heap_id, global);
+   return platform_status_to_int(rc);
+}
+
+int
+splinterdb_stats_get(const splinterdb *kvs, splinterdb_stats *stats)
+{
+   uint32 size = stats->size;
+   if (size < offsetof(splinterdb_stats, size) + sizeof(stats->size)) {
+      return EINVAL;
+   }
+
+   splinterdb_stats all;
+   int              rc = splinterdb_stats_collect(kvs, &all);
+
+   // Callers built against an older header only know its first size bytes
+   all.size = MIN(size, sizeof(all));
+   memmove(stats, &all, all.size);
+   return rc;
+}
+
 static void
 splinterdb_close_print_stats(splinterdb *kvs)
 {
@@ -825,19 +2267,19 @@ splinterdb_get_task_system_handle(const splinterdb *kvs)
 const platform_io_handle *
 splinterdb_get_io_handle(const splinterdb *kvs)
 {
-   return &kvs->io_handle;
+   return kvs->parent == NULL ? &kvs->io_handle : &kvs->parent->io_handle;
 }
 
 const allocator *
 splinterdb_get_allocator_handle(const splinterdb *kvs)
 {
-   return (allocator *)&kvs->allocator_handle;
+   return kvs->spl->al;
 }
 
 const cache *
 splinterdb_get_cache_handle(const splinterdb *kvs)
 {
-   return (cache *)&kvs->cache_handle;
+   return kvs->spl->cc;
 }
 
 const trunk_handle *
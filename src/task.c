@@ -16,28 +16,49 @@ _Static_assert((ARRAY_SIZE(task_type_name) == NUM_TASK_TYPES),
 /****************************************
  * Thread ID allocation and management  *
  ****************************************/
+#define TASK_TIDS_PER_WORD (sizeof(uint64) * 8)
+
+static inline uint64
+task_tid_bitmask_num_words(uint64 max_threads)
+{
+   return (max_threads + TASK_TIDS_PER_WORD - 1) / TASK_TIDS_PER_WORD;
+}
+
+/*
+ * Returns the value of word word_no of the tid bitmask when none of its
+ * thread IDs are in use. The bits past max_threads are never free.
+ */
+static inline uint64
+task_tid_bitmask_free_word(uint64 max_threads, uint64 word_no)
+{
+   uint64 num_tids = max_threads - word_no * TASK_TIDS_PER_WORD;
+   if (num_tids >= TASK_TIDS_PER_WORD) {
+      return (uint64)-1;
+   }
+   return (1ULL << num_tids) - 1;
+}
+
 /*
  * task_init_tid_bitmask() - Initialize the global bitmask of active threads in
  * the task system structure to indicate that no threads are currently active.
  */
 static void
-task_init_tid_bitmask(uint64 *tid_bitmask)
+task_init_tid_bitmask(uint64 *tid_bitmask, uint64 max_threads)
 {
-   // We use a 64 bit word to act as the thread bitmap.
-   _Static_assert(MAX_THREADS == 64, "Max threads should be 64");
    /*
     * This is a special bitmask where 1 indicates free and 0 indicates
     * allocated. So, we set all bits to 1 during init.
     */
-   for (int i = 0; i < MAX_THREADS; i++) {
-      *tid_bitmask |= (1ULL << i);
+   uint64 num_words = task_tid_bitmask_num_words(max_threads);
+   for (uint64 word_no = 0; word_no < num_words; word_no++) {
+      tid_bitmask[word_no] = task_tid_bitmask_free_word(max_threads, word_no);
    }
 }
 
 static inline uint64 *
 task_system_get_tid_bitmask(task_system *ts)
 {
-   return &ts->tid_bitmask;
+   return ts->tid_bitmask;
 }
 
 static threadid *
@@ -47,41 +68,55 @@ task_system_get_max_tid(task_system *ts)
 }
 
 /*
- * Return the bitmasks of tasks active. Mainly intended as a testing hook.
+ * Return the bitmask of the first 64 thread IDs' tasks active. Mainly
+ * intended as a testing hook.
  */
 uint64
 task_active_tasks_mask(task_system *ts)
 {
-   return *task_system_get_tid_bitmask(ts);
+   return task_system_get_tid_bitmask(ts)[0];
 }
 
 /*
  * Allocate a threadid.  Returns INVALID_TID when no tid is available.
+ *
+ * The lowest free tid is taken, so that tids stay dense and are recycled as
+ * soon as they are deallocated.
  */
 static threadid
 task_allocate_threadid(task_system *ts)
 {
    threadid tid         = INVALID_TID;
    uint64  *tid_bitmask = task_system_get_tid_bitmask(ts);
+   uint64   num_words   = task_tid_bitmask_num_words(ts->cfg->max_threads);
    uint64   old_bitmask;
    uint64   new_bitmask;
 
-   do {
-      old_bitmask = *tid_bitmask;
-      // first bit set to 1 starting from LSB.
-      uint64 pos = __builtin_ffsl(old_bitmask);
-
-      // If all threads are in-use, bitmask will be all 0s.
-      if (pos == 0) {
-         return INVALID_TID;
+   for (uint64 word_no = 0; word_no < num_words; word_no++) {
+      old_bitmask = tid_bitmask[word_no];
+      // If all threads of this word are in-use, it will be all 0s.
+      while (old_bitmask != 0) {
+         // first bit set to 1 starting from LSB.
+         // builtin_ffsl returns the position plus 1.
+         uint64 pos = __builtin_ffsl(old_bitmask) - 1;
+
+         // set bit at that position to 0, indicating in use.
+         new_bitmask = (old_bitmask & ~(1ULL << pos));
+         if (__sync_bool_compare_and_swap(
+                &tid_bitmask[word_no], old_bitmask, new_bitmask))
+         {
+            tid = word_no * TASK_TIDS_PER_WORD + pos;
+            break;
+         }
+         old_bitmask = tid_bitmask[word_no];
       }
-
-      // builtin_ffsl returns the position plus 1.
-      tid = pos - 1;
-      // set bit at that position to 0, indicating in use.
-      new_bitmask = (old_bitmask & ~(1ULL << (pos - 1)));
-   } while (
-      !__sync_bool_compare_and_swap(tid_bitmask, old_bitmask, new_bitmask));
+      if (tid != INVALID_TID) {
+         break;
+      }
+   }
+   if (tid == INVALID_TID) {
+      return INVALID_TID;
+   }
 
    // Invariant: we have successfully allocated tid
 
@@ -102,25 +137,19 @@ static void
 task_deallocate_threadid(task_system *ts, threadid tid)
 {
    uint64 *tid_bitmask = task_system_get_tid_bitmask(ts);
+   uint64 *tid_word    = &tid_bitmask[tid / TASK_TIDS_PER_WORD];
+   uint64  tid_bit     = 1ULL << (tid % TASK_TIDS_PER_WORD);
 
-   uint64 bitmask_val = *tid_bitmask;
+   // set bit back to 1 to indicate a free slot.
+   uint64 bitmask_val = __sync_fetch_and_or(tid_word, tid_bit);
 
    // Ensure that caller is only clearing for a thread that's in-use.
-   platform_assert(!(bitmask_val & (1ULL << tid)),
+   platform_assert(!(bitmask_val & tid_bit),
                    "Thread [%lu] is expected to be in-use. Bitmap: 0x%lx",
                    tid,
                    bitmask_val);
-
-   // set bit back to 1 to indicate a free slot.
-   uint64 tmp_bitmask = *tid_bitmask;
-   uint64 new_value   = tmp_bitmask | (1ULL << tid);
-   while (!__sync_bool_compare_and_swap(tid_bitmask, tmp_bitmask, new_value)) {
-      tmp_bitmask = *tid_bitmask;
-      new_value   = tmp_bitmask | (1ULL << tid);
-   }
 }
 
-
 /*
  * Return the max thread-index across all active tasks.
  * Mainly intended as a testing hook.
@@ -251,8 +280,8 @@ task_create_thread_with_hooks(platform_thread       *thread,
    threadid newtid = task_allocate_threadid(ts);
    if (newtid == INVALID_TID) {
       platform_error_log("Cannot create a new thread as the limit on"
-                         " concurrent threads, %d, will be exceeded.\n",
-                         MAX_THREADS);
+                         " concurrent threads, %lu, will be exceeded.\n",
+                         ts->cfg->max_threads);
       return STATUS_BUSY;
    }
 
@@ -556,7 +585,7 @@ task_group_stop_and_wait_for_threads(task_group *group)
                    "Attempt to shut down task group with %lu waiting tasks",
                    group->current_waiting_tasks);
 
-   uint8 num_threads = group->bg.num_threads;
+   uint64 num_threads = group->bg.num_threads;
 
    // Inform the background thread that it's time to exit now.
    group->bg.stop = TRUE;
@@ -564,24 +593,36 @@ task_group_stop_and_wait_for_threads(task_group *group)
    task_group_unlock(group);
 
    // Allow all background threads to wrap up their work.
-   for (uint8 i = 0; i < num_threads; i++) {
+   for (uint64 i = 0; i < num_threads; i++) {
       platform_thread_join(group->bg.threads[i]);
       group->bg.num_threads--;
    }
 }
 
+static void
+task_group_free(task_group *group)
+{
+   if (group->bg.threads != NULL) {
+      platform_free(group->ts->heap_id, group->bg.threads);
+   }
+   if (group->stats != NULL) {
+      platform_free(group->ts->heap_id, group->stats);
+   }
+}
+
 static void
 task_group_deinit(task_group *group)
 {
    task_group_stop_and_wait_for_threads(group);
    platform_condvar_destroy(&group->cv);
+   task_group_free(group);
 }
 
 static platform_status
 task_group_init(task_group  *group,
                 task_system *ts,
                 bool32       use_stats,
-                uint8        num_bg_threads,
+                uint64       num_bg_threads,
                 uint64       scratch_size)
 {
    ZERO_CONTENTS(group);
@@ -590,12 +631,23 @@ task_group_init(task_group  *group,
    platform_heap_id hid = ts->heap_id;
    platform_status  rc;
 
+   group->stats = TYPED_ARRAY_ZALLOC(hid, group->stats, ts->cfg->max_threads);
+   if (0 < num_bg_threads) {
+      group->bg.threads =
+         TYPED_ARRAY_ZALLOC(hid, group->bg.threads, num_bg_threads);
+   }
+   if (group->stats == NULL || (0 < num_bg_threads && !group->bg.threads)) {
+      task_group_free(group);
+      return STATUS_NO_MEMORY;
+   }
+
    rc = platform_condvar_init(&group->cv, hid);
    if (!SUCCESS(rc)) {
+      task_group_free(group);
       return rc;
    }
 
-   for (uint8 i = 0; i < num_bg_threads; i++) {
+   for (uint64 i = 0; i < num_bg_threads; i++) {
       rc = task_thread_create("splinter-bg-thread",
                               task_worker_thread,
                               (void *)group,
@@ -614,6 +666,7 @@ task_group_init(task_group  *group,
 out:
    debug_assert(!SUCCESS(rc));
    platform_condvar_destroy(&group->cv);
+   task_group_free(group);
    return rc;
 }
 
@@ -814,18 +867,25 @@ task_perform_until_quiescent(task_system *ts)
  * Validate that the task system configuration is basically supportable.
  */
 static platform_status
-task_config_valid(const uint64 num_background_threads[NUM_TASK_TYPES])
+task_config_valid(const uint64 num_background_threads[NUM_TASK_TYPES],
+                  uint64       max_threads)
 {
    uint64 normal_bg_threads   = num_background_threads[TASK_TYPE_NORMAL];
    uint64 memtable_bg_threads = num_background_threads[TASK_TYPE_MEMTABLE];
 
-   if ((normal_bg_threads + memtable_bg_threads) >= MAX_THREADS) {
+   if (max_threads == 0 || max_threads > MAX_THREADS) {
+      platform_error_log("Max threads, %lu, must be in [1, %d].\n",
+                         max_threads,
+                         MAX_THREADS);
+      return STATUS_BAD_PARAM;
+   }
+   if ((normal_bg_threads + memtable_bg_threads) >= max_threads) {
       platform_error_log("Total number of background threads configured"
                          ", normal_bg_threads=%lu, memtable_bg_threads=%lu, "
-                         "must be <= %d.\n",
+                         "must be <= %lu.\n",
                          normal_bg_threads,
                          memtable_bg_threads,
-                         (MAX_THREADS - 1));
+                         (max_threads - 1));
       return STATUS_BAD_PARAM;
    }
    return STATUS_OK;
@@ -835,15 +895,17 @@ platform_status
 task_system_config_init(task_system_config *task_cfg,
                         bool32              use_stats,
                         const uint64        num_bg_threads[NUM_TASK_TYPES],
-                        uint64              scratch_size)
+                        uint64              scratch_size,
+                        uint64              max_threads)
 {
-   platform_status rc = task_config_valid(num_bg_threads);
+   platform_status rc = task_config_valid(num_bg_threads, max_threads);
    if (!SUCCESS(rc)) {
       return rc;
    }
 
    task_cfg->use_stats    = use_stats;
    task_cfg->scratch_size = scratch_size;
+   task_cfg->max_threads  = max_threads;
 
    memcpy(task_cfg->num_background_threads,
           num_bg_threads,
@@ -851,6 +913,18 @@ task_system_config_init(task_system_config *task_cfg,
    return STATUS_OK;
 }
 
+static void
+task_system_free(platform_heap_id hid, task_system *ts)
+{
+   if (ts->tid_bitmask != NULL) {
+      platform_free(hid, ts->tid_bitmask);
+   }
+   if (ts->thread_scratch != NULL) {
+      platform_free(hid, ts->thread_scratch);
+   }
+   platform_free(hid, ts);
+}
+
 /*
  * -----------------------------------------------------------------------------
  * Task system initializer. Makes sure that the initial thread has an
@@ -866,7 +940,8 @@ task_system_create(platform_heap_id          hid,
                    task_system             **system,
                    const task_system_config *cfg)
 {
-   platform_status rc = task_config_valid(cfg->num_background_threads);
+   platform_status rc =
+      task_config_valid(cfg->num_background_threads, cfg->max_threads);
    if (!SUCCESS(rc)) {
       return rc;
    }
@@ -879,7 +954,17 @@ task_system_create(platform_heap_id          hid,
    ts->cfg     = cfg;
    ts->ioh     = ioh;
    ts->heap_id = hid;
-   task_init_tid_bitmask(&ts->tid_bitmask);
+
+   ts->tid_bitmask = TYPED_ARRAY_MALLOC(
+      hid, ts->tid_bitmask, task_tid_bitmask_num_words(cfg->max_threads));
+   ts->thread_scratch =
+      TYPED_ARRAY_ZALLOC(hid, ts->thread_scratch, cfg->max_threads);
+   if (ts->tid_bitmask == NULL || ts->thread_scratch == NULL) {
+      task_system_free(hid, ts);
+      *system = NULL;
+      return STATUS_NO_MEMORY;
+   }
+   task_init_tid_bitmask(ts->tid_bitmask, cfg->max_threads);
 
    // task initialization
    register_standard_hooks(ts);
@@ -934,21 +1019,27 @@ task_system_destroy(platform_heap_id hid, task_system **ts_in)
    if (tid != INVALID_TID) {
       task_deregister_this_thread(ts);
    }
-   if (ts->tid_bitmask != ((uint64)-1)) {
-      platform_error_log(
-         "Destroying task system that still has some registered threads."
-         ", tid=%lu, tid_bitmask=0x%lx\n",
-         tid,
-         ts->tid_bitmask);
+   uint64 num_words = task_tid_bitmask_num_words(ts->cfg->max_threads);
+   for (uint64 word_no = 0; word_no < num_words; word_no++) {
+      uint64 free_word =
+         task_tid_bitmask_free_word(ts->cfg->max_threads, word_no);
+      if (ts->tid_bitmask[word_no] != free_word) {
+         platform_error_log(
+            "Destroying task system that still has some registered threads."
+            ", tid=%lu, tid_bitmask[%lu]=0x%lx\n",
+            tid,
+            word_no,
+            ts->tid_bitmask[word_no]);
+      }
    }
-   platform_free(hid, ts);
+   task_system_free(hid, ts);
    *ts_in = (task_system *)NULL;
 }
 
 void *
 task_system_get_thread_scratch(task_system *ts, const threadid tid)
 {
-   platform_assert((tid < MAX_THREADS), "tid=%lu", tid);
+   platform_assert((tid < ts->cfg->max_threads), "tid=%lu", tid);
    return ts->thread_scratch[tid];
 }
 
@@ -971,35 +1062,42 @@ task_wait_for_completion(task_system *ts)
 }
 
 static void
-task_group_print_stats(task_group *group, task_type type)
+task_group_get_stats(task_group *group, task_stats *global)
 {
-   if (!group->use_stats) {
-      platform_default_log("no stats\n");
-      return;
-   }
-
-   task_stats global = {0};
-
-   for (threadid i = 0; i < MAX_THREADS; i++) {
-      global.total_bg_task_executions +=
+   for (threadid i = 0; i < group->ts->cfg->max_threads; i++) {
+      global->total_bg_task_executions +=
          group->stats[i].total_bg_task_executions;
-      global.total_fg_task_executions +=
+      global->total_fg_task_executions +=
          group->stats[i].total_fg_task_executions;
-      global.total_queue_wait_time_ns +=
+      global->total_queue_wait_time_ns +=
          group->stats[i].total_queue_wait_time_ns;
-      if (group->stats[i].max_runtime_ns > global.max_runtime_ns) {
-         global.max_runtime_ns   = group->stats[i].max_runtime_ns;
-         global.max_runtime_func = group->stats[i].max_runtime_func;
+      if (group->stats[i].max_runtime_ns > global->max_runtime_ns) {
+         global->max_runtime_ns   = group->stats[i].max_runtime_ns;
+         global->max_runtime_func = group->stats[i].max_runtime_func;
       }
       if (group->stats[i].max_queue_wait_time_ns
-          > global.max_queue_wait_time_ns) {
-         global.max_queue_wait_time_ns = group->stats[i].max_queue_wait_time_ns;
+          > global->max_queue_wait_time_ns) {
+         global->max_queue_wait_time_ns =
+            group->stats[i].max_queue_wait_time_ns;
       }
-      global.max_outstanding_tasks = MAX(global.max_outstanding_tasks,
-                                         group->stats[i].max_outstanding_tasks);
-      global.total_tasks_enqueued += group->stats[i].total_tasks_enqueued;
+      global->max_outstanding_tasks =
+         MAX(global->max_outstanding_tasks,
+             group->stats[i].max_outstanding_tasks);
+      global->total_tasks_enqueued += group->stats[i].total_tasks_enqueued;
+   }
+}
+
+static void
+task_group_print_stats(task_group *group, task_type type)
+{
+   if (!group->use_stats) {
+      platform_default_log("no stats\n");
+      return;
    }
 
+   task_stats global = {0};
+   task_group_get_stats(group, &global);
+
    switch (type) {
       case TASK_TYPE_NORMAL:
          platform_default_log("\nMain Task Group Statistics\n");
@@ -1039,6 +1137,19 @@ task_group_print_stats(task_group *group, task_type type)
    platform_default_log("\n");
 }
 
+/*
+ * Adds the statistics of all threads for the tasks of the given type into
+ * global, if statistics are enabled. Threads may keep updating their counters
+ * meanwhile.
+ */
+void
+task_get_stats(task_system *ts, task_type type, task_stats *global)
+{
+   if (ts->group[type].use_stats) {
+      task_group_get_stats(&ts->group[type], global);
+   }
+}
+
 void
 task_print_stats(task_system *ts)
 {
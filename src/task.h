@@ -39,9 +39,9 @@ typedef struct task_queue {
 } task_queue;
 
 typedef struct task_bg_thread_group {
-   bool32          stop;
-   uint8           num_threads;
-   platform_thread threads[MAX_THREADS];
+   bool32           stop;
+   uint64           num_threads;
+   platform_thread *threads;
 } task_bg_thread_group;
 
 /*
@@ -58,9 +58,9 @@ typedef struct task_group {
    platform_condvar     cv;
    task_bg_thread_group bg;
 
-   // Per thread stats.
-   bool32     use_stats;
-   task_stats stats[MAX_THREADS];
+   // Per thread stats, by thread ID.
+   bool32      use_stats;
+   task_stats *stats;
 } task_group;
 
 /*
@@ -81,13 +81,15 @@ typedef struct task_system_config {
    bool32 use_stats;
    uint64 num_background_threads[NUM_TASK_TYPES];
    uint64 scratch_size;
+   uint64 max_threads; // threads registered at a time, see MAX_THREADS
 } task_system_config;
 
 platform_status
 task_system_config_init(task_system_config *task_cfg,
                         bool32              use_stats,
                         const uint64 num_background_threads[NUM_TASK_TYPES],
-                        uint64       scratch_size);
+                        uint64       scratch_size,
+                        uint64       max_threads);
 
 
 #define TASK_MAX_HOOKS (4)
@@ -112,15 +114,16 @@ struct task_system {
    platform_io_handle *ioh;
    platform_heap_id    heap_id;
    /*
-    * bitmask used for generating and clearing thread id's.
+    * bitmask used for generating and clearing thread id's, one bit per
+    * thread id in [0, cfg->max_threads), 64 to a word.
     * If a bit is set to 0, it means we have an in use thread id for that
     * particular position, 1 means it is unset and that thread id is available
     * for use.
     */
-   uint64 tid_bitmask;
+   uint64 *tid_bitmask;
    // max thread id so far.
    threadid max_tid;
-   void    *thread_scratch[MAX_THREADS];
+   void   **thread_scratch; // by thread ID
    // task groups
    task_group group[NUM_TASK_TYPES];
 
@@ -195,6 +198,13 @@ task_system_destroy(platform_heap_id hid, task_system **ts);
 void *
 task_system_get_thread_scratch(task_system *ts, threadid tid);
 
+// The number of threads which may be registered at a time
+static inline uint64
+task_system_get_max_threads(task_system *ts)
+{
+   return ts->cfg->max_threads;
+}
+
 platform_status
 task_enqueue(task_system *ts,
              task_type    type,
@@ -273,5 +283,8 @@ task_get_max_tid(task_system *ts);
 uint64
 task_active_tasks_mask(task_system *ts);
 
+void
+task_get_stats(task_system *ts, task_type type, task_stats *global);
+
 void
 task_print_stats(task_system *ts);
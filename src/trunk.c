@@ -19,6 +19,10 @@
 #include "util.h"
 #include "srq.h"
 
+#ifdef __AVX2__
+#   include <immintrin.h>
+#endif
+
 #include "poison.h"
 
 #define LATENCYHISTO_SIZE 15
@@ -94,6 +98,17 @@ static const int64 latency_histo_buckets[LATENCYHISTO_SIZE] = {
  */
 #define TRUNK_ROOT_LOCK_IDX 0
 
+/*
+ * Index of the trunk_root_lock batch rwlock guarding the range delete table.
+ */
+#define TRUNK_RANGE_DELETE_LOCK_IDX 1
+
+/*
+ * Index of the trunk_root_lock batch rwlock pinning the log, see
+ * trunk_log_pin.
+ */
+#define TRUNK_LOG_LOCK_IDX 2
+
 /*
  * During Splinter configuration, the fanout parameter is provided by the user.
  * SplinterDB defers internal node splitting in order to use hand-over-hand
@@ -105,6 +120,19 @@ static const int64 latency_histo_buckets[LATENCYHISTO_SIZE] = {
 
 #define TRUNK_INVALID_PIVOT_NO (UINT16_MAX)
 
+/*
+ * trunk_split_range splits on the pivots of the highest level that has at
+ * least this many pivots per requested partition, so that it can balance the
+ * partitions' sizes.
+ */
+#define TRUNK_SPLIT_RANGE_OVERSAMPLE (4)
+
+/*
+ * How often inserts sample the number of branches in the root for the write
+ * throttle.
+ */
+#define TRUNK_WRITE_THROTTLE_SAMPLE_NS (MILLION)
+
 /*
  * Trunk logging functions.
  *
@@ -449,16 +477,34 @@ trunk_log_node_if_enabled(platform_stream_handle *stream,
 typedef struct ONDISK trunk_super_block {
    uint64 root_addr; // Address of the root of the trunk for the instance
                      // referenced by this superblock.
-   uint64      next_node_id;
-   uint64      meta_tail;
-   uint64      log_addr;
-   uint64      log_meta_addr;
-   uint64      timestamp;
-   bool32      checkpointed;
-   bool32      unmounted;
-   checksum128 checksum;
+   uint64                   next_node_id;
+   uint64                   meta_tail;
+   uint64                   log_addr;
+   uint64                   log_meta_addr;
+   uint64                   log_magic;
+   // the log a checkpoint in progress switched to, 0 if none
+   uint64                   next_log_addr;
+   uint64                   next_log_meta_addr;
+   uint64                   next_log_magic;
+   uint64                   timestamp;
+   bool32                   checkpointed;
+   bool32                   unmounted;
+   uint64                   next_generation; // next mount's generation_base
+   bool32                   filters_keyed_on_prefix; // see data_config
+   trunk_range_delete_table range_deletes;
+   checksum128              checksum;
 } trunk_super_block;
 
+/*
+ * What a checkpoint super block describes, see trunk_checkpoint.
+ */
+typedef struct trunk_checkpoint_state {
+   uint64                   root_addr;
+   uint64                   meta_tail;
+   uint64                   next_generation; // first one root_addr lacks
+   trunk_range_delete_table range_deletes;   // those logged to older logs
+} trunk_checkpoint_state;
+
 /*
  * A subbundle is a collection of branches which originated in the same node.
  * It is used to organize branches with their routing filters when they are
@@ -543,6 +589,10 @@ typedef struct ONDISK trunk_hdr {
    uint16 start_sb_filter;   // first subbundle filter
    uint16 end_sb_filter;     // successor to the last sb filter
 
+   // normalized images of the pivot keys, see trunk_find_pivot()
+   uint16 num_pivot_prefixes; // == num_pivot_keys when up to date
+   uint64 pivot_prefix[TRUNK_MAX_PIVOTS];
+
    trunk_bundle    bundle[TRUNK_MAX_BUNDLES];
    trunk_subbundle subbundle[TRUNK_MAX_SUBBUNDLES];
    routing_filter  sb_filter[TRUNK_MAX_SUBBUNDLE_FILTERS];
@@ -626,9 +676,17 @@ trunk_node_lock(cache *cc, trunk_node *node)
 }
 
 static inline void
-trunk_node_unlock(cache *cc, trunk_node *node)
+trunk_update_pivot_prefixes(trunk_handle *spl, trunk_node *node);
+
+/*
+ * Writers modify nodes under the lock, so the pivot prefixes are brought up
+ * to date as they release it.
+ */
+static inline void
+trunk_node_unlock(trunk_handle *spl, trunk_node *node)
 {
-   cache_unlock(cc, node->page);
+   trunk_update_pivot_prefixes(spl, node);
+   cache_unlock(spl->cc, node->page);
 }
 
 static inline void
@@ -747,10 +805,48 @@ typedef bool32 (*node_fn)(trunk_handle *spl, uint64 addr, void *arg);
 typedef struct {
    trunk_btree_skiperator skip_itor[TRUNK_RANGE_ITOR_MAX_BRANCHES];
    iterator              *itor_arr[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   uint64                 itor_generation[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   trunk_branch           branch[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   uint32                 live_pivots[TRUNK_RANGE_ITOR_MAX_BRANCHES];
    uint64                 num_saved_pivot_keys;
    key_buffer             saved_pivot_keys[TRUNK_MAX_PIVOTS];
+   trunk_range_delete_set range_deletes;
 } compact_bundle_scratch;
 
+_Static_assert(TRUNK_MAX_PIVOTS <= 32, "live_pivots must fit TRUNK_MAX_PIVOTS");
+
+/*
+ * A compaction split into key sub-ranges, which are merged concurrently and
+ * packed as runs of one branch, see trunk_compact_bundle_pack_subranges().
+ *
+ * Tasks claim the sub-ranges nobody has started. Each enqueued task holds a
+ * reference, so that a task which only runs once the compaction has packed
+ * every sub-range itself finds them all claimed, rather than freed memory.
+ * The compaction waits on done_cv for num_done to reach num_subranges.
+ */
+typedef enum trunk_subrange_state {
+   TRUNK_SUBRANGE_PENDING = 0,
+   TRUNK_SUBRANGE_RUNNING,
+   TRUNK_SUBRANGE_DONE,
+} trunk_subrange_state;
+
+typedef struct trunk_compact_subranges {
+   trunk_handle           *spl;
+   compact_bundle_scratch *scratch; // of the compaction: branches, pivots...
+   uint16                  num_branches;
+   uint16                  height;
+   merge_behavior          merge_mode;
+   uint64                  num_subranges;
+   key_buffer              bound[BTREE_PACK_MAX_RUNS + 1];
+   btree_pack_req         *pack_req; // of the output branch
+   btree_pack_req          run[BTREE_PACK_MAX_RUNS];
+   platform_status         rc[BTREE_PACK_MAX_RUNS];
+   volatile uint64         state[BTREE_PACK_MAX_RUNS];
+   volatile uint64         refcount;
+   platform_condvar        done_cv;
+   uint64                  num_done; // protected by done_cv
+} trunk_compact_subranges;
+
 // Used by trunk_split_leaf()
 typedef struct {
    key_buffer     pivot[TRUNK_MAX_PIVOTS];
@@ -826,6 +922,7 @@ static inline void                 trunk_inc_intersection          (trunk_handle
 void                               trunk_memtable_flush_virtual    (void *arg, uint64 generation);
 platform_status                    trunk_memtable_insert           (trunk_handle *spl, key tuple_key, message data);
 void                               trunk_bundle_build_filters      (void *arg, void *scratch);
+static void                        trunk_bundle_build_filters_task (void *arg, void *scratch);
 
 #define trunk_inc_filter(spl, filter)                     \
         trunk_inc_filter_ref((spl), (filter), __LINE__)
@@ -834,6 +931,7 @@ static inline void                 trunk_inc_filter_ref            (trunk_handle
 
 static inline void                 trunk_dec_filter                (trunk_handle *spl, routing_filter *filter);
 void                               trunk_compact_bundle            (void *arg, void *scratch);
+static void                        trunk_compact_bundle_task       (void *arg, void *scratch);
 platform_status                    trunk_flush                     (trunk_handle *spl, trunk_node *parent, trunk_pivot_data *pdata, bool32 is_space_rec);
 platform_status                    trunk_flush_fullest             (trunk_handle *spl, trunk_node *node);
 static inline bool32                 trunk_needs_split               (trunk_handle *spl, trunk_node *node);
@@ -844,7 +942,7 @@ void                               trunk_print                     (platform_log
 void                               trunk_print_node                (platform_log_handle *log_handle, trunk_handle *spl, uint64 addr);
 static void                        trunk_print_pivots              (platform_log_handle *log_handle, trunk_handle *spl, trunk_node *node);
 static void                        trunk_print_branches_and_bundles(platform_log_handle *log_handle, trunk_handle *spl, trunk_node *node);
-static void                        trunk_btree_skiperator_init     (trunk_handle *spl, trunk_btree_skiperator *skip_itor, trunk_node *node, uint16 branch_idx, key_buffer pivots[static TRUNK_MAX_PIVOTS]);
+static void                        trunk_btree_skiperator_init     (trunk_handle *spl, trunk_btree_skiperator *skip_itor, compact_bundle_scratch *scratch, uint16 branch_offset, key min_key, key max_key);
 void                               trunk_btree_skiperator_curr     (iterator *itor, key *curr_key, message *data);
 platform_status                    trunk_btree_skiperator_next     (iterator *itor);
 bool32                             trunk_btree_skiperator_can_prev (iterator *itor);
@@ -853,6 +951,7 @@ void                               trunk_btree_skiperator_print    (iterator *it
 void                               trunk_btree_skiperator_deinit   (trunk_handle *spl, trunk_btree_skiperator *skip_itor);
 bool32                             trunk_verify_node               (trunk_handle *spl, trunk_node *node);
 void                               trunk_maybe_reclaim_space       (trunk_handle *spl);
+bool32                             trunk_node_destroy              (trunk_handle *spl, uint64 addr, void *arg);
 // clang-format on
 
 const static iterator_ops trunk_btree_skiperator_ops = {
@@ -869,6 +968,17 @@ trunk_data_config(trunk_handle *spl)
    return spl->cfg.data_cfg;
 }
 
+/*
+ * With a prefix extractor, routing filters are keyed on key prefixes. The
+ * filters on disk only work with the setting they were built with, so it is
+ * kept in the super block.
+ */
+static inline bool32
+trunk_filters_keyed_on_prefix(trunk_handle *spl)
+{
+   return spl->cfg.data_cfg->key_prefix != NULL;
+}
+
 static inline uint64
 trunk_page_size(const trunk_config *cfg)
 {
@@ -887,6 +997,13 @@ trunk_pages_per_extent(const trunk_config *cfg)
    return cache_config_pages_per_extent(cfg->cache_cfg);
 }
 
+// per-thread state, e.g. the stats, is sized by the task system's limit
+static inline uint64
+trunk_max_threads(trunk_handle *spl)
+{
+   return task_system_get_max_threads(spl->ts);
+}
+
 static inline uint16
 trunk_tree_height(trunk_handle *spl)
 {
@@ -897,22 +1014,210 @@ trunk_tree_height(trunk_handle *spl)
    return tree_height;
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * Range delete table
+ *
+ * A range delete hides every key in [start, end) from the memtables and
+ * branches whose generation is less than the range delete's. Memtable
+ * generations are made absolute by adding generation_base; a branch carries
+ * the newest generation merged into it.
+ *
+ * Readers of spl->range_deletes hold TRUNK_RANGE_DELETE_LOCK_IDX of
+ * trunk_root_lock shared, writers hold it exclusively.
+ *-----------------------------------------------------------------------------
+ */
+typedef struct ONDISK trunk_range_delete_hdr {
+   uint64 generation;
+   uint16 start_length;
+   uint16 end_length;
+   uint8  key_data[]; // start key followed by end key
+} trunk_range_delete_hdr;
+
+static inline uint64
+trunk_absolute_generation(trunk_handle *spl, uint64 mt_gen)
+{
+   return spl->generation_base + mt_gen;
+}
+
+/*
+ * Log entries are ordered by the absolute generation of their memtable, and
+ * within it by the generation of the memtable leaf they were inserted into,
+ * which orders the messages of any one key.
+ */
+#define TRUNK_LOG_LEAF_GENERATION_BITS (32)
+
+static inline uint64
+trunk_log_generation(trunk_handle *spl, uint64 mt_gen, uint64 leaf_generation)
+{
+   debug_assert(leaf_generation < (1ULL << TRUNK_LOG_LEAF_GENERATION_BITS));
+   return (trunk_absolute_generation(spl, mt_gen)
+           << TRUNK_LOG_LEAF_GENERATION_BITS)
+          | leaf_generation;
+}
+
+static inline uint64
+trunk_log_generation_to_absolute(uint64 log_generation)
+{
+   return log_generation >> TRUNK_LOG_LEAF_GENERATION_BITS;
+}
+
+static inline void
+trunk_range_deletes_get(trunk_handle *spl)
+{
+   platform_batch_rwlock_get(&spl->trunk_root_lock,
+                             TRUNK_RANGE_DELETE_LOCK_IDX);
+}
+
+static inline void
+trunk_range_deletes_unget(trunk_handle *spl)
+{
+   platform_batch_rwlock_unget(&spl->trunk_root_lock,
+                               TRUNK_RANGE_DELETE_LOCK_IDX);
+}
+
+static inline void
+trunk_range_deletes_lock(trunk_handle *spl)
+{
+   platform_batch_rwlock_get(&spl->trunk_root_lock,
+                             TRUNK_RANGE_DELETE_LOCK_IDX);
+   platform_batch_rwlock_claim_loop(&spl->trunk_root_lock,
+                                    TRUNK_RANGE_DELETE_LOCK_IDX);
+   platform_batch_rwlock_lock(&spl->trunk_root_lock,
+                              TRUNK_RANGE_DELETE_LOCK_IDX);
+}
+
+static inline void
+trunk_range_deletes_unlock(trunk_handle *spl)
+{
+   platform_batch_rwlock_full_unlock(&spl->trunk_root_lock,
+                                     TRUNK_RANGE_DELETE_LOCK_IDX);
+}
+
+static inline trunk_range_delete_hdr *
+trunk_range_delete_at(const trunk_range_delete_table *table, uint32 offset)
+{
+   return (trunk_range_delete_hdr *)&table->data[offset];
+}
+
+static inline uint32
+trunk_range_delete_size(const trunk_range_delete_hdr *range_delete)
+{
+   return sizeof(*range_delete) + range_delete->start_length
+          + range_delete->end_length;
+}
+
+static inline key
+trunk_range_delete_start(const trunk_range_delete_hdr *range_delete)
+{
+   return key_create(range_delete->start_length, range_delete->key_data);
+}
+
+static inline key
+trunk_range_delete_end(const trunk_range_delete_hdr *range_delete)
+{
+   return key_create(range_delete->end_length,
+                     range_delete->key_data + range_delete->start_length);
+}
+
+/*
+ * Returns the generation below which target is range deleted, 0 if no range
+ * delete in table covers it.
+ */
+static uint64
+trunk_range_delete_table_min_generation(trunk_handle                   *spl,
+                                        const trunk_range_delete_table *table,
+                                        key                             target)
+{
+   data_config *data_cfg       = spl->cfg.data_cfg;
+   uint64       min_generation = 0;
+   uint32       offset         = 0;
+   for (uint32 i = 0; i < table->num_range_deletes; i++) {
+      trunk_range_delete_hdr *range_delete =
+         trunk_range_delete_at(table, offset);
+      offset += trunk_range_delete_size(range_delete);
+      if (range_delete->generation <= min_generation) {
+         continue;
+      }
+      key start_key = trunk_range_delete_start(range_delete);
+      key end_key   = trunk_range_delete_end(range_delete);
+      if (data_key_compare(data_cfg, start_key, target) <= 0
+          && data_key_compare(data_cfg, target, end_key) < 0)
+      {
+         min_generation = range_delete->generation;
+      }
+   }
+   return min_generation;
+}
+
+/*
+ * trunk_range_delete_table_min_generation for the live table.
+ */
+static uint64
+trunk_range_delete_min_generation(trunk_handle *spl, key target)
+{
+   if (spl->range_deletes.num_range_deletes == 0) {
+      return 0;
+   }
+   trunk_range_deletes_get(spl);
+   uint64 min_generation =
+      trunk_range_delete_table_min_generation(spl, &spl->range_deletes, target);
+   trunk_range_deletes_unget(spl);
+   return min_generation;
+}
+
+/*
+ * Copies table into set and decodes it for merge iterators.
+ */
+static void
+trunk_range_delete_set_copy(trunk_range_delete_set         *set,
+                            const trunk_range_delete_table *table)
+{
+   set->table.num_range_deletes = table->num_range_deletes;
+   set->table.num_bytes         = table->num_bytes;
+   memmove(set->table.data, table->data, table->num_bytes);
+
+   uint32 offset = 0;
+   for (uint32 i = 0; i < set->table.num_range_deletes; i++) {
+      trunk_range_delete_hdr *range_delete =
+         trunk_range_delete_at(&set->table, offset);
+      offset += trunk_range_delete_size(range_delete);
+      set->range_delete[i] = (merge_range_delete){
+         .start      = trunk_range_delete_start(range_delete),
+         .end        = trunk_range_delete_end(range_delete),
+         .generation = range_delete->generation,
+      };
+   }
+}
+
+/*
+ * trunk_range_delete_set_copy of the live table.
+ */
+static void
+trunk_range_delete_set_copy_live(trunk_handle *spl, trunk_range_delete_set *set)
+{
+   if (spl->range_deletes.num_range_deletes == 0) {
+      set->table.num_range_deletes = 0;
+      set->table.num_bytes         = 0;
+      return;
+   }
+   trunk_range_deletes_get(spl);
+   trunk_range_delete_set_copy(set, &spl->range_deletes);
+   trunk_range_deletes_unget(spl);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * Super block functions
  *-----------------------------------------------------------------------------
  */
-void
-trunk_set_super_block(trunk_handle *spl,
-                      bool32        is_checkpoint,
-                      bool32        is_unmount,
-                      bool32        is_create)
+static page_handle *
+trunk_super_block_lock(trunk_handle *spl, bool32 is_create)
 {
-   uint64             super_addr;
-   page_handle       *super_page;
-   trunk_super_block *super;
-   uint64             wait = 1;
-   platform_status    rc;
+   uint64          super_addr;
+   page_handle    *super_page;
+   uint64          wait = 1;
+   platform_status rc;
 
    if (is_create) {
       rc = allocator_alloc_super_addr(spl->al, spl->id, &super_addr);
@@ -925,46 +1230,97 @@ trunk_set_super_block(trunk_handle *spl,
       platform_sleep_ns(wait);
       wait *= 2;
    }
-   wait = 1;
    cache_lock(spl->cc, super_page);
+   return super_page;
+}
+
+static void
+trunk_super_block_unlock_and_write(trunk_handle *spl, page_handle *super_page)
+{
+   trunk_super_block *super = (trunk_super_block *)super_page->data;
+   super->checksum =
+      platform_checksum128(super,
+                           sizeof(trunk_super_block) - sizeof(checksum128),
+                           TRUNK_SUPER_CSUM_SEED);
 
-   super               = (trunk_super_block *)super_page->data;
-   super->root_addr    = spl->root_addr;
+   cache_mark_dirty(spl->cc, super_page);
+   cache_unlock(spl->cc, super_page);
+   cache_unclaim(spl->cc, super_page);
+   cache_unget(spl->cc, super_page);
+   cache_page_sync(spl->cc, super_page, TRUE, PAGE_TYPE_SUPERBLOCK);
+}
+
+void
+trunk_set_super_block(trunk_handle                 *spl,
+                      const trunk_checkpoint_state *checkpoint,
+                      bool32                        is_unmount,
+                      bool32                        is_create)
+{
+   page_handle       *super_page = trunk_super_block_lock(spl, is_create);
+   trunk_super_block *super      = (trunk_super_block *)super_page->data;
+   if (checkpoint != NULL) {
+      super->root_addr       = checkpoint->root_addr;
+      super->meta_tail       = checkpoint->meta_tail;
+      super->next_generation = checkpoint->next_generation;
+      super->range_deletes   = checkpoint->range_deletes;
+   } else {
+      super->root_addr       = spl->root_addr;
+      super->meta_tail       = mini_meta_tail(&spl->mini);
+      super->next_generation = spl->generation_base;
+      trunk_range_deletes_get(spl);
+      super->range_deletes = spl->range_deletes;
+      trunk_range_deletes_unget(spl);
+   }
    super->next_node_id = spl->next_node_id;
-   super->meta_tail    = mini_meta_tail(&spl->mini);
    if (spl->cfg.use_log) {
       if (spl->log) {
          super->log_addr      = log_addr(spl->log);
          super->log_meta_addr = log_meta_addr(spl->log);
+         super->log_magic     = log_magic(spl->log);
       } else {
          super->log_addr      = 0;
          super->log_meta_addr = 0;
+         super->log_magic     = 0;
       }
    }
-   super->timestamp    = platform_get_real_time();
-   super->checkpointed = is_checkpoint;
-   super->unmounted    = is_unmount;
-   super->checksum =
-      platform_checksum128(super,
-                           sizeof(trunk_super_block) - sizeof(checksum128),
-                           TRUNK_SUPER_CSUM_SEED);
+   super->next_log_addr           = 0;
+   super->next_log_meta_addr      = 0;
+   super->next_log_magic          = 0;
+   super->timestamp               = platform_get_real_time();
+   super->checkpointed            = checkpoint != NULL;
+   super->unmounted               = is_unmount;
+   super->filters_keyed_on_prefix = trunk_filters_keyed_on_prefix(spl);
+   trunk_super_block_unlock_and_write(spl, super_page);
+}
 
-   cache_mark_dirty(spl->cc, super_page);
-   cache_unlock(spl->cc, super_page);
-   cache_unclaim(spl->cc, super_page);
-   cache_unget(spl->cc, super_page);
-   cache_page_sync(spl->cc, super_page, TRUE, PAGE_TYPE_SUPERBLOCK);
+/*
+ * Adds the log a checkpoint is about to switch to to the super block, so
+ * that a crash before the checkpoint writes its own super block replays the
+ * writes acknowledged from that log too.
+ */
+static void
+trunk_set_super_block_next_log(trunk_handle *spl, log_handle *log)
+{
+   page_handle       *super_page = trunk_super_block_lock(spl, FALSE);
+   trunk_super_block *super      = (trunk_super_block *)super_page->data;
+   super->next_log_addr          = log_addr(log);
+   super->next_log_meta_addr     = log_meta_addr(log);
+   super->next_log_magic         = log_magic(log);
+   trunk_super_block_unlock_and_write(spl, super_page);
 }
 
-trunk_super_block *
-trunk_get_super_block_if_valid(trunk_handle *spl, page_handle **super_page)
+static trunk_super_block *
+trunk_get_super_block_of(allocator        *al,
+                         cache            *cc,
+                         allocator_root_id id,
+                         page_handle     **super_page)
 {
    uint64             super_addr;
    trunk_super_block *super;
 
-   platform_status rc = allocator_get_super_addr(spl->al, spl->id, &super_addr);
+   platform_status rc = allocator_get_super_addr(al, id, &super_addr);
    platform_assert_status_ok(rc);
-   *super_page = cache_get(spl->cc, super_addr, TRUE, PAGE_TYPE_SUPERBLOCK);
+   *super_page = cache_get(cc, super_addr, TRUE, PAGE_TYPE_SUPERBLOCK);
    super       = (trunk_super_block *)(*super_page)->data;
 
    if (!platform_checksum_is_equal(
@@ -973,7 +1329,7 @@ trunk_get_super_block_if_valid(trunk_handle *spl, page_handle **super_page)
                                sizeof(trunk_super_block) - sizeof(checksum128),
                                TRUNK_SUPER_CSUM_SEED)))
    {
-      cache_unget(spl->cc, *super_page);
+      cache_unget(cc, *super_page);
       *super_page = NULL;
       return NULL;
    }
@@ -981,6 +1337,12 @@ trunk_get_super_block_if_valid(trunk_handle *spl, page_handle **super_page)
    return super;
 }
 
+trunk_super_block *
+trunk_get_super_block_if_valid(trunk_handle *spl, page_handle **super_page)
+{
+   return trunk_get_super_block_of(spl->al, spl->cc, spl->id, super_page);
+}
+
 void
 trunk_release_super_block(trunk_handle *spl, page_handle *super_page)
 {
@@ -1285,7 +1647,7 @@ trunk_update_claimed_root_and_unlock(trunk_handle *spl,    // IN
 {
    trunk_update_claimed_root(spl, new_root);
 
-   trunk_node_unlock(spl->cc, new_root);
+   trunk_node_unlock(spl, new_root);
    trunk_node_unclaim(spl->cc, new_root);
    trunk_node_unget(spl->cc, new_root);
 }
@@ -1324,7 +1686,7 @@ trunk_copy_path_by_key_and_height(trunk_handle *spl,      // IN
       trunk_node        child;
       trunk_copy_node_and_add_to_parent(spl, &node, pdata, &child);
       // Hold a writelock on the child
-      trunk_node_unlock(spl->cc, &node);
+      trunk_node_unlock(spl, &node);
       trunk_node_unclaim(spl->cc, &node);
       trunk_node_unget(spl->cc, &node);
       node = child;
@@ -1606,10 +1968,85 @@ trunk_update_lowerbound(uint16 *lo, uint16 *mid, int cmp, comparison comp)
    }
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * Pivot prefixes
+ *
+ *       If the data_config can normalize keys, trunk nodes keep the
+ *       normalized images of their pivot keys in an array in the header,
+ *       which find_pivot scans (with SIMD, where available) to narrow its
+ *       search to the pivots whose images equal that of the target. Only
+ *       those are compared with key_compare.
+ *-----------------------------------------------------------------------------
+ */
+static inline void
+trunk_update_pivot_prefixes(trunk_handle *spl, trunk_node *node)
+{
+   data_config *data_cfg       = spl->cfg.data_cfg;
+   uint16       num_pivot_keys = trunk_num_pivot_keys(spl, node);
+   if (data_cfg->key_normalize == NULL || num_pivot_keys > TRUNK_MAX_PIVOTS) {
+      node->hdr->num_pivot_prefixes = 0;
+      return;
+   }
+   for (uint16 pivot_no = 0; pivot_no < num_pivot_keys; pivot_no++) {
+      node->hdr->pivot_prefix[pivot_no] =
+         data_key_normalize(data_cfg, trunk_get_pivot(spl, node, pivot_no));
+   }
+   node->hdr->num_pivot_prefixes = num_pivot_keys;
+}
+
+static inline bool32
+trunk_has_pivot_prefixes(trunk_handle *spl, trunk_node *node)
+{
+   return spl->cfg.data_cfg->key_normalize != NULL
+          && node->hdr->num_pivot_prefixes == trunk_num_pivot_keys(spl, node);
+}
+
+/*
+ * Returns the number of the first num pivot prefixes of node which are less
+ * than target, or less than or equal to it if or_equal.
+ */
+static inline uint16
+trunk_count_pivot_prefixes(trunk_node *node,
+                           uint16      num,
+                           uint64      target,
+                           bool32      or_equal)
+{
+   const char *prefix_arr =
+      (const char *)node->hdr + offsetof(trunk_hdr, pivot_prefix);
+   uint16 count    = 0;
+   uint16 pivot_no = 0;
+#ifdef __AVX2__
+   // AVX2 only compares signed integers, so flip the sign bits
+   __m256i bias     = _mm256_set1_epi64x(INT64_MIN);
+   __m256i target_v = _mm256_xor_si256(_mm256_set1_epi64x(target), bias);
+   for (; pivot_no + 4 <= num; pivot_no += 4) {
+      __m256i prefix_v = _mm256_xor_si256(
+         _mm256_loadu_si256(
+            (const __m256i *)(prefix_arr + pivot_no * sizeof(uint64))),
+         bias);
+      __m256i mask = or_equal ? _mm256_cmpgt_epi64(prefix_v, target_v)
+                              : _mm256_cmpgt_epi64(target_v, prefix_v);
+      int bits = _mm256_movemask_pd(_mm256_castsi256_pd(mask));
+      count += or_equal ? 4 - __builtin_popcount(bits)
+                        : __builtin_popcount(bits);
+   }
+#endif
+   for (; pivot_no < num; pivot_no++) {
+      uint64 prefix;
+      memmove(&prefix, prefix_arr + pivot_no * sizeof(uint64), sizeof(prefix));
+      count += or_equal ? prefix <= target : prefix < target;
+   }
+   return count;
+}
+
 /*
  * find_pivot performs a binary search for the extremal pivot that satisfies
  * comp, e.g. if comp == greater_than, find_pivot finds the smallest pivot
  * which is greater than key. It returns the found pivot's index.
+ *
+ * If the node has pivot prefixes, the search only compares the pivots whose
+ * prefix equals that of the target.
  */
 static inline uint16
 trunk_find_pivot(trunk_handle *spl,
@@ -1648,17 +2085,38 @@ trunk_find_pivot(trunk_handle *spl,
       }
    }
 
-   // binary search for the pivot
-   mid_idx = size - (1u << (lowerbound(size) - 1));
-   size    = 1u << (lowerbound(size) - 1);
-   cmp = trunk_key_compare(spl, trunk_get_pivot(spl, node, mid_idx), target);
-   trunk_update_lowerbound(&lo_idx, &mid_idx, cmp, comp);
-
-   for (i = lowerbound(size); i != 0; i--) {
-      size /= 2;
-      mid_idx = lo_idx + size;
+   if (trunk_has_pivot_prefixes(spl, node)) {
+      // pivots in [0, lo) are less than target, and those in [hi, size)
+      // greater, so search [lo, hi) for the first pivot not satisfying comp
+      uint64 prefix = data_key_normalize(spl->cfg.data_cfg, target);
+      uint16 lo     = trunk_count_pivot_prefixes(node, size, prefix, FALSE);
+      uint16 hi     = trunk_count_pivot_prefixes(node, size, prefix, TRUE);
+      bool32 strict = comp == less_than || comp == greater_than_or_equal;
+      while (lo < hi) {
+         mid_idx = lo + (hi - lo) / 2;
+         cmp     = trunk_key_compare(
+            spl, trunk_get_pivot(spl, node, mid_idx), target);
+         if (strict ? cmp < 0 : cmp <= 0) {
+            lo = mid_idx + 1;
+         } else {
+            hi = mid_idx;
+         }
+      }
+      lo_idx = lo == 0 ? 0 : lo - 1;
+   } else {
+      // binary search for the pivot
+      mid_idx = size - (1u << (lowerbound(size) - 1));
+      size    = 1u << (lowerbound(size) - 1);
       cmp = trunk_key_compare(spl, trunk_get_pivot(spl, node, mid_idx), target);
       trunk_update_lowerbound(&lo_idx, &mid_idx, cmp, comp);
+
+      for (i = lowerbound(size); i != 0; i--) {
+         size /= 2;
+         mid_idx = lo_idx + size;
+         cmp     = trunk_key_compare(
+            spl, trunk_get_pivot(spl, node, mid_idx), target);
+         trunk_update_lowerbound(&lo_idx, &mid_idx, cmp, comp);
+      }
    }
 
    switch (comp) {
@@ -1868,9 +2326,21 @@ trunk_pivot_clear_counts(trunk_handle *spl, trunk_node *node, uint16 pivot_no)
    pdata->num_kv_bytes_bundle = 0;
 }
 
+/*
+ * Space reclamation compacts the pivots whose filters hold many more
+ * fingerprints than their estimated number of unique keys, i.e. which hold
+ * many stale versions of keys. Filters keyed on key prefixes have the same
+ * fingerprint for every key with a prefix, so the estimate would count
+ * prefixes rather than keys and flag every pivot: such a trunk gives up space
+ * reclamation, and stale versions are only dropped by the compactions that
+ * flushes trigger.
+ */
 static inline uint64
 trunk_pivot_tuples_to_reclaim(trunk_handle *spl, trunk_pivot_data *pdata)
 {
+   if (trunk_filters_keyed_on_prefix(spl)) {
+      return 0;
+   }
    uint64 tuples_in_pivot = pdata->filter.num_fingerprints;
    uint64 est_unique_tuples =
       routing_filter_estimate_unique_keys(&pdata->filter, &spl->cfg.filter_cfg);
@@ -2489,9 +2959,11 @@ trunk_leaf_rebundle_all_branches(trunk_handle *spl,
       srq_print(&spl->srq);
       pdata->srq_idx = -1;
    }
-   pdata->generation        = trunk_inc_pivot_generation(spl, node);
-   pdata->num_tuples_bundle = bundle->num_tuples;
-   pdata->num_tuples_whole  = 0;
+   pdata->generation          = trunk_inc_pivot_generation(spl, node);
+   pdata->num_tuples_bundle   = bundle->num_tuples;
+   pdata->num_tuples_whole    = 0;
+   pdata->num_kv_bytes_bundle = bundle->num_kv_bytes;
+   pdata->num_kv_bytes_whole  = 0;
    return bundle_no;
 }
 
@@ -2865,7 +3337,7 @@ trunk_garbage_collect_node_get(trunk_handle             *spl,
       // Here is where we would deallocate the trunk node
       trunk_node_claim(spl->cc, &child);
       trunk_node_lock(spl->cc, &child);
-      trunk_node_unlock(spl->cc, &node);
+      trunk_node_unlock(spl, &node);
       trunk_node_unclaim(spl->cc, &node);
       trunk_node_unget(spl->cc, &node);
       node = child;
@@ -2920,7 +3392,7 @@ trunk_garbage_collect_bundle(trunk_handle             *spl,
       }
    }
 
-   trunk_node_unlock(spl->cc, &node);
+   trunk_node_unlock(spl, &node);
    trunk_node_unclaim(spl->cc, &node);
    trunk_node_unget(spl->cc, &node);
 }
@@ -3151,6 +3623,83 @@ trunk_inc_branch_range(trunk_handle *spl,
    }
 }
 
+/*
+ * A branch range or filter whose reference is dropped while a snapshot takes
+ * its references, see trunk_snapshot_create.
+ */
+typedef struct trunk_deferred_drop {
+   struct trunk_deferred_drop *next;
+   trunk_branch                branch; // root_addr == 0 for a filter
+   routing_filter              filter;
+   key_buffer                  start_key;
+   key_buffer                  end_key;
+} trunk_deferred_drop;
+
+static void
+trunk_snapshots_init(trunk_handle *spl)
+{
+   platform_status rc = platform_spinlock_init(
+      &spl->snapshot_lock, platform_get_module_id(), spl->heap_id);
+   platform_assert_status_ok(rc);
+   spl->num_snapshots      = 0;
+   spl->num_snapshot_walks = 0;
+   spl->deferred_drops     = NULL;
+}
+
+static void
+trunk_snapshots_deinit(trunk_handle *spl)
+{
+   debug_assert(spl->num_snapshot_walks == 0);
+   debug_assert(spl->deferred_drops == NULL);
+   platform_spinlock_destroy(&spl->snapshot_lock);
+}
+
+/*
+ * Queues the drop of the reference on [start_key, end_key) of branch, or on
+ * filter, if a snapshot is taking its references. Returns FALSE if the caller
+ * must drop it now.
+ */
+static bool32
+trunk_defer_drop(trunk_handle   *spl,
+                 trunk_branch   *branch,
+                 routing_filter *filter,
+                 key             start_key,
+                 key             end_key)
+{
+   if (spl->num_snapshot_walks == 0) {
+      return FALSE;
+   }
+   trunk_deferred_drop *drop = TYPED_ZALLOC(spl->heap_id, drop);
+   platform_assert(drop != NULL);
+   key_buffer_init(&drop->start_key, spl->heap_id);
+   key_buffer_init(&drop->end_key, spl->heap_id);
+   if (branch != NULL) {
+      platform_status rc;
+      drop->branch = *branch;
+      rc           = key_buffer_copy_key(&drop->start_key, start_key);
+      platform_assert_status_ok(rc);
+      rc = key_buffer_copy_key(&drop->end_key, end_key);
+      platform_assert_status_ok(rc);
+   } else {
+      drop->filter = *filter;
+   }
+
+   platform_spin_lock(&spl->snapshot_lock);
+   bool32 deferred = spl->num_snapshot_walks != 0;
+   if (deferred) {
+      drop->next          = spl->deferred_drops;
+      spl->deferred_drops = drop;
+   }
+   platform_spin_unlock(&spl->snapshot_lock);
+
+   if (!deferred) {
+      key_buffer_deinit(&drop->start_key);
+      key_buffer_deinit(&drop->end_key);
+      platform_free(spl->heap_id, drop);
+   }
+   return deferred;
+}
+
 static inline void
 trunk_zap_branch_range(trunk_handle *spl,
                        trunk_branch *branch,
@@ -3162,6 +3711,9 @@ trunk_zap_branch_range(trunk_handle *spl,
    platform_assert((key_is_null(start_key) && key_is_null(end_key))
                    || (type != PAGE_TYPE_MEMTABLE && !key_is_null(start_key)));
    platform_assert(branch->root_addr != 0, "root_addr=%lu", branch->root_addr);
+   if (trunk_defer_drop(spl, branch, NULL, start_key, end_key)) {
+      return;
+   }
    btree_dec_ref_range(
       spl->cc, &spl->cfg.btree_cfg, branch->root_addr, start_key, end_key);
 }
@@ -3218,20 +3770,303 @@ trunk_btree_lookup_and_merge(trunk_handle      *spl,
    return rc;
 }
 
+static void
+trunk_held_table_init(trunk_handle *spl)
+{
+   trunk_held_table *held = &spl->held;
+   platform_status   rc   = platform_spinlock_init(
+      &held->branch_lock, platform_get_module_id(), spl->heap_id);
+   platform_assert_status_ok(rc);
+   for (uint64 branch_no = 0; branch_no < TRUNK_HELD_BRANCHES; branch_no++) {
+      key_buffer_init(&held->branch[branch_no].start_key, spl->heap_id);
+      key_buffer_init(&held->branch[branch_no].end_key, spl->heap_id);
+   }
+   for (uint64 slot_no = 0; slot_no < TRUNK_HELD_PAGES; slot_no++) {
+      rc = platform_spinlock_init(
+         &held->page[slot_no].lock, platform_get_module_id(), spl->heap_id);
+      platform_assert_status_ok(rc);
+   }
+}
 
-/*
- *-----------------------------------------------------------------------------
- * trunk_btree_lookup_async
- *
- * Pre-conditions:
- *    The ctxt should've been initialized using
- *    btree_ctxt_init(). If *found `data` has the most
- *    recent answer. the current memtable is older than the most
- *    recent answer
- *
- *    The return value can be either of:
- *      async_locked: A page needed by lookup is locked. User should retry
- *      request.
+static void
+trunk_held_table_deinit(trunk_handle *spl)
+{
+   trunk_held_table *held = &spl->held;
+   platform_spinlock_destroy(&held->branch_lock);
+   for (uint64 branch_no = 0; branch_no < TRUNK_HELD_BRANCHES; branch_no++) {
+      debug_assert(held->branch[branch_no].root_addr == 0);
+      key_buffer_deinit(&held->branch[branch_no].start_key);
+      key_buffer_deinit(&held->branch[branch_no].end_key);
+   }
+   for (uint64 slot_no = 0; slot_no < TRUNK_HELD_PAGES; slot_no++) {
+      debug_assert(held->page[slot_no].page == NULL);
+      platform_spinlock_destroy(&held->page[slot_no].lock);
+   }
+}
+
+/*
+ * Adds a holder to a held branch entry of the branch rooted at root_addr
+ * whose range covers target, adding one over the range of target's pivot in
+ * node if there is none. Returns the entry's number, or TRUNK_HELD_BRANCHES
+ * if every entry is in use. *is_new is set when the entry was added, in which
+ * case the caller must take the entry's reference on the branch.
+ */
+static uint32
+trunk_held_branch_get(trunk_handle *spl,
+                      trunk_node   *node,
+                      uint64        root_addr,
+                      key           target,
+                      bool32       *is_new)
+{
+   trunk_held_table *held    = &spl->held;
+   uint32            free_no = TRUNK_HELD_BRANCHES;
+   *is_new                   = FALSE;
+   platform_spin_lock(&held->branch_lock);
+   for (uint32 branch_no = 0; branch_no < TRUNK_HELD_BRANCHES; branch_no++) {
+      trunk_held_branch *entry = &held->branch[branch_no];
+      if (entry->root_addr == 0) {
+         free_no = free_no == TRUNK_HELD_BRANCHES ? branch_no : free_no;
+      } else if (entry->root_addr == root_addr && entry->holders != 0
+                 && trunk_key_compare(
+                       spl, key_buffer_key(&entry->start_key), target)
+                       <= 0
+                 && trunk_key_compare(
+                       spl, target, key_buffer_key(&entry->end_key))
+                       < 0)
+      {
+         entry->holders++;
+         platform_spin_unlock(&held->branch_lock);
+         return branch_no;
+      }
+   }
+   if (free_no != TRUNK_HELD_BRANCHES) {
+      uint16 pivot_no = trunk_find_pivot(spl, node, target, less_than_or_equal);
+      key    start_key = trunk_get_pivot(spl, node, pivot_no);
+      key    end_key   = trunk_get_pivot(spl, node, pivot_no + 1);
+
+      trunk_held_branch *entry = &held->branch[free_no];
+      if (SUCCESS(key_buffer_copy_key(&entry->start_key, start_key))
+          && SUCCESS(key_buffer_copy_key(&entry->end_key, end_key)))
+      {
+         entry->root_addr = root_addr;
+         entry->holders   = 1;
+         *is_new          = TRUE;
+      } else {
+         free_no = TRUNK_HELD_BRANCHES;
+      }
+   }
+   platform_spin_unlock(&held->branch_lock);
+   return free_no;
+}
+
+static void
+trunk_held_branch_release(trunk_handle *spl, trunk_held_branch *entry)
+{
+   trunk_branch branch = {.root_addr = entry->root_addr};
+   trunk_zap_branch_range(spl,
+                          &branch,
+                          key_buffer_key(&entry->start_key),
+                          key_buffer_key(&entry->end_key),
+                          PAGE_TYPE_BRANCH);
+   platform_spin_lock(&spl->held.branch_lock);
+   entry->root_addr = 0;
+   platform_spin_unlock(&spl->held.branch_lock);
+}
+
+typedef struct trunk_held_branch_release_args {
+   trunk_handle      *spl;
+   trunk_held_branch *entry;
+} trunk_held_branch_release_args;
+
+static void
+trunk_held_branch_release_task(void *arg, void *scratch)
+{
+   trunk_held_branch_release_args *args = arg;
+   trunk_held_branch_release(args->spl, args->entry);
+   platform_free(args->spl->heap_id, args);
+}
+
+/*
+ * Removes a holder from held branch entry branch_no. The last one drops the
+ * entry's reference on the branch and then frees the entry.
+ */
+static void
+trunk_held_branch_put(trunk_handle *spl, uint32 branch_no)
+{
+   trunk_held_table  *held  = &spl->held;
+   trunk_held_branch *entry = &held->branch[branch_no];
+   platform_spin_lock(&held->branch_lock);
+   debug_assert(entry->holders != 0);
+   entry->holders--;
+   bool32 is_last = entry->holders == 0;
+   platform_spin_unlock(&held->branch_lock);
+   if (!is_last) {
+      return;
+   }
+
+   /*
+    * Dropping the reference waits for the iterators blocking dec_refs of the
+    * branch, see mini_keyed_dec_ref, and this thread may have one open, so it
+    * is left to a task.
+    */
+   trunk_held_branch_release_args *args = TYPED_MALLOC(spl->heap_id, args);
+   if (args != NULL) {
+      args->spl          = spl;
+      args->entry        = entry;
+      platform_status rc = task_enqueue(spl->ts,
+                                        TASK_TYPE_NORMAL,
+                                        trunk_held_branch_release_task,
+                                        args,
+                                        FALSE);
+      if (SUCCESS(rc)) {
+         return;
+      }
+      platform_free(spl->heap_id, args);
+   }
+   trunk_held_branch_release(spl, entry);
+}
+
+/*
+ * Holds page, which the caller has read locked, for ref. The page is a leaf
+ * holding target of the branch rooted at root_addr, which was found in node.
+ * Returns FALSE if it cannot be held, see trunk_held_table.
+ */
+static bool32
+trunk_hold_page(trunk_handle     *spl,
+                trunk_node       *node,
+                uint64            root_addr,
+                key               target,
+                page_handle      *page,
+                trunk_lookup_ref *ref)
+{
+   uint64 slot_no =
+      page->disk_addr / cache_page_size(spl->cc) % TRUNK_HELD_PAGES;
+   trunk_held_page *slot       = &spl->held.page[slot_no];
+   bool32           new_branch = FALSE;
+   uint32           branch_no  = TRUNK_HELD_BRANCHES;
+   platform_spin_lock(&slot->lock);
+   if (slot->page == NULL) {
+      branch_no =
+         trunk_held_branch_get(spl, node, root_addr, target, &new_branch);
+      if (branch_no != TRUNK_HELD_BRANCHES) {
+         // the read lock keeps the page from being evicted before the pin
+         cache_pin(spl->cc, page);
+         slot->page      = page;
+         slot->holders   = 0;
+         slot->branch_no = branch_no;
+      }
+   }
+   bool32 held = slot->page == page;
+   if (held) {
+      slot->holders++;
+   }
+   platform_spin_unlock(&slot->lock);
+
+   if (new_branch) {
+      // the branch is live while the caller holds node
+      trunk_held_branch *entry  = &spl->held.branch[branch_no];
+      trunk_branch       branch = {.root_addr = root_addr};
+      trunk_inc_branch_range(spl,
+                             &branch,
+                             key_buffer_key(&entry->start_key),
+                             key_buffer_key(&entry->end_key));
+   }
+   if (held) {
+      ref->spl     = spl;
+      ref->slot_no = slot_no;
+   }
+   return held;
+}
+
+void
+trunk_lookup_ref_release(trunk_lookup_ref *ref)
+{
+   if (!trunk_lookup_ref_held(ref)) {
+      return;
+   }
+   trunk_handle    *spl       = ref->spl;
+   trunk_held_page *slot      = &spl->held.page[ref->slot_no];
+   uint32           branch_no = TRUNK_HELD_BRANCHES;
+   platform_spin_lock(&slot->lock);
+   debug_assert(slot->holders != 0);
+   slot->holders--;
+   if (slot->holders == 0) {
+      cache_unpin(spl->cc, slot->page);
+      slot->page = NULL;
+      branch_no  = slot->branch_no;
+   }
+   platform_spin_unlock(&slot->lock);
+   if (branch_no != TRUNK_HELD_BRANCHES) {
+      trunk_held_branch_put(spl, branch_no);
+   }
+   ZERO_CONTENTS(ref);
+}
+
+/*
+ * trunk_btree_lookup_and_merge_with_ref is trunk_btree_lookup_and_merge for
+ * lookups which can take a reference to the value. Must be called with node,
+ * the trunk node holding branch, read locked, so branch is still live.
+ *
+ * If ref is not NULL and data holds no answer yet, an INSERT found in the
+ * branch is left in place, held by ref through the held table, and data stays
+ * null. If the table has no room for its page, the value is copied instead.
+ * Anything else is merged into data as usual.
+ */
+static inline platform_status
+trunk_btree_lookup_and_merge_with_ref(trunk_handle      *spl,
+                                      trunk_node        *node,
+                                      trunk_branch      *branch,
+                                      key                target,
+                                      merge_accumulator *data,
+                                      trunk_lookup_ref  *ref,
+                                      bool32            *local_found)
+{
+   if (ref == NULL || !merge_accumulator_is_null(data)) {
+      return trunk_btree_lookup_and_merge(
+         spl, branch, target, data, local_found);
+   }
+
+   cache        *cc  = spl->cc;
+   btree_config *cfg = &spl->cfg.btree_cfg;
+   btree_node    leaf;
+   message       msg;
+   btree_lookup_with_ref(cc,
+                         cfg,
+                         branch->root_addr,
+                         PAGE_TYPE_BRANCH,
+                         target,
+                         &leaf,
+                         &msg,
+                         local_found);
+   if (!*local_found) {
+      return STATUS_OK;
+   }
+   if (message_class(msg) == MESSAGE_TYPE_INSERT
+       && trunk_hold_page(spl, node, branch->root_addr, target, leaf.page, ref))
+   {
+      ref->msg = msg;
+      btree_node_unget(cc, cfg, &leaf);
+      return STATUS_OK;
+   }
+   bool32 success = merge_accumulator_copy_message(data, msg);
+   btree_node_unget(cc, cfg, &leaf);
+   return success ? STATUS_OK : STATUS_NO_MEMORY;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ * trunk_btree_lookup_async
+ *
+ * Pre-conditions:
+ *    The ctxt should've been initialized using
+ *    btree_ctxt_init(). If *found `data` has the most
+ *    recent answer. the current memtable is older than the most
+ *    recent answer
+ *
+ *    The return value can be either of:
+ *      async_locked: A page needed by lookup is locked. User should retry
+ *      request.
  *      async_no_reqs: A page needed by lookup is not in cache and the IO
  *      subsystem is out of requests. User should throttle.
  *      async_io_started: Async IO was started to read a page needed by the
@@ -3380,19 +4215,87 @@ trunk_memtable_iterator_deinit(trunk_handle   *spl,
  *    lock_acquired if the current memtable is full and this thread is
  *       responsible for flushing it.
  */
-platform_status
-trunk_memtable_insert(trunk_handle *spl, key tuple_key, message msg)
+static platform_status
+trunk_memtable_begin_insert(trunk_handle *spl, uint64 *generation)
 {
-   uint64 generation;
-
    platform_status rc =
-      memtable_maybe_rotate_and_begin_insert(spl->mt_ctxt, &generation);
+      memtable_maybe_rotate_and_begin_insert(spl->mt_ctxt, generation);
+   if (!STATUS_IS_EQ(rc, STATUS_BUSY)) {
+      return rc;
+   }
+
+   timestamp stall_start = platform_get_timestamp();
    while (STATUS_IS_EQ(rc, STATUS_BUSY)) {
       // Memtable isn't ready, do a task if available; may be required to
       // incorporate memtable that we're waiting on
       task_perform_one_if_needed(spl->ts, 0);
-      rc = memtable_maybe_rotate_and_begin_insert(spl->mt_ctxt, &generation);
+      rc = memtable_maybe_rotate_and_begin_insert(spl->mt_ctxt, generation);
+   }
+   if (spl->cfg.use_stats) {
+      const threadid tid = platform_get_tid();
+      spl->stats[tid].write_stalls++;
+      spl->stats[tid].write_stall_time_ns +=
+         platform_timestamp_elapsed(stall_start);
+   }
+   return rc;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Log writes
+ *
+ *      trunk_checkpoint switches to a new log while inserts are blocked, so
+ *      spl->log does not change while the insert lock is held. Writers sync
+ *      the log only once they have released the insert lock, so until then
+ *      they pin the log they wrote to, and a checkpoint waits for them
+ *      before it releases the old log.
+ *-----------------------------------------------------------------------------
+ */
+static inline log_handle *
+trunk_log_pin(trunk_handle *spl)
+{
+   log_handle *log = spl->log;
+   if (log != NULL) {
+      platform_batch_rwlock_get(&spl->trunk_root_lock, TRUNK_LOG_LOCK_IDX);
+   }
+   return log;
+}
+
+static inline bool32
+trunk_log_is_full(trunk_handle *spl, log_handle *log)
+{
+   return log != NULL && spl->cfg.checkpoint_log_size != 0
+          && spl->cfg.checkpoint_log_size <= log_size(log);
+}
+
+static void
+trunk_checkpoint_if_log_is_full(trunk_handle *spl);
+
+/*
+ * Syncs log and unpins it. Once the log has grown past checkpoint_log_size,
+ * the thread then checkpoints, which truncates the log.
+ */
+static inline void
+trunk_log_sync_and_unpin(trunk_handle *spl, log_handle *log)
+{
+   if (log == NULL) {
+      return;
    }
+   log_sync(log);
+   bool32 is_full = trunk_log_is_full(spl, log);
+   platform_batch_rwlock_unget(&spl->trunk_root_lock, TRUNK_LOG_LOCK_IDX);
+   if (is_full) {
+      trunk_checkpoint_if_log_is_full(spl);
+   }
+}
+
+platform_status
+trunk_memtable_insert(trunk_handle *spl, key tuple_key, message msg)
+{
+   uint64      generation;
+   log_handle *log = NULL;
+
+   platform_status rc = trunk_memtable_begin_insert(spl, &generation);
    if (!SUCCESS(rc)) {
       goto out;
    }
@@ -3406,15 +4309,23 @@ trunk_memtable_insert(trunk_handle *spl, key tuple_key, message msg)
       goto unlock_insert_lock;
    }
 
-   if (spl->cfg.use_log) {
-      int crappy_rc = log_write(spl->log, tuple_key, msg, leaf_generation);
+   if (spl->log != NULL) {
+      int crappy_rc =
+         log_write(spl->log,
+                   tuple_key,
+                   msg,
+                   trunk_log_generation(spl, generation, leaf_generation));
       if (crappy_rc != 0) {
+         rc = STATUS_IO_ERROR;
          goto unlock_insert_lock;
       }
    }
 
 unlock_insert_lock:
+   log = trunk_log_pin(spl);
    memtable_end_insert(spl->mt_ctxt);
+   // wait for the log outside the insert lock, so rotation is not held up
+   trunk_log_sync_and_unpin(spl, log);
 out:
    return rc;
 }
@@ -3484,7 +4395,8 @@ trunk_memtable_compact_and_build_filter(trunk_handle  *spl,
    }
    trunk_memtable_iterator_deinit(spl, &btree_itor, FALSE, FALSE);
 
-   new_branch->root_addr = req.root_addr;
+   new_branch->root_addr  = req.root_addr;
+   new_branch->generation = trunk_absolute_generation(spl, generation);
 
    platform_assert(req.num_tuples > 0);
    uint64 filter_build_start;
@@ -3748,7 +4660,7 @@ trunk_memtable_incorporate_and_flush(trunk_handle  *spl,
       req->bundle_no);
    trunk_close_log_stream_if_enabled(spl, &stream);
    task_enqueue(
-      spl->ts, TASK_TYPE_NORMAL, trunk_bundle_build_filters, req, TRUE);
+      spl->ts, TASK_TYPE_NORMAL, trunk_bundle_build_filters_task, req, TRUE);
 
    /*
     * Decrement the now-incorporated memtable ref count and recycle if no
@@ -3910,7 +4822,9 @@ trunk_inc_filter_ref(trunk_handle *spl, routing_filter *filter, uint32 lineno)
 static inline void
 trunk_dec_filter(trunk_handle *spl, routing_filter *filter)
 {
-   if (filter->addr == 0) {
+   if (filter->addr == 0
+       || trunk_defer_drop(spl, NULL, filter, NULL_KEY, NULL_KEY))
+   {
       return;
    }
    cache *cc = spl->cc;
@@ -4223,7 +5137,7 @@ trunk_garbage_collect_filters(trunk_handle             *spl,
       debug_assert(pdata->generation < req->max_pivot_generation);
       trunk_dec_filter(spl, &pdata->filter);
    }
-   trunk_node_unlock(spl->cc, &node);
+   trunk_node_unlock(spl, &node);
    trunk_node_unclaim(spl->cc, &node);
    trunk_node_unget(spl->cc, &node);
 }
@@ -4273,7 +5187,7 @@ trunk_bundle_build_filters(void *arg, void *scratch)
       if (trunk_build_filter_should_reenqueue(compact_req, &node)) {
          task_enqueue(spl->ts,
                       TASK_TYPE_NORMAL,
-                      trunk_bundle_build_filters,
+                      trunk_bundle_build_filters_task,
                       compact_req,
                       FALSE);
          trunk_log_stream_if_enabled(
@@ -4305,7 +5219,7 @@ trunk_bundle_build_filters(void *arg, void *scratch)
             trunk_log_stream_if_enabled(
                spl, &stream, "replace_filter abort leaf split\n");
             trunk_root_full_unclaim(spl);
-            trunk_node_unlock(spl->cc, &node);
+            trunk_node_unlock(spl, &node);
             trunk_node_unclaim(spl->cc, &node);
             trunk_node_unget(spl->cc, &node);
             for (uint64 pos = 0; pos < TRUNK_MAX_PIVOTS; pos++) {
@@ -4323,7 +5237,7 @@ trunk_bundle_build_filters(void *arg, void *scratch)
             trunk_clear_bundle(spl, &node, compact_req->bundle_no);
          }
 
-         trunk_node_unlock(spl->cc, &node);
+         trunk_node_unlock(spl, &node);
          trunk_node_unclaim(spl->cc, &node);
          debug_assert(trunk_verify_node(spl, &node));
 
@@ -4412,6 +5326,40 @@ out:
    return;
 }
 
+/*
+ * Task functions of filter builds and compactions. Their I/O is throttled as
+ * background I/O, and their reads are probationary. They wait for the I/O
+ * limit before they start, while they hold no locks. The request may be
+ * freed by the time they return.
+ */
+static void
+trunk_bundle_build_filters_task(void *arg, void *scratch)
+{
+   trunk_compact_bundle_req *compact_req      = arg;
+   cache                    *cc               = compact_req->spl->cc;
+   bool32                    was_throttled    = cache_throttle_io(cc, TRUE);
+   bool32                    was_probationary =
+      cache_read_probationary(cc, TRUE);
+   cache_io_limit_wait(cc);
+   trunk_bundle_build_filters(arg, scratch);
+   cache_read_probationary(cc, was_probationary);
+   cache_throttle_io(cc, was_throttled);
+}
+
+static void
+trunk_compact_bundle_task(void *arg, void *scratch)
+{
+   trunk_compact_bundle_req *req              = arg;
+   cache                    *cc               = req->spl->cc;
+   bool32                    was_throttled    = cache_throttle_io(cc, TRUE);
+   bool32                    was_probationary =
+      cache_read_probationary(cc, TRUE);
+   cache_io_limit_wait(cc);
+   trunk_compact_bundle(arg, scratch);
+   cache_read_probationary(cc, was_probationary);
+   cache_throttle_io(cc, was_throttled);
+}
+
 static cache_async_result
 trunk_filter_lookup_async(trunk_handle       *spl,
                           routing_config     *cfg,
@@ -4619,7 +5567,7 @@ trunk_compact_bundle_enqueue(trunk_handle             *spl,
    key end_key   = key_buffer_key(&req->end_key);
    platform_assert(trunk_key_compare(spl, start_key, end_key) < 0);
    return task_enqueue(
-      spl->ts, TASK_TYPE_NORMAL, trunk_compact_bundle, req, FALSE);
+      spl->ts, TASK_TYPE_NORMAL, trunk_compact_bundle_task, req, FALSE);
 }
 
 /*
@@ -4716,7 +5664,7 @@ trunk_flush(trunk_handle     *spl,
       trunk_flush_fullest(spl, &new_child);
    }
 
-   trunk_node_unlock(spl->cc, &new_child);
+   trunk_node_unlock(spl, &new_child);
    trunk_node_unclaim(spl->cc, &new_child);
    trunk_node_unget(spl->cc, &new_child);
 
@@ -4885,55 +5833,128 @@ trunk_branch_iterator_deinit(trunk_handle   *spl,
  *       an iterator which can skip over tuples in branches which aren't live
  *-----------------------------------------------------------------------------
  */
+
+/*
+ * Returns a bitmask of the pivots of node for which the branch is live.
+ */
+static uint32
+trunk_branch_live_pivots(trunk_handle *spl, trunk_node *node, uint16 branch_no)
+{
+   uint32 live_pivots  = 0;
+   uint16 num_children = trunk_num_children(spl, node);
+   debug_assert(
+      (num_children < TRUNK_MAX_PIVOTS), "num_children = %d", num_children);
+   for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
+      if (trunk_branch_live_for_pivot(spl, node, branch_no, pivot_no)) {
+         live_pivots |= 1U << pivot_no;
+      }
+   }
+   return live_pivots;
+}
+
+/*
+ * Finds the next run of consecutive live pivots [*start, *end) at or after
+ * *end. Returns FALSE if there are none.
+ */
+static bool32
+trunk_next_live_pivots(uint32  live_pivots,
+                       uint64  num_children,
+                       uint16 *start,
+                       uint16 *end)
+{
+   uint16 pivot_no = *end;
+   while (pivot_no < num_children && !(live_pivots & (1U << pivot_no))) {
+      pivot_no++;
+   }
+   if (pivot_no == num_children) {
+      return FALSE;
+   }
+   *start = pivot_no;
+   while (pivot_no < num_children && (live_pivots & (1U << pivot_no))) {
+      pivot_no++;
+   }
+   *end = pivot_no;
+   return TRUE;
+}
+
+/*
+ * Takes (or drops) references on the ranges of the branches of a compaction
+ * which are live, so that they outlive its iterators.
+ */
+static void
+trunk_compact_bundle_inc_ref(trunk_handle           *spl,
+                             compact_bundle_scratch *scratch,
+                             uint16                  num_branches,
+                             bool32                  inc)
+{
+   uint64      num_children = scratch->num_saved_pivot_keys - 1;
+   key_buffer *pivots       = scratch->saved_pivot_keys;
+   for (uint16 branch_offset = 0; branch_offset < num_branches; branch_offset++)
+   {
+      uint64 root_addr   = scratch->branch[branch_offset].root_addr;
+      uint32 live_pivots = scratch->live_pivots[branch_offset];
+      uint16 start = 0, end = 0;
+      while (root_addr != 0
+             && trunk_next_live_pivots(live_pivots, num_children, &start, &end))
+      {
+         key min_key = key_buffer_key(&pivots[start]);
+         key max_key = key_buffer_key(&pivots[end]);
+         if (inc) {
+            btree_inc_ref_range(
+               spl->cc, &spl->cfg.btree_cfg, root_addr, min_key, max_key);
+         } else {
+            btree_dec_ref_range(
+               spl->cc, &spl->cfg.btree_cfg, root_addr, min_key, max_key);
+         }
+      }
+   }
+}
+
+/*
+ * Initializes a skiperator over the tuples of a branch of the compaction in
+ * scratch within [min_key, max_key), which are live. The compaction holds the
+ * references on the branch.
+ */
 static void
 trunk_btree_skiperator_init(trunk_handle           *spl,
                             trunk_btree_skiperator *skip_itor,
-                            trunk_node             *node,
-                            uint16                  branch_idx,
-                            key_buffer pivots[static TRUNK_MAX_PIVOTS])
+                            compact_bundle_scratch *scratch,
+                            uint16                  branch_offset,
+                            key                     min_key,
+                            key                     max_key)
 {
    ZERO_CONTENTS(skip_itor);
    skip_itor->super.ops = &trunk_btree_skiperator_ops;
-   uint16 min_pivot_no  = 0;
-   uint16 max_pivot_no  = trunk_num_children(spl, node);
-   debug_assert(
-      (max_pivot_no < TRUNK_MAX_PIVOTS), "max_pivot_no = %d", max_pivot_no);
-
-   key min_key       = key_buffer_key(&pivots[min_pivot_no]);
-   key max_key       = key_buffer_key(&pivots[max_pivot_no]);
-   skip_itor->branch = *trunk_get_branch(spl, node, branch_idx);
-
-   uint16 first_pivot      = 0;
-   bool32 iterator_started = FALSE;
-
-   for (uint16 i = min_pivot_no; i < max_pivot_no + 1; i++) {
-      bool32 branch_valid =
-         i == max_pivot_no
-            ? FALSE
-            : trunk_branch_live_for_pivot(spl, node, branch_idx, i);
-      if (branch_valid && !iterator_started) {
-         first_pivot      = i;
-         iterator_started = TRUE;
-      }
-      if (!branch_valid && iterator_started) {
-         // create a new btree iterator
-         key pivot_min_key = first_pivot == min_pivot_no
-                                ? min_key
-                                : key_buffer_key(&pivots[first_pivot]);
-         key pivot_max_key =
-            i == max_pivot_no ? max_key : key_buffer_key(&pivots[i]);
-         btree_iterator *btree_itor = &skip_itor->itor[skip_itor->end++];
-         trunk_branch_iterator_init(spl,
-                                    btree_itor,
-                                    &skip_itor->branch,
-                                    pivot_min_key,
-                                    pivot_max_key,
-                                    pivot_min_key,
-                                    greater_than_or_equal,
-                                    TRUE,
-                                    TRUE);
-         iterator_started = FALSE;
+   skip_itor->branch    = scratch->branch[branch_offset];
+
+   uint64      num_children = scratch->num_saved_pivot_keys - 1;
+   key_buffer *pivots       = scratch->saved_pivot_keys;
+   uint16      start = 0, end = 0;
+   while (trunk_next_live_pivots(
+      scratch->live_pivots[branch_offset], num_children, &start, &end))
+   {
+      // create a new btree iterator for the live pivots within the range
+      key pivot_min_key = key_buffer_key(&pivots[start]);
+      key pivot_max_key = key_buffer_key(&pivots[end]);
+      if (trunk_key_compare(spl, pivot_min_key, min_key) < 0) {
+         pivot_min_key = min_key;
+      }
+      if (trunk_key_compare(spl, max_key, pivot_max_key) < 0) {
+         pivot_max_key = max_key;
       }
+      if (trunk_key_compare(spl, pivot_min_key, pivot_max_key) >= 0) {
+         continue;
+      }
+      btree_iterator *btree_itor = &skip_itor->itor[skip_itor->end++];
+      trunk_branch_iterator_init(spl,
+                                 btree_itor,
+                                 &skip_itor->branch,
+                                 pivot_min_key,
+                                 pivot_max_key,
+                                 pivot_min_key,
+                                 greater_than_or_equal,
+                                 TRUE,
+                                 FALSE);
    }
 
    bool32 at_end;
@@ -5018,7 +6039,7 @@ trunk_btree_skiperator_deinit(trunk_handle           *spl,
                               trunk_btree_skiperator *skip_itor)
 {
    for (uint64 i = 0; i < skip_itor->end; i++) {
-      trunk_branch_iterator_deinit(spl, &skip_itor->itor[i], TRUE);
+      trunk_branch_iterator_deinit(spl, &skip_itor->itor[i], FALSE);
    }
 }
 
@@ -5062,66 +6083,538 @@ trunk_compact_bundle_cleanup_iterators(trunk_handle           *spl,
 }
 
 /*
- * compact_bundle compacts a bundle of flushed branches into a single branch
- *
- * See "Interactions between Concurrent Processes"
- * (numbering here mirrors that section)
- *
- * Interacts with splitting in two ways:
- * 4. Internal node split occurs between job issue and this compact_bundle call:
- *    the bundle was split too, issue compact_bundle on the new siblings
- * 6. Leaf split occurs before this call or during compaction:
- *    the bundle will be compacted as part of the split, so this compaction is
- *    aborted if split occurred before this call or discarded if it occurred
- *    during compaction.
- *
- * Node splits are determined using generation numbers (in trunk_hdr)
- *   internal: generation number of left node is incremented on split
- *      -- given generation number g of a node, all the nodes it split
- *         into can be found by searching right until a node with
- *         generation number g is found
- *   leaf: generation numbers of all leaves affected by split are
- *         incremented
- *      -- can tell if a leaf has split by checking if generation number
- *         has changed
+ *-----------------------------------------------------------------------------
+ * Compaction sub-ranges
  *
- * Algorithm:
- * 1.  Acquire node read lock
- * 2.  If the node has split before this call (interaction 4), this
- *     bundle exists in the new split siblings, so issue compact_bundles
- *     for those nodes
- * 3.  Abort if node is a leaf and started splitting (interaction 6)
- * 4.  The bundle may have been completely flushed by step 2, if so abort
- * 5.  Build iterators
- * 6.  Release read lock
- * 7.  Perform compaction
- * 8.  Build filter
- * 9. Clean up
- * 10. Reacquire read lock
- * 11. For each newly split sibling replace bundle with new branch unless
- *        a. node if leaf which has split, in which case discard (interaction 6)
- *        b. node is internal and bundle has been flushed
+ *       A compaction of a large bundle is split into sub-ranges with similar
+ *       amounts of live tuples. Their merges run concurrently, on the
+ *       compacting thread and on normal background tasks, and each packs a
+ *       run of leaves of the output branch, see btree_pack_runs_start(). The
+ *       output is still a single branch, which the routing filters of the
+ *       node require.
+ *-----------------------------------------------------------------------------
  */
-void
-trunk_compact_bundle(void *arg, void *scratch_buf)
+
+/*
+ * Compactions of bundles with fewer bytes of live tuples per sub-range than
+ * this are not split.
+ */
+#define TRUNK_COMPACTION_SUBRANGE_MIN_KV_BYTES (1 * MiB)
+
+/*
+ * Returns the number of sub-ranges worth splitting the compaction in scratch
+ * into, and estimates the bytes of its live tuples in kv_bytes.
+ */
+static uint64
+trunk_compact_bundle_num_subranges(trunk_handle           *spl,
+                                   compact_bundle_scratch *scratch,
+                                   uint16                  num_branches,
+                                   uint64                 *kv_bytes)
 {
-   platform_status           rc;
-   trunk_compact_bundle_req *req          = arg;
-   trunk_task_scratch       *task_scratch = scratch_buf;
-   compact_bundle_scratch   *scratch      = &task_scratch->compact_bundle;
-   trunk_handle             *spl          = req->spl;
-   threadid                  tid;
-   key                       start_key = key_buffer_key(&req->start_key);
-   key                       end_key   = key_buffer_key(&req->end_key);
+   uint64      num_children = scratch->num_saved_pivot_keys - 1;
+   key_buffer *pivots       = scratch->saved_pivot_keys;
+
+   *kv_bytes = 0;
+   for (uint16 branch_offset = 0; branch_offset < num_branches; branch_offset++)
+   {
+      uint16 start = 0, end = 0;
+      while (trunk_next_live_pivots(
+         scratch->live_pivots[branch_offset], num_children, &start, &end))
+      {
+         btree_pivot_stats stats;
+         btree_count_in_range(spl->cc,
+                              &spl->cfg.btree_cfg,
+                              scratch->branch[branch_offset].root_addr,
+                              key_buffer_key(&pivots[start]),
+                              key_buffer_key(&pivots[end]),
+                              &stats);
+         *kv_bytes += stats.key_bytes + stats.message_bytes;
+      }
+   }
+
+   uint64 num_subranges =
+      MIN(spl->cfg.max_compaction_subranges, BTREE_PACK_MAX_RUNS);
+   num_subranges =
+      MIN(num_subranges, *kv_bytes / TRUNK_COMPACTION_SUBRANGE_MIN_KV_BYTES);
+   return MAX(num_subranges, 1);
+}
+
+/*
+ * Chooses the bounds of sr->num_subranges sub-ranges of the compaction, using
+ * a rough merge iterator (see trunk_split_leaf()) on the live ranges of its
+ * branches. Fewer sub-ranges may result, e.g. if the branches have few
+ * leaves.
+ */
+static void
+trunk_compact_bundle_split_range(trunk_compact_subranges *sr, uint64 kv_bytes)
+{
+   trunk_handle           *spl           = sr->spl;
+   compact_bundle_scratch *scratch       = sr->scratch;
+   uint64                  num_children  = scratch->num_saved_pivot_keys - 1;
+   key_buffer             *pivots        = scratch->saved_pivot_keys;
+   uint64                  num_subranges = sr->num_subranges;
+
+   key_buffer_init_from_key(
+      &sr->bound[0], spl->heap_id, key_buffer_key(&pivots[0]));
+   sr->num_subranges = 1;
 
    /*
-    * 1. Acquire node read lock
+    * 1. Create a rough merge iterator on the live ranges of the branches
     */
-   trunk_node node;
-   trunk_node_get(spl->cc, req->addr, &node);
+   uint64 num_ranges = 0;
+   for (uint16 branch_offset = 0; branch_offset < sr->num_branches;
+        branch_offset++)
+   {
+      num_ranges += platform_popcount(scratch->live_pivots[branch_offset]);
+   }
+   btree_iterator *rough_btree_itor = NULL;
+   iterator      **rough_itor       = NULL;
+   if (num_ranges <= MAX_MERGE_ARITY) {
+      rough_btree_itor =
+         TYPED_ARRAY_MALLOC(spl->heap_id, rough_btree_itor, num_ranges);
+      rough_itor = TYPED_ARRAY_MALLOC(spl->heap_id, rough_itor, num_ranges);
+   }
+   if (rough_btree_itor == NULL || rough_itor == NULL) {
+      goto out;
+   }
 
-   // timers for stats if enabled
-   uint64 compaction_start, pack_start;
+   num_ranges = 0;
+   for (uint16 branch_offset = 0; branch_offset < sr->num_branches;
+        branch_offset++)
+   {
+      uint16 start = 0, end = 0;
+      while (trunk_next_live_pivots(
+         scratch->live_pivots[branch_offset], num_children, &start, &end))
+      {
+         key min_key = key_buffer_key(&pivots[start]);
+         key max_key = key_buffer_key(&pivots[end]);
+         btree_iterator_init(spl->cc,
+                             &spl->cfg.btree_cfg,
+                             &rough_btree_itor[num_ranges],
+                             scratch->branch[branch_offset].root_addr,
+                             PAGE_TYPE_BRANCH,
+                             min_key,
+                             max_key,
+                             min_key,
+                             greater_than_or_equal,
+                             FALSE,
+                             1);
+         rough_itor[num_ranges] = &rough_btree_itor[num_ranges].super;
+         num_ranges++;
+      }
+   }
+
+   merge_iterator *rough_merge_itor;
+   platform_status rc = merge_iterator_create(spl->heap_id,
+                                              spl->cfg.data_cfg,
+                                              num_ranges,
+                                              rough_itor,
+                                              MERGE_RAW,
+                                              &rough_merge_itor);
+   platform_assert_status_ok(rc);
+
+   /*
+    * 2. Use it to choose the bounds, which must be increasing
+    */
+   uint64 rough_kv_bytes = 0;
+   while (sr->num_subranges < num_subranges
+          && iterator_can_next(&rough_merge_itor->super))
+   {
+      key     curr_key;
+      message pivot_data_message;
+      iterator_curr(&rough_merge_itor->super, &curr_key, &pivot_data_message);
+
+      key prev_bound = key_buffer_key(&sr->bound[sr->num_subranges - 1]);
+      if (rough_kv_bytes >= sr->num_subranges * kv_bytes / num_subranges
+          && trunk_key_compare(spl, prev_bound, curr_key) < 0)
+      {
+         key_buffer_init_from_key(
+            &sr->bound[sr->num_subranges], spl->heap_id, curr_key);
+         sr->num_subranges++;
+      }
+
+      const btree_pivot_data *pivot_data = message_data(pivot_data_message);
+      rough_kv_bytes +=
+         pivot_data->stats.key_bytes + pivot_data->stats.message_bytes;
+      rc = iterator_next(&rough_merge_itor->super);
+      platform_assert_status_ok(rc);
+   }
+
+   rc = merge_iterator_destroy(spl->heap_id, &rough_merge_itor);
+   platform_assert_status_ok(rc);
+   for (uint64 i = 0; i < num_ranges; i++) {
+      btree_iterator_deinit(&rough_btree_itor[i]);
+   }
+
+out:
+   if (rough_btree_itor != NULL) {
+      platform_free(spl->heap_id, rough_btree_itor);
+   }
+   if (rough_itor != NULL) {
+      platform_free(spl->heap_id, rough_itor);
+   }
+   key_buffer_init_from_key(&sr->bound[sr->num_subranges],
+                            spl->heap_id,
+                            key_buffer_key(&pivots[num_children]));
+}
+
+/*
+ * Merges the tuples of sub-range subrange_no and packs them as its run of
+ * the output branch, using the skiperators in scratch (which needn't be the
+ * scratch of the compaction).
+ */
+static void
+trunk_compact_subrange(trunk_compact_subranges *sr,
+                       uint64                   subrange_no,
+                       compact_bundle_scratch  *scratch)
+{
+   trunk_handle           *spl     = sr->spl;
+   compact_bundle_scratch *compact = sr->scratch;
+
+   key min_key = key_buffer_key(&sr->bound[subrange_no]);
+   key max_key = key_buffer_key(&sr->bound[subrange_no + 1]);
+
+   for (uint16 branch_offset = 0; branch_offset < sr->num_branches;
+        branch_offset++)
+   {
+      trunk_btree_skiperator_init(spl,
+                                  &scratch->skip_itor[branch_offset],
+                                  compact,
+                                  branch_offset,
+                                  min_key,
+                                  max_key);
+      scratch->itor_arr[branch_offset] =
+         &scratch->skip_itor[branch_offset].super;
+   }
+
+   merge_iterator *merge_itor;
+   platform_status rc = merge_iterator_create_for_compaction(
+      spl->heap_id,
+      spl->cfg.data_cfg,
+      sr->num_branches,
+      scratch->itor_arr,
+      compact->itor_generation,
+      compact->range_deletes.table.num_range_deletes,
+      compact->range_deletes.range_delete,
+      sr->merge_mode,
+      sr->height,
+      &merge_itor);
+   platform_assert_status_ok(rc);
+
+   btree_pack_req *run = &sr->run[subrange_no];
+   btree_pack_run_init(
+      run, sr->pack_req, subrange_no, &merge_itor->super, spl->heap_id);
+   sr->rc[subrange_no] = btree_pack(run);
+
+   trunk_compact_bundle_cleanup_iterators(
+      spl, &merge_itor, sr->num_branches, scratch->skip_itor);
+
+   bool32 success = __sync_bool_compare_and_swap(
+      &sr->state[subrange_no], TRUNK_SUBRANGE_RUNNING, TRUNK_SUBRANGE_DONE);
+   platform_assert(success);
+
+   platform_condvar_lock(&sr->done_cv);
+   sr->num_done++;
+   if (sr->num_done == sr->num_subranges) {
+      platform_condvar_broadcast(&sr->done_cv);
+   }
+   platform_condvar_unlock(&sr->done_cv);
+}
+
+/*
+ * Claims a sub-range nobody has started. Returns FALSE if there are none.
+ */
+static bool32
+trunk_compact_subranges_claim(trunk_compact_subranges *sr, uint64 *subrange_no)
+{
+   for (uint64 i = 0; i < sr->num_subranges; i++) {
+      if (sr->state[i] == TRUNK_SUBRANGE_PENDING
+          && __sync_bool_compare_and_swap(
+             &sr->state[i], TRUNK_SUBRANGE_PENDING, TRUNK_SUBRANGE_RUNNING))
+      {
+         *subrange_no = i;
+         return TRUE;
+      }
+   }
+   return FALSE;
+}
+
+static void
+trunk_compact_subranges_release(trunk_compact_subranges *sr)
+{
+   if (__sync_sub_and_fetch(&sr->refcount, 1) == 0) {
+      platform_condvar_destroy(&sr->done_cv);
+      platform_free(sr->spl->heap_id, sr);
+   }
+}
+
+/*
+ * Task function packing sub-ranges of a compaction. Its I/O is throttled as
+ * background I/O and its reads are probationary, like those of the
+ * compaction. It waits for the I/O limit before claiming each sub-range, so
+ * that the compacting thread can pack the rest meanwhile.
+ */
+static void
+trunk_compact_subranges_task(void *arg, void *scratch)
+{
+   trunk_compact_subranges *sr               = arg;
+   cache                   *cc               = sr->spl->cc;
+   bool32                   was_throttled    = cache_throttle_io(cc, TRUE);
+   bool32                   was_probationary =
+      cache_read_probationary(cc, TRUE);
+   trunk_task_scratch      *task_scratch     = scratch;
+   uint64                   subrange_no;
+   cache_io_limit_wait(cc);
+   while (trunk_compact_subranges_claim(sr, &subrange_no)) {
+      trunk_compact_subrange(sr, subrange_no, &task_scratch->compact_bundle);
+      cache_io_limit_wait(cc);
+   }
+   cache_read_probationary(cc, was_probationary);
+   cache_throttle_io(cc, was_throttled);
+   trunk_compact_subranges_release(sr);
+}
+
+/*
+ * Packs the output branch of the compaction from its sub-ranges. Background
+ * tasks pack some of them, and the compacting thread packs the rest, so the
+ * compaction never waits on tasks which haven't started, only on the ones
+ * still packing the sub-ranges they claimed.
+ */
+static platform_status
+trunk_compact_bundle_pack_subranges(trunk_compact_subranges *sr,
+                                    compact_bundle_scratch  *scratch)
+{
+   trunk_handle *spl = sr->spl;
+   btree_pack_runs_start(sr->pack_req, sr->num_subranges);
+
+   for (uint64 i = 1; i < sr->num_subranges; i++) {
+      __sync_fetch_and_add(&sr->refcount, 1);
+      platform_status rc = task_enqueue(
+         spl->ts, TASK_TYPE_NORMAL, trunk_compact_subranges_task, sr, FALSE);
+      if (!SUCCESS(rc)) {
+         __sync_fetch_and_sub(&sr->refcount, 1);
+         break;
+      }
+   }
+
+   uint64 subrange_no;
+   while (trunk_compact_subranges_claim(sr, &subrange_no)) {
+      trunk_compact_subrange(sr, subrange_no, scratch);
+   }
+
+   platform_condvar_lock(&sr->done_cv);
+   while (sr->num_done < sr->num_subranges) {
+      platform_condvar_wait(&sr->done_cv);
+   }
+   platform_condvar_unlock(&sr->done_cv);
+
+   platform_status rc = STATUS_OK;
+   for (uint64 i = 0; i < sr->num_subranges; i++) {
+      debug_assert(sr->state[i] == TRUNK_SUBRANGE_DONE);
+      if (!SUCCESS(sr->rc[i])) {
+         rc = sr->rc[i];
+      }
+   }
+
+   if (SUCCESS(rc)) {
+      rc = btree_pack_runs_finish(sr->pack_req, sr->run, sr->num_subranges);
+   } else {
+      btree_pack_runs_abort(sr->pack_req);
+   }
+   for (uint64 i = 0; i < sr->num_subranges; i++) {
+      btree_pack_run_deinit(&sr->run[i]);
+   }
+   return rc;
+}
+
+/*
+ * Packs the output branch of the compaction in scratch, splitting it into
+ * sub-ranges if it is large enough. Returns the number of sub-ranges in
+ * num_subranges.
+ */
+static platform_status
+trunk_compact_bundle_pack(trunk_handle           *spl,
+                          compact_bundle_scratch *scratch,
+                          uint16                  num_branches,
+                          merge_behavior          merge_mode,
+                          uint16                  height,
+                          btree_pack_req         *pack_req,
+                          uint64                 *num_subranges)
+{
+   platform_status rc;
+   key_buffer     *pivots = scratch->saved_pivot_keys;
+
+   key min_key = key_buffer_key(&pivots[0]);
+   key max_key = key_buffer_key(&pivots[scratch->num_saved_pivot_keys - 1]);
+
+   uint64 kv_bytes = 0;
+   *num_subranges  = 1;
+   if (spl->cfg.max_compaction_subranges > 1) {
+      *num_subranges = trunk_compact_bundle_num_subranges(
+         spl, scratch, num_branches, &kv_bytes);
+   }
+
+   trunk_compact_subranges *sr = NULL;
+   if (*num_subranges > 1) {
+      sr = TYPED_ZALLOC(spl->heap_id, sr);
+      if (sr != NULL) {
+         sr->spl           = spl;
+         sr->scratch       = scratch;
+         sr->num_branches  = num_branches;
+         sr->height        = height;
+         sr->merge_mode    = merge_mode;
+         sr->num_subranges = *num_subranges;
+         sr->refcount      = 1;
+         trunk_compact_bundle_split_range(sr, kv_bytes);
+         if (sr->num_subranges == 1
+             || !SUCCESS(platform_condvar_init(&sr->done_cv, spl->heap_id)))
+         {
+            for (uint64 i = 0; i <= sr->num_subranges; i++) {
+               key_buffer_deinit(&sr->bound[i]);
+            }
+            platform_free(spl->heap_id, sr);
+            sr = NULL;
+         }
+      }
+      *num_subranges = sr == NULL ? 1 : sr->num_subranges;
+   }
+
+   if (sr != NULL) {
+      rc = trunk_btree_pack_req_init(spl, NULL, pack_req);
+      if (!SUCCESS(rc)) {
+         platform_error_log("trunk_btree_pack_req_init failed: %s\n",
+                            platform_status_to_string(rc));
+      } else {
+         sr->pack_req = pack_req;
+         rc           = trunk_compact_bundle_pack_subranges(sr, scratch);
+         if (!SUCCESS(rc)) {
+            platform_default_log("btree_pack failed: %s\n",
+                                 platform_status_to_string(rc));
+            btree_pack_req_deinit(pack_req, spl->heap_id);
+         }
+      }
+      for (uint64 i = 0; i <= sr->num_subranges; i++) {
+         key_buffer_deinit(&sr->bound[i]);
+      }
+      trunk_compact_subranges_release(sr);
+      return rc;
+   }
+
+   trunk_btree_skiperator *skip_itor_arr = scratch->skip_itor;
+   iterator              **itor_arr      = scratch->itor_arr;
+   for (uint16 branch_offset = 0; branch_offset < num_branches;
+        branch_offset++)
+   {
+      trunk_btree_skiperator_init(spl,
+                                  &skip_itor_arr[branch_offset],
+                                  scratch,
+                                  branch_offset,
+                                  min_key,
+                                  max_key);
+      itor_arr[branch_offset] = &skip_itor_arr[branch_offset].super;
+   }
+
+   merge_iterator *merge_itor;
+   rc = merge_iterator_create_for_compaction(
+      spl->heap_id,
+      spl->cfg.data_cfg,
+      num_branches,
+      itor_arr,
+      scratch->itor_generation,
+      scratch->range_deletes.table.num_range_deletes,
+      scratch->range_deletes.range_delete,
+      merge_mode,
+      height,
+      &merge_itor);
+   platform_assert_status_ok(rc);
+   rc = trunk_btree_pack_req_init(spl, &merge_itor->super, pack_req);
+   if (!SUCCESS(rc)) {
+      platform_error_log("trunk_btree_pack_req_init failed: %s\n",
+                         platform_status_to_string(rc));
+   } else {
+      rc = btree_pack(pack_req);
+      if (!SUCCESS(rc)) {
+         platform_default_log("btree_pack failed: %s\n",
+                              platform_status_to_string(rc));
+         btree_pack_req_deinit(pack_req, spl->heap_id);
+      }
+   }
+   trunk_compact_bundle_cleanup_iterators(
+      spl, &merge_itor, num_branches, skip_itor_arr);
+   return rc;
+}
+
+/*
+ * compact_bundle compacts a bundle of flushed branches into a single branch
+ *
+ * See "Interactions between Concurrent Processes"
+ * (numbering here mirrors that section)
+ *
+ * Interacts with splitting in two ways:
+ * 4. Internal node split occurs between job issue and this compact_bundle call:
+ *    the bundle was split too, issue compact_bundle on the new siblings
+ * 6. Leaf split occurs before this call or during compaction:
+ *    the bundle will be compacted as part of the split, so this compaction is
+ *    aborted if split occurred before this call or discarded if it occurred
+ *    during compaction.
+ *
+ * Node splits are determined using generation numbers (in trunk_hdr)
+ *   internal: generation number of left node is incremented on split
+ *      -- given generation number g of a node, all the nodes it split
+ *         into can be found by searching right until a node with
+ *         generation number g is found
+ *   leaf: generation numbers of all leaves affected by split are
+ *         incremented
+ *      -- can tell if a leaf has split by checking if generation number
+ *         has changed
+ *
+ * Algorithm:
+ * 1.  Acquire node read lock
+ * 2.  If the node has split before this call (interaction 4), this
+ *     bundle exists in the new split siblings, so issue compact_bundles
+ *     for those nodes
+ * 3.  Abort if node is a leaf and started splitting (interaction 6)
+ * 4.  The bundle may have been completely flushed by step 2, if so abort
+ * 5.  Build iterators
+ * 6.  Release read lock
+ * 7.  Perform compaction
+ * 8.  Build filter
+ * 9. Clean up
+ * 10. Reacquire read lock
+ * 11. For each newly split sibling replace bundle with new branch unless
+ *        a. node if leaf which has split, in which case discard (interaction 6)
+ *        b. node is internal and bundle has been flushed
+ */
+void
+trunk_compact_bundle(void *arg, void *scratch_buf)
+{
+   platform_status           rc;
+   trunk_compact_bundle_req *req          = arg;
+   trunk_task_scratch       *task_scratch = scratch_buf;
+   compact_bundle_scratch   *scratch      = &task_scratch->compact_bundle;
+   trunk_handle             *spl          = req->spl;
+   threadid                  tid;
+   key                       start_key = key_buffer_key(&req->start_key);
+   key                       end_key   = key_buffer_key(&req->end_key);
+
+   /*
+    * 0. Copy the range deletes, so the compaction can drop the tuples they
+    *    cover. A range delete retired after this point is not needed: the
+    *    bundle read below has no branches it applies to. Those published
+    *    later have at least the generation of the current memtable.
+    */
+   uint64 current_generation =
+      trunk_absolute_generation(spl, memtable_generation(spl->mt_ctxt));
+   trunk_range_delete_set_copy_live(spl, &scratch->range_deletes);
+
+   /*
+    * 1. Acquire node read lock
+    */
+   trunk_node node;
+   trunk_node_get(spl->cc, req->addr, &node);
+
+   // timers for stats if enabled
+   uint64 compaction_start, pack_start;
    uint16 height = trunk_node_height(&node);
    if (spl->cfg.use_stats) {
       tid              = platform_get_tid();
@@ -5202,29 +6695,43 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
       req->bundle_no);
 
    /*
-    * 5. Build iterators
+    * 5. Save the branches and their live pivots, and take references on
+    *    their live ranges, so the merge can run without the lock
     */
    platform_assert(num_branches <= ARRAY_SIZE(scratch->skip_itor));
-   trunk_btree_skiperator *skip_itor_arr = scratch->skip_itor;
-   iterator              **itor_arr      = scratch->itor_arr;
 
    save_pivots_to_compact_bundle_scratch(spl, &node, scratch);
 
-   uint16 tree_offset = 0;
+   uint16 tree_offset       = 0;
+   uint64 output_generation = 0;
    for (uint16 branch_no = bundle_start_branch; branch_no != bundle_end_branch;
         branch_no        = trunk_add_branch_number(spl, branch_no, 1))
    {
       /*
        * We are iterating from oldest to newest branch
        */
-      trunk_btree_skiperator_init(spl,
-                                  &skip_itor_arr[tree_offset],
-                                  &node,
-                                  branch_no,
-                                  scratch->saved_pivot_keys);
-      itor_arr[tree_offset] = &skip_itor_arr[tree_offset].super;
+      scratch->branch[tree_offset] = *trunk_get_branch(spl, &node, branch_no);
+      scratch->live_pivots[tree_offset] =
+         trunk_branch_live_pivots(spl, &node, branch_no);
+      uint64 generation = scratch->branch[tree_offset].generation;
+      scratch->itor_generation[tree_offset] = generation;
+      output_generation = MAX(output_generation, generation);
       tree_offset++;
    }
+
+   /*
+    * The output holds nothing the copied range deletes cover, so it is as new
+    * as they are, which lets them retire. Those of the current memtable are
+    * left out, as a range delete published later may share their generation.
+    */
+   for (uint32 i = 0; i < scratch->range_deletes.table.num_range_deletes; i++)
+   {
+      uint64 generation = scratch->range_deletes.range_delete[i].generation;
+      if (generation < current_generation) {
+         output_generation = MAX(output_generation, generation);
+      }
+   }
+   trunk_compact_bundle_inc_ref(spl, scratch, num_branches, TRUE);
    trunk_log_node_if_enabled(&stream, spl, &node);
 
    /*
@@ -5235,37 +6742,22 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
    /*
     * 7. Perform compaction
     */
-   merge_iterator *merge_itor;
-   rc = merge_iterator_create(spl->heap_id,
-                              spl->cfg.data_cfg,
-                              num_branches,
-                              itor_arr,
-                              merge_mode,
-                              &merge_itor);
-   platform_assert_status_ok(rc);
-   btree_pack_req pack_req;
-   rc = trunk_btree_pack_req_init(spl, &merge_itor->super, &pack_req);
-   if (!SUCCESS(rc)) {
-      platform_error_log("trunk_btree_pack_req_init failed: %s\n",
-                         platform_status_to_string(rc));
-
-      trunk_compact_bundle_cleanup_iterators(
-         spl, &merge_itor, num_branches, skip_itor_arr);
-      platform_free(spl->heap_id, req);
-      goto out;
-   }
-   req->fp_arr = pack_req.fingerprint_arr;
    if (spl->cfg.use_stats) {
       pack_start = platform_get_timestamp();
    }
 
-   platform_status pack_status = btree_pack(&pack_req);
-   if (!SUCCESS(pack_status)) {
-      platform_default_log("btree_pack failed: %s\n",
-                           platform_status_to_string(pack_status));
-      trunk_compact_bundle_cleanup_iterators(
-         spl, &merge_itor, num_branches, skip_itor_arr);
-      btree_pack_req_deinit(&pack_req, spl->heap_id);
+   btree_pack_req pack_req;
+   uint64         num_subranges;
+   rc = trunk_compact_bundle_pack(spl,
+                                  scratch,
+                                  num_branches,
+                                  merge_mode,
+                                  height,
+                                  &pack_req,
+                                  &num_subranges);
+   trunk_compact_bundle_inc_ref(spl, scratch, num_branches, FALSE);
+   if (!SUCCESS(rc)) {
+      deinit_saved_pivots_in_scratch(scratch);
       platform_free(spl->heap_id, req);
       goto out;
    }
@@ -5273,10 +6765,15 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
    if (spl->cfg.use_stats) {
       spl->stats[tid].compaction_pack_time_ns[height] +=
          platform_timestamp_elapsed(pack_start);
+      if (num_subranges > 1) {
+         spl->stats[tid].compactions_parallel[height]++;
+         spl->stats[tid].compaction_subranges[height] += num_subranges;
+      }
    }
 
    trunk_branch new_branch;
    new_branch.root_addr     = pack_req.root_addr;
+   new_branch.generation    = output_generation;
    uint64 num_tuples        = pack_req.num_tuples;
    req->fp_arr              = pack_req.fingerprint_arr;
    pack_req.fingerprint_arr = NULL;
@@ -5298,9 +6795,6 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
    /*
     * 9. Clean up
     */
-   trunk_compact_bundle_cleanup_iterators(
-      spl, &merge_itor, num_branches, skip_itor_arr);
-
    deinit_saved_pivots_in_scratch(scratch);
 
    /*
@@ -5338,7 +6832,7 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
             spl->stats[tid].compaction_time_wasted_ns[height] +=
                platform_timestamp_elapsed(compaction_start);
          }
-         trunk_node_unlock(spl->cc, &node);
+         trunk_node_unlock(spl, &node);
          trunk_node_unclaim(spl->cc, &node);
          trunk_node_unget(spl->cc, &node);
 
@@ -5400,7 +6894,7 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
       }
 
       // only release locks on node after the garbage collection is complete
-      trunk_node_unlock(spl->cc, &node);
+      trunk_node_unlock(spl, &node);
       trunk_node_unclaim(spl->cc, &node);
       trunk_node_unget(spl->cc, &node);
    }
@@ -5446,7 +6940,7 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
          req->height,
          req->bundle_no);
       task_enqueue(
-         spl->ts, TASK_TYPE_NORMAL, trunk_bundle_build_filters, req, TRUE);
+         spl->ts, TASK_TYPE_NORMAL, trunk_bundle_build_filters_task, req, TRUE);
    }
 out:
    trunk_log_stream_if_enabled(spl, &stream, "\n");
@@ -5589,7 +7083,7 @@ trunk_split_index(trunk_handle             *spl,
       platform_assert_status_ok(rc);
    }
 
-   trunk_node_unlock(spl->cc, &right_node);
+   trunk_node_unlock(spl, &right_node);
    trunk_node_unclaim(spl->cc, &right_node);
    trunk_node_unget(spl->cc, &right_node);
 }
@@ -5699,8 +7193,8 @@ trunk_split_leaf(trunk_handle *spl,
    uint64              num_branches = trunk_branch_count(spl, leaf);
    uint64              start_branch = trunk_start_branch(spl, leaf);
 
-   trunk_node_unlock(spl->cc, parent);
-   trunk_node_unlock(spl->cc, leaf);
+   trunk_node_unlock(spl, parent);
+   trunk_node_unlock(spl, leaf);
 
    platform_stream_handle stream;
    platform_status        rc = trunk_open_log_stream_if_enabled(spl, &stream);
@@ -5715,9 +7209,11 @@ trunk_split_leaf(trunk_handle *spl,
    }
 
    trunk_pivot_data *pdata = trunk_get_pivot_data(spl, leaf, 0);
+   uint64            num_tuples = trunk_pivot_num_tuples(spl, leaf, 0);
    uint64            estimated_unique_keys =
-      trunk_pivot_estimate_unique_keys(spl, leaf, pdata);
-   uint64 num_tuples = trunk_pivot_num_tuples(spl, leaf, 0);
+      trunk_filters_keyed_on_prefix(spl)
+         ? num_tuples
+         : trunk_pivot_estimate_unique_keys(spl, leaf, pdata);
    if (estimated_unique_keys > num_tuples * 19 / 20) {
       estimated_unique_keys = num_tuples;
    }
@@ -5989,7 +7485,7 @@ trunk_split_leaf(trunk_handle *spl,
          trunk_log_node_if_enabled(&stream, spl, leaf);
 
          debug_assert(trunk_verify_node(spl, leaf));
-         trunk_node_unlock(spl->cc, leaf);
+         trunk_node_unlock(spl, leaf);
          trunk_node_unclaim(spl->cc, leaf);
          trunk_node_unget(spl->cc, leaf);
       }
@@ -6026,7 +7522,7 @@ trunk_split_leaf(trunk_handle *spl,
    trunk_log_node_if_enabled(&stream, spl, leaf);
 
    debug_assert(trunk_verify_node(spl, leaf));
-   trunk_node_unlock(spl->cc, leaf);
+   trunk_node_unlock(spl, leaf);
    trunk_node_unclaim(spl->cc, leaf);
    trunk_node_unget(spl->cc, leaf);
 
@@ -6074,7 +7570,7 @@ trunk_split_root(trunk_handle *spl, trunk_node *root)
 
    trunk_split_index(spl, root, &child, 0, NULL);
 
-   trunk_node_unlock(spl->cc, &child);
+   trunk_node_unlock(spl, &child);
    trunk_node_unclaim(spl->cc, &child);
    trunk_node_unget(spl->cc, &child);
 
@@ -6103,28 +7599,149 @@ trunk_range_iterator_prev(iterator *itor);
 void
 trunk_range_iterator_deinit(trunk_range_iterator *range_itor);
 
-const static iterator_ops trunk_range_iterator_ops = {
-   .curr     = trunk_range_iterator_curr,
-   .can_prev = trunk_range_iterator_can_prev,
-   .can_next = trunk_range_iterator_can_next,
-   .next     = trunk_range_iterator_next,
-   .prev     = trunk_range_iterator_prev,
-};
-
-platform_status
-trunk_range_iterator_init(trunk_handle         *spl,
-                          trunk_range_iterator *range_itor,
-                          key                   min_key,
-                          key                   max_key,
-                          key                   start_key,
-                          comparison            start_type,
-                          uint64                num_tuples)
+/*
+ * Marks in may_contain[], by offset from pdata->start_branch, the branches of
+ * the pivot whose routing filters do not rule out filter_key. The filters
+ * consulted are the ones trunk_pivot_lookup uses, so a branch left unmarked
+ * holds no tuple of the pivot whose filter key is filter_key.
+ */
+static void
+trunk_pivot_filter_branches(trunk_handle     *spl,
+                            trunk_node       *node,
+                            trunk_pivot_data *pdata,
+                            key               filter_key,
+                            bool32           *may_contain)
 {
-   debug_assert(!key_is_null(min_key));
+   routing_config *cfg          = &spl->cfg.filter_cfg;
+   uint16          num_branches = trunk_pivot_branch_count(spl, node, pdata);
+   for (uint16 offset = 0; offset < num_branches; offset++) {
+      may_contain[offset] = FALSE;
+   }
+
+   uint64          found_values;
+   platform_status rc = routing_filter_lookup(
+      spl->cc, cfg, &pdata->filter, filter_key, &found_values);
+   platform_assert_status_ok(rc);
+   uint16 value =
+      routing_filter_get_next_value(found_values, ROUTING_NOT_FOUND);
+   while (value != ROUTING_NOT_FOUND) {
+      if (value < num_branches) {
+         may_contain[value] = TRUE;
+      }
+      value = routing_filter_get_next_value(found_values, value);
+   }
+
+   uint16 num_bundles = trunk_pivot_bundle_count(spl, node, pdata);
+   for (uint16 bundle_off = 0; bundle_off != num_bundles; bundle_off++) {
+      uint16 bundle_no =
+         trunk_add_bundle_number(spl, pdata->start_bundle, bundle_off);
+      trunk_bundle *bundle   = trunk_get_bundle(spl, node, bundle_no);
+      uint16        sb_count = trunk_bundle_subbundle_count(spl, node, bundle);
+      for (uint16 sb_off = 0; sb_off != sb_count; sb_off++) {
+         uint16 sb_no =
+            trunk_add_subbundle_number(spl, bundle->start_subbundle, sb_off);
+         trunk_subbundle *sb        = trunk_get_subbundle(spl, node, sb_no);
+         uint16           sb_offset = trunk_subtract_branch_number(
+            spl, sb->start_branch, pdata->start_branch);
+         uint16 filter_count = sb->state == SB_STATE_COMPACTED
+                                  ? trunk_subbundle_filter_count(spl, node, sb)
+                                  : 1;
+         for (uint16 filter_no = 0; filter_no != filter_count; filter_no++) {
+            routing_filter *filter =
+               trunk_subbundle_filter(spl, node, sb, filter_no);
+            rc = routing_filter_lookup(
+               spl->cc, cfg, filter, filter_key, &found_values);
+            platform_assert_status_ok(rc);
+            if (sb->state == SB_STATE_COMPACTED) {
+               // A compacted subbundle is a single branch
+               if (found_values && sb_offset < num_branches) {
+                  may_contain[sb_offset] = TRUE;
+               }
+               continue;
+            }
+            value =
+               routing_filter_get_next_value(found_values, ROUTING_NOT_FOUND);
+            while (value != ROUTING_NOT_FOUND) {
+               if (sb_offset + value < num_branches) {
+                  may_contain[sb_offset + value] = TRUE;
+               }
+               value = routing_filter_get_next_value(found_values, value);
+            }
+         }
+      }
+   }
+}
+
+/*
+ * Returns TRUE if target has the prefix of a prefix scan, or if the range
+ * iterator is not a prefix scan.
+ */
+static bool32
+trunk_range_iterator_in_prefix(trunk_range_iterator *range_itor, key target)
+{
+   if (!range_itor->has_prefix) {
+      return TRUE;
+   }
+   if (!key_is_user_key(target)) {
+      return FALSE;
+   }
+   data_config *data_cfg   = range_itor->spl->cfg.data_cfg;
+   key          filter_key = data_key_filter_key(data_cfg, target);
+   key          prefix     = key_buffer_key(&range_itor->prefix);
+   return slice_lex_cmp(key_slice(filter_key), key_slice(prefix)) == 0;
+}
+
+/*
+ * A prefix scan which has stepped onto a key outside its prefix has reached
+ * the end of its range in the direction it was moving.
+ */
+static void
+trunk_range_iterator_clip_to_prefix(trunk_range_iterator *range_itor,
+                                    bool32                forwards)
+{
+   if (!range_itor->has_prefix
+       || !iterator_can_curr(&range_itor->merge_itor->super))
+   {
+      return;
+   }
+   key     curr_key;
+   message msg;
+   iterator_curr(&range_itor->merge_itor->super, &curr_key, &msg);
+   if (!trunk_range_iterator_in_prefix(range_itor, curr_key)) {
+      if (forwards) {
+         range_itor->can_next = FALSE;
+      } else {
+         range_itor->can_prev = FALSE;
+      }
+   }
+}
+
+const static iterator_ops trunk_range_iterator_ops = {
+   .curr     = trunk_range_iterator_curr,
+   .can_prev = trunk_range_iterator_can_prev,
+   .can_next = trunk_range_iterator_can_next,
+   .next     = trunk_range_iterator_next,
+   .prev     = trunk_range_iterator_prev,
+};
+
+static platform_status
+trunk_range_iterator_init_internal(trunk_handle         *spl,
+                                   trunk_range_iterator *range_itor,
+                                   key                   min_key,
+                                   key                   max_key,
+                                   key                   start_key,
+                                   comparison            start_type,
+                                   uint64                num_tuples,
+                                   key                   prefix,
+                                   const trunk_snapshot *snapshot)
+{
+   debug_assert(!key_is_null(min_key));
    debug_assert(!key_is_null(max_key));
    debug_assert(!key_is_null(start_key));
+   debug_assert(key_is_null(prefix) || spl->cfg.data_cfg->key_prefix != NULL);
 
    range_itor->spl          = spl;
+   range_itor->snapshot     = snapshot;
    range_itor->super.ops    = &trunk_range_iterator_ops;
    range_itor->num_branches = 0;
    range_itor->num_tuples   = num_tuples;
@@ -6144,17 +7761,36 @@ trunk_range_iterator_init(trunk_handle         *spl,
    // copy over global min and max
    key_buffer_init_from_key(&range_itor->min_key, spl->heap_id, min_key);
    key_buffer_init_from_key(&range_itor->max_key, spl->heap_id, max_key);
+   range_itor->has_prefix = !key_is_null(prefix);
+   key_buffer_init_from_key(&range_itor->prefix,
+                            spl->heap_id,
+                            range_itor->has_prefix ? prefix
+                                                   : NEGATIVE_INFINITY_KEY);
 
    ZERO_ARRAY(range_itor->compacted);
 
+   // Range deletes are copied ahead of the memtables and root they apply to
+   if (snapshot == NULL) {
+      trunk_range_delete_set_copy_live(spl, &range_itor->range_deletes);
+   } else {
+      trunk_range_delete_set_copy(&range_itor->range_deletes,
+                                  &snapshot->range_deletes.table);
+   }
+
    // grab the lookup lock
    memtable_begin_lookup(spl->mt_ctxt);
 
    // memtables
    ZERO_ARRAY(range_itor->branch);
    // Note this iteration is in descending generation order
-   range_itor->memtable_start_gen = memtable_generation(spl->mt_ctxt);
-   range_itor->memtable_end_gen   = memtable_generation_retired(spl->mt_ctxt);
+   if (snapshot == NULL) {
+      range_itor->memtable_start_gen = memtable_generation(spl->mt_ctxt);
+      range_itor->memtable_end_gen = memtable_generation_retired(spl->mt_ctxt);
+   } else {
+      // A snapshot's root covers every write it sees, it has no memtables
+      range_itor->memtable_start_gen = 0;
+      range_itor->memtable_end_gen   = 0;
+   }
    range_itor->num_memtable_branches =
       range_itor->memtable_start_gen - range_itor->memtable_end_gen;
    for (uint64 mt_gen = range_itor->memtable_start_gen;
@@ -6179,15 +7815,27 @@ trunk_range_iterator_init(trunk_handle         *spl,
          trunk_memtable_inc_ref(spl, mt_gen);
       }
 
-      range_itor->branch[range_itor->num_branches].root_addr = root_addr;
+      trunk_branch *branch = &range_itor->branch[range_itor->num_branches];
+      branch->root_addr    = root_addr;
+      branch->generation   = trunk_absolute_generation(spl, mt_gen);
 
       range_itor->num_branches++;
    }
 
    trunk_node node;
-   trunk_node_get(spl->cc, spl->root_addr, &node);
+   if (snapshot == NULL) {
+      trunk_node_get(spl->cc, spl->root_addr, &node);
+   } else {
+      trunk_node_get(spl->cc, snapshot->root_addr, &node);
+   }
    memtable_end_lookup(spl->mt_ctxt);
 
+   /*
+    * For a prefix scan, the routing filters tell which branches may hold keys
+    * with the prefix; the others are never opened.
+    */
+   bool32 may_contain[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+
    // index btrees
    uint16 height = trunk_node_height(&node);
    for (uint16 h = height; h > 0; h--) {
@@ -6199,11 +7847,20 @@ trunk_range_iterator_init(trunk_handle         *spl,
       }
       debug_assert(pivot_no < trunk_num_children(spl, &node));
       trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, pivot_no);
+      uint16 pivot_branches   = trunk_pivot_branch_count(spl, &node, pdata);
+      if (range_itor->has_prefix) {
+         platform_assert(pivot_branches <= ARRAY_SIZE(may_contain));
+         trunk_pivot_filter_branches(spl, &node, pdata, prefix, may_contain);
+      }
 
-      for (uint16 branch_offset = 0;
-           branch_offset != trunk_pivot_branch_count(spl, &node, pdata);
+      for (uint16 branch_offset = 0; branch_offset != pivot_branches;
            branch_offset++)
       {
+         if (range_itor->has_prefix
+             && !may_contain[pivot_branches - branch_offset - 1])
+         {
+            continue;
+         }
          platform_assert(
             (range_itor->num_branches < TRUNK_RANGE_ITOR_MAX_BRANCHES),
             "range_itor->num_branches=%lu should be < "
@@ -6231,12 +7888,24 @@ trunk_range_iterator_init(trunk_handle         *spl,
    }
 
    // leaf btrees
+   trunk_pivot_data *leaf_pdata     = trunk_get_pivot_data(spl, &node, 0);
+   uint16            pivot_branches = 0;
+   if (range_itor->has_prefix) {
+      pivot_branches = trunk_pivot_branch_count(spl, &node, leaf_pdata);
+      platform_assert(pivot_branches <= ARRAY_SIZE(may_contain));
+      trunk_pivot_filter_branches(spl, &node, leaf_pdata, prefix, may_contain);
+   }
    for (uint16 branch_offset = 0;
         branch_offset != trunk_branch_count(spl, &node);
         branch_offset++)
    {
       uint16 branch_no = trunk_subtract_branch_number(
          spl, trunk_end_branch(spl, &node), branch_offset + 1);
+      if (range_itor->has_prefix && branch_offset < pivot_branches
+          && !may_contain[pivot_branches - branch_offset - 1])
+      {
+         continue;
+      }
       range_itor->branch[range_itor->num_branches] =
          *trunk_get_branch(spl, &node, branch_no);
       uint64 root_addr = range_itor->branch[range_itor->num_branches].root_addr;
@@ -6261,10 +7930,24 @@ trunk_range_iterator_init(trunk_handle         *spl,
 
    trunk_node_unget(spl->cc, &node);
 
+   uint64 num_itors = 0;
    for (uint64 i = 0; i < range_itor->num_branches; i++) {
       uint64          branch_no  = range_itor->num_branches - i - 1;
       btree_iterator *btree_itor = &range_itor->btree_itor[branch_no];
       trunk_branch   *branch     = &range_itor->branch[branch_no];
+      // A branch with no tuples in [local_min, local_max) can never
+      // produce a tuple for this leaf, so it gets no iterator at all.
+      range_itor->opened[branch_no] = btree_may_have_tuples_in_range(
+         spl->cc,
+         &spl->cfg.btree_cfg,
+         branch->root_addr,
+         range_itor->compacted[branch_no] ? PAGE_TYPE_BRANCH
+                                          : PAGE_TYPE_MEMTABLE,
+         key_buffer_key(&range_itor->local_min_key),
+         key_buffer_key(&range_itor->local_max_key));
+      if (!range_itor->opened[branch_no]) {
+         continue;
+      }
       if (range_itor->compacted[branch_no]) {
          bool32 do_prefetch =
             range_itor->compacted[branch_no] && num_tuples > TRUNK_PREFETCH_MIN
@@ -6293,15 +7976,21 @@ trunk_range_iterator_init(trunk_handle         *spl,
             is_live,
             FALSE);
       }
-      range_itor->itor[i] = &btree_itor->super;
-   }
-
-   platform_status rc = merge_iterator_create(spl->heap_id,
-                                              spl->cfg.data_cfg,
-                                              range_itor->num_branches,
-                                              range_itor->itor,
-                                              MERGE_FULL,
-                                              &range_itor->merge_itor);
+      range_itor->itor[num_itors]            = &btree_itor->super;
+      range_itor->itor_generation[num_itors] = branch->generation;
+      num_itors++;
+   }
+
+   platform_status rc = merge_iterator_create_with_range_deletes(
+      spl->heap_id,
+      spl->cfg.data_cfg,
+      num_itors,
+      range_itor->itor,
+      range_itor->itor_generation,
+      range_itor->range_deletes.table.num_range_deletes,
+      range_itor->range_deletes.range_delete,
+      MERGE_FULL,
+      &range_itor->merge_itor);
    if (!SUCCESS(rc)) {
       return rc;
    }
@@ -6313,7 +8002,9 @@ trunk_range_iterator_init(trunk_handle         *spl,
     * db/range, move to prev/next leaf
     */
    if (!in_range && start_type >= greater_than) {
-      if (trunk_key_compare(spl, local_max, max_key) < 0) {
+      if (trunk_key_compare(spl, local_max, max_key) < 0
+          && trunk_range_iterator_in_prefix(range_itor, local_max))
+      {
          trunk_range_iterator_deinit(range_itor);
          rc = trunk_range_iterator_init(spl,
                                         range_itor,
@@ -6321,7 +8012,9 @@ trunk_range_iterator_init(trunk_handle         *spl,
                                         max_key,
                                         local_max,
                                         start_type,
-                                        range_itor->num_tuples);
+                                        range_itor->num_tuples,
+                                        prefix,
+                                        snapshot);
          if (!SUCCESS(rc)) {
             return rc;
          }
@@ -6332,7 +8025,9 @@ trunk_range_iterator_init(trunk_handle         *spl,
       }
    }
    if (!in_range && start_type <= less_than_or_equal) {
-      if (trunk_key_compare(spl, local_min, min_key) > 0) {
+      if (trunk_key_compare(spl, local_min, min_key) > 0
+          && trunk_range_iterator_in_prefix(range_itor, local_min))
+      {
          trunk_range_iterator_deinit(range_itor);
          rc = trunk_range_iterator_init(spl,
                                         range_itor,
@@ -6340,7 +8035,9 @@ trunk_range_iterator_init(trunk_handle         *spl,
                                         max_key,
                                         local_min,
                                         start_type,
-                                        range_itor->num_tuples);
+                                        range_itor->num_tuples,
+                                        prefix,
+                                        snapshot);
          if (!SUCCESS(rc)) {
             return rc;
          }
@@ -6350,6 +8047,39 @@ trunk_range_iterator_init(trunk_handle         *spl,
             iterator_can_next(&range_itor->merge_itor->super);
       }
    }
+   if (SUCCESS(rc)) {
+      trunk_range_iterator_clip_to_prefix(range_itor,
+                                          start_type >= greater_than);
+   }
+   return rc;
+}
+
+/*
+ * Range iterators read pages as probationary, so that a scan does not evict
+ * the pages point lookups reuse.
+ */
+platform_status
+trunk_range_iterator_init(trunk_handle         *spl,
+                          trunk_range_iterator *range_itor,
+                          key                   min_key,
+                          key                   max_key,
+                          key                   start_key,
+                          comparison            start_type,
+                          uint64                num_tuples,
+                          key                   prefix,
+                          const trunk_snapshot *snapshot)
+{
+   bool32          was_probationary = cache_read_probationary(spl->cc, TRUE);
+   platform_status rc = trunk_range_iterator_init_internal(spl,
+                                                           range_itor,
+                                                           min_key,
+                                                           max_key,
+                                                           start_key,
+                                                           start_type,
+                                                           num_tuples,
+                                                           prefix,
+                                                           snapshot);
+   cache_read_probationary(spl->cc, was_probationary);
    return rc;
 }
 
@@ -6361,8 +8091,8 @@ trunk_range_iterator_curr(iterator *itor, key *curr_key, message *data)
    iterator_curr(&range_itor->merge_itor->super, curr_key, data);
 }
 
-platform_status
-trunk_range_iterator_next(iterator *itor)
+static platform_status
+trunk_range_iterator_next_internal(iterator *itor)
 {
    trunk_range_iterator *range_itor = (trunk_range_iterator *)itor;
    debug_assert(range_itor != NULL);
@@ -6397,9 +8127,21 @@ trunk_range_iterator_next(iterator *itor)
       if (!SUCCESS(rc)) {
          return rc;
       }
+      KEY_CREATE_LOCAL_COPY(rc,
+                            prefix,
+                            range_itor->spl->heap_id,
+                            key_buffer_key(&range_itor->prefix));
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+      if (!range_itor->has_prefix) {
+         prefix = NULL_KEY;
+      }
 
       // if there is more data to get, rebuild the iterator for next leaf
-      if (trunk_key_compare(range_itor->spl, local_max_key, max_key) < 0) {
+      if (trunk_key_compare(range_itor->spl, local_max_key, max_key) < 0
+          && trunk_range_iterator_in_prefix(range_itor, local_max_key))
+      {
          uint64 temp_tuples = range_itor->num_tuples;
          trunk_range_iterator_deinit(range_itor);
          rc = trunk_range_iterator_init(range_itor->spl,
@@ -6408,20 +8150,25 @@ trunk_range_iterator_next(iterator *itor)
                                         max_key,
                                         local_max_key,
                                         greater_than_or_equal,
-                                        temp_tuples);
+                                        temp_tuples,
+                                        prefix,
+                                        range_itor->snapshot);
          if (!SUCCESS(rc)) {
             return rc;
          }
-         debug_assert(range_itor->can_next
-                      == iterator_can_next(&range_itor->merge_itor->super));
+         debug_assert(range_itor->has_prefix
+                      || range_itor->can_next
+                            == iterator_can_next(
+                               &range_itor->merge_itor->super));
       }
    }
+   trunk_range_iterator_clip_to_prefix(range_itor, TRUE);
 
    return STATUS_OK;
 }
 
-platform_status
-trunk_range_iterator_prev(iterator *itor)
+static platform_status
+trunk_range_iterator_prev_internal(iterator *itor)
 {
    trunk_range_iterator *range_itor = (trunk_range_iterator *)itor;
    debug_assert(itor != NULL);
@@ -6456,9 +8203,21 @@ trunk_range_iterator_prev(iterator *itor)
       if (!SUCCESS(rc)) {
          return rc;
       }
+      KEY_CREATE_LOCAL_COPY(rc,
+                            prefix,
+                            range_itor->spl->heap_id,
+                            key_buffer_key(&range_itor->prefix));
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+      if (!range_itor->has_prefix) {
+         prefix = NULL_KEY;
+      }
 
       // if there is more data to get, rebuild the iterator for prev leaf
-      if (trunk_key_compare(range_itor->spl, local_min_key, min_key) > 0) {
+      if (trunk_key_compare(range_itor->spl, local_min_key, min_key) > 0
+          && trunk_range_iterator_in_prefix(range_itor, local_min_key))
+      {
          trunk_range_iterator_deinit(range_itor);
          rc = trunk_range_iterator_init(range_itor->spl,
                                         range_itor,
@@ -6466,18 +8225,43 @@ trunk_range_iterator_prev(iterator *itor)
                                         max_key,
                                         local_min_key,
                                         less_than,
-                                        range_itor->num_tuples);
+                                        range_itor->num_tuples,
+                                        prefix,
+                                        range_itor->snapshot);
          if (!SUCCESS(rc)) {
             return rc;
          }
-         debug_assert(range_itor->can_prev
-                      == iterator_can_prev(&range_itor->merge_itor->super));
+         debug_assert(range_itor->has_prefix
+                      || range_itor->can_prev
+                            == iterator_can_prev(
+                               &range_itor->merge_itor->super));
       }
    }
+   trunk_range_iterator_clip_to_prefix(range_itor, FALSE);
 
    return STATUS_OK;
 }
 
+platform_status
+trunk_range_iterator_next(iterator *itor)
+{
+   cache          *cc               = ((trunk_range_iterator *)itor)->spl->cc;
+   bool32          was_probationary = cache_read_probationary(cc, TRUE);
+   platform_status rc               = trunk_range_iterator_next_internal(itor);
+   cache_read_probationary(cc, was_probationary);
+   return rc;
+}
+
+platform_status
+trunk_range_iterator_prev(iterator *itor)
+{
+   cache          *cc               = ((trunk_range_iterator *)itor)->spl->cc;
+   bool32          was_probationary = cache_read_probationary(cc, TRUE);
+   platform_status rc               = trunk_range_iterator_prev_internal(itor);
+   cache_read_probationary(cc, was_probationary);
+   return rc;
+}
+
 bool32
 trunk_range_iterator_can_prev(iterator *itor)
 {
@@ -6505,12 +8289,16 @@ trunk_range_iterator_deinit(trunk_range_iterator *range_itor)
       for (uint64 i = 0; i < range_itor->num_branches; i++) {
          btree_iterator *btree_itor = &range_itor->btree_itor[i];
          if (range_itor->compacted[i]) {
-            uint64 root_addr = btree_itor->root_addr;
-            trunk_branch_iterator_deinit(spl, btree_itor, FALSE);
+            uint64 root_addr = range_itor->branch[i].root_addr;
+            if (range_itor->opened[i]) {
+               trunk_branch_iterator_deinit(spl, btree_itor, FALSE);
+            }
             btree_unblock_dec_ref(spl->cc, &spl->cfg.btree_cfg, root_addr);
          } else {
             uint64 mt_gen = range_itor->memtable_start_gen - i;
-            trunk_memtable_iterator_deinit(spl, btree_itor, mt_gen, FALSE);
+            if (range_itor->opened[i]) {
+               trunk_memtable_iterator_deinit(spl, btree_itor, mt_gen, FALSE);
+            }
             trunk_memtable_dec_ref(spl, mt_gen);
          }
       }
@@ -6518,6 +8306,7 @@ trunk_range_iterator_deinit(trunk_range_iterator *range_itor)
       key_buffer_deinit(&range_itor->max_key);
       key_buffer_deinit(&range_itor->local_min_key);
       key_buffer_deinit(&range_itor->local_max_key);
+      key_buffer_deinit(&range_itor->prefix);
    }
 }
 
@@ -6661,13 +8450,13 @@ trunk_reclaim_space(trunk_handle *spl)
                platform_timestamp_elapsed(sr_start);
          }
          if (!SUCCESS(rc)) {
-            trunk_node_unlock(spl->cc, &node);
+            trunk_node_unlock(spl, &node);
             trunk_node_unclaim(spl->cc, &node);
             trunk_node_unget(spl->cc, &node);
             continue;
          }
       }
-      trunk_node_unlock(spl->cc, &node);
+      trunk_node_unlock(spl, &node);
       trunk_node_unclaim(spl->cc, &node);
       trunk_node_unget(spl->cc, &node);
       return STATUS_OK;
@@ -6695,6 +8484,76 @@ trunk_maybe_reclaim_space(trunk_handle *spl)
  *-----------------------------------------------------------------------------
  */
 
+/*
+ *-----------------------------------------------------------------------------
+ * trunk_write_throttle --
+ *
+ *      Delays an update of num_msgs messages in proportion to how close
+ *      updates are to stalling, so that they slow down gradually instead of
+ *      blocking outright when memtable incorporations or compactions fall
+ *      behind.
+ *
+ *      There are two measures of pressure, each going from 0 to 1:
+ *       - memtables: grows as the room updates can fill before waiting for an
+ *         incorporation shrinks below one memtable.
+ *       - root branches: grows as the branches in the root go from
+ *         max_branches_per_node to hard_max_branches_per_node, which happens
+ *         when the root cannot flush to children that are not compacted yet.
+ *      Each message is delayed by write_throttle_max_delay_ns times the
+ *      larger of the two, but no update, however many messages it has, by
+ *      more than write_throttle_max_delay_ns: a large write batch would
+ *      otherwise sleep for seconds.
+ *-----------------------------------------------------------------------------
+ */
+static void
+trunk_write_throttle(trunk_handle *spl, uint64 num_msgs)
+{
+   uint64 max_delay_ns = spl->cfg.write_throttle_max_delay_ns;
+   if (max_delay_ns == 0) {
+      return;
+   }
+
+   uint64 delay_ns     = 0;
+   uint64 memtable_ext = spl->cfg.mt_cfg.max_extents_per_memtable;
+   uint64 headroom     = memtable_insert_headroom(spl->mt_ctxt);
+   if (headroom < memtable_ext) {
+      delay_ns = max_delay_ns * (memtable_ext - headroom) / memtable_ext;
+   }
+
+   timestamp now         = platform_get_timestamp();
+   timestamp last_sample = spl->write_throttle_sample_ts;
+   if (now - last_sample > TRUNK_WRITE_THROTTLE_SAMPLE_NS
+       && __sync_bool_compare_and_swap(
+          &spl->write_throttle_sample_ts, last_sample, now))
+   {
+      trunk_node root;
+      trunk_root_get(spl, &root);
+      spl->root_branch_count = trunk_branch_count(spl, &root);
+      trunk_node_unget(spl->cc, &root);
+   }
+   uint64 num_branches = spl->root_branch_count;
+   uint64 soft_max     = spl->cfg.max_branches_per_node;
+   uint64 hard_max     = spl->cfg.hard_max_branches_per_node;
+   if (soft_max < num_branches && soft_max < hard_max) {
+      uint64 excess = MIN(num_branches, hard_max) - soft_max;
+      delay_ns = MAX(delay_ns, max_delay_ns * excess / (hard_max - soft_max));
+   }
+
+   if (delay_ns == 0) {
+      return;
+   }
+   delay_ns        = MIN(delay_ns * num_msgs, max_delay_ns);
+   timestamp start = platform_get_timestamp();
+   platform_sleep_ns(delay_ns);
+   if (spl->cfg.use_stats) {
+      const threadid tid = platform_get_tid();
+      spl->stats[tid].write_throttles++;
+      // the time actually slept, which the scheduler may stretch
+      spl->stats[tid].write_throttle_time_ns +=
+         platform_timestamp_elapsed(start);
+   }
+}
+
 platform_status
 trunk_insert(trunk_handle *spl, key tuple_key, message data)
 {
@@ -6712,6 +8571,7 @@ trunk_insert(trunk_handle *spl, key tuple_key, message data)
       data = DELETE_MESSAGE;
    }
 
+   trunk_write_throttle(spl, 1);
    platform_status rc = trunk_memtable_insert(spl, tuple_key, data);
    if (!SUCCESS(rc)) {
       goto out;
@@ -6745,6 +8605,229 @@ out:
    return rc;
 }
 
+typedef struct trunk_insert_batch_sort_ctxt {
+   trunk_handle *spl;
+   key          *keys;
+} trunk_insert_batch_sort_ctxt;
+
+/*
+ * Orders batch entries by key, breaking ties by position in the batch so that
+ * later messages for a key are applied on top of earlier ones.
+ */
+static int
+trunk_insert_batch_compare(const void *a, const void *b, void *arg)
+{
+   trunk_insert_batch_sort_ctxt *ctxt = (trunk_insert_batch_sort_ctxt *)arg;
+   uint64                        i    = *(const uint64 *)a;
+   uint64                        j    = *(const uint64 *)b;
+   int cmp = trunk_key_compare(ctxt->spl, ctxt->keys[i], ctxt->keys[j]);
+   if (cmp != 0) {
+      return cmp;
+   }
+   return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+/*
+ * Logs the first num_msgs messages of a batch in the given order as one log
+ * batch, then ends it. Must hold the insert lock of generation.
+ */
+static platform_status
+trunk_log_batch(trunk_handle *spl,
+                uint64        generation,
+                key           keys[],
+                message       msgs[],
+                const uint64  order[],
+                const uint64  leaf_generation[],
+                uint64        num_msgs)
+{
+   uint64 batch = __sync_add_and_fetch(&spl->last_log_batch, 1);
+   for (uint64 i = 0; i < num_msgs; i++) {
+      message msg = msgs[order[i]];
+      if (message_class(msg) == MESSAGE_TYPE_DELETE) {
+         msg = DELETE_MESSAGE;
+      }
+      uint64 log_generation =
+         trunk_log_generation(spl, generation, leaf_generation[i]);
+      int crappy_rc = log_write_entry(spl->log,
+                                      LOG_ENTRY_MESSAGE,
+                                      batch,
+                                      keys[order[i]],
+                                      msg,
+                                      log_generation);
+      if (crappy_rc != 0) {
+         return STATUS_IO_ERROR;
+      }
+   }
+   int crappy_rc = log_write_entry(spl->log,
+                                   LOG_ENTRY_BATCH_END,
+                                   batch,
+                                   NULL_KEY,
+                                   NULL_MESSAGE,
+                                   trunk_log_generation(spl, generation, 0));
+   return crappy_rc == 0 ? STATUS_OK : STATUS_IO_ERROR;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * trunk_insert_batch --
+ *
+ *      Inserts num_msgs (key, message) pairs as a single unit: all of them
+ *      are applied under one hold of the memtable insert lock, so they land
+ *      in the same memtable generation and are incorporated into the trunk
+ *      together. The messages are applied in key order, which keeps
+ *      successive btree descents on the same (cached) path.
+ *
+ *      Once all of them are applied, they are logged as one log batch, which
+ *      replay recovers whole or not at all. If the log cannot be written, the
+ *      batch stays applied but is not durable: STATUS_IO_ERROR is returned,
+ *      and as its log batch is left without an end, a crash before the next
+ *      checkpoint loses the batch whole.
+ *
+ *      Every message is validated before any is applied, so a bad key or
+ *      message fails the whole batch with STATUS_BAD_PARAM. Only an
+ *      allocation failure while merging can stop a batch partway; the
+ *      messages applied until then are still logged as a batch.
+ *
+ *      Concurrent lookups may observe a prefix of the batch while it is
+ *      being applied.
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+trunk_insert_batch(trunk_handle *spl,      // IN
+                   key           keys[],   // IN
+                   message       msgs[],   // IN
+                   uint64        num_msgs) // IN
+{
+   timestamp      ts;
+   const threadid tid = platform_get_tid();
+   if (spl->cfg.use_stats) {
+      ts = platform_get_timestamp();
+   }
+
+   if (num_msgs == 0) {
+      return STATUS_OK;
+   }
+
+   uint64 page_size = trunk_page_size(&spl->cfg);
+   for (uint64 i = 0; i < num_msgs; i++) {
+      if (trunk_max_key_size(spl) < key_length(keys[i])
+          || MAX_INLINE_KEY_SIZE(page_size) < key_length(keys[i])
+          || MAX_INLINE_MESSAGE_SIZE(page_size) < message_length(msgs[i])
+          || message_is_invalid_user_type(msgs[i]))
+      {
+         return STATUS_BAD_PARAM;
+      }
+   }
+
+   uint64 *order = TYPED_ARRAY_MALLOC(spl->heap_id, order, num_msgs);
+   if (order == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+   uint64 *leaf_generation =
+      TYPED_ARRAY_MALLOC(spl->heap_id, leaf_generation, num_msgs);
+   if (leaf_generation == NULL) {
+      platform_free(spl->heap_id, order);
+      return STATUS_NO_MEMORY;
+   }
+   for (uint64 i = 0; i < num_msgs; i++) {
+      order[i] = i;
+   }
+   trunk_insert_batch_sort_ctxt sort_ctxt = {.spl = spl, .keys = keys};
+   uint64                       tmp;
+   platform_sort_slow(order,
+                      num_msgs,
+                      sizeof(*order),
+                      trunk_insert_batch_compare,
+                      &sort_ctxt,
+                      &tmp);
+
+   trunk_write_throttle(spl, num_msgs);
+   uint64          generation;
+   platform_status rc = trunk_memtable_begin_insert(spl, &generation);
+   if (!SUCCESS(rc)) {
+      goto free_order;
+   }
+
+   // this call is safe because we hold the insert lock
+   memtable *mt          = trunk_get_memtable(spl, generation);
+   uint64    num_applied = 0;
+   for (; num_applied < num_msgs; num_applied++) {
+      key     tuple_key = keys[order[num_applied]];
+      message msg       = msgs[order[num_applied]];
+      if (message_class(msg) == MESSAGE_TYPE_DELETE) {
+         msg = DELETE_MESSAGE;
+      }
+      // the leaf generation orders the log
+      rc = memtable_insert(spl->mt_ctxt,
+                           mt,
+                           spl->heap_id,
+                           tuple_key,
+                           msg,
+                           &leaf_generation[num_applied]);
+      if (!SUCCESS(rc)) {
+         break;
+      }
+   }
+
+   if (spl->log != NULL) {
+      platform_status log_rc = trunk_log_batch(spl,
+                                               generation,
+                                               keys,
+                                               msgs,
+                                               order,
+                                               leaf_generation,
+                                               num_applied);
+      if (SUCCESS(rc)) {
+         rc = log_rc;
+      }
+   }
+
+   log_handle *log = trunk_log_pin(spl);
+   memtable_end_insert(spl->mt_ctxt);
+   trunk_log_sync_and_unpin(spl, log);
+   if (!SUCCESS(rc)) {
+      goto free_order;
+   }
+
+   task_perform_one_if_needed(spl->ts, spl->cfg.queue_scale_percent);
+
+   if (spl->cfg.use_stats) {
+      uint64 elapsed = platform_timestamp_elapsed(ts);
+      for (uint64 i = 0; i < num_msgs; i++) {
+         switch (message_class(msgs[i])) {
+            case MESSAGE_TYPE_INSERT:
+               spl->stats[tid].insertions++;
+               break;
+            case MESSAGE_TYPE_UPDATE:
+               spl->stats[tid].updates++;
+               break;
+            case MESSAGE_TYPE_DELETE:
+               spl->stats[tid].deletions++;
+               break;
+            default:
+               platform_assert(0);
+         }
+      }
+      platform_histo_insert(spl->stats[tid].insert_latency_histo, elapsed);
+   }
+
+free_order:
+   platform_free(spl->heap_id, leaf_generation);
+   platform_free(spl->heap_id, order);
+   return rc;
+}
+
+/*
+ * Returns TRUE if the lookup has its final answer, either referenced from ref
+ * or accumulated in data.
+ */
+static inline bool32
+trunk_lookup_is_definitive(merge_accumulator *data, trunk_lookup_ref *ref)
+{
+   return trunk_lookup_ref_held(ref)
+          || message_is_definitive(merge_accumulator_to_message(data));
+}
+
 bool32
 trunk_filter_lookup(trunk_handle      *spl,
                     trunk_node        *node,
@@ -6752,7 +8835,9 @@ trunk_filter_lookup(trunk_handle      *spl,
                     routing_config    *cfg,
                     uint16             start_branch,
                     key                target,
-                    merge_accumulator *data)
+                    uint64             min_generation,
+                    merge_accumulator *data,
+                    trunk_lookup_ref  *ref)
 {
    uint16   height;
    threadid tid;
@@ -6772,18 +8857,21 @@ trunk_filter_lookup(trunk_handle      *spl,
       routing_filter_get_next_value(found_values, ROUTING_NOT_FOUND);
    while (next_value != ROUTING_NOT_FOUND) {
       uint16 branch_no = trunk_add_branch_number(spl, start_branch, next_value);
-      trunk_branch   *branch = trunk_get_branch(spl, node, branch_no);
+      trunk_branch *branch = trunk_get_branch(spl, node, branch_no);
+      if (branch->generation < min_generation) {
+         // range deleted, as is every older branch
+         return FALSE;
+      }
       bool32          local_found;
       platform_status rc;
-      rc =
-         trunk_btree_lookup_and_merge(spl, branch, target, data, &local_found);
+      rc = trunk_btree_lookup_and_merge_with_ref(
+         spl, node, branch, target, data, ref, &local_found);
       platform_assert_status_ok(rc);
       if (spl->cfg.use_stats) {
          spl->stats[tid].branch_lookups[height]++;
       }
       if (local_found) {
-         message msg = merge_accumulator_to_message(data);
-         if (message_is_definitive(msg)) {
+         if (trunk_lookup_is_definitive(data, ref)) {
             return FALSE;
          }
       } else if (spl->cfg.use_stats) {
@@ -6799,7 +8887,9 @@ trunk_compacted_subbundle_lookup(trunk_handle      *spl,
                                  trunk_node        *node,
                                  trunk_subbundle   *sb,
                                  key                target,
-                                 merge_accumulator *data)
+                                 uint64             min_generation,
+                                 merge_accumulator *data,
+                                 trunk_lookup_ref  *ref)
 {
    debug_assert(sb->state == SB_STATE_COMPACTED);
    debug_assert(trunk_subbundle_branch_count(spl, node, sb) == 1);
@@ -6822,19 +8912,21 @@ trunk_compacted_subbundle_lookup(trunk_handle      *spl,
          spl->cc, &spl->cfg.filter_cfg, filter, target, &found_values);
       platform_assert_status_ok(rc);
       if (found_values) {
-         uint16          branch_no = sb->start_branch;
-         trunk_branch   *branch    = trunk_get_branch(spl, node, branch_no);
+         uint16        branch_no = sb->start_branch;
+         trunk_branch *branch    = trunk_get_branch(spl, node, branch_no);
+         if (branch->generation < min_generation) {
+            return FALSE;
+         }
          bool32          local_found;
          platform_status rc;
-         rc = trunk_btree_lookup_and_merge(
-            spl, branch, target, data, &local_found);
+         rc = trunk_btree_lookup_and_merge_with_ref(
+            spl, node, branch, target, data, ref, &local_found);
          platform_assert_status_ok(rc);
          if (spl->cfg.use_stats) {
             spl->stats[tid].branch_lookups[height]++;
          }
          if (local_found) {
-            message msg = merge_accumulator_to_message(data);
-            if (message_is_definitive(msg)) {
+            if (trunk_lookup_is_definitive(data, ref)) {
                return FALSE;
             }
          } else if (spl->cfg.use_stats) {
@@ -6851,7 +8943,9 @@ trunk_bundle_lookup(trunk_handle      *spl,
                     trunk_node        *node,
                     trunk_bundle      *bundle,
                     key                target,
-                    merge_accumulator *data)
+                    uint64             min_generation,
+                    merge_accumulator *data,
+                    trunk_lookup_ref  *ref)
 {
    uint16 sb_count = trunk_bundle_subbundle_count(spl, node, bundle);
    for (uint16 sb_off = 0; sb_off != sb_count; sb_off++) {
@@ -6860,14 +8954,21 @@ trunk_bundle_lookup(trunk_handle      *spl,
       trunk_subbundle *sb = trunk_get_subbundle(spl, node, sb_no);
       bool32           should_continue;
       if (sb->state == SB_STATE_COMPACTED) {
-         should_continue =
-            trunk_compacted_subbundle_lookup(spl, node, sb, target, data);
+         should_continue = trunk_compacted_subbundle_lookup(
+            spl, node, sb, target, min_generation, data, ref);
       } else {
          routing_filter *filter = trunk_subbundle_filter(spl, node, sb, 0);
          routing_config *cfg    = &spl->cfg.filter_cfg;
          debug_assert(filter->addr != 0);
-         should_continue = trunk_filter_lookup(
-            spl, node, filter, cfg, sb->start_branch, target, data);
+         should_continue = trunk_filter_lookup(spl,
+                                               node,
+                                               filter,
+                                               cfg,
+                                               sb->start_branch,
+                                               target,
+                                               min_generation,
+                                               data,
+                                               ref);
       }
       if (!should_continue) {
          return should_continue;
@@ -6881,7 +8982,9 @@ trunk_pivot_lookup(trunk_handle      *spl,
                    trunk_node        *node,
                    trunk_pivot_data  *pdata,
                    key                target,
-                   merge_accumulator *data)
+                   uint64             min_generation,
+                   merge_accumulator *data,
+                   trunk_lookup_ref  *ref)
 {
    // first check in bundles
    uint16 num_bundles = trunk_pivot_bundle_count(spl, node, pdata);
@@ -6890,76 +8993,79 @@ trunk_pivot_lookup(trunk_handle      *spl,
          spl, trunk_end_bundle(spl, node), bundle_off + 1);
       debug_assert(trunk_bundle_live(spl, node, bundle_no));
       trunk_bundle *bundle = trunk_get_bundle(spl, node, bundle_no);
-      bool32        should_continue =
-         trunk_bundle_lookup(spl, node, bundle, target, data);
+      bool32        should_continue = trunk_bundle_lookup(
+         spl, node, bundle, target, min_generation, data, ref);
       if (!should_continue) {
          return should_continue;
       }
    }
 
    routing_config *cfg = &spl->cfg.filter_cfg;
-   return trunk_filter_lookup(
-      spl, node, &pdata->filter, cfg, pdata->start_branch, target, data);
+   return trunk_filter_lookup(spl,
+                              node,
+                              &pdata->filter,
+                              cfg,
+                              pdata->start_branch,
+                              target,
+                              min_generation,
+                              data,
+                              ref);
 }
 
-// If any change is made in here, please make similar change in
-// trunk_lookup_async
-platform_status
-trunk_lookup(trunk_handle *spl, key target, merge_accumulator *result)
+/*
+ * Finalizes an update the lookup found once there is nothing older for it to
+ * merge with: the search reached the last branch, or a range delete.
+ */
+static inline void
+trunk_lookup_finalize_update(trunk_handle      *spl,
+                             key                target,
+                             merge_accumulator *result)
 {
-   // look in memtables
-
-   // 1. get read lock on lookup lock
-   //     --- 2. for [mt_no = mt->generation..mt->gen_to_incorp]
-   // 2. for gen = mt->generation; mt[gen % ...].gen == gen; gen --;
-   //                also handles switch to READY ^^^^^
-
-   merge_accumulator_set_to_null(result);
-
-   memtable_begin_lookup(spl->mt_ctxt);
-   bool32 found_in_memtable = FALSE;
-   uint64 mt_gen_start      = memtable_generation(spl->mt_ctxt);
-   uint64 mt_gen_end        = memtable_generation_retired(spl->mt_ctxt);
-   platform_assert(mt_gen_start - mt_gen_end <= TRUNK_NUM_MEMTABLES);
-
-   for (uint64 mt_gen = mt_gen_start; mt_gen != mt_gen_end; mt_gen--) {
-      platform_status rc;
-      rc = trunk_memtable_lookup(spl, mt_gen, target, result);
-      platform_assert_status_ok(rc);
-      if (merge_accumulator_is_definitive(result)) {
-         found_in_memtable = TRUE;
-         goto found_final_answer_early;
-      }
-   }
-
-   trunk_node node;
-   trunk_root_get(spl, &node);
-
-   // release memtable lookup lock
-   memtable_end_lookup(spl->mt_ctxt);
+   if (!merge_accumulator_is_null(result)
+       && merge_accumulator_message_class(result) == MESSAGE_TYPE_UPDATE)
+   {
+      data_merge_tuples_final(spl->cfg.data_cfg, target, result);
+   }
+}
 
+/*
+ * Looks target up in the trunk below node, descending hand-over-hand, and
+ * merges what it finds into result. Branches older than min_generation are
+ * range deleted and end the search. Releases node, or whichever descendent
+ * the search stopped at.
+ *
+ * If ref is not NULL, an INSERT which answers the lookup by itself is left in
+ * its branch page and referenced from ref instead of being copied to result.
+ */
+static void
+trunk_lookup_in_trunk(trunk_handle      *spl,
+                      trunk_node        *node,
+                      key                target,
+                      uint64             min_generation,
+                      merge_accumulator *result,
+                      trunk_lookup_ref  *ref)
+{
    // look in index nodes
-   uint16 height = trunk_node_height(&node);
+   uint16 height = trunk_node_height(node);
    for (uint16 h = height; h > 0; h--) {
-      uint16 pivot_no =
-         trunk_find_pivot(spl, &node, target, less_than_or_equal);
-      debug_assert(pivot_no < trunk_num_children(spl, &node));
-      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, pivot_no);
-      bool32            should_continue =
-         trunk_pivot_lookup(spl, &node, pdata, target, result);
+      uint16 pivot_no = trunk_find_pivot(spl, node, target, less_than_or_equal);
+      debug_assert(pivot_no < trunk_num_children(spl, node));
+      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
+      bool32            should_continue = trunk_pivot_lookup(
+         spl, node, pdata, target, min_generation, result, ref);
       if (!should_continue) {
          goto found_final_answer_early;
       }
       trunk_node child;
       trunk_node_get(spl->cc, pdata->addr, &child);
-      trunk_node_unget(spl->cc, &node);
-      node = child;
+      trunk_node_unget(spl->cc, node);
+      *node = child;
    }
 
    // look in leaf
-   trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, 0);
-   bool32            should_continue =
-      trunk_pivot_lookup(spl, &node, pdata, target, result);
+   trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, 0);
+   bool32            should_continue = trunk_pivot_lookup(
+      spl, node, pdata, target, min_generation, result, ref);
    if (!should_continue) {
       goto found_final_answer_early;
    }
@@ -6967,20 +9073,23 @@ trunk_lookup(trunk_handle *spl, key target, merge_accumulator *result)
    debug_assert(merge_accumulator_is_null(result)
                 || merge_accumulator_message_class(result)
                       == MESSAGE_TYPE_UPDATE);
-   if (!merge_accumulator_is_null(result)) {
-      data_merge_tuples_final(spl->cfg.data_cfg, target, result);
-   }
 found_final_answer_early:
+   trunk_lookup_finalize_update(spl, target, result);
+   trunk_node_unget(spl->cc, node);
+}
 
-   if (found_in_memtable) {
-      // release memtable lookup lock
-      memtable_end_lookup(spl->mt_ctxt);
-   } else {
-      trunk_node_unget(spl->cc, &node);
-   }
+/*
+ * Records the lookup in the stats and normalizes DELETE messages to a null
+ * result.
+ */
+static void
+trunk_lookup_finish(trunk_handle      *spl,
+                    merge_accumulator *result,
+                    trunk_lookup_ref  *ref)
+{
    if (spl->cfg.use_stats) {
       threadid tid = platform_get_tid();
-      if (!merge_accumulator_is_null(result)) {
+      if (!merge_accumulator_is_null(result) || trunk_lookup_ref_held(ref)) {
          spl->stats[tid].lookups_found++;
       } else {
          spl->stats[tid].lookups_not_found++;
@@ -6993,7 +9102,105 @@ found_final_answer_early:
    {
       merge_accumulator_set_to_null(result);
    }
+}
+
+platform_status
+trunk_lookup(trunk_handle *spl, key target, merge_accumulator *result)
+{
+   return trunk_lookup_with_ref(spl, target, result, NULL);
+}
+
+/*
+ * trunk_lookup_with_ref is trunk_lookup, except that when ref is not NULL and
+ * the answer is a single INSERT in a branch, the value is not copied: ref
+ * keeps the branch page holding it pinned, and result stays null. The caller
+ * must release ref with trunk_lookup_ref_release before looking up with it
+ * again, and before closing the trunk. Until then, the branch outlives its
+ * compaction.
+ *
+ * Answers found in the memtables are always copied, since memtable pages are
+ * still being written to.
+ */
+// If any change is made in here, please make similar change in
+// trunk_lookup_async
+platform_status
+trunk_lookup_with_ref(trunk_handle      *spl,
+                      key                target,
+                      merge_accumulator *result,
+                      trunk_lookup_ref  *ref)
+{
+   // look in memtables
+
+   // 1. get read lock on lookup lock
+   //     --- 2. for [mt_no = mt->generation..mt->gen_to_incorp]
+   // 2. for gen = mt->generation; mt[gen % ...].gen == gen; gen --;
+   //                also handles switch to READY ^^^^^
+
+   debug_assert(!trunk_lookup_ref_held(ref));
+   merge_accumulator_set_to_null(result);
+   uint64 min_generation = trunk_range_delete_min_generation(spl, target);
+
+   memtable_begin_lookup(spl->mt_ctxt);
+   bool32 found_in_memtable = FALSE;
+   uint64 mt_gen_start      = memtable_generation(spl->mt_ctxt);
+   uint64 mt_gen_end        = memtable_generation_retired(spl->mt_ctxt);
+   platform_assert(mt_gen_start - mt_gen_end <= TRUNK_NUM_MEMTABLES);
+
+   for (uint64 mt_gen = mt_gen_start; mt_gen != mt_gen_end; mt_gen--) {
+      if (trunk_absolute_generation(spl, mt_gen) < min_generation) {
+         // range deleted, as is everything older
+         trunk_lookup_finalize_update(spl, target, result);
+         found_in_memtable = TRUE;
+         break;
+      }
+      platform_status rc;
+      rc = trunk_memtable_lookup(spl, mt_gen, target, result);
+      platform_assert_status_ok(rc);
+      if (merge_accumulator_is_definitive(result)) {
+         found_in_memtable = TRUE;
+         break;
+      }
+   }
+
+   if (found_in_memtable) {
+      // release memtable lookup lock
+      memtable_end_lookup(spl->mt_ctxt);
+   } else {
+      trunk_node node;
+      trunk_root_get(spl, &node);
+
+      // release memtable lookup lock
+      memtable_end_lookup(spl->mt_ctxt);
+
+      trunk_lookup_in_trunk(spl, &node, target, min_generation, result, ref);
+   }
+
+   trunk_lookup_finish(spl, result, ref);
+   return STATUS_OK;
+}
+
+/*
+ * Looks target up as of the snapshot. Snapshots hold no memtables, so this
+ * descends from the snapshot's root straight away. ref is as for
+ * trunk_lookup_with_ref, and may be NULL.
+ */
+platform_status
+trunk_snapshot_lookup(trunk_handle         *spl,
+                      const trunk_snapshot *snapshot,
+                      key                   target,
+                      merge_accumulator    *result,
+                      trunk_lookup_ref     *ref)
+{
+   debug_assert(!trunk_lookup_ref_held(ref));
+   merge_accumulator_set_to_null(result);
+   uint64 min_generation = trunk_range_delete_table_min_generation(
+      spl, &snapshot->range_deletes.table, target);
+
+   trunk_node node;
+   trunk_node_get(spl->cc, snapshot->root_addr, &node);
+   trunk_lookup_in_trunk(spl, &node, target, min_generation, result, ref);
 
+   trunk_lookup_finish(spl, result, ref);
    return STATUS_OK;
 }
 
@@ -7031,15 +9238,11 @@ trunk_async_callback(cache_async_ctxt *cache_ctxt)
    //                cache_ctxt->page);
    ctxt->was_async = TRUE;
    // Move state machine ahead and requeue for dispatch
-   if (UNLIKELY(ctxt->state == async_state_get_root_reentrant)) {
-      trunk_async_set_state(ctxt, async_state_trunk_node_lookup);
-   } else {
-      debug_assert((ctxt->state == async_state_get_child_trunk_node_reentrant),
-                   "ctxt->state=%d != expected state=%d",
-                   ctxt->state,
-                   async_state_get_child_trunk_node_reentrant);
-      trunk_async_set_state(ctxt, async_state_unget_parent_trunk_node);
-   }
+   debug_assert((ctxt->state == async_state_get_child_trunk_node_reentrant),
+                "ctxt->state=%d != expected state=%d",
+                ctxt->state,
+                async_state_get_child_trunk_node_reentrant);
+   trunk_async_set_state(ctxt, async_state_unget_parent_trunk_node);
    ctxt->cb(ctxt);
 }
 
@@ -7133,6 +9336,8 @@ trunk_lookup_async(trunk_handle      *spl,    // IN
          case async_state_start:
          {
             merge_accumulator_set_to_null(result);
+            ctxt->min_generation =
+               trunk_range_delete_min_generation(spl, target);
             trunk_async_set_state(ctxt, async_state_lookup_memtable);
             // fallthrough
          }
@@ -7143,6 +9348,15 @@ trunk_lookup_async(trunk_handle      *spl,    // IN
             uint64 mt_gen_end   = memtable_generation_retired(spl->mt_ctxt);
             for (uint64 mt_gen = mt_gen_start; mt_gen != mt_gen_end; mt_gen--) {
                platform_status rc;
+               if (trunk_absolute_generation(spl, mt_gen)
+                   < ctxt->min_generation) {
+                  // range deleted, as is everything older
+                  trunk_lookup_finalize_update(spl, target, result);
+                  trunk_async_set_state(ctxt,
+                                        async_state_found_final_answer_early);
+                  memtable_end_lookup(spl->mt_ctxt);
+                  break;
+               }
                rc = trunk_memtable_lookup(spl, mt_gen, target, result);
                platform_assert_status_ok(rc);
                if (merge_accumulator_is_definitive(result)) {
@@ -7159,43 +9373,17 @@ trunk_lookup_async(trunk_handle      *spl,    // IN
          }
          case async_state_get_root_reentrant:
          {
-            cache_ctxt_init(
-               spl->cc, trunk_async_callback, NULL, &ctxt->cache_ctxt);
-            res = trunk_node_get_async(spl->cc, spl->root_addr, ctxt);
-            switch (res) {
-               case async_locked:
-               case async_no_reqs:
-                  //            platform_default_log("%s:%d tid %2lu: ctxt %p is
-                  //            retry\n",
-                  //                         __FILE__, __LINE__,
-                  //                         platform_get_tid(), ctxt);
-                  /*
-                   * Ctxt remains at same state. The invocation is done, but
-                   * the request isn't; and caller will re-invoke me.
-                   */
-                  done = TRUE;
-                  break;
-               case async_io_started:
-                  //            platform_default_log("%s:%d tid %2lu: ctxt %p is
-                  //            io_started\n",
-                  //                         __FILE__, __LINE__,
-                  //                         platform_get_tid(), ctxt);
-                  // Invocation is done; request isn't. Callback will move
-                  // state.
-                  done = TRUE;
-                  break;
-               case async_success:
-                  ctxt->was_async = FALSE;
-                  trunk_async_set_state(ctxt, async_state_trunk_node_lookup);
-                  ctxt->trunk_node.page = ctxt->cache_ctxt.page;
-                  ctxt->trunk_node.hdr =
-                     (trunk_hdr *)(ctxt->cache_ctxt.page->data);
-                  memtable_end_lookup(spl->mt_ctxt);
-                  break;
-               default:
-                  platform_assert(0);
-            }
-            break;
+            /*
+             * The root is fetched synchronously, under the memtable lookup
+             * lock, just as in trunk_lookup. It is nearly always cached,
+             * and the lookup lock cannot be held across an async IO: it is
+             * a per-thread lock, and other lookups in flight on this
+             * thread would need to take it in the meantime.
+             */
+            trunk_root_get(spl, node);
+            memtable_end_lookup(spl->mt_ctxt);
+            trunk_async_set_state(ctxt, async_state_trunk_node_lookup);
+            // fallthrough
          }
          case async_state_trunk_node_lookup:
          {
@@ -7355,6 +9543,15 @@ trunk_lookup_async(trunk_handle      *spl,    // IN
                   platform_assert(0);
             }
             ctxt->branch = trunk_get_branch(spl, node, branch_no);
+            if (ctxt->branch->generation < ctxt->min_generation) {
+               // range deleted, as is every older branch
+               trunk_lookup_finalize_update(spl, target, result);
+               trunk_async_set_state(ctxt,
+                                     async_state_found_final_answer_early);
+               trunk_node_unget(spl->cc, &ctxt->trunk_node);
+               ZERO_CONTENTS(&ctxt->trunk_node);
+               break;
+            }
             btree_ctxt_init(&ctxt->btree_ctxt,
                             &ctxt->cache_ctxt,
                             trunk_btree_async_callback);
@@ -7539,69 +9736,2259 @@ trunk_lookup_async(trunk_handle      *spl,    // IN
                }
             }
 
-            if (!merge_accumulator_is_null(result)) {
-               message_type type = merge_accumulator_message_class(result);
-               debug_assert(type == MESSAGE_TYPE_DELETE
-                            || type == MESSAGE_TYPE_INSERT);
-               if (type == MESSAGE_TYPE_DELETE) {
-                  merge_accumulator_set_to_null(result);
-               }
-            }
+            if (!merge_accumulator_is_null(result)) {
+               message_type type = merge_accumulator_message_class(result);
+               debug_assert(type == MESSAGE_TYPE_DELETE
+                            || type == MESSAGE_TYPE_INSERT);
+               if (type == MESSAGE_TYPE_DELETE) {
+                  merge_accumulator_set_to_null(result);
+               }
+            }
+
+            res  = async_success;
+            done = TRUE;
+            break;
+         }
+         default:
+            platform_assert(0);
+      }
+   } while (!done);
+#if TRUNK_DEBUG
+   cache_enable_sync_get(spl->cc, TRUE);
+#endif
+
+   return res;
+}
+
+
+platform_status
+trunk_range(trunk_handle  *spl,
+            key            start_key,
+            uint64         num_tuples,
+            tuple_function func,
+            void          *arg)
+{
+   trunk_range_iterator *range_itor =
+      TYPED_MALLOC(PROCESS_PRIVATE_HEAP_ID, range_itor);
+   platform_status rc = trunk_range_iterator_init(spl,
+                                                  range_itor,
+                                                  start_key,
+                                                  POSITIVE_INFINITY_KEY,
+                                                  start_key,
+                                                  greater_than_or_equal,
+                                                  num_tuples,
+                                                  NULL_KEY,
+                                                  NULL);
+   if (!SUCCESS(rc)) {
+      goto destroy_range_itor;
+   }
+
+   for (int i = 0; i < num_tuples && iterator_can_next(&range_itor->super); i++)
+   {
+      key     curr_key;
+      message data;
+      iterator_curr(&range_itor->super, &curr_key, &data);
+      func(curr_key, data, arg);
+      rc = iterator_next(&range_itor->super);
+      if (!SUCCESS(rc)) {
+         goto destroy_range_itor;
+      }
+   }
+
+destroy_range_itor:
+   trunk_range_iterator_deinit(range_itor);
+   platform_free(PROCESS_PRIVATE_HEAP_ID, range_itor);
+   return rc;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Range Splitting
+ *
+ * trunk_split_range splits [start_key, end_key) into up to num_partitions
+ * sub-ranges of about the same size, so that they can be scanned in
+ * parallel.
+ *
+ * The boundaries are pivots of the nodes at a single height. Each pivot is
+ * weighted by the kv bytes its node holds for it, plus an equal share of the
+ * kv bytes its ancestors hold for the pivots it descends from. The tree is
+ * walked twice: once to total the weights, and once to place a boundary
+ * wherever the running weight crosses the next multiple of
+ * total / num_partitions. The walks hold read locks hand-over-hand as
+ * lookups do, so the tree may change between them; the partitions then stay
+ * correct, just less balanced.
+ *
+ * Data still in the memtables is not weighed.
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct trunk_split_range_ctxt {
+   key         start_key;
+   key         end_key;
+   uint16      height;         // height of the pivots split on
+   uint64      num_partitions;
+   uint64      num_pivots;     // pivots at height in range
+   uint64      total_weight;   // sum of their weights
+   bool32      placing;        // FALSE while totalling the weights
+   uint64      weight;         // weight of the pivots visited so far
+   uint64      num_boundaries;
+   key_buffer *boundaries;
+} trunk_split_range_ctxt;
+
+static platform_status
+trunk_split_range_visit_pivot(trunk_handle           *spl,
+                              trunk_split_range_ctxt *ctxt,
+                              key                     pivot,
+                              uint64                  weight)
+{
+   if (!ctxt->placing) {
+      ctxt->num_pivots++;
+      ctxt->total_weight += weight;
+      return STATUS_OK;
+   }
+
+   uint64 total = ctxt->total_weight;
+   if (total == 0) {
+      // the pivots hold no data yet, so balance the number of pivots
+      weight = 1;
+      total  = ctxt->num_pivots;
+   }
+   uint64 next = ctxt->num_boundaries + 1;
+   if (next < ctxt->num_partitions
+       && trunk_key_compare(spl, ctxt->start_key, pivot) < 0
+       && ctxt->weight >= total / ctxt->num_partitions * next)
+   {
+      platform_status rc =
+         key_buffer_copy_key(&ctxt->boundaries[ctxt->num_boundaries], pivot);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+      ctxt->num_boundaries++;
+   }
+   ctxt->weight += weight;
+   return STATUS_OK;
+}
+
+/*
+ * Visits the pivots of node that overlap the range, descending to
+ * ctxt->height. inherited is the weight passed down from node's ancestors,
+ * which is shared evenly among those pivots.
+ */
+static platform_status
+trunk_split_range_visit_node(trunk_handle           *spl,
+                             trunk_split_range_ctxt *ctxt,
+                             trunk_node             *node,
+                             uint64                  inherited)
+{
+   uint16 num_children = trunk_num_children(spl, node);
+   uint16 first        = 0;
+   if (trunk_key_compare(spl, trunk_min_key(spl, node), ctxt->start_key) < 0)
+   {
+      first =
+         trunk_find_pivot(spl, node, ctxt->start_key, less_than_or_equal);
+   }
+   uint16 end = first;
+   while (end < num_children
+          && trunk_key_compare(spl, trunk_get_pivot(spl, node, end),
+                               ctxt->end_key) < 0)
+   {
+      end++;
+   }
+   if (end == first) {
+      return STATUS_OK;
+   }
+
+   uint64          share = inherited / (end - first);
+   platform_status rc    = STATUS_OK;
+   for (uint16 pivot_no = first; pivot_no < end && SUCCESS(rc); pivot_no++) {
+      uint64 weight = share + trunk_pivot_kv_bytes(spl, node, pivot_no);
+      if (trunk_node_height(node) == ctxt->height) {
+         rc = trunk_split_range_visit_pivot(
+            spl, ctxt, trunk_get_pivot(spl, node, pivot_no), weight);
+      } else {
+         trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
+         trunk_node        child;
+         trunk_node_get(spl->cc, pdata->addr, &child);
+         rc = trunk_split_range_visit_node(spl, ctxt, &child, weight);
+         trunk_node_unget(spl->cc, &child);
+      }
+   }
+   return rc;
+}
+
+/*
+ * Returns the number of partitions in *num_partitions. boundaries must hold
+ * num_partitions - 1 initialized key buffers; on return, the first
+ * *num_partitions - 1 of them hold the boundaries in increasing order.
+ * Partition i is [boundaries[i - 1], boundaries[i]), where boundaries[-1] is
+ * start_key and boundaries[*num_partitions - 1] is end_key.
+ */
+platform_status
+trunk_split_range(trunk_handle *spl,            // IN
+                  key           start_key,      // IN
+                  key           end_key,        // IN
+                  uint64        max_partitions, // IN
+                  key_buffer   *boundaries,     // OUT
+                  uint64       *num_partitions) // OUT
+{
+   debug_assert(max_partitions > 0);
+   trunk_split_range_ctxt ctxt = {
+      .start_key      = start_key,
+      .end_key        = end_key,
+      .num_partitions = max_partitions,
+      .boundaries     = boundaries,
+   };
+
+   trunk_node root;
+   trunk_root_get(spl, &root);
+
+   // Estimate how far down there are enough pivots to choose from
+   uint16 end = 0;
+   while (end < trunk_num_children(spl, &root)
+          && trunk_key_compare(spl, trunk_get_pivot(spl, &root, end), end_key)
+                < 0)
+   {
+      end++;
+   }
+   uint16 first =
+      trunk_key_compare(spl, trunk_min_key(spl, &root), start_key) < 0
+         ? trunk_find_pivot(spl, &root, start_key, less_than_or_equal)
+         : 0;
+   uint64 estimate = end - first;
+   ctxt.height     = trunk_node_height(&root);
+   while (ctxt.height > 0
+          && estimate < max_partitions * TRUNK_SPLIT_RANGE_OVERSAMPLE)
+   {
+      estimate *= MAX(spl->cfg.fanout / 2, 2);
+      ctxt.height--;
+   }
+
+   platform_status rc = STATUS_OK;
+   if (max_partitions > 1) {
+      rc = trunk_split_range_visit_node(spl, &ctxt, &root, 0);
+   }
+   trunk_node_unget(spl->cc, &root);
+   if (!SUCCESS(rc) || max_partitions == 1) {
+      goto out;
+   }
+
+   ctxt.placing = TRUE;
+   trunk_root_get(spl, &root);
+   if (trunk_node_height(&root) < ctxt.height) {
+      // the tree shrank in between
+      ctxt.height = trunk_node_height(&root);
+   }
+   rc = trunk_split_range_visit_node(spl, &ctxt, &root, 0);
+   trunk_node_unget(spl->cc, &root);
+
+out:
+   *num_partitions = ctxt.num_boundaries + 1;
+   return rc;
+}
+
+
+/*
+ * Finalizes the current memtable and waits until it, and every memtable
+ * before it, is incorporated. Without background threads, the incorporation
+ * is a task this thread has to perform itself.
+ */
+static void
+trunk_incorporate_memtables(trunk_handle *spl)
+{
+   uint64          generation;
+   uint64          wait = 100;
+   platform_status rc   = memtable_rotate(spl->mt_ctxt, &generation);
+   while (!SUCCESS(rc)
+          || memtable_generation_retired(spl->mt_ctxt) + 1 < generation)
+   {
+      platform_assert(SUCCESS(rc) || STATUS_IS_EQ(rc, STATUS_BUSY));
+      platform_status task_rc =
+         task_perform_one_if_needed(spl->ts, spl->cfg.queue_scale_percent);
+      if (!SUCCESS(task_rc)) {
+         platform_sleep_ns(wait);
+         wait = wait > 2048 ? wait : 2 * wait;
+      }
+      if (!SUCCESS(rc)) {
+         rc = memtable_rotate(spl->mt_ctxt, &generation);
+      }
+   }
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Range deletes
+ *
+ *      trunk_delete_range appends [start, end) to the range delete table,
+ *      stamped with the generation of the current memtable, so the older
+ *      memtables and branches are covered. Lookups stop at the first memtable
+ *      or branch older than a range delete covering their key, and iterators
+ *      and compactions skip the tuples it covers, so compactions eventually
+ *      drop them. The keys of the range in the current memtable itself get a
+ *      point delete each, so the cost of a range delete grows with the part
+ *      of the range which was written since the last memtable rotation.
+ *
+ *      The range delete and those point deletes are logged as one log batch.
+ *      Replay applies the range delete once every message logged before it
+ *      is applied, see trunk_replay_log.
+ *
+ *      Once no memtable or branch older than a range delete is left in a
+ *      pivot overlapping its range, it has nothing left to hide and is
+ *      retired. A compaction output holds nothing the range deletes it
+ *      applied cover, so it takes their generation. Retirement is attempted
+ *      when the table fills up. If that frees no room, the ranges of the
+ *      pending range deletes are flushed down and their leaves compacted, and
+ *      retirement is tried again once the compactions are done.
+ *-----------------------------------------------------------------------------
+ */
+static inline uint32
+trunk_range_delete_encoded_size(key start_key, key end_key)
+{
+   return sizeof(trunk_range_delete_hdr) + key_length(start_key)
+          + key_length(end_key);
+}
+
+static bool32
+trunk_range_delete_table_has_room(const trunk_range_delete_table *table,
+                                  uint32                          size)
+{
+   return table->num_range_deletes < TRUNK_MAX_RANGE_DELETES
+          && table->num_bytes + size <= sizeof(table->data);
+}
+
+static bool32
+trunk_range_deletes_have_room(trunk_handle *spl, uint32 size)
+{
+   trunk_range_deletes_get(spl);
+   bool32 has_room =
+      trunk_range_delete_table_has_room(&spl->range_deletes, size);
+   trunk_range_deletes_unget(spl);
+   return has_room;
+}
+
+/*
+ * Appends [start_key, end_key) to the range delete table, stamped with the
+ * absolute generation of the current memtable. Must hold its insert lock.
+ * Returns STATUS_LIMIT_EXCEEDED if the table is full.
+ */
+static platform_status
+trunk_range_delete_publish(trunk_handle *spl,
+                           key           start_key,
+                           key           end_key,
+                           uint64        generation)
+{
+   trunk_range_delete_table *table = &spl->range_deletes;
+   uint32 size = trunk_range_delete_encoded_size(start_key, end_key);
+
+   trunk_range_deletes_lock(spl);
+   if (!trunk_range_delete_table_has_room(table, size)) {
+      trunk_range_deletes_unlock(spl);
+      return STATUS_LIMIT_EXCEEDED;
+   }
+   trunk_range_delete_hdr *range_delete =
+      trunk_range_delete_at(table, table->num_bytes);
+   range_delete->generation   = trunk_absolute_generation(spl, generation);
+   range_delete->start_length = key_length(start_key);
+   range_delete->end_length   = key_length(end_key);
+   memmove(range_delete->key_data, key_data(start_key), key_length(start_key));
+   memmove(range_delete->key_data + range_delete->start_length,
+           key_data(end_key),
+           key_length(end_key));
+   table->num_bytes += size;
+   table->num_range_deletes++;
+   trunk_range_deletes_unlock(spl);
+   return STATUS_OK;
+}
+
+typedef struct trunk_range_delete_retire_scratch {
+   trunk_range_delete_set set;
+   bool32                 live[TRUNK_MAX_RANGE_DELETES];
+} trunk_range_delete_retire_scratch;
+
+/*
+ * Returns TRUE if a branch of the pivot is older than generation.
+ */
+static bool32
+trunk_pivot_has_branch_older_than(trunk_handle     *spl,
+                                  trunk_node       *node,
+                                  trunk_pivot_data *pdata,
+                                  uint64            generation)
+{
+   for (uint16 branch_no = pdata->start_branch;
+        branch_no != trunk_end_branch(spl, node);
+        branch_no = trunk_add_branch_number(spl, branch_no, 1))
+   {
+      trunk_branch *branch = trunk_get_branch(spl, node, branch_no);
+      if (branch->generation < generation) {
+         return TRUE;
+      }
+   }
+   return FALSE;
+}
+
+/*
+ * Returns TRUE if pivot_no of node overlaps [start_key, end_key).
+ */
+static bool32
+trunk_pivot_overlaps(trunk_handle *spl,
+                     trunk_node   *node,
+                     uint16        pivot_no,
+                     key           start_key,
+                     key           end_key)
+{
+   key min_key = trunk_get_pivot(spl, node, pivot_no);
+   key max_key = trunk_get_pivot(spl, node, pivot_no + 1);
+   return trunk_key_compare(spl, min_key, end_key) < 0
+          && trunk_key_compare(spl, start_key, max_key) < 0;
+}
+
+/*
+ * Marks live the range deletes overlapping a pivot of the node which are
+ * newer than one of its branches.
+ */
+static bool32
+trunk_node_mark_live_range_deletes(trunk_handle *spl, uint64 addr, void *arg)
+{
+   trunk_range_delete_retire_scratch *scratch = arg;
+
+   trunk_node node;
+   trunk_node_get(spl->cc, addr, &node);
+   uint16 num_children = trunk_num_children(spl, &node);
+   for (uint32 i = 0; i < scratch->set.table.num_range_deletes; i++) {
+      merge_range_delete *range_delete = &scratch->set.range_delete[i];
+      for (uint16 pivot_no = 0; pivot_no < num_children && !scratch->live[i];
+           pivot_no++)
+      {
+         trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, pivot_no);
+         scratch->live[i] =
+            trunk_pivot_overlaps(
+               spl, &node, pivot_no, range_delete->start, range_delete->end)
+            && trunk_pivot_has_branch_older_than(
+               spl, &node, pdata, range_delete->generation);
+      }
+   }
+   trunk_node_unget(spl->cc, &node);
+   return TRUE;
+}
+
+/*
+ * Removes the range deletes which no longer cover any memtable or branch of
+ * the live tree. Range deletes are only ever appended, so the ones checked
+ * are still the first in the table.
+ */
+static platform_status
+trunk_range_deletes_retire(trunk_handle *spl)
+{
+   trunk_range_delete_retire_scratch *scratch =
+      TYPED_ZALLOC(spl->heap_id, scratch);
+   if (scratch == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+
+   platform_mutex_lock(&spl->range_delete_retire_mutex);
+   trunk_range_delete_set_copy_live(spl, &scratch->set);
+   uint32 num_checked = scratch->set.table.num_range_deletes;
+
+   // Memtables are checked before the tree, which they may move into
+   uint64 first_unincorporated = trunk_absolute_generation(
+      spl, memtable_generation_retired(spl->mt_ctxt) + 1);
+   for (uint32 i = 0; i < num_checked; i++) {
+      if (first_unincorporated < scratch->set.range_delete[i].generation) {
+         scratch->live[i] = TRUE;
+      }
+   }
+
+   platform_batch_rwlock_get(&spl->trunk_root_lock, TRUNK_ROOT_LOCK_IDX);
+   trunk_for_each_subtree(
+      spl, spl->root_addr, trunk_node_mark_live_range_deletes, scratch);
+   platform_batch_rwlock_unget(&spl->trunk_root_lock, TRUNK_ROOT_LOCK_IDX);
+
+   trunk_range_delete_table *table        = &spl->range_deletes;
+   uint32                    read_offset  = 0;
+   uint32                    write_offset = 0;
+   uint32                    num_kept     = 0;
+   trunk_range_deletes_lock(spl);
+   for (uint32 i = 0; i < table->num_range_deletes; i++) {
+      trunk_range_delete_hdr *range_delete =
+         trunk_range_delete_at(table, read_offset);
+      uint32 size = trunk_range_delete_size(range_delete);
+      if (num_checked <= i || scratch->live[i]) {
+         memmove(&table->data[write_offset], range_delete, size);
+         write_offset += size;
+         num_kept++;
+      }
+      read_offset += size;
+   }
+   table->num_range_deletes = num_kept;
+   table->num_bytes         = write_offset;
+   trunk_range_deletes_unlock(spl);
+   platform_mutex_unlock(&spl->range_delete_retire_mutex);
+
+   platform_free(spl->heap_id, scratch);
+   return STATUS_OK;
+}
+
+static bool32
+trunk_room_to_flush_child(trunk_handle     *spl,
+                          trunk_node       *parent,
+                          trunk_pivot_data *pdata)
+{
+   trunk_node child;
+   trunk_node_get(spl->cc, pdata->addr, &child);
+   bool32 has_room = trunk_room_to_flush(spl, parent, &child, pdata);
+   trunk_node_unget(spl->cc, &child);
+   return has_room;
+}
+
+/*
+ * Flushes the branches older than generation out of the pivots at height
+ * which overlap [start_key, end_key), or compacts the leaves holding such
+ * branches, adding the number of flushes and compactions to *num_compactions.
+ * The nodes are changed in a copy of their path, as compactions change them,
+ * so snapshots and checkpoints still see the tree as it was.
+ *
+ * Leaves with bundles still being compacted are skipped, since compacting
+ * the leaf would discard those bundles; the caller tries again later.
+ */
+static platform_status
+trunk_range_delete_compact_height(trunk_handle *spl,
+                                  key           start_key,
+                                  key           end_key,
+                                  uint16        height,
+                                  uint64        generation,
+                                  uint64       *num_compactions)
+{
+   DECLARE_AUTO_KEY_BUFFER(next_key, spl->heap_id);
+   platform_status rc = key_buffer_copy_key(&next_key, start_key);
+   while (SUCCESS(rc)
+          && trunk_key_compare(spl, key_buffer_key(&next_key), end_key) < 0)
+   {
+      trunk_node node;
+      uint64     old_root_addr;
+      trunk_copy_path_by_key_and_height(
+         spl, key_buffer_key(&next_key), height, &node, &old_root_addr);
+      if (trunk_node_is_leaf(&node)) {
+         trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, 0);
+         if (trunk_bundle_count(spl, &node) == 0
+             && trunk_pivot_has_branch_older_than(
+                spl, &node, pdata, generation))
+         {
+            trunk_compact_leaf(spl, &node);
+            (*num_compactions)++;
+         }
+      } else {
+         // flushes may split children, so the pivot count is read every time
+         for (uint16 pivot_no = 0; pivot_no < trunk_num_children(spl, &node);
+              pivot_no++)
+         {
+            trunk_pivot_data *pdata =
+               trunk_get_pivot_data(spl, &node, pivot_no);
+            if (trunk_pivot_overlaps(spl, &node, pivot_no, start_key, end_key)
+                && trunk_pivot_has_branch_older_than(
+                   spl, &node, pdata, generation)
+                && trunk_room_to_flush_child(spl, &node, pdata))
+            {
+               rc = trunk_flush(spl, &node, pdata, FALSE);
+               if (!SUCCESS(rc)) {
+                  break;
+               }
+               (*num_compactions)++;
+            }
+         }
+      }
+      if (SUCCESS(rc)) {
+         rc = key_buffer_copy_key(&next_key, trunk_max_key(spl, &node));
+      }
+      trunk_node_unlock(spl, &node);
+      trunk_node_unclaim(spl->cc, &node);
+      trunk_node_unget(spl->cc, &node);
+   }
+   return rc;
+}
+
+/*
+ * Pushes the branches older than the range deletes in set down their ranges,
+ * from the root to the leaves, and compacts those leaves, so the compactions
+ * drop the tuples the range deletes cover. Does not wait for the compactions.
+ */
+static platform_status
+trunk_range_deletes_compact(trunk_handle           *spl,
+                            trunk_range_delete_set *set,
+                            uint64                 *num_compactions)
+{
+   trunk_node root;
+   trunk_root_get(spl, &root);
+   uint16 root_height = trunk_node_height(&root);
+   trunk_node_unget(spl->cc, &root);
+
+   platform_status rc = STATUS_OK;
+   for (uint32 i = 0; SUCCESS(rc) && i < set->table.num_range_deletes; i++) {
+      merge_range_delete *range_delete = &set->range_delete[i];
+      for (uint16 h = root_height + 1; SUCCESS(rc) && h != 0; h--) {
+         rc = trunk_range_delete_compact_height(spl,
+                                                range_delete->start,
+                                                range_delete->end,
+                                                h - 1,
+                                                range_delete->generation,
+                                                num_compactions);
+      }
+   }
+   return rc;
+}
+
+/*
+ * Performs tasks, retiring range deletes as they finish, until there is room
+ * for size more bytes in the range delete table or the tasks are all done.
+ */
+static platform_status
+trunk_range_deletes_wait_for_room(trunk_handle *spl,
+                                  uint32        size,
+                                  bool32       *has_room)
+{
+   uint64 wait = 1;
+   while (TRUE) {
+      bool32          was_quiescent = task_system_is_quiescent(spl->ts);
+      platform_status rc            = trunk_range_deletes_retire(spl);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+      *has_room = trunk_range_deletes_have_room(spl, size);
+      if (*has_room || was_quiescent) {
+         return STATUS_OK;
+      }
+      rc = task_perform_one_if_needed(spl->ts, 0);
+      if (SUCCESS(rc)) {
+         wait = 1;
+      } else {
+         platform_sleep_ns(wait);
+         wait = MIN(2 * wait, 1 << 16);
+      }
+   }
+}
+
+/*
+ * Makes room for size more bytes in the range delete table. Retires what it
+ * can, and if that is not enough, compacts the ranges of the pending range
+ * deletes and retires them as their compactions finish, until there is room
+ * or nothing is left to compact. Every round compacts only branches older
+ * than a pending range delete, which later writes do not add to, so this
+ * ends. Returns STATUS_LIMIT_EXCEEDED if there is still no room.
+ */
+static platform_status
+trunk_range_deletes_make_room(trunk_handle *spl, uint32 size)
+{
+   platform_status rc = trunk_range_deletes_retire(spl);
+   if (!SUCCESS(rc) || trunk_range_deletes_have_room(spl, size)) {
+      return rc;
+   }
+
+   trunk_range_delete_set *set = TYPED_MALLOC(spl->heap_id, set);
+   if (set == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+   bool32 has_room        = FALSE;
+   uint64 num_compactions = 1;
+   while (SUCCESS(rc) && !has_room && num_compactions != 0) {
+      // The memtables go first, so the range deletes only cover branches
+      trunk_incorporate_memtables(spl);
+      trunk_range_delete_set_copy_live(spl, set);
+      num_compactions = 0;
+      rc              = trunk_range_deletes_compact(spl, set, &num_compactions);
+      if (SUCCESS(rc)) {
+         rc = trunk_range_deletes_wait_for_room(spl, size, &has_room);
+      }
+   }
+   platform_free(spl->heap_id, set);
+   if (SUCCESS(rc) && !has_room) {
+      rc = STATUS_LIMIT_EXCEEDED;
+   }
+   return rc;
+}
+
+/*
+ * Copies into keys the next up to TRUNK_RANGE_DELETE_CHUNK keys of the
+ * memtable from resume_key (as per start_type) to end_key which are not
+ * deleted yet. A count less than TRUNK_RANGE_DELETE_CHUNK means the range is
+ * done. Must hold the insert lock of the memtable.
+ */
+#define TRUNK_RANGE_DELETE_CHUNK (64)
+
+static platform_status
+trunk_range_delete_collect_keys(trunk_handle *spl,        // IN
+                                memtable     *mt,         // IN
+                                key           start_key,  // IN
+                                key           end_key,    // IN
+                                key           resume_key, // IN
+                                comparison    start_type, // IN
+                                key_buffer    keys[],     // OUT
+                                uint64       *num_keys)   // OUT
+{
+   btree_iterator btree_itor;
+   trunk_memtable_iterator_init(spl,
+                                &btree_itor,
+                                mt->root_addr,
+                                start_key,
+                                end_key,
+                                resume_key,
+                                start_type,
+                                TRUE,
+                                FALSE);
+   iterator       *itor = (iterator *)&btree_itor;
+   platform_status rc   = STATUS_OK;
+   *num_keys            = 0;
+   while (*num_keys < TRUNK_RANGE_DELETE_CHUNK && iterator_can_curr(itor)) {
+      key     tuple_key;
+      message msg;
+      iterator_curr(itor, &tuple_key, &msg);
+      if (message_class(msg) != MESSAGE_TYPE_DELETE) {
+         rc = key_buffer_copy_key(&keys[*num_keys], tuple_key);
+         if (!SUCCESS(rc)) {
+            break;
+         }
+         (*num_keys)++;
+      }
+      rc = iterator_next(itor);
+      if (!SUCCESS(rc)) {
+         break;
+      }
+   }
+   trunk_memtable_iterator_deinit(spl, &btree_itor, 0, FALSE);
+   return rc;
+}
+
+/*
+ * Inserts a point delete of tuple_key into mt and logs it in batch.
+ */
+static platform_status
+trunk_range_delete_memtable_key(trunk_handle *spl,
+                                memtable     *mt,
+                                key           tuple_key,
+                                uint64        generation,
+                                uint64        batch)
+{
+   uint64          leaf_generation;
+   platform_status rc = memtable_insert(spl->mt_ctxt,
+                                        mt,
+                                        spl->heap_id,
+                                        tuple_key,
+                                        DELETE_MESSAGE,
+                                        &leaf_generation);
+   if (SUCCESS(rc) && spl->log != NULL) {
+      int crappy_rc = log_write_entry(
+         spl->log,
+         LOG_ENTRY_MESSAGE,
+         batch,
+         tuple_key,
+         DELETE_MESSAGE,
+         trunk_log_generation(spl, generation, leaf_generation));
+      rc = crappy_rc == 0 ? STATUS_OK : STATUS_IO_ERROR;
+   }
+   return rc;
+}
+
+/*
+ * Deletes the keys of [start_key, end_key) in the current memtable, which the
+ * range delete stamped with its generation does not cover, and logs the point
+ * deletes in batch. Must hold the insert lock of generation.
+ *
+ * The keys are copied out a chunk at a time and deleted once the memtable
+ * iterator is released, as it holds its leaf read locked.
+ */
+static platform_status
+trunk_range_delete_memtable(trunk_handle *spl,
+                            key           start_key,
+                            key           end_key,
+                            uint64        generation,
+                            uint64        batch)
+{
+   memtable   *mt = trunk_get_memtable(spl, generation);
+   key_buffer *keys =
+      TYPED_ARRAY_MALLOC(spl->heap_id, keys, TRUNK_RANGE_DELETE_CHUNK);
+   if (keys == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+   for (uint64 i = 0; i < TRUNK_RANGE_DELETE_CHUNK; i++) {
+      key_buffer_init(&keys[i], spl->heap_id);
+   }
+   DECLARE_AUTO_KEY_BUFFER(resume, spl->heap_id);
+   platform_status rc         = key_buffer_copy_key(&resume, start_key);
+   comparison      start_type = greater_than_or_equal;
+   uint64          num_keys   = TRUNK_RANGE_DELETE_CHUNK;
+   while (SUCCESS(rc) && num_keys == TRUNK_RANGE_DELETE_CHUNK) {
+      rc = trunk_range_delete_collect_keys(spl,
+                                           mt,
+                                           start_key,
+                                           end_key,
+                                           key_buffer_key(&resume),
+                                           start_type,
+                                           keys,
+                                           &num_keys);
+      for (uint64 i = 0; SUCCESS(rc) && i < num_keys; i++) {
+         rc = trunk_range_delete_memtable_key(
+            spl, mt, key_buffer_key(&keys[i]), generation, batch);
+      }
+      if (SUCCESS(rc) && num_keys != 0) {
+         rc = key_buffer_copy_key(&resume, key_buffer_key(&keys[num_keys - 1]));
+         start_type = greater_than;
+      }
+   }
+
+   /*
+    * A memtable with a range delete must not be empty, so it is rotated like
+    * any other, and range deletes published after the rotation get a newer
+    * generation. Deleting start_key changes nothing the range delete does not.
+    */
+   if (SUCCESS(rc) && memtable_is_empty(spl->mt_ctxt)) {
+      rc = trunk_range_delete_memtable_key(
+         spl, mt, start_key, generation, batch);
+   }
+
+   for (uint64 i = 0; i < TRUNK_RANGE_DELETE_CHUNK; i++) {
+      key_buffer_deinit(&keys[i]);
+   }
+   platform_free(spl->heap_id, keys);
+   return rc;
+}
+
+/*
+ * The range delete is published and logged, and the current memtable is
+ * cleared of its range, under one hold of the insert lock, so no rotation
+ * can come in between. The log entries form one log batch.
+ */
+platform_status
+trunk_delete_range(trunk_handle *spl, key start_key, key end_key)
+{
+   debug_assert(key_is_user_key(start_key) && key_is_user_key(end_key));
+   if (trunk_max_key_size(spl) < key_length(start_key)
+       || trunk_max_key_size(spl) < key_length(end_key)
+       || trunk_key_compare(spl, start_key, end_key) >= 0)
+   {
+      return STATUS_BAD_PARAM;
+   }
+
+   uint32 size = trunk_range_delete_encoded_size(start_key, end_key);
+   if (TRUNK_RANGE_DELETE_TABLE_SIZE < size) {
+      return STATUS_LIMIT_EXCEEDED;
+   }
+
+   uint64          generation;
+   platform_status rc;
+   while (TRUE) {
+      rc = trunk_memtable_begin_insert(spl, &generation);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+      rc = trunk_range_delete_publish(spl, start_key, end_key, generation);
+      if (SUCCESS(rc)) {
+         break;
+      }
+      // make room outside the insert lock, so rotation is not held up
+      memtable_end_insert(spl->mt_ctxt);
+      rc = trunk_range_deletes_make_room(spl, size);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+   }
+
+   uint64 batch = LOG_NO_BATCH;
+   if (spl->log != NULL) {
+      batch = __sync_add_and_fetch(&spl->last_log_batch, 1);
+      int crappy_rc = log_write_entry(
+         spl->log,
+         LOG_ENTRY_RANGE_DELETE,
+         batch,
+         start_key,
+         message_create(MESSAGE_TYPE_INSERT, key_slice(end_key)),
+         trunk_log_generation(spl, generation, 0));
+      rc = crappy_rc == 0 ? STATUS_OK : STATUS_IO_ERROR;
+   }
+   if (SUCCESS(rc)) {
+      rc = trunk_range_delete_memtable(
+         spl, start_key, end_key, generation, batch);
+   }
+   if (SUCCESS(rc) && spl->log != NULL) {
+      int crappy_rc = log_write_entry(spl->log,
+                                      LOG_ENTRY_BATCH_END,
+                                      batch,
+                                      NULL_KEY,
+                                      NULL_MESSAGE,
+                                      trunk_log_generation(spl, generation, 0));
+      rc = crappy_rc == 0 ? STATUS_OK : STATUS_IO_ERROR;
+   }
+
+   log_handle *log = trunk_log_pin(spl);
+   memtable_end_insert(spl->mt_ctxt);
+   trunk_log_sync_and_unpin(spl, log);
+   task_perform_one_if_needed(spl->ts, spl->cfg.queue_scale_percent);
+   return rc;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Bulk load
+ *
+ *      trunk_bulk_load builds the tree of an empty database bottom up from a
+ *      sorted iterator. The input is cut into runs of at most a leaf's target
+ *      size. Each run is packed straight into a branch by btree_pack, whose
+ *      fingerprints give its routing filter, and becomes a leaf holding that
+ *      one whole branch. Index nodes are filled left to right with up to
+ *      fanout children as their children are finished, so the data is
+ *      written exactly once and never goes through the memtable, flushes or
+ *      compactions.
+ *
+ *      The loaded branches are stamped one generation before the current
+ *      memtable, so range deletes issued afterwards cover them. Generations
+ *      start at 1, which keeps this defined for a new database.
+ *
+ *      Nothing of a bulk load is logged. Instead, the new root is switched in
+ *      and checkpointed before trunk_bulk_load returns, so the super block
+ *      names it and a crash afterwards recovers it. The replaced empty tree
+ *      is destroyed like a retired snapshot; its node pages, like every node
+ *      copy, belong to the trunk mini allocator.
+ *-----------------------------------------------------------------------------
+ */
+
+/*
+ * Iterator over one run of the input. It ends at the run's size limits, and
+ * early, with rc set, at a tuple that is out of order or too large.
+ */
+typedef struct trunk_bulk_load_run {
+   iterator        super;
+   trunk_handle   *spl;
+   iterator       *source;
+   uint64          max_tuples;
+   uint64          max_kv_bytes;
+   uint64          num_tuples;
+   uint64          kv_bytes;
+   bool32          has_last_key;
+   key_buffer      last_key; // last key handed out, to check the order
+   platform_status rc;
+} trunk_bulk_load_run;
+
+/*
+ * Checks the current tuple of the input, which must be valid.
+ */
+static bool32
+trunk_bulk_load_run_check_curr(trunk_bulk_load_run *run)
+{
+   trunk_handle *spl = run->spl;
+   key           tuple_key;
+   message       msg;
+   iterator_curr(run->source, &tuple_key, &msg);
+   if (trunk_max_key_size(spl) < key_length(tuple_key)
+       || MAX_INLINE_MESSAGE_SIZE(trunk_page_size(&spl->cfg))
+             < message_length(msg)
+       || (run->has_last_key
+           && trunk_key_compare(spl, key_buffer_key(&run->last_key), tuple_key)
+                 >= 0))
+   {
+      run->rc = STATUS_BAD_PARAM;
+      return FALSE;
+   }
+   return TRUE;
+}
+
+static void
+trunk_bulk_load_run_curr(iterator *itor, key *curr_key, message *data)
+{
+   trunk_bulk_load_run *run = (trunk_bulk_load_run *)itor;
+   iterator_curr(run->source, curr_key, data);
+}
+
+static bool32
+trunk_bulk_load_run_can_prev(iterator *itor)
+{
+   trunk_bulk_load_run *run = (trunk_bulk_load_run *)itor;
+   return iterator_can_prev(run->source);
+}
+
+static bool32
+trunk_bulk_load_run_can_next(iterator *itor)
+{
+   trunk_bulk_load_run *run = (trunk_bulk_load_run *)itor;
+   return SUCCESS(run->rc) && run->num_tuples < run->max_tuples
+          && run->kv_bytes < run->max_kv_bytes
+          && iterator_can_next(run->source)
+          && trunk_bulk_load_run_check_curr(run);
+}
+
+static platform_status
+trunk_bulk_load_run_next(iterator *itor)
+{
+   trunk_bulk_load_run *run = (trunk_bulk_load_run *)itor;
+   key                  tuple_key;
+   message              msg;
+   iterator_curr(run->source, &tuple_key, &msg);
+   platform_status rc = key_buffer_copy_key(&run->last_key, tuple_key);
+   if (!SUCCESS(rc)) {
+      run->rc = rc;
+      return rc;
+   }
+   run->has_last_key = TRUE;
+   run->num_tuples++;
+   run->kv_bytes += key_length(tuple_key) + message_length(msg);
+   rc = iterator_next(run->source);
+   if (!SUCCESS(rc)) {
+      run->rc = rc;
+   }
+   return rc;
+}
+
+static const iterator_ops trunk_bulk_load_run_ops = {
+   .curr     = trunk_bulk_load_run_curr,
+   .can_prev = trunk_bulk_load_run_can_prev,
+   .can_next = trunk_bulk_load_run_can_next,
+   .next     = trunk_bulk_load_run_next,
+};
+
+/*
+ * The index node being filled at each height.
+ */
+typedef struct trunk_bulk_load_builder {
+   trunk_node node[TRUNK_MAX_HEIGHT];
+   bool32     is_open[TRUNK_MAX_HEIGHT];
+   uint16     num_children[TRUNK_MAX_HEIGHT];
+} trunk_bulk_load_builder;
+
+static void
+trunk_bulk_load_init_node(trunk_handle *spl, uint16 height, trunk_node *node)
+{
+   trunk_alloc(spl->cc, &spl->mini, height, node);
+   memset(node->hdr, 0, trunk_page_size(&spl->cfg));
+   node->hdr->node_id = trunk_next_node_id(spl);
+   node->hdr->height  = height;
+}
+
+/*
+ * Completes the pivots of an index node with its upper bound.
+ */
+static void
+trunk_bulk_load_set_max_key(trunk_handle *spl,
+                            trunk_node   *node,
+                            uint16        num_children,
+                            key           max_key)
+{
+   trunk_set_num_pivot_keys(spl, node, num_children + 1);
+   trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, num_children);
+   ZERO_CONTENTS(pdata);
+   pdata->srq_idx = -1;
+   copy_key_to_ondisk_key(&pdata->pivot, max_key);
+   node->hdr->pivot_generation = num_children;
+   debug_assert(trunk_verify_node(spl, node));
+}
+
+static void
+trunk_bulk_load_add_child(trunk_handle            *spl,
+                          trunk_bulk_load_builder *builder,
+                          trunk_node              *child);
+
+/*
+ * Bounds the index node being filled at height and hands it to its parent.
+ */
+static void
+trunk_bulk_load_finish_node(trunk_handle            *spl,
+                            trunk_bulk_load_builder *builder,
+                            uint16                   height,
+                            key                      max_key)
+{
+   trunk_node *node = &builder->node[height];
+   trunk_bulk_load_set_max_key(
+      spl, node, builder->num_children[height], max_key);
+   trunk_bulk_load_add_child(spl, builder, node);
+   trunk_node_unlock(spl, node);
+   trunk_node_unclaim(spl->cc, node);
+   trunk_node_unget(spl->cc, node);
+   builder->is_open[height] = FALSE;
+}
+
+/*
+ * Adds child as the last child of the index node being filled above it,
+ * first finishing that node if it already has fanout children.
+ */
+static void
+trunk_bulk_load_add_child(trunk_handle            *spl,
+                          trunk_bulk_load_builder *builder,
+                          trunk_node              *child)
+{
+   uint16 height = trunk_node_height(child) + 1;
+   platform_assert(height < TRUNK_MAX_HEIGHT,
+                   "bulk load exceeds the maximum trunk height %u\n",
+                   TRUNK_MAX_HEIGHT);
+   trunk_node *parent    = &builder->node[height];
+   key         child_min = trunk_min_key(spl, child);
+   if (builder->is_open[height]
+       && builder->num_children[height] == spl->cfg.fanout)
+   {
+      trunk_bulk_load_finish_node(spl, builder, height, child_min);
+   }
+   if (!builder->is_open[height]) {
+      trunk_bulk_load_init_node(spl, height, parent);
+      builder->is_open[height]      = TRUE;
+      builder->num_children[height] = 0;
+   }
+
+   uint16            pivot_no = builder->num_children[height]++;
+   trunk_pivot_data *pdata    = trunk_get_pivot_data(spl, parent, pivot_no);
+   ZERO_CONTENTS(pdata);
+   pdata->addr       = child->addr;
+   pdata->generation = pivot_no;
+   pdata->srq_idx    = -1;
+   copy_key_to_ondisk_key(&pdata->pivot, child_min);
+}
+
+/*
+ * Finishes the index nodes still being filled, all of which end the key
+ * space, and returns the address of the root, or 0 if no leaf was built.
+ */
+static uint64
+trunk_bulk_load_finish(trunk_handle *spl, trunk_bulk_load_builder *builder)
+{
+   for (uint16 height = 1; height < TRUNK_MAX_HEIGHT; height++) {
+      if (!builder->is_open[height]) {
+         continue;
+      }
+      bool32 is_root = TRUE;
+      for (uint16 above = height + 1; above < TRUNK_MAX_HEIGHT; above++) {
+         is_root = is_root && !builder->is_open[above];
+      }
+      if (!is_root) {
+         trunk_bulk_load_finish_node(
+            spl, builder, height, POSITIVE_INFINITY_KEY);
+         continue;
+      }
+
+      trunk_node *root = &builder->node[height];
+      trunk_bulk_load_set_max_key(
+         spl, root, builder->num_children[height], POSITIVE_INFINITY_KEY);
+      uint64 root_addr = root->addr;
+      trunk_node_unlock(spl, root);
+      trunk_node_unclaim(spl->cc, root);
+      trunk_node_unget(spl->cc, root);
+      builder->is_open[height] = FALSE;
+      return root_addr;
+   }
+   return 0;
+}
+
+/*
+ * Makes the packed run a leaf over [min_key, max_key).
+ */
+static void
+trunk_bulk_load_add_leaf(trunk_handle            *spl,
+                         trunk_bulk_load_builder *builder,
+                         btree_pack_req          *req,
+                         routing_filter          *filter,
+                         uint64                   generation,
+                         key                      min_key,
+                         key                      max_key)
+{
+   trunk_node leaf;
+   trunk_bulk_load_init_node(spl, 0, &leaf);
+   trunk_set_initial_pivots(spl, &leaf);
+   trunk_inc_pivot_generation(spl, &leaf);
+   copy_key_to_ondisk_key(&trunk_get_pivot_data(spl, &leaf, 0)->pivot,
+                          min_key);
+   copy_key_to_ondisk_key(&trunk_get_pivot_data(spl, &leaf, 1)->pivot,
+                          max_key);
+
+   trunk_branch *branch        = trunk_get_new_branch(spl, &leaf);
+   branch->root_addr           = req->root_addr;
+   branch->generation          = generation;
+   leaf.hdr->start_frac_branch = trunk_end_branch(spl, &leaf);
+
+   trunk_pivot_data *pdata   = trunk_get_pivot_data(spl, &leaf, 0);
+   pdata->filter             = *filter;
+   pdata->num_tuples_whole   = req->num_tuples;
+   pdata->num_kv_bytes_whole = req->key_bytes + req->message_bytes;
+   debug_assert(trunk_verify_node(spl, &leaf));
+
+   trunk_bulk_load_add_child(spl, builder, &leaf);
+   trunk_node_unlock(spl, &leaf);
+   trunk_node_unclaim(spl->cc, &leaf);
+   trunk_node_unget(spl->cc, &leaf);
+}
+
+static bool32
+trunk_node_has_no_branches(trunk_handle *spl, uint64 addr, void *arg)
+{
+   trunk_node node;
+   trunk_node_get(spl->cc, addr, &node);
+   bool32 has_no_branches = trunk_branch_count(spl, &node) == 0;
+   trunk_node_unget(spl->cc, &node);
+   return has_no_branches;
+}
+
+/*
+ * A bulk load replaces the tree, so the tree, the memtables and the range
+ * delete table must hold nothing.
+ */
+static platform_status
+trunk_bulk_load_check_empty(trunk_handle *spl)
+{
+   if (!memtable_is_empty(spl->mt_ctxt)
+       || memtable_generation_retired(spl->mt_ctxt) + 1
+             != memtable_generation(spl->mt_ctxt))
+   {
+      return STATUS_INVALID_STATE;
+   }
+
+   if (spl->range_deletes.num_range_deletes != 0) {
+      platform_status rc = trunk_range_deletes_retire(spl);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+      if (spl->range_deletes.num_range_deletes != 0) {
+         return STATUS_INVALID_STATE;
+      }
+   }
+
+   platform_batch_rwlock_get(&spl->trunk_root_lock, TRUNK_ROOT_LOCK_IDX);
+   bool32 is_empty = trunk_for_each_subtree(
+      spl, spl->root_addr, trunk_node_has_no_branches, NULL);
+   platform_batch_rwlock_unget(&spl->trunk_root_lock, TRUNK_ROOT_LOCK_IDX);
+   return is_empty ? STATUS_OK : STATUS_INVALID_STATE;
+}
+
+platform_status
+trunk_bulk_load(trunk_handle *spl, iterator *itor)
+{
+   platform_status rc = trunk_bulk_load_check_empty(spl);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+
+   trunk_bulk_load_run *run = TYPED_ZALLOC(spl->heap_id, run);
+   if (run == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+   trunk_bulk_load_builder *builder = TYPED_ZALLOC(spl->heap_id, builder);
+   if (builder == NULL) {
+      platform_free(spl->heap_id, run);
+      return STATUS_NO_MEMORY;
+   }
+   run->super.ops    = &trunk_bulk_load_run_ops;
+   run->spl          = spl;
+   run->source       = itor;
+   run->max_tuples   = spl->cfg.max_tuples_per_node;
+   run->max_kv_bytes = spl->cfg.target_leaf_kv_bytes;
+   run->rc           = STATUS_OK;
+   key_buffer_init(&run->last_key, spl->heap_id);
+
+   key_buffer min_key;
+   key_buffer max_key;
+   key_buffer_init_from_key(&min_key, spl->heap_id, NEGATIVE_INFINITY_KEY);
+   key_buffer_init(&max_key, spl->heap_id);
+
+   uint64 generation =
+      trunk_absolute_generation(spl, memtable_generation(spl->mt_ctxt)) - 1;
+   while (SUCCESS(rc)) {
+      run->num_tuples = 0;
+      run->kv_bytes   = 0;
+      if (!iterator_can_next(&run->super)) {
+         break;
+      }
+
+      btree_pack_req req;
+      rc = btree_pack_req_init(&req,
+                               spl->cc,
+                               &spl->cfg.btree_cfg,
+                               &run->super,
+                               spl->cfg.max_tuples_per_node,
+                               spl->cfg.filter_cfg.hash,
+                               spl->cfg.filter_cfg.seed,
+                               spl->heap_id);
+      if (!SUCCESS(rc)) {
+         break;
+      }
+      rc = btree_pack(&req);
+      if (!SUCCESS(rc) || req.num_tuples == 0) {
+         btree_pack_req_deinit(&req, spl->heap_id);
+         break;
+      }
+
+      routing_filter empty_filter = {0};
+      routing_filter filter;
+      rc = routing_filter_add(spl->cc,
+                              &spl->cfg.filter_cfg,
+                              &empty_filter,
+                              &filter,
+                              req.fingerprint_arr,
+                              req.num_tuples,
+                              0);
+      if (!SUCCESS(rc)) {
+         trunk_branch branch = {.root_addr = req.root_addr};
+         trunk_zap_branch_range(spl,
+                                &branch,
+                                NEGATIVE_INFINITY_KEY,
+                                POSITIVE_INFINITY_KEY,
+                                PAGE_TYPE_BRANCH);
+         btree_pack_req_deinit(&req, spl->heap_id);
+         break;
+      }
+
+      // The run ended before the next tuple, which bounds its leaf
+      key next_key = POSITIVE_INFINITY_KEY;
+      if (SUCCESS(run->rc) && iterator_can_next(itor)
+          && trunk_bulk_load_run_check_curr(run))
+      {
+         message msg;
+         iterator_curr(itor, &next_key, &msg);
+      }
+      rc = key_buffer_copy_key(&max_key, next_key);
+      platform_assert_status_ok(rc);
+      trunk_bulk_load_add_leaf(spl,
+                               builder,
+                               &req,
+                               &filter,
+                               generation,
+                               key_buffer_key(&min_key),
+                               key_buffer_key(&max_key));
+      btree_pack_req_deinit(&req, spl->heap_id);
+      rc = key_buffer_copy_key(&min_key, key_buffer_key(&max_key));
+      platform_assert_status_ok(rc);
+      rc = run->rc;
+   }
+   if (SUCCESS(rc)) {
+      rc = run->rc;
+   }
+
+   uint64 root_addr = trunk_bulk_load_finish(spl, builder);
+   if (root_addr != 0) {
+      if (SUCCESS(rc)) {
+         trunk_root_full_claim(spl);
+         trunk_root_lock(spl);
+         uint64 old_root_addr = spl->root_addr;
+         spl->root_addr       = root_addr;
+         trunk_root_unlock(spl);
+         trunk_root_full_unclaim(spl);
+         // drains the readers of the replaced tree and drops its references
+         trunk_for_each_subtree(spl, old_root_addr, trunk_node_destroy, NULL);
+         // nothing of the load is logged, so make it durable now
+         rc = trunk_checkpoint(spl);
+      } else {
+         trunk_for_each_subtree(spl, root_addr, trunk_node_destroy, NULL);
+      }
+   }
+
+   key_buffer_deinit(&max_key);
+   key_buffer_deinit(&min_key);
+   key_buffer_deinit(&run->last_key);
+   platform_free(spl->heap_id, builder);
+   platform_free(spl->heap_id, run);
+   return rc;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ * Snapshots
+ *
+ *      The trunk is copy-on-write, so a retired root still describes the tree
+ *      as of the moment it was replaced. A snapshot is such a root plus a
+ *      reference on every branch and filter reachable from it, taken exactly
+ *      as the node itself holds them, so compactions retiring those branches
+ *      from the live tree do not reclaim them. No data is copied.
+ *
+ *      Creating a snapshot first pushes the current memtable into the trunk,
+ *      so that the root alone covers every write made before the call. The
+ *      root and the range delete table are read under the root claim, since
+ *      retiring a range delete from the live tree says nothing about the
+ *      snapshot's older branches. The references are then taken walking the
+ *      tree without the claim, while flushes and compactions carry on. A
+ *      reference they drop meanwhile may be one the walk has yet to take, so
+ *      drops are deferred, see trunk_defer_drop, and made once no snapshot is
+ *      walking its tree.
+ *
+ *      Extent reference counts are 8 bits, and each snapshot adds to every
+ *      extent as many references as the tree holds on it, so at most
+ *      TRUNK_MAX_SNAPSHOTS can be live.
+ *-----------------------------------------------------------------------------
+ */
+
+/*
+ * Takes the references on the node's branches and filters that
+ * trunk_node_destroy drops.
+ */
+static bool32
+trunk_node_inc_snapshot_refs(trunk_handle *spl, uint64 addr, void *arg)
+{
+   trunk_node node;
+   trunk_node_get(spl->cc, addr, &node);
+   uint16 num_children = trunk_num_children(spl, &node);
+   for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
+      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, pivot_no);
+      if (pdata->filter.addr != 0) {
+         trunk_inc_filter(spl, &pdata->filter);
+      }
+      for (uint16 branch_no = pdata->start_branch;
+           branch_no != trunk_end_branch(spl, &node);
+           branch_no = trunk_add_branch_number(spl, branch_no, 1))
+      {
+         trunk_branch *branch    = trunk_get_branch(spl, &node, branch_no);
+         key           start_key = trunk_get_pivot(spl, &node, pivot_no);
+         key           end_key   = trunk_get_pivot(spl, &node, pivot_no + 1);
+
+         trunk_inc_branch_range(spl, branch, start_key, end_key);
+      }
+   }
+   uint16 start_filter = trunk_start_sb_filter(spl, &node);
+   uint16 end_filter   = trunk_end_sb_filter(spl, &node);
+   for (uint16 filter_no = start_filter; filter_no != end_filter;
+        filter_no        = trunk_add_subbundle_filter_number(spl, filter_no, 1))
+   {
+      routing_filter *filter = trunk_get_sb_filter(spl, &node, filter_no);
+      trunk_inc_filter(spl, filter);
+   }
+
+   trunk_node_unget(spl->cc, &node);
+   return TRUE;
+}
+
+/*
+ * Ends a snapshot's walk, and makes the deferred drops if it was the last.
+ */
+static void
+trunk_snapshot_walk_end(trunk_handle *spl)
+{
+   trunk_deferred_drop *drops = NULL;
+   platform_spin_lock(&spl->snapshot_lock);
+   spl->num_snapshot_walks--;
+   if (spl->num_snapshot_walks == 0) {
+      drops               = spl->deferred_drops;
+      spl->deferred_drops = NULL;
+   }
+   platform_spin_unlock(&spl->snapshot_lock);
+
+   while (drops != NULL) {
+      trunk_deferred_drop *drop = drops;
+      drops                     = drop->next;
+      if (drop->branch.root_addr != 0) {
+         btree_dec_ref_range(spl->cc,
+                             &spl->cfg.btree_cfg,
+                             drop->branch.root_addr,
+                             key_buffer_key(&drop->start_key),
+                             key_buffer_key(&drop->end_key));
+      } else {
+         routing_filter_zap(spl->cc, &drop->filter);
+      }
+      key_buffer_deinit(&drop->start_key);
+      key_buffer_deinit(&drop->end_key);
+      platform_free(spl->heap_id, drop);
+   }
+}
+
+platform_status
+trunk_snapshot_create(trunk_handle *spl, trunk_snapshot *snapshot)
+{
+   // Space reclamation rewrites nodes in place, under the snapshot's feet
+   if (spl->cfg.reclaim_threshold != UINT64_MAX) {
+      return STATUS_NOTSUP;
+   }
+
+   platform_spin_lock(&spl->snapshot_lock);
+   bool32 has_room = spl->num_snapshots < TRUNK_MAX_SNAPSHOTS;
+   if (has_room) {
+      spl->num_snapshots++;
+      spl->num_snapshot_walks++;
+   }
+   platform_spin_unlock(&spl->snapshot_lock);
+   if (!has_room) {
+      return STATUS_LIMIT_EXCEEDED;
+   }
+
+   trunk_incorporate_memtables(spl);
+
+   trunk_root_full_claim(spl);
+   snapshot->root_addr = spl->root_addr;
+   trunk_range_delete_set_copy_live(spl, &snapshot->range_deletes);
+   trunk_root_full_unclaim(spl);
+
+   trunk_for_each_subtree(
+      spl, snapshot->root_addr, trunk_node_inc_snapshot_refs, NULL);
+   trunk_snapshot_walk_end(spl);
+
+   return STATUS_OK;
+}
+
+/*
+ * Drops the snapshot's references. Iterators over the snapshot must have been
+ * deinitialized first.
+ */
+void
+trunk_snapshot_release(trunk_handle *spl, trunk_snapshot *snapshot)
+{
+   trunk_for_each_subtree(spl, snapshot->root_addr, trunk_node_destroy, NULL);
+   snapshot->root_addr = 0;
+
+   platform_spin_lock(&spl->snapshot_lock);
+   spl->num_snapshots--;
+   platform_spin_unlock(&spl->snapshot_lock);
+}
+
+
+/*
+ * Writes the trunk node if it is dirty. The nodes of a pinned root are not
+ * changed, but garbage collection may hold them claimed, which keeps
+ * cache_write_back from writing them.
+ */
+static bool32
+trunk_node_write(trunk_handle *spl, uint64 addr, void *arg)
+{
+   trunk_node node;
+   trunk_node_get(spl->cc, addr, &node);
+   cache_page_write(spl->cc, node.page, PAGE_TYPE_TRUNK);
+   trunk_node_unget(spl->cc, &node);
+   return TRUE;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * trunk_checkpoint --
+ *
+ *      Makes the trunk as of now durable, so that a mount after a crash can
+ *      start from it and replay only the log written since, and truncates
+ *      the log.
+ *
+ *      Inserts are blocked just long enough to switch to a new log, which
+ *      is first added to the current super block: until the checkpoint
+ *      writes its own, a mount after a crash replays the new log after the
+ *      old one. The memtables written to the old log are then incorporated,
+ *      and the root holding them is pinned, the way a snapshot is. Every
+ *      dirty page is written back, the allocator ref counts are persisted
+ *      and a super block naming the pinned root and the new log is written,
+ *      after which the old log is released. The entries in the new log from
+ *      memtables the root already holds are skipped by replay.
+ *
+ *      The ref counts persisted are those of every trunk using the
+ *      allocator, so the trunks of a cfg.checkpoint_group are checkpointed
+ *      together: a super block naming an older checkpoint than the ref
+ *      counts could name extents freed, and reused, since.
+ *
+ *      Other calls to spl may run concurrently, except trunk_unmount; inserts
+ *      call it themselves once the log has grown past checkpoint_log_size.
+ *-----------------------------------------------------------------------------
+ */
+
+/*
+ * What a trunk being checkpointed keeps until its super block is written.
+ */
+typedef struct trunk_checkpoint_member {
+   trunk_handle          *spl;
+   log_handle            *old_log;
+   trunk_checkpoint_state state;
+} trunk_checkpoint_member;
+
+/*
+ * Switches spl to a new log and pins the root holding everything logged to
+ * the old one.
+ */
+static void
+trunk_checkpoint_begin(trunk_handle *spl, trunk_checkpoint_member *member)
+{
+   member->spl = spl;
+
+   /*
+    * The range deletes in the table when the log is switched are the ones
+    * logged to the old log, which the checkpoint has to record itself.
+    */
+   log_handle *new_log = NULL;
+   if (spl->cfg.use_log) {
+      new_log = log_create(spl->cc, spl->cfg.log_cfg, spl->heap_id);
+   }
+   if (new_log != NULL && spl->log != NULL) {
+      // writes are acknowledged from the new log before this checkpoint ends
+      trunk_set_super_block_next_log(spl, new_log);
+      cache_sync(spl->cc);
+   }
+   memtable_block_inserts(spl->mt_ctxt);
+   member->old_log = spl->log;
+   spl->log        = new_log;
+   trunk_range_deletes_get(spl);
+   member->state.range_deletes = spl->range_deletes;
+   trunk_range_deletes_unget(spl);
+   memtable_unblock_inserts(spl->mt_ctxt);
+
+   trunk_incorporate_memtables(spl);
+   trunk_root_full_claim(spl);
+   member->state.root_addr       = spl->root_addr;
+   member->state.meta_tail       = mini_meta_tail(&spl->mini);
+   member->state.next_generation = trunk_absolute_generation(
+      spl, memtable_generation_retired(spl->mt_ctxt) + 1);
+   trunk_for_each_subtree(
+      spl, member->state.root_addr, trunk_node_inc_snapshot_refs, NULL);
+   trunk_root_full_unclaim(spl);
+}
+
+/*
+ * Unpins the root once the super block names it, and releases the old log
+ * once the writers still syncing it are done.
+ */
+static void
+trunk_checkpoint_end(trunk_checkpoint_member *member)
+{
+   trunk_handle *spl = member->spl;
+   trunk_for_each_subtree(
+      spl, member->state.root_addr, trunk_node_destroy, NULL);
+
+   if (member->old_log != NULL) {
+      platform_batch_rwlock_get(&spl->trunk_root_lock, TRUNK_LOG_LOCK_IDX);
+      platform_batch_rwlock_claim_loop(&spl->trunk_root_lock,
+                                       TRUNK_LOG_LOCK_IDX);
+      platform_batch_rwlock_lock(&spl->trunk_root_lock, TRUNK_LOG_LOCK_IDX);
+      platform_batch_rwlock_full_unlock(&spl->trunk_root_lock,
+                                        TRUNK_LOG_LOCK_IDX);
+      log_release(member->old_log);
+      platform_free(spl->heap_id, member->old_log);
+   }
+}
+
+/*
+ * Checkpoints the trunks of the list members, linked by
+ * next_in_checkpoint_group, together with the allocator al they use. With no
+ * members, only the ref counts are persisted.
+ */
+static platform_status
+trunk_checkpoint_members(allocator *al, trunk_handle *members)
+{
+   uint64 num_members = 0;
+   for (trunk_handle *spl = members; spl != NULL;
+        spl               = spl->next_in_checkpoint_group)
+   {
+      num_members++;
+   }
+   trunk_checkpoint_member *member = NULL;
+   if (num_members != 0) {
+      member = TYPED_ARRAY_ZALLOC(members->heap_id, member, num_members);
+      if (member == NULL) {
+         return STATUS_NO_MEMORY;
+      }
+   }
+
+   uint64 i = 0;
+   for (trunk_handle *spl = members; spl != NULL;
+        spl               = spl->next_in_checkpoint_group)
+   {
+      trunk_checkpoint_begin(spl, &member[i]);
+      i++;
+   }
+
+   if (num_members != 0) {
+      cache_write_back(members->cc);
+   }
+   for (i = 0; i < num_members; i++) {
+      trunk_for_each_subtree(
+         member[i].spl, member[i].state.root_addr, trunk_node_write, NULL);
+   }
+   // only the super blocks written next let the old logs go
+   platform_status rc = allocator_checkpoint(al);
+   platform_assert_status_ok(rc);
+   if (num_members == 0) {
+      return rc;
+   }
+
+   // the super blocks must not reach the disk before what they point to
+   cache_sync(members->cc);
+   for (i = 0; i < num_members; i++) {
+      trunk_set_super_block(member[i].spl, &member[i].state, FALSE, FALSE);
+   }
+   cache_sync(members->cc);
+   for (i = 0; i < num_members; i++) {
+      trunk_checkpoint_end(&member[i]);
+   }
+   platform_free(members->heap_id, member);
+   return rc;
+}
+
+static platform_mutex *
+trunk_checkpoint_mutex(trunk_handle *spl)
+{
+   trunk_checkpoint_group *group = spl->cfg.checkpoint_group;
+   return group == NULL ? &spl->checkpoint_mutex : &group->mutex;
+}
+
+// The caller holds trunk_checkpoint_mutex(spl)
+static platform_status
+trunk_checkpoint_locked(trunk_handle *spl)
+{
+   trunk_checkpoint_group *group = spl->cfg.checkpoint_group;
+   return trunk_checkpoint_members(spl->al,
+                                   group == NULL ? spl : group->members);
+}
+
+platform_status
+trunk_checkpoint(trunk_handle *spl)
+{
+   platform_mutex *mutex = trunk_checkpoint_mutex(spl);
+   platform_mutex_lock(mutex);
+   platform_status rc = trunk_checkpoint_locked(spl);
+   platform_mutex_unlock(mutex);
+   return rc;
+}
+
+/*
+ * A log which has grown past checkpoint_log_size is truncated by a
+ * checkpoint. The thread which finds it full does it, unless another one
+ * already is.
+ */
+static void
+trunk_checkpoint_if_log_is_full(trunk_handle *spl)
+{
+   if (!__sync_bool_compare_and_swap(&spl->checkpoint_pending, FALSE, TRUE)) {
+      return;
+   }
+   platform_status rc    = STATUS_OK;
+   platform_mutex *mutex = trunk_checkpoint_mutex(spl);
+   platform_mutex_lock(mutex);
+   // another checkpoint may have switched the log in the meantime
+   if (trunk_log_is_full(spl, spl->log)) {
+      rc = trunk_checkpoint_locked(spl);
+   }
+   platform_mutex_unlock(mutex);
+   spl->checkpoint_pending = FALSE;
+   if (!SUCCESS(rc)) {
+      platform_error_log("Checkpoint to truncate the log failed: %s\n",
+                         platform_status_to_string(rc));
+   }
+}
+
+void
+trunk_checkpoint_group_init(trunk_checkpoint_group *group,
+                            platform_heap_id        hid)
+{
+   platform_mutex_init(&group->mutex, platform_get_module_id(), hid);
+   group->members = NULL;
+}
+
+void
+trunk_checkpoint_group_deinit(trunk_checkpoint_group *group)
+{
+   platform_assert(group->members == NULL);
+   platform_mutex_destroy(&group->mutex);
+}
+
+// The caller holds the mutex of the group
+static void
+trunk_checkpoint_group_add(trunk_checkpoint_group *group, trunk_handle *spl)
+{
+   spl->next_in_checkpoint_group = group->members;
+   group->members                = spl;
+}
+
+// The caller holds the mutex of the group
+static void
+trunk_checkpoint_group_remove(trunk_checkpoint_group *group,
+                              trunk_handle           *spl)
+{
+   trunk_handle **link = &group->members;
+   while (*link != spl) {
+      link = &(*link)->next_in_checkpoint_group;
+   }
+   *link                         = spl->next_in_checkpoint_group;
+   spl->next_in_checkpoint_group = NULL;
+}
+
+/*
+ * A checkpoint taken while compactions were running holds the bundles they
+ * had yet to replace, and a mount after a crash finds those bundles with no
+ * compaction left to replace them. Issues a compact_bundle for each live
+ * bundle of the node, the way the flush which created the bundle does.
+ */
+static bool32
+trunk_node_compact_recovered_bundles(trunk_handle *spl, uint64 addr, void *arg)
+{
+   trunk_node node;
+   trunk_node_get(spl->cc, addr, &node);
+   uint16 num_children = trunk_num_children(spl, &node);
+   for (uint16 bundle_no = trunk_start_bundle(spl, &node);
+        bundle_no != trunk_end_bundle(spl, &node);
+        bundle_no = trunk_add_bundle_number(spl, bundle_no, 1))
+   {
+      trunk_compact_bundle_req *req = TYPED_ZALLOC(spl->heap_id, req);
+      platform_assert(req != NULL);
+      req->spl                  = spl;
+      req->addr                 = addr;
+      req->height               = trunk_node_height(&node);
+      req->bundle_no            = bundle_no;
+      req->max_pivot_generation = trunk_pivot_generation(spl, &node);
+      req->node_id              = node.hdr->node_id;
+      req->type                 = TRUNK_COMPACTION_TYPE_FLUSH;
+      key_buffer_init_from_key(
+         &req->start_key, spl->heap_id, trunk_min_key(spl, &node));
+      key_buffer_init_from_key(
+         &req->end_key, spl->heap_id, trunk_max_key(spl, &node));
+      for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
+         trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, pivot_no);
+         req->pivot_generation[pivot_no] = pdata->generation;
+      }
+      trunk_bundle *bundle = trunk_get_bundle(spl, &node, bundle_no);
+      trunk_tuples_in_bundle(spl,
+                             &node,
+                             bundle,
+                             req->input_pivot_tuple_count,
+                             req->input_pivot_kv_byte_count);
+
+      platform_status rc = trunk_compact_bundle_enqueue(spl, "recovered", req);
+      platform_assert_status_ok(rc);
+   }
+   trunk_node_unget(spl->cc, &node);
+   return TRUE;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Log replay
+ *
+ *      After a crash, the super block still describes the trunk as of the
+ *      last checkpoint, and the log it names holds the writes made since.
+ *      Mount reads the log back in generation order and inserts again, with
+ *      logging off, the entries from memtables the checkpoint does not
+ *      cover.
+ *
+ *      The entries of a log batch are only replayed if the batch was logged
+ *      to its end, so a write batch cut short by the crash is dropped whole.
+ *      Range deletes are replayed in between the messages, as barriers, see
+ *      trunk_log_replay_entries.
+ *
+ *      The entries are split into partitions by key hash, so that the
+ *      partitions can be inserted by background threads in parallel while
+ *      the messages of each key are still applied in log order. Each
+ *      partition is inserted in batches with trunk_insert_batch, which
+ *      applies equal keys in batch order.
+ *-----------------------------------------------------------------------------
+ */
+#define TRUNK_LOG_REPLAY_BATCH_SIZE     (256)
+#define TRUNK_LOG_REPLAY_MAX_PARTITIONS (64)
+
+static int
+trunk_log_batch_compare(const void *a, const void *b, void *arg)
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+   return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*
+ * Returns TRUE if batch is LOG_NO_BATCH or among the sorted ended batches.
+ */
+static bool32
+trunk_log_batch_is_whole(const uint64 ended[], uint64 num_ended, uint64 batch)
+{
+   if (batch == LOG_NO_BATCH) {
+      return TRUE;
+   }
+   uint64 lo = 0;
+   uint64 hi = num_ended;
+   while (lo < hi) {
+      uint64 mid = lo + (hi - lo) / 2;
+      if (ended[mid] < batch) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+   return lo < num_ended && ended[lo] == batch;
+}
+
+typedef struct trunk_log_replay_partition {
+   trunk_handle   *spl;
+   key            *keys;
+   message        *msgs;
+   uint64          num_msgs;
+   platform_status rc;
+} trunk_log_replay_partition;
+
+static void
+trunk_log_replay_partition_task(void *arg, void *scratch)
+{
+   trunk_log_replay_partition *part = (trunk_log_replay_partition *)arg;
+   trunk_handle               *spl  = part->spl;
+
+   for (uint64 i = 0; i < part->num_msgs && SUCCESS(part->rc);
+        i += TRUNK_LOG_REPLAY_BATCH_SIZE)
+   {
+      uint64 batch_size = MIN(TRUNK_LOG_REPLAY_BATCH_SIZE, part->num_msgs - i);
+      part->rc =
+         trunk_insert_batch(spl, &part->keys[i], &part->msgs[i], batch_size);
+   }
+}
+
+/*
+ * The log entries to replay, in log order, and the scratch space to replay
+ * them in.
+ */
+typedef struct trunk_log_replay {
+   trunk_handle               *spl;
+   uint64                      num_partitions;
+   trunk_log_replay_partition *parts;
+   uint64                      num_entries;
+   key                        *log_keys;
+   message                    *log_msgs;
+   log_entry_type             *log_type;
+   uint64                     *log_generation; // absolute
+   uint64                     *log_part;
+   key                        *keys; // the partitions, back to back
+   message                    *msgs;
+} trunk_log_replay;
 
-            res  = async_success;
-            done = TRUE;
-            break;
-         }
-         default:
-            platform_assert(0);
+/*
+ * Inserts the messages among entries [start, end), waiting until they are
+ * all applied.
+ */
+static platform_status
+trunk_log_replay_messages(trunk_log_replay *replay, uint64 start, uint64 end)
+{
+   trunk_handle *spl      = replay->spl;
+   data_config  *data_cfg = spl->cfg.data_cfg;
+
+   // size the partitions
+   for (uint64 part_no = 0; part_no < replay->num_partitions; part_no++) {
+      replay->parts[part_no].num_msgs = 0;
+   }
+   for (uint64 i = start; i < end; i++) {
+      if (replay->log_type[i] != LOG_ENTRY_MESSAGE) {
+         continue;
       }
-   } while (!done);
-#if TRUNK_DEBUG
-   cache_enable_sync_get(spl->cc, TRUE);
-#endif
+      key    tuple_key = replay->log_keys[i];
+      uint64 part_no   = 0;
+      if (replay->num_partitions > 1) {
+         part_no = data_cfg->key_hash(
+                      key_data(tuple_key), key_length(tuple_key), HASH_SEED)
+                   % replay->num_partitions;
+      }
+      replay->log_part[i] = part_no;
+      replay->parts[part_no].num_msgs++;
+   }
+
+   // lay the partitions out back to back, keeping log order within each
+   uint64 offset = 0;
+   for (uint64 part_no = 0; part_no < replay->num_partitions; part_no++) {
+      trunk_log_replay_partition *part = &replay->parts[part_no];
+      part->spl                        = spl;
+      part->keys                       = &replay->keys[offset];
+      part->msgs                       = &replay->msgs[offset];
+      part->rc                         = STATUS_OK;
+      offset += part->num_msgs;
+      part->num_msgs = 0;
+   }
+   for (uint64 i = start; i < end; i++) {
+      if (replay->log_type[i] != LOG_ENTRY_MESSAGE) {
+         continue;
+      }
+      trunk_log_replay_partition *part = &replay->parts[replay->log_part[i]];
+      part->keys[part->num_msgs]       = replay->log_keys[i];
+      part->msgs[part->num_msgs]       = replay->log_msgs[i];
+      part->num_msgs++;
+   }
 
-   return res;
+   platform_status rc;
+   for (uint64 part_no = 0; part_no < replay->num_partitions; part_no++) {
+      rc = task_enqueue(spl->ts,
+                        TASK_TYPE_NORMAL,
+                        trunk_log_replay_partition_task,
+                        &replay->parts[part_no],
+                        FALSE);
+      if (!SUCCESS(rc)) {
+         // run it here instead
+         trunk_log_replay_partition_task(&replay->parts[part_no], NULL);
+      }
+   }
+   rc = task_perform_until_quiescent(spl->ts);
+   for (uint64 part_no = 0; SUCCESS(rc) && part_no < replay->num_partitions;
+        part_no++)
+   {
+      rc = replay->parts[part_no].rc;
+   }
+   return rc;
 }
 
+/*
+ * Replays the entries, in order. A range delete is applied once every message
+ * of an older memtable generation is, and before any message of its own or a
+ * later generation. The messages of its own generation which it deleted were
+ * logged with it as point deletes, which are replayed after them.
+ */
+static platform_status
+trunk_log_replay_entries(trunk_log_replay *replay)
+{
+   platform_status rc    = STATUS_OK;
+   uint64          start = 0;
+   for (uint64 i = 0; SUCCESS(rc) && i < replay->num_entries; i++) {
+      if (replay->log_type[i] != LOG_ENTRY_RANGE_DELETE) {
+         continue;
+      }
+      uint64 generation = replay->log_generation[i];
+      uint64 end        = start;
+      while (end < replay->num_entries
+             && replay->log_generation[end] < generation)
+      {
+         end++;
+      }
+      rc = trunk_log_replay_messages(replay, start, end);
+      if (SUCCESS(rc)) {
+         slice end_key = message_slice(replay->log_msgs[i]);
+         rc            = trunk_delete_range(
+            replay->spl, replay->log_keys[i], key_create_from_slice(end_key));
+      }
+      start = end;
+   }
+   if (SUCCESS(rc)) {
+      rc = trunk_log_replay_messages(replay, start, replay->num_entries);
+   }
+   return rc;
+}
 
-platform_status
-trunk_range(trunk_handle  *spl,
-            key            start_key,
-            uint64         num_tuples,
-            tuple_function func,
-            void          *arg)
+/*
+ * Appends to replay the entries of the log which are newer than the
+ * checkpoint, in log order, and of batches logged to their end. batch_of and
+ * ended are scratch space for as many entries as the log has.
+ */
+static platform_status
+trunk_replay_log_collect(trunk_handle       *spl,
+                         shard_log_iterator *log_itor,
+                         trunk_log_replay   *replay,
+                         uint64             *batch_of,
+                         uint64             *ended)
+{
+   iterator *itor = (iterator *)log_itor;
+
+   // collect the entries newer than the checkpoint, in log order
+   uint64 start      = replay->num_entries;
+   uint64 num_logged = 0;
+   uint64 num_ended  = 0;
+   while (iterator_can_curr(itor)) {
+      uint64 generation = trunk_log_generation_to_absolute(
+         shard_log_iterator_curr_generation(log_itor));
+      log_entry_type type = shard_log_iterator_curr_type(log_itor);
+      if (type == LOG_ENTRY_BATCH_END) {
+         ended[num_ended] = shard_log_iterator_curr_batch(log_itor);
+         num_ended++;
+      } else if (spl->generation_base <= generation) {
+         uint64 i = start + num_logged;
+         iterator_curr(itor, &replay->log_keys[i], &replay->log_msgs[i]);
+         replay->log_type[i]       = type;
+         replay->log_generation[i] = generation;
+         batch_of[num_logged] = shard_log_iterator_curr_batch(log_itor);
+         num_logged++;
+      }
+      platform_status rc = iterator_next(itor);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+   }
+
+   // keep those of whole batches
+   uint64 tmp;
+   platform_sort_slow(ended,
+                      num_ended,
+                      sizeof(*ended),
+                      trunk_log_batch_compare,
+                      NULL,
+                      &tmp);
+   for (uint64 k = 0; k < num_logged; k++) {
+      if (!trunk_log_batch_is_whole(ended, num_ended, batch_of[k])) {
+         continue;
+      }
+      uint64 i                  = start + k;
+      uint64 j                  = replay->num_entries;
+      replay->log_keys[j]       = replay->log_keys[i];
+      replay->log_msgs[j]       = replay->log_msgs[i];
+      replay->log_type[j]       = replay->log_type[i];
+      replay->log_generation[j] = replay->log_generation[i];
+      replay->num_entries++;
+   }
+   return STATUS_OK;
+}
+
+/*
+ * Replays the logs, in order. Writes only move on to a log once they are
+ * done with the one before it, so the logs hold the entries of later
+ * memtables in turn.
+ */
+static platform_status
+trunk_replay_log(trunk_handle       *spl,
+                 shard_log_iterator *log_itor,
+                 uint64              num_logs)
 {
-   trunk_range_iterator *range_itor =
-      TYPED_MALLOC(PROCESS_PRIVATE_HEAP_ID, range_itor);
-   platform_status rc = trunk_range_iterator_init(spl,
-                                                  range_itor,
-                                                  start_key,
-                                                  POSITIVE_INFINITY_KEY,
-                                                  start_key,
-                                                  greater_than_or_equal,
-                                                  num_tuples);
-   if (!SUCCESS(rc)) {
-      goto destroy_range_itor;
+   platform_status rc          = STATUS_OK;
+   uint64          num_entries = 0;
+   for (uint64 l = 0; l < num_logs; l++) {
+      num_entries += log_itor[l].num_entries;
    }
 
-   for (int i = 0; i < num_tuples && iterator_can_next(&range_itor->super); i++)
+   if (num_entries == 0) {
+      return STATUS_OK;
+   }
+
+   trunk_log_replay replay = {
+      .spl            = spl,
+      .num_partitions = MIN(
+         1 + spl->ts->cfg->num_background_threads[TASK_TYPE_NORMAL],
+         TRUNK_LOG_REPLAY_MAX_PARTITIONS),
+   };
+   replay.parts =
+      TYPED_ARRAY_ZALLOC(spl->heap_id, replay.parts, replay.num_partitions);
+   replay.log_keys =
+      TYPED_ARRAY_MALLOC(spl->heap_id, replay.log_keys, num_entries);
+   replay.log_msgs =
+      TYPED_ARRAY_MALLOC(spl->heap_id, replay.log_msgs, num_entries);
+   replay.log_type =
+      TYPED_ARRAY_MALLOC(spl->heap_id, replay.log_type, num_entries);
+   replay.log_generation =
+      TYPED_ARRAY_MALLOC(spl->heap_id, replay.log_generation, num_entries);
+   replay.log_part =
+      TYPED_ARRAY_MALLOC(spl->heap_id, replay.log_part, num_entries);
+   replay.keys = TYPED_ARRAY_MALLOC(spl->heap_id, replay.keys, num_entries);
+   replay.msgs = TYPED_ARRAY_MALLOC(spl->heap_id, replay.msgs, num_entries);
+   // the log batch of each entry, and the batches logged to their end
+   uint64 *batch_of = TYPED_ARRAY_MALLOC(spl->heap_id, batch_of, num_entries);
+   uint64 *ended    = TYPED_ARRAY_MALLOC(spl->heap_id, ended, num_entries);
+   if (replay.parts == NULL || replay.log_keys == NULL
+       || replay.log_msgs == NULL || replay.log_type == NULL
+       || replay.log_generation == NULL || replay.log_part == NULL
+       || replay.keys == NULL || replay.msgs == NULL || batch_of == NULL
+       || ended == NULL)
    {
-      key     curr_key;
-      message data;
-      iterator_curr(&range_itor->super, &curr_key, &data);
-      func(curr_key, data, arg);
-      rc = iterator_next(&range_itor->super);
+      rc = STATUS_NO_MEMORY;
+      goto out;
+   }
+
+   for (uint64 l = 0; l < num_logs; l++) {
+      rc = trunk_replay_log_collect(
+         spl, &log_itor[l], &replay, batch_of, ended);
       if (!SUCCESS(rc)) {
-         goto destroy_range_itor;
+         goto out;
       }
    }
 
-destroy_range_itor:
-   trunk_range_iterator_deinit(range_itor);
-   platform_free(PROCESS_PRIVATE_HEAP_ID, range_itor);
+   rc = trunk_log_replay_entries(&replay);
+
+   platform_default_log("Replayed %lu of %lu log entries in %lu partitions\n",
+                        replay.num_entries,
+                        num_entries,
+                        replay.num_partitions);
+
+out:
+   if (replay.parts != NULL) {
+      platform_free(spl->heap_id, replay.parts);
+   }
+   if (replay.log_keys != NULL) {
+      platform_free(spl->heap_id, replay.log_keys);
+   }
+   if (replay.log_msgs != NULL) {
+      platform_free(spl->heap_id, replay.log_msgs);
+   }
+   if (replay.log_type != NULL) {
+      platform_free(spl->heap_id, replay.log_type);
+   }
+   if (replay.log_generation != NULL) {
+      platform_free(spl->heap_id, replay.log_generation);
+   }
+   if (replay.log_part != NULL) {
+      platform_free(spl->heap_id, replay.log_part);
+   }
+   if (replay.keys != NULL) {
+      platform_free(spl->heap_id, replay.keys);
+   }
+   if (replay.msgs != NULL) {
+      platform_free(spl->heap_id, replay.msgs);
+   }
+   if (batch_of != NULL) {
+      platform_free(spl->heap_id, batch_of);
+   }
+   if (ended != NULL) {
+      platform_free(spl->heap_id, ended);
+   }
    return rc;
 }
 
+/*
+ * The logs a crash left behind: the one the checkpointed super block names,
+ * and the one a checkpoint in progress had switched to.
+ */
+typedef struct trunk_recovered_logs {
+   uint64             num_logs;
+   uint64             addr[2];
+   uint64             meta_addr[2];
+   uint64             magic[2];
+   shard_log_iterator itor[2];
+} trunk_recovered_logs;
+
+static bool32
+trunk_super_block_crashed(const trunk_super_block *super, bool32 use_log)
+{
+   return !super->unmounted && super->checkpointed && super->log_addr != 0
+          && use_log;
+}
+
+static void
+trunk_recovered_logs_read(const trunk_super_block *super,
+                          trunk_recovered_logs    *logs)
+{
+   logs->addr[0]      = super->log_addr;
+   logs->meta_addr[0] = super->log_meta_addr;
+   logs->magic[0]     = super->log_magic;
+   logs->addr[1]      = super->next_log_addr;
+   logs->meta_addr[1] = super->next_log_meta_addr;
+   logs->magic[1]     = super->next_log_magic;
+   logs->num_logs     = super->next_log_addr != 0 ? 2 : 1;
+}
+
+/*
+ * Reads the logs back, which takes the extents they allocated since the
+ * checkpoint, free in the recovered allocator, back for them.
+ */
+static void
+trunk_recovered_logs_hold(cache                *cc,
+                          shard_log_config     *log_cfg,
+                          platform_heap_id      hid,
+                          trunk_recovered_logs *logs)
+{
+   for (uint64 i = 0; i < logs->num_logs; i++) {
+      shard_log_hold_recovered_meta(cc, logs->meta_addr[i]);
+      platform_status rc = shard_log_iterator_init(cc,
+                                                   log_cfg,
+                                                   hid,
+                                                   logs->addr[i],
+                                                   logs->magic[i],
+                                                   &logs->itor[i]);
+      platform_assert_status_ok(rc);
+   }
+}
+
+/*
+ * Holds the logs the trunk with root id id left behind in a crash, as its
+ * trunk_mount does. A trunk of a checkpoint group which is mounted after
+ * others has them held from before the others allocate anything, since the
+ * extents the logs took since the checkpoint are free in the recovered
+ * allocator.
+ */
+void
+trunk_hold_recovered_logs(trunk_config     *cfg,
+                          allocator        *al,
+                          cache            *cc,
+                          allocator_root_id id,
+                          platform_heap_id  hid)
+{
+   page_handle         *super_page;
+   trunk_recovered_logs logs;
+   trunk_super_block   *super =
+      trunk_get_super_block_of(al, cc, id, &super_page);
+   if (super == NULL) {
+      return;
+   }
+   bool32 crashed = trunk_super_block_crashed(super, cfg->use_log);
+   if (crashed) {
+      trunk_recovered_logs_read(super, &logs);
+   }
+   cache_unget(cc, super_page);
+   if (!crashed) {
+      return;
+   }
+
+   trunk_recovered_logs_hold(cc, (shard_log_config *)cfg->log_cfg, hid, &logs);
+   for (uint64 i = 0; i < logs.num_logs; i++) {
+      shard_log_iterator_deinit(hid, &logs.itor[i]);
+   }
+}
 
 /*
  *-----------------------------------------------------------------------------
@@ -7628,17 +12015,26 @@ trunk_create(trunk_config     *cfg,
    spl->id      = id;
    spl->heap_id = hid;
    spl->ts      = ts;
+   // Generation 0 is kept for data older than any memtable, see bulk load
+   spl->generation_base = 1;
 
-   platform_batch_rwlock_init(&spl->trunk_root_lock);
+   platform_status rc = platform_batch_rwlock_init(
+      &spl->trunk_root_lock, task_system_get_max_threads(ts), hid);
+   platform_assert_status_ok(rc);
+   platform_mutex_init(
+      &spl->range_delete_retire_mutex, platform_get_module_id(), hid);
+   platform_mutex_init(&spl->checkpoint_mutex, platform_get_module_id(), hid);
+   trunk_held_table_init(spl);
+   trunk_snapshots_init(spl);
 
    srq_init(&spl->srq, platform_get_module_id(), hid);
 
    // get a free node for the root
    //    we don't use the mini allocator for this, since the root doesn't
    //    maintain constant height
-   uint64          root_addr;
-   platform_status rc = allocator_alloc(spl->al, &root_addr, PAGE_TYPE_TRUNK);
-   spl->root_addr     = root_addr;
+   uint64 root_addr;
+   rc             = allocator_alloc(spl->al, &root_addr, PAGE_TYPE_TRUNK);
+   spl->root_addr = root_addr;
    platform_assert_status_ok(rc);
    trunk_node root;
    root.addr = spl->root_addr;
@@ -7665,13 +12061,8 @@ trunk_create(trunk_config     *cfg,
    spl->mt_ctxt            = memtable_context_create(
       spl->heap_id, cc, mt_cfg, trunk_memtable_flush_virtual, spl);
 
-   // set up the log
-   if (spl->cfg.use_log) {
-      spl->log = log_create(cc, spl->cfg.log_cfg, spl->heap_id);
-   }
-
    // ALEX: For now we assume an init means destroying any present super blocks
-   trunk_set_super_block(spl, FALSE, FALSE, TRUE);
+   trunk_set_super_block(spl, NULL, FALSE, TRUE);
 
    // set up the initial leaf
    trunk_node leaf;
@@ -7689,18 +12080,19 @@ trunk_create(trunk_config     *cfg,
    leaf.hdr->node_id = trunk_next_node_id(spl);
 
 
-   trunk_node_unlock(spl->cc, &leaf);
+   trunk_node_unlock(spl, &leaf);
    trunk_node_unclaim(spl->cc, &leaf);
    trunk_node_unget(spl->cc, &leaf);
 
-   trunk_node_unlock(spl->cc, &root);
+   trunk_node_unlock(spl, &root);
    trunk_node_unclaim(spl->cc, &root);
    trunk_node_unget(spl->cc, &root);
 
    if (spl->cfg.use_stats) {
-      spl->stats = TYPED_ARRAY_ZALLOC(spl->heap_id, spl->stats, MAX_THREADS);
+      spl->stats =
+         TYPED_ARRAY_ZALLOC(spl->heap_id, spl->stats, trunk_max_threads(spl));
       platform_assert(spl->stats);
-      for (uint64 i = 0; i < MAX_THREADS; i++) {
+      for (uint64 i = 0; i < trunk_max_threads(spl); i++) {
          platform_status rc;
          rc = platform_histo_create(spl->heap_id,
                                     LATENCYHISTO_SIZE + 1,
@@ -7720,20 +12112,87 @@ trunk_create(trunk_config     *cfg,
       }
    }
 
+   trunk_checkpoint_group *group = spl->cfg.checkpoint_group;
+   if (group != NULL) {
+      platform_mutex_lock(&group->mutex);
+      trunk_checkpoint_group_add(group, spl);
+      platform_mutex_unlock(&group->mutex);
+   }
+
+   if (spl->cfg.use_log) {
+      /*
+       * The empty trunk is what a crash before the first unmount recovers
+       * to. The checkpoint also sets up the log.
+       */
+      rc = trunk_checkpoint(spl);
+      platform_assert_status_ok(rc);
+   }
+
    return spl;
 }
 
 /*
- * Open (mount) an existing splinter database
+ * Undoes a trunk_mount which failed once it started recovering, waiting for
+ * the tasks the replay started. Nothing is written, so the super block still
+ * names the checkpoint and the logs, and a later mount can recover again.
  */
-trunk_handle *
+static void
+trunk_mount_abort(trunk_handle *spl, trunk_recovered_logs *old_logs)
+{
+   platform_status rc = task_perform_until_quiescent(spl->ts);
+   platform_assert_status_ok(rc);
+
+   platform_mutex_unlock(trunk_checkpoint_mutex(spl));
+
+   for (uint64 i = 0; i < old_logs->num_logs; i++) {
+      shard_log_iterator_deinit(spl->heap_id, &old_logs->itor[i]);
+   }
+   if (spl->mt_ctxt != NULL) {
+      memtable_context_destroy(spl->heap_id, spl->mt_ctxt);
+      mini_release(&spl->mini, NULL_KEY);
+   }
+   if (spl->log != NULL) {
+      log_release(spl->log);
+      platform_free(spl->heap_id, spl->log);
+   }
+   if (spl->stats != NULL) {
+      for (uint64 i = 0; i < trunk_max_threads(spl); i++) {
+         platform_histo_destroy(spl->heap_id,
+                                &spl->stats[i].insert_latency_histo);
+         platform_histo_destroy(spl->heap_id,
+                                &spl->stats[i].update_latency_histo);
+         platform_histo_destroy(spl->heap_id,
+                                &spl->stats[i].delete_latency_histo);
+      }
+      platform_free(spl->heap_id, spl->stats);
+   }
+   platform_mutex_destroy(&spl->range_delete_retire_mutex);
+   platform_mutex_destroy(&spl->checkpoint_mutex);
+   trunk_held_table_deinit(spl);
+   trunk_snapshots_deinit(spl);
+   srq_deinit(&spl->srq);
+   platform_batch_rwlock_deinit(&spl->trunk_root_lock, spl->heap_id);
+   platform_free(spl->heap_id, spl);
+}
+
+/*
+ * Open (mount) an existing splinter database. If it was not unmounted, but
+ * has been checkpointed with a log, it is recovered by replaying the log on
+ * top of the checkpoint.
+ *
+ * Returns the status of the recovery, which the caller gets instead of a
+ * handle if it fails.
+ */
+platform_status
 trunk_mount(trunk_config     *cfg,
             allocator        *al,
             cache            *cc,
             task_system      *ts,
             allocator_root_id id,
-            platform_heap_id  hid)
+            platform_heap_id  hid,
+            trunk_handle    **spl_out)
 {
+   *spl_out          = NULL;
    trunk_handle *spl = TYPED_FLEXIBLE_STRUCT_ZALLOC(
       hid, spl, compacted_memtable, TRUNK_NUM_MEMTABLES);
    memmove(&spl->cfg, cfg, sizeof(*cfg));
@@ -7747,20 +12206,47 @@ trunk_mount(trunk_config     *cfg,
 
    srq_init(&spl->srq, platform_get_module_id(), hid);
 
-   platform_batch_rwlock_init(&spl->trunk_root_lock);
+   platform_status rc = platform_batch_rwlock_init(
+      &spl->trunk_root_lock, task_system_get_max_threads(ts), hid);
+   platform_assert_status_ok(rc);
 
-   // find the unmounted super block
-   spl->root_addr                      = 0;
-   uint64             meta_tail        = 0;
-   uint64             latest_timestamp = 0;
-   page_handle       *super_page;
+   // find the unmounted, or checkpointed and logged, super block
+   spl->root_addr                        = 0;
+   uint64               meta_tail        = 0;
+   uint64               latest_timestamp = 0;
+   bool32               replay_log       = FALSE;
+   trunk_recovered_logs old_logs         = {.num_logs = 0};
+   page_handle         *super_page;
    trunk_super_block *super = trunk_get_super_block_if_valid(spl, &super_page);
+   if (super != NULL
+       && super->filters_keyed_on_prefix != trunk_filters_keyed_on_prefix(spl))
+   {
+      platform_error_log("SplinterDB device was created %s a key_prefix"
+                         " function in its data_config, and cannot be"
+                         " mounted %s one.\n",
+                         super->filters_keyed_on_prefix ? "with" : "without",
+                         super->filters_keyed_on_prefix ? "without" : "with");
+      trunk_release_super_block(spl, super_page);
+      platform_batch_rwlock_deinit(&spl->trunk_root_lock, hid);
+      srq_deinit(&spl->srq);
+      platform_free(hid, spl);
+      return STATUS_BAD_PARAM;
+   }
    if (super != NULL) {
-      if (super->unmounted && super->timestamp > latest_timestamp) {
-         spl->root_addr    = super->root_addr;
-         spl->next_node_id = super->next_node_id;
-         meta_tail         = super->meta_tail;
-         latest_timestamp  = super->timestamp;
+      bool32 crashed = trunk_super_block_crashed(super, spl->cfg.use_log);
+      if ((super->unmounted || crashed)
+          && super->timestamp > latest_timestamp)
+      {
+         spl->root_addr       = super->root_addr;
+         spl->next_node_id    = super->next_node_id;
+         meta_tail            = super->meta_tail;
+         latest_timestamp     = super->timestamp;
+         spl->generation_base = super->next_generation;
+         spl->range_deletes   = super->range_deletes;
+         replay_log           = crashed;
+         if (crashed) {
+            trunk_recovered_logs_read(super, &old_logs);
+         }
       }
       trunk_release_super_block(spl, super_page);
    }
@@ -7773,11 +12259,44 @@ trunk_mount(trunk_config     *cfg,
          super,
          meta_tail,
          latest_timestamp);
+      platform_batch_rwlock_deinit(&spl->trunk_root_lock, hid);
+      srq_deinit(&spl->srq);
       platform_free(hid, spl);
-      return (trunk_handle *)NULL;
+      return STATUS_INVALID_STATE;
    }
    uint64 meta_head = spl->root_addr + trunk_page_size(&spl->cfg);
 
+   platform_mutex_init(
+      &spl->range_delete_retire_mutex, platform_get_module_id(), hid);
+   platform_mutex_init(&spl->checkpoint_mutex, platform_get_module_id(), hid);
+   trunk_held_table_init(spl);
+   trunk_snapshots_init(spl);
+
+   /*
+    * The other trunks of the group checkpoint only once this one has, as
+    * their checkpoints would persist ref counts of the trunk being recovered
+    * which its super block does not describe.
+    */
+   trunk_checkpoint_group *group = spl->cfg.checkpoint_group;
+   platform_mutex_lock(trunk_checkpoint_mutex(spl));
+
+   /*
+    * Read the logs back before anything is allocated: the extents they took
+    * since the checkpoint are free in the recovered allocator. Checkpointing
+    * the allocator, with the other trunks using it, right away keeps both
+    * the logs and the checkpointed trunk intact on disk until the recovered
+    * state has been checkpointed.
+    */
+   if (replay_log) {
+      platform_default_log("Recovering SplinterDB from its log\n");
+      trunk_recovered_logs_hold(
+         cc, (shard_log_config *)spl->cfg.log_cfg, hid, &old_logs);
+      rc = trunk_checkpoint_members(al, group == NULL ? NULL : group->members);
+      if (!SUCCESS(rc)) {
+         goto abort;
+      }
+   }
+
    memtable_config *mt_cfg = &spl->cfg.mt_cfg;
    spl->mt_ctxt            = memtable_context_create(
       spl->heap_id, cc, mt_cfg, trunk_memtable_flush_virtual, spl);
@@ -7791,16 +12310,12 @@ trunk_mount(trunk_config     *cfg,
              TRUNK_MAX_HEIGHT,
              PAGE_TYPE_TRUNK,
              FALSE);
-   if (spl->cfg.use_log) {
-      spl->log = log_create(cc, spl->cfg.log_cfg, spl->heap_id);
-   }
-
-   trunk_set_super_block(spl, FALSE, FALSE, FALSE);
 
    if (spl->cfg.use_stats) {
-      spl->stats = TYPED_ARRAY_ZALLOC(spl->heap_id, spl->stats, MAX_THREADS);
+      spl->stats =
+         TYPED_ARRAY_ZALLOC(spl->heap_id, spl->stats, trunk_max_threads(spl));
       platform_assert(spl->stats);
-      for (uint64 i = 0; i < MAX_THREADS; i++) {
+      for (uint64 i = 0; i < trunk_max_threads(spl); i++) {
          platform_status rc;
          rc = platform_histo_create(spl->heap_id,
                                     LATENCYHISTO_SIZE + 1,
@@ -7819,7 +12334,52 @@ trunk_mount(trunk_config     *cfg,
          platform_assert_status_ok(rc);
       }
    }
-   return spl;
+
+   if (replay_log) {
+      trunk_for_each_node(spl, trunk_node_compact_recovered_bundles, NULL);
+      rc = trunk_replay_log(spl, old_logs.itor, old_logs.num_logs);
+      if (!SUCCESS(rc)) {
+         goto abort;
+      }
+   }
+
+   if (group != NULL) {
+      trunk_checkpoint_group_add(group, spl);
+   }
+   if (spl->cfg.use_log) {
+      // the checkpoint also sets up the log
+      rc = trunk_checkpoint_locked(spl);
+      if (!SUCCESS(rc)) {
+         if (group != NULL) {
+            trunk_checkpoint_group_remove(group, spl);
+         }
+         goto abort;
+      }
+   } else {
+      trunk_set_super_block(spl, NULL, FALSE, FALSE);
+   }
+
+   if (replay_log) {
+      /*
+       * The new checkpoint no longer needs the old logs. The ref counts
+       * persisted stop holding them from the checkpoint after next on.
+       */
+      for (uint64 i = 0; i < old_logs.num_logs; i++) {
+         shard_log_zap_recovered(
+            cc, &old_logs.itor[i], old_logs.meta_addr[i]);
+         shard_log_iterator_deinit(hid, &old_logs.itor[i]);
+      }
+   }
+   platform_mutex_unlock(trunk_checkpoint_mutex(spl));
+
+   *spl_out = spl;
+   return STATUS_OK;
+
+abort:
+   platform_error_log("Failed to recover SplinterDB: %s\n",
+                      platform_status_to_string(rc));
+   trunk_mount_abort(spl, &old_logs);
+   return rc;
 }
 
 /*
@@ -7846,12 +12406,21 @@ trunk_prepare_for_shutdown(trunk_handle *spl)
    platform_status rc = task_perform_until_quiescent(spl->ts);
    platform_assert_status_ok(rc);
 
+   // the next mount's generations must come after every one used here
+   spl->generation_base += memtable_generation(spl->mt_ctxt) + 1;
+
    // destroy memtable context (and its memtables)
    memtable_context_destroy(spl->heap_id, spl->mt_ctxt);
-
-   // release the log
-   if (spl->cfg.use_log) {
+   platform_mutex_destroy(&spl->range_delete_retire_mutex);
+   platform_mutex_destroy(&spl->checkpoint_mutex);
+   trunk_held_table_deinit(spl);
+   trunk_snapshots_deinit(spl);
+
+   // release the log, which the unmounted super block no longer needs
+   if (spl->log != NULL) {
+      log_release(spl->log);
       platform_free(spl->heap_id, spl->log);
+      spl->log = NULL;
    }
 
    // release the trunk mini allocator
@@ -7888,12 +12457,14 @@ trunk_node_destroy(trunk_handle *spl, uint64 addr, void *arg)
    }
    uint16 start_filter = trunk_start_sb_filter(spl, &node);
    uint16 end_filter   = trunk_end_sb_filter(spl, &node);
-   for (uint16 filter_no = start_filter; filter_no != end_filter; filter_no++) {
+   for (uint16 filter_no = start_filter; filter_no != end_filter;
+        filter_no        = trunk_add_subbundle_filter_number(spl, filter_no, 1))
+   {
       routing_filter *filter = trunk_get_sb_filter(spl, &node, filter_no);
       trunk_dec_filter(spl, filter);
    }
 
-   trunk_node_unlock(spl->cc, &node);
+   trunk_node_unlock(spl, &node);
    trunk_node_unclaim(spl->cc, &node);
    trunk_node_unget(spl->cc, &node);
    return TRUE;
@@ -7905,6 +12476,12 @@ trunk_node_destroy(trunk_handle *spl, uint64 addr, void *arg)
 void
 trunk_destroy(trunk_handle *spl)
 {
+   trunk_checkpoint_group *group = spl->cfg.checkpoint_group;
+   if (group != NULL) {
+      platform_mutex_lock(&group->mutex);
+      trunk_checkpoint_group_remove(group, spl);
+      platform_mutex_unlock(&group->mutex);
+   }
    srq_deinit(&spl->srq);
    trunk_prepare_for_shutdown(spl);
    trunk_for_each_node(spl, trunk_node_destroy, NULL);
@@ -7913,7 +12490,7 @@ trunk_destroy(trunk_handle *spl)
    allocator_remove_super_addr(spl->al, spl->id);
 
    if (spl->cfg.use_stats) {
-      for (uint64 i = 0; i < MAX_THREADS; i++) {
+      for (uint64 i = 0; i < trunk_max_threads(spl); i++) {
          platform_histo_destroy(spl->heap_id,
                                 &spl->stats[i].insert_latency_histo);
          platform_histo_destroy(spl->heap_id,
@@ -7923,6 +12500,7 @@ trunk_destroy(trunk_handle *spl)
       }
       platform_free(spl->heap_id, spl->stats);
    }
+   platform_batch_rwlock_deinit(&spl->trunk_root_lock, spl->heap_id);
    platform_free(spl->heap_id, spl);
 }
 
@@ -7933,12 +12511,29 @@ trunk_destroy(trunk_handle *spl)
 void
 trunk_unmount(trunk_handle **spl_in)
 {
-   trunk_handle *spl = *spl_in;
+   trunk_handle           *spl   = *spl_in;
+   trunk_checkpoint_group *group = spl->cfg.checkpoint_group;
+   if (group != NULL) {
+      platform_mutex_lock(&group->mutex);
+      trunk_checkpoint_group_remove(group, spl);
+   }
    srq_deinit(&spl->srq);
    trunk_prepare_for_shutdown(spl);
-   trunk_set_super_block(spl, FALSE, TRUE, FALSE);
+   if (group != NULL && spl->cfg.use_log) {
+      /*
+       * Other trunks use the allocator, so the ref counts holding the tree
+       * the super block names are persisted with a checkpoint of theirs.
+       * Without a log, only a clean shutdown of the allocator persists any.
+       */
+      platform_status rc = trunk_checkpoint_members(spl->al, group->members);
+      platform_assert_status_ok(rc);
+   }
+   trunk_set_super_block(spl, NULL, TRUE, FALSE);
+   if (group != NULL) {
+      platform_mutex_unlock(&group->mutex);
+   }
    if (spl->cfg.use_stats) {
-      for (uint64 i = 0; i < MAX_THREADS; i++) {
+      for (uint64 i = 0; i < trunk_max_threads(spl); i++) {
          platform_histo_destroy(spl->heap_id,
                                 &spl->stats[i].insert_latency_histo);
          platform_histo_destroy(spl->heap_id,
@@ -7948,6 +12543,7 @@ trunk_unmount(trunk_handle **spl_in)
       }
       platform_free(spl->heap_id, spl->stats);
    }
+   platform_batch_rwlock_deinit(&spl->trunk_root_lock, spl->heap_id);
    platform_free(spl->heap_id, spl);
    *spl_in = (trunk_handle *)NULL;
 }
@@ -8850,7 +13446,7 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
                          latency_histo_buckets,
                          &delete_lat_accum);
 
-   for (thr_i = 0; thr_i < MAX_THREADS; thr_i++) {
+   for (thr_i = 0; thr_i < trunk_max_threads(spl); thr_i++) {
       platform_histo_merge_in(insert_lat_accum,
                               spl->stats[thr_i].insert_latency_histo);
       platform_histo_merge_in(update_lat_accum,
@@ -8881,6 +13477,8 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
          global->compaction_time_ns[h]               += spl->stats[thr_i].compaction_time_ns[h];
          global->compaction_time_wasted_ns[h]        += spl->stats[thr_i].compaction_time_wasted_ns[h];
          global->compaction_pack_time_ns[h]          += spl->stats[thr_i].compaction_pack_time_ns[h];
+         global->compactions_parallel[h]             += spl->stats[thr_i].compactions_parallel[h];
+         global->compaction_subranges[h]             += spl->stats[thr_i].compaction_subranges[h];
          if (spl->stats[thr_i].compaction_time_max_ns[h] >
              global->compaction_time_max_ns[h]) {
             global->compaction_time_max_ns[h] =
@@ -8924,6 +13522,10 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
             spl->stats[thr_i].memtable_flush_time_max_ns;
       }
       global->memtable_flush_root_full    += spl->stats[thr_i].memtable_flush_root_full;
+      global->write_throttles             += spl->stats[thr_i].write_throttles;
+      global->write_throttle_time_ns      += spl->stats[thr_i].write_throttle_time_ns;
+      global->write_stalls                += spl->stats[thr_i].write_stalls;
+      global->write_stall_time_ns         += spl->stats[thr_i].write_stall_time_ns;
       global->root_full_flushes           += spl->stats[thr_i].root_full_flushes;
       global->root_count_flushes          += spl->stats[thr_i].root_count_flushes;
       global->root_flush_time_ns          += spl->stats[thr_i].root_flush_time_ns;
@@ -8967,6 +13569,8 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
    platform_log(log_handle, "| completed deletes: %10lu\n", global->discarded_deletes);
    platform_log(log_handle, "------------------------------------------------------------------------------------\n");
    platform_log(log_handle, "| root stalls:       %10lu\n", global->memtable_flush_root_full);
+   platform_log(log_handle, "| write throttles:   %10lu (%lu ms)\n", global->write_throttles, NSEC_TO_MSEC(global->write_throttle_time_ns));
+   platform_log(log_handle, "| write stalls:      %10lu (%lu ms)\n", global->write_stalls, NSEC_TO_MSEC(global->write_stall_time_ns));
    platform_log(log_handle, "------------------------------------------------------------------------------------\n");
    platform_log(log_handle, "\n");
 
@@ -9050,6 +13654,15 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
    platform_log(log_handle, "------------------------------------------------------------------------------------------------------------------------------------------\n");
    platform_log(log_handle, "\n");
 
+   uint64 compactions_parallel = 0;
+   uint64 compaction_subranges = 0;
+   for (h = 0; h < height; h++) {
+      compactions_parallel += global->compactions_parallel[h];
+      compaction_subranges += global->compaction_subranges[h];
+   }
+   platform_log(log_handle, "| parallel compactions: %10lu (%lu sub-ranges)\n", compactions_parallel, compaction_subranges);
+   platform_log(log_handle, "\n");
+
    if (global->leaf_splits == 0) {
       avg_leaves_created = zero_fraction;
    } else {
@@ -9153,7 +13766,7 @@ trunk_print_lookup_stats(platform_log_handle *log_handle, trunk_handle *spl)
       return;
    }
 
-   for (thr_i = 0; thr_i < MAX_THREADS; thr_i++) {
+   for (thr_i = 0; thr_i < trunk_max_threads(spl); thr_i++) {
       for (h = 0; h <= height; h++) {
          global->filter_lookups[h]         += spl->stats[thr_i].filter_lookups[h];
          global->branch_lookups[h]         += spl->stats[thr_i].branch_lookups[h];
@@ -9277,7 +13890,7 @@ trunk_print_lookup(trunk_handle        *spl,
       debug_assert(pivot_no < trunk_num_children(spl, &node));
       trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, pivot_no);
       merge_accumulator_set_to_null(&data);
-      trunk_pivot_lookup(spl, &node, pdata, target, &data);
+      trunk_pivot_lookup(spl, &node, pdata, target, 0, &data, NULL);
       if (!merge_accumulator_is_null(&data)) {
          char key_str[128];
          char message_str[128];
@@ -9330,7 +13943,7 @@ trunk_print_lookup(trunk_handle        *spl,
    trunk_print_locked_node(Platform_default_log_handle, spl, &node);
    trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, 0);
    merge_accumulator_set_to_null(&data);
-   trunk_pivot_lookup(spl, &node, pdata, target, &data);
+   trunk_pivot_lookup(spl, &node, pdata, target, 0, &data, NULL);
    if (!merge_accumulator_is_null(&data)) {
       char key_str[128];
       char message_str[128];
@@ -9382,7 +13995,7 @@ void
 trunk_reset_stats(trunk_handle *spl)
 {
    if (spl->cfg.use_stats) {
-      for (threadid thr_i = 0; thr_i < MAX_THREADS; thr_i++) {
+      for (threadid thr_i = 0; thr_i < trunk_max_threads(spl); thr_i++) {
          platform_histo_destroy(spl->heap_id,
                                 &spl->stats[thr_i].insert_latency_histo);
          platform_histo_destroy(spl->heap_id,
@@ -9412,6 +14025,130 @@ trunk_reset_stats(trunk_handle *spl)
    }
 }
 
+/*
+ * Sums the statistics of all threads into global, taking the maximum of the
+ * max fields. If global has latency histograms, those of the threads are
+ * merged into them. The counters are read while other threads may still be
+ * updating them, so the sums are consistent only approximately.
+ */
+void
+trunk_get_stats(trunk_handle *spl, trunk_stats *global)
+{
+   if (!spl->cfg.use_stats) {
+      return;
+   }
+
+   for (threadid thr_i = 0; thr_i < trunk_max_threads(spl); thr_i++) {
+      trunk_stats *stats = &spl->stats[thr_i];
+      if (global->insert_latency_histo != NULL) {
+         platform_histo_merge_in(global->insert_latency_histo,
+                                 stats->insert_latency_histo);
+      }
+      if (global->update_latency_histo != NULL) {
+         platform_histo_merge_in(global->update_latency_histo,
+                                 stats->update_latency_histo);
+      }
+      if (global->delete_latency_histo != NULL) {
+         platform_histo_merge_in(global->delete_latency_histo,
+                                 stats->delete_latency_histo);
+      }
+      global->insertions += stats->insertions;
+      global->updates += stats->updates;
+      global->deletions += stats->deletions;
+      global->memtable_flushes += stats->memtable_flushes;
+      global->memtable_flush_time_ns += stats->memtable_flush_time_ns;
+      global->memtable_flush_time_max_ns =
+         MAX(global->memtable_flush_time_max_ns,
+             stats->memtable_flush_time_max_ns);
+      global->memtable_flush_wait_time_ns += stats->memtable_flush_wait_time_ns;
+      global->memtable_flush_root_full += stats->memtable_flush_root_full;
+      global->write_throttles += stats->write_throttles;
+      global->write_throttle_time_ns += stats->write_throttle_time_ns;
+      global->write_stalls += stats->write_stalls;
+      global->write_stall_time_ns += stats->write_stall_time_ns;
+      global->root_full_flushes += stats->root_full_flushes;
+      global->root_count_flushes += stats->root_count_flushes;
+      global->root_flush_time_ns += stats->root_flush_time_ns;
+      global->root_flush_time_max_ns =
+         MAX(global->root_flush_time_max_ns, stats->root_flush_time_max_ns);
+      global->root_flush_wait_time_ns += stats->root_flush_wait_time_ns;
+      global->root_failed_flushes += stats->root_failed_flushes;
+      global->memtable_failed_flushes += stats->memtable_failed_flushes;
+      global->root_compactions += stats->root_compactions;
+      global->root_compaction_pack_time_ns +=
+         stats->root_compaction_pack_time_ns;
+      global->root_compaction_tuples += stats->root_compaction_tuples;
+      global->root_compaction_max_tuples =
+         MAX(global->root_compaction_max_tuples,
+             stats->root_compaction_max_tuples);
+      global->root_compaction_time_ns += stats->root_compaction_time_ns;
+      global->root_compaction_time_max_ns =
+         MAX(global->root_compaction_time_max_ns,
+             stats->root_compaction_time_max_ns);
+      global->discarded_deletes += stats->discarded_deletes;
+      global->index_splits += stats->index_splits;
+      global->leaf_splits += stats->leaf_splits;
+      global->leaf_splits_leaves_created += stats->leaf_splits_leaves_created;
+      global->leaf_split_time_ns += stats->leaf_split_time_ns;
+      global->leaf_split_max_time_ns =
+         MAX(global->leaf_split_max_time_ns, stats->leaf_split_max_time_ns);
+      global->single_leaf_splits += stats->single_leaf_splits;
+      global->single_leaf_tuples += stats->single_leaf_tuples;
+      global->single_leaf_max_tuples =
+         MAX(global->single_leaf_max_tuples, stats->single_leaf_max_tuples);
+      global->root_filters_built += stats->root_filters_built;
+      global->root_filter_tuples += stats->root_filter_tuples;
+      global->root_filter_time_ns += stats->root_filter_time_ns;
+      global->lookups_found += stats->lookups_found;
+      global->lookups_not_found += stats->lookups_not_found;
+      for (uint32 h = 0; h < TRUNK_MAX_HEIGHT; h++) {
+         global->flush_wait_time_ns[h] += stats->flush_wait_time_ns[h];
+         global->flush_time_ns[h] += stats->flush_time_ns[h];
+         global->flush_time_max_ns[h] =
+            MAX(global->flush_time_max_ns[h], stats->flush_time_max_ns[h]);
+         global->full_flushes[h] += stats->full_flushes[h];
+         global->count_flushes[h] += stats->count_flushes[h];
+         global->failed_flushes[h] += stats->failed_flushes[h];
+         global->compactions[h] += stats->compactions[h];
+         global->compactions_aborted_flushed[h] +=
+            stats->compactions_aborted_flushed[h];
+         global->compactions_aborted_leaf_split[h] +=
+            stats->compactions_aborted_leaf_split[h];
+         global->compactions_discarded_flushed[h] +=
+            stats->compactions_discarded_flushed[h];
+         global->compactions_discarded_leaf_split[h] +=
+            stats->compactions_discarded_leaf_split[h];
+         global->compactions_empty[h] += stats->compactions_empty[h];
+         global->compaction_tuples[h] += stats->compaction_tuples[h];
+         global->compaction_max_tuples[h] =
+            MAX(global->compaction_max_tuples[h],
+                stats->compaction_max_tuples[h]);
+         global->compaction_time_ns[h] += stats->compaction_time_ns[h];
+         global->compaction_time_max_ns[h] =
+            MAX(global->compaction_time_max_ns[h],
+                stats->compaction_time_max_ns[h]);
+         global->compaction_time_wasted_ns[h] +=
+            stats->compaction_time_wasted_ns[h];
+         global->compaction_pack_time_ns[h] +=
+            stats->compaction_pack_time_ns[h];
+         global->compactions_parallel[h] += stats->compactions_parallel[h];
+         global->compaction_subranges[h] += stats->compaction_subranges[h];
+         global->filters_built[h] += stats->filters_built[h];
+         global->filter_tuples[h] += stats->filter_tuples[h];
+         global->filter_time_ns[h] += stats->filter_time_ns[h];
+         global->filter_lookups[h] += stats->filter_lookups[h];
+         global->branch_lookups[h] += stats->branch_lookups[h];
+         global->filter_false_positives[h] += stats->filter_false_positives[h];
+         global->filter_negatives[h] += stats->filter_negatives[h];
+         global->space_recs[h] += stats->space_recs[h];
+         global->space_rec_time_ns[h] += stats->space_rec_time_ns[h];
+         global->space_rec_tuples_reclaimed[h] +=
+            stats->space_rec_tuples_reclaimed[h];
+         global->tuples_reclaimed[h] += stats->tuples_reclaimed[h];
+      }
+   }
+}
+
 void
 trunk_branch_count_num_tuples(trunk_handle *spl,
                               trunk_node   *node,
@@ -31,10 +31,10 @@
 /*
  * Mini-allocator uses separate batches for each height of the Trunk tree.
  * Therefore, the max # of mini-batches that the mini-allocator can track
- * is limited by the max height of the SplinterDB trunk.
+ * limits the max height of the SplinterDB trunk.
  */
-_Static_assert(TRUNK_MAX_HEIGHT == MINI_MAX_BATCHES,
-               "TRUNK_MAX_HEIGHT should be == MINI_MAX_BATCHES");
+_Static_assert(TRUNK_MAX_HEIGHT <= MINI_MAX_BATCHES,
+               "TRUNK_MAX_HEIGHT should be <= MINI_MAX_BATCHES");
 
 /*
  * Upper-bound on most number of branches that we can find our lookup-key in.
@@ -44,6 +44,15 @@ _Static_assert(TRUNK_MAX_HEIGHT == MINI_MAX_BATCHES,
 #define TRUNK_RANGE_ITOR_MAX_BRANCHES 256
 
 
+/*
+ * Trunks which share an allocator, and so the ref counts it checkpoints,
+ * checkpoint together, see trunk_checkpoint.
+ */
+typedef struct trunk_checkpoint_group {
+   platform_mutex       mutex;
+   struct trunk_handle *members; // by next_in_checkpoint_group
+} trunk_checkpoint_group;
+
 /*
  *----------------------------------------------------------------------
  * Splinter Configuration structure
@@ -64,6 +73,9 @@ typedef struct trunk_config {
                                 // free space < threshold
    uint64 queue_scale_percent;  // Governs when inserters perform bg tasks.  See
                                 // task.h
+   uint64 write_throttle_max_delay_ns; // per message, 0 disables
+   uint64 max_compaction_subranges;    // split compactions, < 2 disables
+   uint64 checkpoint_log_size; // checkpoint once the log is this big
    bool32          use_stats;   // stats
    memtable_config mt_cfg;
    btree_config    btree_cfg;
@@ -72,6 +84,9 @@ typedef struct trunk_config {
    bool32          use_log;
    log_config     *log_cfg;
 
+   // NULL if the trunk is the only user of its allocator
+   trunk_checkpoint_group *checkpoint_group;
+
    // verbose logging
    bool32               verbose_logging_enabled;
    platform_log_handle *log_handle;
@@ -105,6 +120,11 @@ typedef struct trunk_stats {
    uint64 root_failed_flushes;
    uint64 memtable_failed_flushes;
 
+   uint64 write_throttles; // updates delayed by the write throttle
+   uint64 write_throttle_time_ns;
+   uint64 write_stalls; // updates that waited for a memtable
+   uint64 write_stall_time_ns;
+
    uint64 compactions[TRUNK_MAX_HEIGHT];
    uint64 compactions_aborted_flushed[TRUNK_MAX_HEIGHT];
    uint64 compactions_aborted_leaf_split[TRUNK_MAX_HEIGHT];
@@ -117,6 +137,8 @@ typedef struct trunk_stats {
    uint64 compaction_time_max_ns[TRUNK_MAX_HEIGHT];
    uint64 compaction_time_wasted_ns[TRUNK_MAX_HEIGHT];
    uint64 compaction_pack_time_ns[TRUNK_MAX_HEIGHT];
+   uint64 compactions_parallel[TRUNK_MAX_HEIGHT]; // split into sub-ranges
+   uint64 compaction_subranges[TRUNK_MAX_HEIGHT];
 
    uint64 root_compactions;
    uint64 root_compaction_pack_time_ns;
@@ -158,9 +180,65 @@ typedef struct trunk_stats {
 
 // splinter refers to btrees as branches
 typedef struct trunk_branch {
-   uint64 root_addr; // root address of point btree
+   uint64 root_addr;  // root address of point btree
+   uint64 generation; // newest memtable generation merged into the btree
 } trunk_branch;
 
+/*
+ * Range deletes, see trunk_delete_range, are kept packed in a table, which is
+ * persisted in the super block. Each entry is a small header followed by the
+ * start and end key bytes.
+ */
+#define TRUNK_MAX_RANGE_DELETES       (32)
+#define TRUNK_RANGE_DELETE_TABLE_SIZE (2048)
+
+typedef struct ONDISK trunk_range_delete_table {
+   uint32 num_range_deletes;
+   uint32 num_bytes;
+   uint8  data[TRUNK_RANGE_DELETE_TABLE_SIZE];
+} trunk_range_delete_table;
+
+/*
+ * A private copy of the range delete table, decoded for merge iterators. The
+ * keys in range_delete point into table.
+ */
+typedef struct trunk_range_delete_set {
+   trunk_range_delete_table table;
+   merge_range_delete       range_delete[TRUNK_MAX_RANGE_DELETES];
+} trunk_range_delete_set;
+
+/*
+ * Zero-copy lookups, see trunk_lookup_with_ref, hold the branch page with the
+ * value through a slot of the held table. The slot pins the page once for all
+ * its holders, and belongs to a branch entry, which takes one reference on
+ * the branch, over the range of the trunk pivot it was found in, for all its
+ * held pages. So compaction can go ahead and drop the branch from the tree.
+ * A page hashes to a single slot; when that slot holds another page, or every
+ * branch entry is in use, the lookup copies the value instead.
+ */
+#define TRUNK_HELD_PAGES    (64)
+#define TRUNK_HELD_BRANCHES (16)
+
+typedef struct trunk_held_page {
+   platform_spinlock lock;
+   page_handle      *page;      // NULL when the slot is free
+   uint32            holders;   // lookup results
+   uint32            branch_no; // of its trunk_held_branch
+} trunk_held_page;
+
+typedef struct trunk_held_branch {
+   uint64     root_addr; // 0 when the entry is free
+   uint32     holders;   // held pages, 0 while the reference is dropped
+   key_buffer start_key;
+   key_buffer end_key;
+} trunk_held_branch;
+
+typedef struct trunk_held_table {
+   platform_spinlock branch_lock;
+   trunk_held_branch branch[TRUNK_HELD_BRANCHES];
+   trunk_held_page   page[TRUNK_HELD_PAGES];
+} trunk_held_table;
+
 typedef struct trunk_handle             trunk_handle;
 typedef struct trunk_compact_bundle_req trunk_compact_bundle_req;
 
@@ -192,12 +270,42 @@ struct trunk_handle {
    allocator     *al;
    cache         *cc;
    log_handle    *log;
+   uint64         last_log_batch; // numbers the batches written to the log
    mini_allocator mini;
 
    // memtables
    allocator_root_id id;
    memtable_context *mt_ctxt;
 
+   /*
+    * Memtable generations restart from 0 on every mount; adding
+    * generation_base keeps branch and range delete generations increasing
+    * across mounts.
+    */
+   uint64 generation_base;
+
+   // range deletes, guarded by TRUNK_RANGE_DELETE_LOCK_IDX of trunk_root_lock
+   trunk_range_delete_table range_deletes;
+   platform_mutex           range_delete_retire_mutex;
+
+   // checkpoints, see trunk_checkpoint
+   platform_mutex  checkpoint_mutex;   // unless in a cfg.checkpoint_group
+   volatile bool32 checkpoint_pending; // one triggered by the log size
+   trunk_handle   *next_in_checkpoint_group;
+
+   // pages held by zero-copy lookups
+   trunk_held_table held;
+
+   // live snapshots, and the reference drops deferred while they are created
+   platform_spinlock           snapshot_lock;
+   uint64                      num_snapshots;
+   uint64                      num_snapshot_walks;
+   struct trunk_deferred_drop *deferred_drops;
+
+   // write throttle, the root branch count is sampled by inserts
+   volatile timestamp write_throttle_sample_ts;
+   volatile uint64    root_branch_count;
+
    // task system
    task_system *ts; // ALEX: currently not durable
 
@@ -207,42 +315,54 @@ struct trunk_handle {
    // Link inside the splinter list
    List_Links links;
 
-   /*
-    * Per thread task and per splinter table task counter. Used to decide when
-    * to run tasks.
-    */
-
-   struct {
-      uint64 counter;
-   } PLATFORM_CACHELINE_ALIGNED task_countup[MAX_THREADS];
-
    // space rec queue
    srq srq;
 
    trunk_compacted_memtable compacted_memtable[/*cfg.mt_cfg.max_memtables*/];
 };
 
+// Live snapshots at once, kept well within the 8-bit extent ref counts
+#define TRUNK_MAX_SNAPSHOTS (64)
+
+/*
+ * A read-only, point-in-time view of the trunk. The trunk is copy-on-write,
+ * so a retired root still describes the tree as it was; the snapshot holds a
+ * reference on every branch and filter reachable from that root so that
+ * compaction cannot reclaim them while the snapshot is live.
+ */
+typedef struct trunk_snapshot {
+   uint64                 root_addr;
+   trunk_range_delete_set range_deletes; // as of the snapshot
+} trunk_snapshot;
+
 typedef struct trunk_range_iterator {
-   iterator        super;
-   trunk_handle   *spl;
-   uint64          num_tuples;
-   uint64          num_branches;
-   uint64          num_memtable_branches;
-   uint64          memtable_start_gen;
-   uint64          memtable_end_gen;
-   bool32          compacted[TRUNK_RANGE_ITOR_MAX_BRANCHES];
-   merge_iterator *merge_itor;
-   bool32          can_prev;
-   bool32          can_next;
-   key_buffer      min_key;
-   key_buffer      max_key;
-   key_buffer      local_min_key;
-   key_buffer      local_max_key;
-   btree_iterator  btree_itor[TRUNK_RANGE_ITOR_MAX_BRANCHES];
-   trunk_branch    branch[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   iterator               super;
+   trunk_handle          *spl;
+   const trunk_snapshot  *snapshot; // NULL when iterating the live tree
+   uint64                 num_tuples;
+   uint64                 num_branches;
+   uint64                 num_memtable_branches;
+   uint64                 memtable_start_gen;
+   uint64                 memtable_end_gen;
+   bool32                 compacted[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   // FALSE for the branches left without an iterator, see init
+   bool32                 opened[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   merge_iterator        *merge_itor;
+   bool32                 can_prev;
+   bool32                 can_next;
+   key_buffer             min_key;
+   key_buffer             max_key;
+   key_buffer             local_min_key;
+   key_buffer             local_max_key;
+   bool32                 has_prefix;
+   key_buffer             prefix;
+   btree_iterator         btree_itor[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   trunk_branch           branch[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   trunk_range_delete_set range_deletes;
 
    // used for merge iterator construction
    iterator *itor[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   uint64    itor_generation[TRUNK_RANGE_ITOR_MAX_BRANCHES];
 } trunk_range_iterator;
 
 
@@ -310,11 +430,13 @@ typedef struct trunk_async_ctxt {
    uint64                   found_values; // values found in filter
    uint16                   value;        // Current value found in filter
 
-   uint16 branch_no;        // branch number (newest)
-   uint16 branch_no_end;    // branch number end (oldest,
-                            // exclusive)
-   bool32        was_async; // Did an async IO for trunk ?
-   trunk_branch *branch;    // Current branch
+   uint16 branch_no;             // branch number (newest)
+   uint16 branch_no_end;         // branch number end (oldest,
+                                 // exclusive)
+   bool32        was_async;      // Did an async IO for trunk ?
+   trunk_branch *branch;         // Current branch
+   uint64        min_generation; // Older memtables and branches are hidden
+                                 // by a range delete
    union {
       routing_async_ctxt filter_ctxt; // Filter async context
       btree_async_ctxt   btree_ctxt;  // Btree async context
@@ -334,9 +456,46 @@ typedef struct trunk_async_ctxt {
 platform_status
 trunk_insert(trunk_handle *spl, key tuple_key, message data);
 
+platform_status
+trunk_insert_batch(trunk_handle *spl,
+                   key           keys[],
+                   message       msgs[],
+                   uint64        num_msgs);
+
+platform_status
+trunk_delete_range(trunk_handle *spl, key start_key, key end_key);
+
+platform_status
+trunk_bulk_load(trunk_handle *spl, iterator *itor);
+
 platform_status
 trunk_lookup(trunk_handle *spl, key target, merge_accumulator *result);
 
+/*
+ * A hold on the branch page with the value of a lookup, so the value can be
+ * read in place. See trunk_lookup_with_ref.
+ */
+typedef struct trunk_lookup_ref {
+   trunk_handle *spl;     // NULL unless held
+   uint64        slot_no; // in spl->held.page
+   message       msg;     // the INSERT, pointing into the held page
+} trunk_lookup_ref;
+
+static inline bool32
+trunk_lookup_ref_held(const trunk_lookup_ref *ref)
+{
+   return ref != NULL && ref->spl != NULL;
+}
+
+void
+trunk_lookup_ref_release(trunk_lookup_ref *ref);
+
+platform_status
+trunk_lookup_with_ref(trunk_handle      *spl,
+                      key                target,
+                      merge_accumulator *result,
+                      trunk_lookup_ref  *ref);
+
 static inline bool32
 trunk_lookup_found(merge_accumulator *result)
 {
@@ -355,10 +514,25 @@ trunk_range_iterator_init(trunk_handle         *spl,
                           key                   max_key,
                           key                   start_key,
                           comparison            start_type,
-                          uint64                num_tuples);
+                          uint64                num_tuples,
+                          key                   prefix,
+                          const trunk_snapshot *snapshot);
 void
 trunk_range_iterator_deinit(trunk_range_iterator *range_itor);
 
+platform_status
+trunk_snapshot_create(trunk_handle *spl, trunk_snapshot *snapshot);
+
+void
+trunk_snapshot_release(trunk_handle *spl, trunk_snapshot *snapshot);
+
+platform_status
+trunk_snapshot_lookup(trunk_handle         *spl,
+                      const trunk_snapshot *snapshot,
+                      key                   target,
+                      merge_accumulator    *result,
+                      trunk_lookup_ref     *ref);
+
 typedef void (*tuple_function)(key tuple_key, message value, void *arg);
 platform_status
 trunk_range(trunk_handle  *spl,
@@ -367,6 +541,14 @@ trunk_range(trunk_handle  *spl,
             tuple_function func,
             void          *arg);
 
+platform_status
+trunk_split_range(trunk_handle *spl,
+                  key           start_key,
+                  key           end_key,
+                  uint64        max_partitions,
+                  key_buffer   *boundaries,
+                  uint64       *num_partitions);
+
 trunk_handle *
 trunk_create(trunk_config     *cfg,
              allocator        *al,
@@ -376,15 +558,30 @@ trunk_create(trunk_config     *cfg,
              platform_heap_id  hid);
 void
 trunk_destroy(trunk_handle *spl);
-trunk_handle *
+platform_status
 trunk_mount(trunk_config     *cfg,
             allocator        *al,
             cache            *cc,
             task_system      *ts,
             allocator_root_id id,
-            platform_heap_id  hid);
+            platform_heap_id  hid,
+            trunk_handle    **spl_out);
 void
 trunk_unmount(trunk_handle **spl);
+platform_status
+trunk_checkpoint(trunk_handle *spl);
+
+void
+trunk_checkpoint_group_init(trunk_checkpoint_group *group,
+                            platform_heap_id        hid);
+void
+trunk_checkpoint_group_deinit(trunk_checkpoint_group *group);
+void
+trunk_hold_recovered_logs(trunk_config     *cfg,
+                          allocator        *al,
+                          cache            *cc,
+                          allocator_root_id id,
+                          platform_heap_id  hid);
 
 void
 trunk_perform_tasks(trunk_handle *spl);
@@ -395,6 +592,8 @@ void
 trunk_print_lookup_stats(platform_log_handle *log_handle, trunk_handle *spl);
 void
 trunk_reset_stats(trunk_handle *spl);
+void
+trunk_get_stats(trunk_handle *spl, trunk_stats *global);
 
 void
 trunk_print(platform_log_handle *log_handle, trunk_handle *spl);
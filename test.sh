@@ -592,6 +592,8 @@ function test_make_run_tests() {
 function run_fast_unit_tests() {
 
    "$BINDIR"/unit/splinterdb_quick_test "$Use_shmem"
+   "$BINDIR"/unit/splinterdb_compaction_test "$Use_shmem"
+   "$BINDIR"/unit/splinterdb_cache_test "$Use_shmem"
    "$BINDIR"/unit/btree_test "$Use_shmem"
    "$BINDIR"/unit/util_test "$Use_shmem"
    "$BINDIR"/unit/misc_test "$Use_shmem"
@@ -657,6 +659,18 @@ function run_slower_unit_tests() {
           "$BINDIR"/unit/splinter_test ${Use_shmem} test_splinter_print_diags
     rm db
 
+    msg="SplinterDB crash recovery tests ${use_msg}"
+    # shellcheck disable=SC2086
+    run_with_timing "${msg}" "$BINDIR"/unit/splinterdb_recovery_test ${Use_shmem}
+
+    msg="SplinterDB snapshot tests ${use_msg}"
+    # shellcheck disable=SC2086
+    run_with_timing "${msg}" "$BINDIR"/unit/splinterdb_snapshot_test ${Use_shmem}
+
+    msg="SplinterDB bulk load tests ${use_msg}"
+    # shellcheck disable=SC2086
+    run_with_timing "${msg}" "$BINDIR"/unit/splinterdb_bulk_load_test ${Use_shmem}
+
     # Test runs w/ default of 1M rows for --num-inserts
     n_mills=1
     num_rows=$((n_mills * 1000 * 1000))
@@ -47,6 +47,8 @@
 
 #define TEST_CONFIG_DEFAULT_QUEUE_SCALE_PERCENT (100)
 
+#define TEST_CONFIG_DEFAULT_LOG_SYNC_MAX_DELAY_US (100)
+
 // clang-format off
 /*
  * ---------------------------------------------------------------------------
@@ -80,6 +82,8 @@ config_set_defaults(master_config *cfg)
       .filter_remainder_size    = 4,
       .filter_index_size        = TEST_CONFIG_DEFAULT_FILTER_INDEX_SIZE,
       .use_log                  = FALSE,
+      .log_sync                 = FALSE,
+      .log_sync_max_delay_us    = TEST_CONFIG_DEFAULT_LOG_SYNC_MAX_DELAY_US,
       .num_normal_bg_threads    = TEST_CONFIG_DEFAULT_NUM_NORMAL_BG_THREADS,
       .num_memtable_bg_threads  = TEST_CONFIG_DEFAULT_NUM_MEMTABLE_BG_THREADS,
       .memtable_capacity        = MiB_TO_B(TEST_CONFIG_DEFAULT_MEMTABLE_CAPACITY_MB),
@@ -152,6 +156,9 @@ config_usage()
    platform_error_log("\t--no-stats\n");
    platform_error_log("\t--log\n");
    platform_error_log("\t--no-log\n");
+   platform_error_log("\t--log-sync\n");
+   platform_error_log("\t--log-sync-max-delay-us (%d)\n",
+                      TEST_CONFIG_DEFAULT_LOG_SYNC_MAX_DELAY_US);
    platform_error_log("\t--verbose-logging\n");
    platform_error_log("\t--no-verbose-logging\n");
    platform_error_log("\t--verbose-progress\n");
@@ -327,6 +334,15 @@ config_parse(master_config *cfg, const uint8 num_config, int argc, char *argv[])
                cfg[cfg_idx].use_log = FALSE;
             }
          }
+         config_has_option("log-sync")
+         {
+            for (uint8 cfg_idx = 0; cfg_idx < num_config; cfg_idx++) {
+               cfg[cfg_idx].use_log  = TRUE;
+               cfg[cfg_idx].log_sync = TRUE;
+            }
+         }
+         config_set_uint64("log-sync-max-delay-us", cfg, log_sync_max_delay_us)
+         {}
          config_has_option("verbose-logging")
          {
             for (uint8 cfg_idx = 0; cfg_idx < num_config; cfg_idx++) {
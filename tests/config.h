@@ -73,6 +73,8 @@ typedef struct master_config {
 
    // log
    bool32 use_log;
+   bool32 log_sync;
+   uint64 log_sync_max_delay_us;
 
    // task system
    uint64 num_normal_bg_threads;   // Both bg_threads fields have to be non-zero
@@ -279,7 +279,8 @@ splinter_io_apis_test(int argc, char *argv[])
    rc = task_system_config_init(&task_cfg,
                                 TRUE /* use stats */,
                                 num_bg_threads,
-                                trunk_get_scratch_size());
+                                trunk_get_scratch_size(),
+                                DEFAULT_MAX_THREADS);
    platform_assert(SUCCESS(rc));
 
    task_system *tasks = NULL;
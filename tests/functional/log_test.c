@@ -49,7 +49,7 @@ test_log_crash(clockcache             *cc,
    DECLARE_AUTO_KEY_BUFFER(keybuffer, hid);
 
    platform_assert(cc != NULL);
-   rc = shard_log_init(log, (cache *)cc, cfg);
+   rc = shard_log_init(log, (cache *)cc, cfg, hid);
    platform_assert_status_ok(rc);
    logh = (log_handle *)log;
 
@@ -169,7 +169,7 @@ test_log_perf(cache                  *cc,
    uint64          start_time;
    platform_status ret;
 
-   ret = shard_log_init(log, (cache *)cc, cfg);
+   ret = shard_log_init(log, (cache *)cc, cfg, hid);
    platform_assert_status_ok(ret);
 
    for (uint64 i = 0; i < num_threads; i++) {
@@ -238,7 +238,11 @@ test_config_init(trunk_config           *splinter_cfg,  // OUT
                           master_cfg->cache_logfile,
                           master_cfg->use_stats);
 
-   shard_log_config_init(log_cfg, &cache_cfg->super, *data_cfg);
+   shard_log_config_init(log_cfg,
+                         &cache_cfg->super,
+                         *data_cfg,
+                         master_cfg->log_sync,
+                         master_cfg->log_sync_max_delay_us * 1000);
 
    uint64 num_bg_threads[NUM_TASK_TYPES] = {0};
    num_bg_threads[TASK_TYPE_NORMAL]      = master_cfg->num_normal_bg_threads;
@@ -246,7 +250,8 @@ test_config_init(trunk_config           *splinter_cfg,  // OUT
    platform_status rc                    = task_system_config_init(task_cfg,
                                                 master_cfg->use_stats,
                                                 num_bg_threads,
-                                                trunk_get_scratch_size());
+                                                trunk_get_scratch_size(),
+                                                DEFAULT_MAX_THREADS);
    platform_assert_status_ok(rc);
 
    rc = trunk_config_init(splinter_cfg,
@@ -39,7 +39,9 @@ search_for_key_via_iterator(trunk_handle *spl, key target)
                              POSITIVE_INFINITY_KEY,
                              NEGATIVE_INFINITY_KEY,
                              greater_than_or_equal,
-                             UINT64_MAX);
+                             UINT64_MAX,
+                             NULL_KEY,
+                             NULL);
    uint64 count = 0;
    while (iterator_can_curr((iterator *)&iter)) {
       key     curr_key;
@@ -244,7 +246,9 @@ verify_range_against_shadow(trunk_handle               *spl,
                                       end_key,
                                       start_key,
                                       greater_than_or_equal,
-                                      end_index - start_index);
+                                      end_index - start_index,
+                                      NULL_KEY,
+                                      NULL);
    if (!SUCCESS(status)) {
       platform_error_log("failed to create range itor: %s\n",
                          platform_status_to_string(status));
@@ -1300,13 +1300,14 @@ ycsb_test(int argc, char *argv[])
                            hid,
                            platform_get_module_id());
       platform_assert_status_ok(rc);
-      spl = trunk_mount(splinter_cfg,
-                        (allocator *)&al,
-                        (cache *)cc,
-                        ts,
-                        test_generate_allocator_root_id(),
-                        hid);
-      platform_assert(spl);
+      rc = trunk_mount(splinter_cfg,
+                       (allocator *)&al,
+                       (cache *)cc,
+                       ts,
+                       test_generate_allocator_root_id(),
+                       hid,
+                       &spl);
+      platform_assert_status_ok(rc);
    } else {
       rc_allocator_init(
          &al, &allocator_cfg, (io_handle *)io, hid, platform_get_module_id());
@@ -59,8 +59,11 @@ init_task_config_from_master_config(task_system_config  *task_cfg,
    num_bg_threads[TASK_TYPE_NORMAL]   = master_cfg->num_normal_bg_threads;
    num_bg_threads[TASK_TYPE_MEMTABLE] = master_cfg->num_memtable_bg_threads;
 
-   rc = task_system_config_init(
-      task_cfg, master_cfg->use_stats, num_bg_threads, scratch_size);
+   rc = task_system_config_init(task_cfg,
+                                master_cfg->use_stats,
+                                num_bg_threads,
+                                scratch_size,
+                                DEFAULT_MAX_THREADS);
    return SUCCESS(rc);
 }
 
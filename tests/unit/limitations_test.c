@@ -252,7 +252,7 @@ CTEST2(limitations, test_splinterdb_create_invalid_task_system_config)
    create_default_cfg(&cfg, &default_data_cfg, data->use_shmem);
 
    // Cannot use up all possible threads for just bg-threads.
-   cfg.num_normal_bg_threads   = (MAX_THREADS - 1);
+   cfg.num_normal_bg_threads   = (DEFAULT_MAX_THREADS - 1);
    cfg.num_memtable_bg_threads = 1;
 
    int rc = splinterdb_create(&cfg, &kvsb);
@@ -0,0 +1,251 @@
+// Copyright 2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * -----------------------------------------------------------------------------
+ * splinterdb_bulk_load_test.c --
+ *
+ *  Tests of bulk loads, which build the tree of an empty database in one
+ *  pass from sorted input, and of how the loaded data is persisted.
+ * -----------------------------------------------------------------------------
+ */
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "splinterdb/splinterdb.h"
+#include "splinterdb/default_data_config.h"
+#include "unit_tests.h"
+#include "ctest.h" // This is required for all test-case files.
+#include "config.h"
+
+#define TEST_MAX_KEY_SIZE 13
+
+// Function Prototypes
+static void
+create_default_cfg(splinterdb_config *out_cfg, data_config *default_data_cfg);
+
+// Bulk load source of num_keys sorted keys, one of which may be out of order
+#define BULK_LOAD_KEY_LENGTH (9 + 1)
+#define BULK_LOAD_VAL_LENGTH (24 + 1)
+static const char bulk_load_key_fmt[] = "b%08x";
+static const char bulk_load_val_fmt[] = "bulk-load-value-%08x";
+
+typedef struct {
+   int  next_i;
+   int  num_keys;
+   int  out_of_order_i; // position that repeats key 0, or -1
+   char key[BULK_LOAD_KEY_LENGTH];
+   char val[BULK_LOAD_VAL_LENGTH];
+} bulk_load_source_state;
+
+static _Bool
+bulk_load_source(void *arg, slice *key, slice *value);
+
+/*
+ * Global data declaration macro:
+ */
+CTEST_DATA(splinterdb_bulk_load)
+{
+   splinterdb       *kvsb;
+   splinterdb_config cfg;
+   data_config       default_data_cfg;
+};
+
+// Optional setup function for suite, called before every test in suite
+CTEST_SETUP(splinterdb_bulk_load)
+{
+   default_data_config_init(TEST_MAX_KEY_SIZE, &data->default_data_cfg);
+   create_default_cfg(&data->cfg, &data->default_data_cfg);
+   data->cfg.use_shmem =
+      config_parse_use_shmem(Ctest_argc, (char **)Ctest_argv);
+
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+}
+
+// Optional teardown function for suite, called after every test in suite
+CTEST_TEARDOWN(splinterdb_bulk_load)
+{
+   if (data->kvsb) {
+      splinterdb_close(&data->kvsb);
+   }
+}
+
+/*
+ * A bulk load fills an empty database in one pass, spanning several leaves
+ * and index levels here. Out-of-order input is rejected without loading
+ * anything, and so is a load into a database that is no longer empty.
+ */
+CTEST2(splinterdb_bulk_load, test_bulk_load)
+{
+   const int num_keys = 300 * 1000;
+   int       rc;
+
+   // Small nodes, so that the tree built has some height
+   splinterdb_close(&data->kvsb);
+   data->cfg.memtable_capacity = 1 * Mega;
+   data->cfg.fanout            = 4;
+   rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   bulk_load_source_state source = {.num_keys       = num_keys,
+                                    .out_of_order_i = num_keys / 2};
+   rc = splinterdb_bulk_load(data->kvsb, bulk_load_source, &source);
+   ASSERT_EQUAL(EINVAL, rc);
+
+   splinterdb_iterator *it = NULL;
+   rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(splinterdb_iterator_valid(it));
+   splinterdb_iterator_deinit(it);
+
+   source = (bulk_load_source_state){.num_keys       = num_keys,
+                                     .out_of_order_i = -1};
+   rc     = splinterdb_bulk_load(data->kvsb, bulk_load_source, &source);
+   ASSERT_EQUAL(0, rc);
+
+   char key[BULK_LOAD_KEY_LENGTH];
+   char val[BULK_LOAD_VAL_LENGTH];
+   rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   int i = 0;
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      slice curr_key, curr_val;
+      splinterdb_iterator_get_current(it, &curr_key, &curr_val);
+      snprintf(key, sizeof(key), bulk_load_key_fmt, i);
+      snprintf(val, sizeof(val), bulk_load_val_fmt, i);
+      ASSERT_EQUAL(sizeof(key), slice_length(curr_key));
+      ASSERT_EQUAL(0, memcmp(key, slice_data(curr_key), sizeof(key)));
+      ASSERT_EQUAL(sizeof(val), slice_length(curr_val));
+      ASSERT_EQUAL(0, memcmp(val, slice_data(curr_val), sizeof(val)));
+      i++;
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   ASSERT_EQUAL(num_keys, i);
+   splinterdb_iterator_deinit(it);
+
+   source = (bulk_load_source_state){.num_keys = 1, .out_of_order_i = -1};
+   rc     = splinterdb_bulk_load(data->kvsb, bulk_load_source, &source);
+   ASSERT_EQUAL(EINVAL, rc);
+
+   // Later writes and range deletes apply on top of the loaded data
+   snprintf(key, sizeof(key), bulk_load_key_fmt, 7);
+   rc = splinterdb_delete(data->kvsb, slice_create(sizeof(key), key));
+   ASSERT_EQUAL(0, rc);
+   char end_key[BULK_LOAD_KEY_LENGTH];
+   snprintf(key, sizeof(key), bulk_load_key_fmt, 1000);
+   snprintf(end_key, sizeof(end_key), bulk_load_key_fmt, 2000);
+   rc = splinterdb_delete_range(data->kvsb,
+                                slice_create(sizeof(key), key),
+                                slice_create(sizeof(end_key), end_key));
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (i = 0; i < num_keys; i += 3) {
+      snprintf(key, sizeof(key), bulk_load_key_fmt, i);
+      rc = splinterdb_lookup(
+         data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      bool32 expected = i != 7 && (i < 1000 || 2000 <= i);
+      ASSERT_EQUAL(expected, splinterdb_lookup_found(&result), "i=%d", i);
+      if (expected) {
+         slice value;
+         rc = splinterdb_lookup_result_value(&result, &value);
+         ASSERT_EQUAL(0, rc);
+         snprintf(val, sizeof(val), bulk_load_val_fmt, i);
+         ASSERT_EQUAL(sizeof(val), slice_length(value));
+         ASSERT_EQUAL(0, memcmp(val, slice_data(value), sizeof(val)));
+      }
+   }
+   splinterdb_lookup_result_deinit(&result);
+}
+
+/*
+ * Test case to verify that a bulk load survives a crash right after it
+ * returns. A child process loads the database and exits without closing it.
+ */
+CTEST2(splinterdb_bulk_load, test_bulk_load_crash)
+{
+   const int num_keys = 10 * 1000;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log = TRUE;
+   int rc            = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   pid_t pid = fork();
+   ASSERT_TRUE(pid >= 0);
+   if (pid == 0) {
+      splinterdb_config child_cfg = data->cfg;
+      child_cfg.use_shmem         = FALSE;
+      splinterdb *kvsb;
+      if (splinterdb_open(&child_cfg, &kvsb) != 0) {
+         _exit(1);
+      }
+      bulk_load_source_state source = {.num_keys       = num_keys,
+                                       .out_of_order_i = -1};
+      if (splinterdb_bulk_load(kvsb, bulk_load_source, &source) != 0) {
+         _exit(2);
+      }
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_iterator *it = NULL;
+   rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   int i = 0;
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      i++;
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   ASSERT_EQUAL(num_keys, i);
+   splinterdb_iterator_deinit(it);
+}
+
+/*
+ * ********************************************************************************
+ * Define minions and helper functions here, after all test cases are
+ * enumerated.
+ * ********************************************************************************
+ */
+
+static void
+create_default_cfg(splinterdb_config *out_cfg, data_config *default_data_cfg)
+{
+   *out_cfg = (splinterdb_config){.filename   = TEST_DB_NAME,
+                                  .cache_size = 64 * Mega,
+                                  .disk_size  = 127 * Mega,
+                                  .use_shmem  = FALSE,
+                                  .data_cfg   = default_data_cfg};
+}
+
+// Bulk load source: keys 0 .. num_keys - 1, with key 0 at out_of_order_i
+static _Bool
+bulk_load_source(void *arg, slice *key, slice *value)
+{
+   bulk_load_source_state *state = (bulk_load_source_state *)arg;
+   if (state->next_i == state->num_keys) {
+      return FALSE;
+   }
+   int i = state->next_i == state->out_of_order_i ? 0 : state->next_i;
+   snprintf(state->key, sizeof(state->key), bulk_load_key_fmt, i);
+   snprintf(state->val, sizeof(state->val), bulk_load_val_fmt, i);
+   *key   = slice_create(sizeof(state->key), state->key);
+   *value = slice_create(sizeof(state->val), state->val);
+   state->next_i++;
+   return TRUE;
+}
@@ -0,0 +1,437 @@
+// Copyright 2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * -----------------------------------------------------------------------------
+ * splinterdb_cache_test.c --
+ *
+ *  Tests of how SplinterDB sizes, fills and backs its cache, and the
+ *  per-thread state that goes with it, exercised through the public API.
+ * -----------------------------------------------------------------------------
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "splinterdb/splinterdb.h"
+#include "splinterdb/default_data_config.h"
+#include "platform.h"
+#include "unit_tests.h"
+#include "ctest.h" // This is required for all test-case files.
+#include "config.h"
+
+#define TEST_MAX_KEY_SIZE 13
+
+// Format of the keys insert_keys() inserts, with room for 16 bits of keys
+#define TEST_KEY_FMT           "key-%04x"
+#define TEST_VAL_FMT           "val-%04x"
+#define TEST_INSERT_KEY_LENGTH (8 + 1)
+#define TEST_INSERT_VAL_LENGTH (8 + 1)
+
+// More threads than DEFAULT_MAX_THREADS, all registered at the same time
+#define MANY_THREADS_NUM_THREADS (100)
+
+typedef struct {
+   splinterdb   *kvsb;
+   int           minkey;
+   int           num_keys;
+   volatile int *num_registered;
+   int           rc;
+} many_threads_inserter;
+
+// Function Prototypes
+static void
+create_default_cfg(splinterdb_config *out_cfg, data_config *default_data_cfg);
+
+static int
+insert_keys(splinterdb *kvsb, int minkey, int numkeys);
+
+static void
+check_lookups(splinterdb *kvsb, int num_keys);
+
+static int
+count_keys(splinterdb *kvsb, slice start_key);
+
+static void *
+many_threads_insert_thread(void *arg);
+
+/*
+ * Global data declaration macro:
+ */
+CTEST_DATA(splinterdb_cache)
+{
+   splinterdb       *kvsb;
+   splinterdb_config cfg;
+   data_config       default_data_cfg;
+};
+
+// Optional setup function for suite, called before every test in suite
+CTEST_SETUP(splinterdb_cache)
+{
+   default_data_config_init(TEST_MAX_KEY_SIZE, &data->default_data_cfg);
+   create_default_cfg(&data->cfg, &data->default_data_cfg);
+   data->cfg.use_shmem =
+      config_parse_use_shmem(Ctest_argc, (char **)Ctest_argv);
+
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+}
+
+// Optional teardown function for suite, called after every test in suite
+CTEST_TEARDOWN(splinterdb_cache)
+{
+   if (data->kvsb) {
+      splinterdb_close(&data->kvsb);
+   }
+}
+
+/*
+ * Test case to verify that raising max_threads lets more threads than the
+ * default limit be registered at once, and that they all insert correctly.
+ */
+CTEST2(splinterdb_cache, test_max_threads)
+{
+   const int num_inserts = 500; // TEST_KEY_FMT has 16 bits of keys
+
+   // Leave room for this thread, which registers itself on create.
+   data->cfg.max_threads = 2 * MANY_THREADS_NUM_THREADS;
+   splinterdb_close(&data->kvsb);
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb *kvsb = data->kvsb;
+
+   volatile int          num_registered = 0;
+   pthread_t             threads[MANY_THREADS_NUM_THREADS];
+   many_threads_inserter inserters[MANY_THREADS_NUM_THREADS];
+   for (int t = 0; t < MANY_THREADS_NUM_THREADS; t++) {
+      inserters[t].kvsb           = kvsb;
+      inserters[t].minkey         = t * num_inserts;
+      inserters[t].num_keys       = num_inserts;
+      inserters[t].num_registered = &num_registered;
+      rc                          = pthread_create(
+         &threads[t], NULL, many_threads_insert_thread, &inserters[t]);
+      ASSERT_EQUAL(0, rc);
+   }
+   for (int t = 0; t < MANY_THREADS_NUM_THREADS; t++) {
+      pthread_join(threads[t], NULL);
+      ASSERT_EQUAL(0, inserters[t].rc);
+   }
+
+   int num_keys = count_keys(kvsb, NULL_SLICE);
+   ASSERT_EQUAL(MANY_THREADS_NUM_THREADS * num_inserts, num_keys);
+
+   // max_threads is a runtime limit, but MAX_THREADS still caps it.
+   data->cfg.max_threads = MAX_THREADS + 1;
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_NOT_EQUAL(0, rc);
+}
+
+/*
+ * Test case to verify that a disk much larger than the cache works, now
+ * that the cache's lookup table only covers the addresses it has cached.
+ * It used to cost 4 bytes per page of disk, 4 GiB here.
+ */
+CTEST2(splinterdb_cache, test_large_disk_small_cache)
+{
+   const int num_inserts = 50 * 1000;
+
+   data->cfg.disk_size = TiB_TO_B(4);
+   splinterdb_close(&data->kvsb);
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   rc = insert_keys(data->kvsb, 0, num_inserts);
+   ASSERT_EQUAL(0, rc);
+   check_lookups(data->kvsb, num_inserts);
+}
+
+/*
+ * Test case to verify that, with a scan-resistant cache, a full scan of a
+ * database larger than the cache evicts fewer of the pages that point
+ * lookups used before it than it does under CLOCK.
+ */
+CTEST2(splinterdb_cache, test_scan_resistant_cache)
+{
+   const int  num_inserts    = 200 * 1000;
+   const int  num_hot        = 100;
+   const char scan_key_fmt[] = "scan%08x";
+   char       key[TEST_MAX_KEY_SIZE];
+   char       val[100];
+   uint64     misses[2];
+
+   for (int resistant = 0; resistant < 2; resistant++) {
+      data->cfg.use_stats            = TRUE;
+      data->cfg.cache_size           = 8 * Mega;
+      data->cfg.memtable_capacity    = 1 * Mega;
+      data->cfg.cache_scan_resistant = resistant;
+      splinterdb_close(&data->kvsb);
+      int rc = splinterdb_create(&data->cfg, &data->kvsb);
+      ASSERT_EQUAL(0, rc);
+      splinterdb *kvsb = data->kvsb;
+
+      for (int k = 0; k < num_inserts; k++) {
+         snprintf(key, sizeof(key), scan_key_fmt, k);
+         memset(val, 'a' + k % 26, sizeof(val));
+         rc = splinterdb_insert(kvsb,
+                                slice_create(strnlen(key, sizeof(key)), key),
+                                slice_create(sizeof(val), val));
+         ASSERT_EQUAL(0, rc);
+      }
+
+      splinterdb_lookup_result result;
+      splinterdb_lookup_result_init(kvsb, &result, 0, NULL);
+      splinterdb_stats stats[2] = {{.size = sizeof(stats[0])},
+                                   {.size = sizeof(stats[0])}};
+      for (int round = 0; round < 3; round++) {
+         // warm the cache up with two rounds of lookups, then scan
+         if (round == 2) {
+            int num_keys = count_keys(kvsb, NULL_SLICE);
+            ASSERT_EQUAL(num_inserts, num_keys);
+            rc = splinterdb_stats_get(kvsb, &stats[0]);
+            ASSERT_EQUAL(0, rc);
+         }
+         for (int h = 0; h < num_hot; h++) {
+            snprintf(key, sizeof(key), scan_key_fmt, h * num_inserts / num_hot);
+            rc = splinterdb_lookup(kvsb,
+                                   slice_create(strnlen(key, sizeof(key)), key),
+                                   &result);
+            ASSERT_EQUAL(0, rc);
+            ASSERT_TRUE(splinterdb_lookup_found(&result));
+         }
+      }
+      splinterdb_lookup_result_deinit(&result);
+      rc = splinterdb_stats_get(kvsb, &stats[1]);
+      ASSERT_EQUAL(0, rc);
+
+      misses[resistant] =
+         stats[1].trunk_cache.misses - stats[0].trunk_cache.misses
+         + stats[1].branch_cache.misses - stats[0].branch_cache.misses
+         + stats[1].filter_cache.misses - stats[0].filter_cache.misses;
+      ASSERT_EQUAL(resistant, 0 < stats[1].branch_cache.probationary_reads);
+   }
+   ASSERT_TRUE(2 * misses[1] < misses[0],
+               "misses: clock=%lu scan-resistant=%lu",
+               misses[0],
+               misses[1]);
+}
+
+/*
+ * Test case to verify that trunk and filter pages within their reservations
+ * stay cached through a scan, and that the pages cached are reported.
+ */
+CTEST2(splinterdb_cache, test_cache_reservations)
+{
+   const int  num_inserts   = 200 * 1000;
+   const int  num_hot       = 100;
+   const char res_key_fmt[] = "res%08x";
+   char       key[TEST_MAX_KEY_SIZE];
+   char       val[100];
+
+   // Reservations may leave at most 25% of the cache to other pages
+   data->cfg.cache_size                   = 8 * Mega;
+   data->cfg.cache_trunk_reserve_percent  = 50;
+   data->cfg.cache_filter_reserve_percent = 50;
+   splinterdb_close(&data->kvsb);
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_NOT_EQUAL(0, rc);
+
+   data->cfg.use_stats                    = TRUE;
+   data->cfg.memtable_capacity            = 1 * Mega;
+   data->cfg.cache_trunk_reserve_percent  = 10;
+   data->cfg.cache_filter_reserve_percent = 20;
+   data->cfg.cache_pin_reserved           = TRUE;
+   rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb *kvsb = data->kvsb;
+
+   for (int k = 0; k < num_inserts; k++) {
+      snprintf(key, sizeof(key), res_key_fmt, k);
+      memset(val, 'a' + k % 26, sizeof(val));
+      rc = splinterdb_insert(kvsb,
+                             slice_create(strnlen(key, sizeof(key)), key),
+                             slice_create(sizeof(val), val));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(kvsb, &result, 0, NULL);
+   splinterdb_stats stats[2] = {{.size = sizeof(stats[0])},
+                                {.size = sizeof(stats[0])}};
+   for (int round = 0; round < 2; round++) {
+      // warm the cache up with lookups, then scan
+      for (int h = 0; h < num_hot; h++) {
+         snprintf(key, sizeof(key), res_key_fmt, h * num_inserts / num_hot);
+         rc = splinterdb_lookup(kvsb,
+                                slice_create(strnlen(key, sizeof(key)), key),
+                                &result);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_TRUE(splinterdb_lookup_found(&result));
+      }
+      if (round == 0) {
+         int num_keys = count_keys(kvsb, NULL_SLICE);
+         ASSERT_EQUAL(num_inserts, num_keys);
+      }
+      rc = splinterdb_stats_get(kvsb, &stats[round]);
+      ASSERT_EQUAL(0, rc);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   uint64 cache_pages = data->cfg.cache_size / LAIO_DEFAULT_PAGE_SIZE;
+   ASSERT_TRUE(0 < stats[1].trunk_pages_cached);
+   ASSERT_TRUE(0 < stats[1].branch_pages_cached);
+   ASSERT_TRUE(0 < stats[1].filter_pages_cached);
+   ASSERT_TRUE(stats[1].trunk_pages_cached + stats[1].branch_pages_cached
+                  + stats[1].filter_pages_cached
+               <= cache_pages);
+
+   // Without the reservations, the scan evicts some of them
+   ASSERT_EQUAL(stats[0].trunk_cache.misses, stats[1].trunk_cache.misses);
+   ASSERT_EQUAL(stats[0].filter_cache.misses, stats[1].filter_cache.misses);
+}
+
+/*
+ * Test case to verify that a cache asking for huge pages works whether or not
+ * it gets them, and reports the memory backing it.
+ */
+CTEST2(splinterdb_cache, test_cache_huge_pages)
+{
+   const int num_inserts = 50 * 1000;
+
+   splinterdb_stats stats = {.size = sizeof(stats)};
+   int              rc    = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(SPLINTERDB_MEMORY_PAGES, stats.cache_pages_backing);
+   ASSERT_EQUAL(SPLINTERDB_MEMORY_PAGES, stats.cache_refcount_backing);
+   ASSERT_EQUAL(SPLINTERDB_MEMORY_PAGES, stats.cache_lookup_backing);
+
+   data->cfg.cache_huge_pages = TRUE;
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb *kvsb = data->kvsb;
+
+   rc = insert_keys(kvsb, 0, num_inserts);
+   ASSERT_EQUAL(0, rc);
+   check_lookups(kvsb, num_inserts);
+
+   rc = splinterdb_stats_get(kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(stats.cache_pages_backing <= SPLINTERDB_MEMORY_HUGE_PAGES);
+   ASSERT_TRUE(stats.cache_refcount_backing <= SPLINTERDB_MEMORY_HUGE_PAGES);
+   // The lookup table comes from the heap, so it can only get transparent ones
+   ASSERT_TRUE(stats.cache_lookup_backing
+               <= SPLINTERDB_MEMORY_TRANSPARENT_HUGE_PAGES);
+
+   // The pages are shared memory, which only gets transparent huge pages if
+   // the kernel's policy for shared memory allows them
+   char  shmem_policy[128] = {0};
+   FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/shmem_enabled", "r");
+   if (f != NULL) {
+      ASSERT_NOT_NULL(fgets(shmem_policy, sizeof(shmem_policy), f));
+      fclose(f);
+   }
+   if (strstr(shmem_policy, "[never]") || strstr(shmem_policy, "[deny]")) {
+      ASSERT_NOT_EQUAL(SPLINTERDB_MEMORY_TRANSPARENT_HUGE_PAGES,
+                       stats.cache_pages_backing);
+      ASSERT_NOT_EQUAL(SPLINTERDB_MEMORY_TRANSPARENT_HUGE_PAGES,
+                       stats.cache_refcount_backing);
+   }
+}
+
+/*
+ * ********************************************************************************
+ * Define minions and helper functions here, after all test cases are
+ * enumerated.
+ * ********************************************************************************
+ */
+
+static void
+create_default_cfg(splinterdb_config *out_cfg, data_config *default_data_cfg)
+{
+   *out_cfg = (splinterdb_config){.filename   = TEST_DB_NAME,
+                                  .cache_size = 64 * Mega,
+                                  .disk_size  = 127 * Mega,
+                                  .use_shmem  = FALSE,
+                                  .data_cfg   = default_data_cfg};
+}
+
+/*
+ * Inserts numkeys keys starting from minkey, formatted with TEST_KEY_FMT and
+ * TEST_VAL_FMT.
+ *
+ * Returns: Return code: rc == 0 => success; anything else => failure
+ */
+static int
+insert_keys(splinterdb *kvsb, int minkey, int numkeys)
+{
+   int rc = -1;
+   for (int k = minkey; k < minkey + numkeys; k++) {
+      char key[TEST_INSERT_KEY_LENGTH] = {0};
+      char val[TEST_INSERT_VAL_LENGTH] = {0};
+
+      snprintf(key, sizeof(key), TEST_KEY_FMT, k & 0xffff);
+      snprintf(val, sizeof(val), TEST_VAL_FMT, k & 0xffff);
+
+      rc = splinterdb_insert(
+         kvsb, slice_create(sizeof(key), key), slice_create(sizeof(val), val));
+      if (rc != 0) {
+         return rc;
+      }
+   }
+   return rc;
+}
+
+/*
+ * Checks that lookups find the keys insert_keys() inserted from 0 up to
+ * num_keys, and none past them.
+ */
+static void
+check_lookups(splinterdb *kvsb, int num_keys)
+{
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(kvsb, &result, 0, NULL);
+   for (int k = 0; k < num_keys + 100; k += 7) {
+      char key[TEST_INSERT_KEY_LENGTH] = {0};
+      snprintf(key, sizeof(key), TEST_KEY_FMT, k & 0xffff);
+      int rc = splinterdb_lookup(kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(k < num_keys, splinterdb_lookup_found(&result), "k=%d", k);
+   }
+   splinterdb_lookup_result_deinit(&result);
+}
+
+// Returns the number of keys an iterator from start_key goes through
+static int
+count_keys(splinterdb *kvsb, slice start_key)
+{
+   splinterdb_iterator *it = NULL;
+   int                  rc = splinterdb_iterator_init(kvsb, &it, start_key);
+   ASSERT_EQUAL(0, rc);
+   int num_keys = 0;
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      num_keys++;
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   splinterdb_iterator_deinit(it);
+   return num_keys;
+}
+
+/*
+ * Registers, then waits for all the other inserters to register before
+ * inserting its keys, so that they are all registered at the same time.
+ */
+static void *
+many_threads_insert_thread(void *arg)
+{
+   many_threads_inserter *inserter = (many_threads_inserter *)arg;
+   splinterdb_register_thread(inserter->kvsb);
+   __sync_fetch_and_add(inserter->num_registered, 1);
+   while (*inserter->num_registered < MANY_THREADS_NUM_THREADS) {
+      platform_yield();
+   }
+   inserter->rc = insert_keys(
+      inserter->kvsb, inserter->minkey, inserter->num_keys);
+   splinterdb_deregister_thread(inserter->kvsb);
+   return NULL;
+}
@@ -0,0 +1,481 @@
+// Copyright 2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * -----------------------------------------------------------------------------
+ * splinterdb_compaction_test.c --
+ *
+ *  Tests of how SplinterDB compacts the trunk, and of the trunk searches
+ *  that depend on its layout, exercised through the public API.
+ * -----------------------------------------------------------------------------
+ */
+#include <string.h>
+#include <pthread.h>
+
+#include "splinterdb/splinterdb.h"
+#include "splinterdb/data.h"
+#include "splinterdb/default_data_config.h"
+#include "platform.h"
+#include "unit_tests.h"
+#include "ctest.h" // This is required for all test-case files.
+#include "config.h"
+
+#define TEST_MAX_KEY_SIZE 13
+
+// Format of the keys insert_keys() inserts, with room for 16 bits of keys
+#define TEST_KEY_FMT           "key-%04x"
+#define TEST_VAL_FMT           "val-%04x"
+#define TEST_INSERT_KEY_LENGTH (8 + 1)
+#define TEST_INSERT_VAL_LENGTH (8 + 1)
+
+// Compaction filter dropping the keys whose value starts with "drop"
+typedef struct {
+   data_config super;
+   uint64      num_calls;
+   uint64      num_dropped;
+} dropping_data_config;
+
+// Concurrent inserters, to exercise the write throttle
+#define WRITE_THROTTLE_NUM_THREADS (4)
+
+typedef struct {
+   splinterdb *kvsb;
+   int         minkey;
+   int         num_keys;
+   int         rc;
+} write_throttle_inserter;
+
+// Function Prototypes
+static void
+create_default_cfg(splinterdb_config *out_cfg, data_config *default_data_cfg);
+
+static int
+insert_keys(splinterdb *kvsb, int minkey, int numkeys);
+
+static int
+count_keys(splinterdb *kvsb, slice start_key);
+
+static int
+drop_compaction_filter(const data_config *cfg,
+                       slice              key,
+                       uint64             height,
+                       merge_accumulator *msg);
+
+static void *
+write_throttle_insert_thread(void *arg);
+
+/*
+ * Global data declaration macro:
+ */
+CTEST_DATA(splinterdb_compaction)
+{
+   splinterdb       *kvsb;
+   splinterdb_config cfg;
+   data_config       default_data_cfg;
+};
+
+// Optional setup function for suite, called before every test in suite
+CTEST_SETUP(splinterdb_compaction)
+{
+   default_data_config_init(TEST_MAX_KEY_SIZE, &data->default_data_cfg);
+   create_default_cfg(&data->cfg, &data->default_data_cfg);
+   data->cfg.use_shmem =
+      config_parse_use_shmem(Ctest_argc, (char **)Ctest_argv);
+
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+}
+
+// Optional teardown function for suite, called after every test in suite
+CTEST_TEARDOWN(splinterdb_compaction)
+{
+   if (data->kvsb) {
+      splinterdb_close(&data->kvsb);
+   }
+}
+
+/*
+ * Test case to verify that compactions drop the keys the compaction filter
+ * asks them to, and that dropping a key that has an older value deeper in
+ * the tree does not bring that value back.
+ */
+CTEST2(splinterdb_compaction, test_compaction_filter)
+{
+   const char key_fmt_filter[] = "f%08x";
+   const char keep_val_fmt[]   = "keep-%08x";
+   const char drop_val_fmt[]   = "drop-%08x";
+   const int  num_keys         = 200 * 1000;
+   const int  num_overwrites   = 1000;
+   char       key[sizeof("f") + 8];
+   char       val[sizeof("keep-") + 8];
+   int        rc;
+
+   // Small memtables and nodes, so that there are compactions at all heights
+   dropping_data_config filter_cfg = {0};
+   default_data_config_init(TEST_MAX_KEY_SIZE, &filter_cfg.super);
+   filter_cfg.super.compaction_filter = drop_compaction_filter;
+   data->cfg.data_cfg                 = &filter_cfg.super;
+   data->cfg.memtable_capacity        = 1 * Mega;
+   data->cfg.fanout                   = 4;
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb *kvsb = data->kvsb;
+
+   // Even keys are to be dropped. The first num_overwrites odd keys are kept
+   // at first, then overwritten with values to be dropped once they have
+   // been flushed out of the memtable.
+   for (int i = 0; i < num_keys + num_overwrites; i++) {
+      int k = i < num_keys ? i : 2 * (i - num_keys) + 1;
+      snprintf(key, sizeof(key), key_fmt_filter, k);
+      snprintf(val,
+               sizeof(val),
+               k % 2 == 0 || num_keys <= i ? drop_val_fmt : keep_val_fmt,
+               k);
+      rc = splinterdb_insert(
+         kvsb, slice_create(sizeof(key), key), slice_create(sizeof(val), val));
+      ASSERT_EQUAL(0, rc);
+   }
+   for (int i = 0; i < num_keys; i++) {
+      // push the overwrites down with more keys to be dropped
+      snprintf(key, sizeof(key), key_fmt_filter, num_keys + 2 * i);
+      snprintf(val, sizeof(val), drop_val_fmt, num_keys + 2 * i);
+      rc = splinterdb_insert(
+         kvsb, slice_create(sizeof(key), key), slice_create(sizeof(val), val));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   int                      num_dropped = 0;
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(kvsb, &result, 0, NULL);
+   for (int k = 0; k < num_keys; k++) {
+      snprintf(key, sizeof(key), key_fmt_filter, k);
+      rc = splinterdb_lookup(kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      bool32 keep = k % 2 == 1 && k >= 2 * num_overwrites;
+      if (!splinterdb_lookup_found(&result)) {
+         ASSERT_FALSE(keep, "k=%d", k);
+         num_dropped++;
+         continue;
+      }
+      slice value;
+      rc = splinterdb_lookup_result_value(&result, &value);
+      ASSERT_EQUAL(0, rc);
+      snprintf(val, sizeof(val), keep ? keep_val_fmt : drop_val_fmt, k);
+      ASSERT_EQUAL(sizeof(val), slice_length(value), "k=%d", k);
+      ASSERT_EQUAL(0, memcmp(val, slice_data(value), sizeof(val)), "k=%d", k);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   ASSERT_TRUE(0 < num_dropped);
+   ASSERT_TRUE(filter_cfg.num_dropped <= filter_cfg.num_calls);
+   ASSERT_TRUE(0 < filter_cfg.num_dropped);
+
+   // filter_cfg is on the stack, so close before it goes out of scope
+   splinterdb_close(&data->kvsb);
+}
+
+/*
+ * Test case to verify that compactions are throttled to the background I/O
+ * limit, and that the limit can be changed and lifted at runtime.
+ */
+CTEST2(splinterdb_compaction, test_compaction_io_limit)
+{
+   const int    num_inserts = 500 * 1000;
+   const uint64 limit       = 2 * Mega;
+
+   // A small cache, so that compactions read and write back pages
+   data->cfg.cache_size                  = 4 * Mega;
+   data->cfg.memtable_capacity           = 1 * Mega;
+   data->cfg.use_stats                   = TRUE;
+   data->cfg.compaction_io_bytes_per_sec = limit;
+   splinterdb_close(&data->kvsb);
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb *kvsb = data->kvsb;
+
+   splinterdb_stats stats = {.size = sizeof(stats)};
+   rc                     = splinterdb_stats_get(kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(limit, stats.compaction_io_bytes_per_sec);
+   ASSERT_EQUAL(0, stats.compaction_io_throttle_time_ns);
+
+   rc = insert_keys(kvsb, 0, num_inserts);
+   ASSERT_EQUAL(0, rc);
+
+   rc = splinterdb_stats_get(kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(0 < stats.compactions);
+   ASSERT_TRUE(0 < stats.compaction_io_throttle_time_ns);
+
+   // Auto-tuning never raises the limit above the one given
+   splinterdb_set_compaction_io_limit(kvsb, limit / 2, 1);
+   rc = insert_keys(kvsb, num_inserts, num_inserts);
+   ASSERT_EQUAL(0, rc);
+   rc = splinterdb_stats_get(kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(0 < stats.compaction_io_bytes_per_sec);
+   ASSERT_TRUE(stats.compaction_io_bytes_per_sec <= limit / 2);
+
+   splinterdb_set_compaction_io_limit(kvsb, 0, 0);
+   uint64 throttle_time_ns = stats.compaction_io_throttle_time_ns;
+   rc = insert_keys(kvsb, 2 * num_inserts, num_inserts);
+   ASSERT_EQUAL(0, rc);
+   rc = splinterdb_stats_get(kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(0, stats.compaction_io_bytes_per_sec);
+   ASSERT_EQUAL(throttle_time_ns, stats.compaction_io_throttle_time_ns);
+}
+
+/*
+ * Test case to verify that concurrent updates account for throttling and
+ * stalls consistently, and that disabling the throttle turns it off.
+ */
+CTEST2(splinterdb_compaction, test_write_throttle)
+{
+   const int num_inserts = 100 * 1000;
+
+   for (int disabled = 0; disabled < 2; disabled++) {
+      data->cfg.use_stats              = TRUE;
+      data->cfg.disable_write_throttle = disabled;
+      splinterdb_close(&data->kvsb);
+      int rc = splinterdb_create(&data->cfg, &data->kvsb);
+      ASSERT_EQUAL(0, rc);
+      splinterdb *kvsb = data->kvsb;
+
+      pthread_t               threads[WRITE_THROTTLE_NUM_THREADS];
+      write_throttle_inserter inserters[WRITE_THROTTLE_NUM_THREADS];
+      for (int t = 0; t < WRITE_THROTTLE_NUM_THREADS; t++) {
+         inserters[t].kvsb     = kvsb;
+         inserters[t].minkey   = t * num_inserts;
+         inserters[t].num_keys = num_inserts;
+         rc                    = pthread_create(
+            &threads[t], NULL, write_throttle_insert_thread, &inserters[t]);
+         ASSERT_EQUAL(0, rc);
+      }
+      for (int t = 0; t < WRITE_THROTTLE_NUM_THREADS; t++) {
+         pthread_join(threads[t], NULL);
+         ASSERT_EQUAL(0, inserters[t].rc);
+      }
+
+      splinterdb_stats stats = {.size = sizeof(stats)};
+      rc                     = splinterdb_stats_get(kvsb, &stats);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(SPLINTERDB_STATS_VERSION, stats.version);
+      ASSERT_EQUAL(WRITE_THROTTLE_NUM_THREADS * num_inserts, stats.insertions);
+      ASSERT_TRUE(stats.write_throttles <= stats.insertions);
+      ASSERT_TRUE(stats.write_throttles || !stats.write_throttle_time_ns);
+      ASSERT_TRUE(stats.write_stalls || !stats.write_stall_time_ns);
+      if (disabled) {
+         ASSERT_EQUAL(0, stats.write_throttles);
+         ASSERT_EQUAL(0, stats.write_throttle_time_ns);
+      }
+   }
+}
+
+/*
+ * Test case to verify that compactions split into key sub-ranges, which run
+ * on the background threads, keep every key, and that splitting can be
+ * turned off.
+ */
+CTEST2(splinterdb_compaction, test_parallel_compaction)
+{
+   const int  num_inserts = 250 * 1000;
+   const char par_key_fmt[] = "pc%08x";
+   const char par_val_fmt[] = "parallel-compaction-value-%08x-%064x";
+   char       key[sizeof(par_key_fmt) + 4];
+   char       val[sizeof(par_val_fmt) + 63];
+
+   for (int disabled = 0; disabled < 2; disabled++) {
+      data->cfg.use_stats                = TRUE;
+      data->cfg.memtable_capacity        = 2 * Mega;
+      data->cfg.num_normal_bg_threads    = 4;
+      data->cfg.num_memtable_bg_threads  = 1;
+      data->cfg.max_compaction_subranges = disabled ? 1 : 0;
+      splinterdb_close(&data->kvsb);
+      int rc = splinterdb_create(&data->cfg, &data->kvsb);
+      ASSERT_EQUAL(0, rc);
+      splinterdb *kvsb = data->kvsb;
+
+      for (int k = 0; k < num_inserts; k++) {
+         snprintf(key, sizeof(key), par_key_fmt, k);
+         snprintf(val, sizeof(val), par_val_fmt, k, k);
+         rc = splinterdb_insert(kvsb,
+                                slice_create(sizeof(key), key),
+                                slice_create(sizeof(val), val));
+         ASSERT_EQUAL(0, rc);
+      }
+
+      splinterdb_lookup_result result;
+      splinterdb_lookup_result_init(kvsb, &result, 0, NULL);
+      for (int k = 0; k < num_inserts; k++) {
+         snprintf(key, sizeof(key), par_key_fmt, k);
+         rc = splinterdb_lookup(kvsb, slice_create(sizeof(key), key), &result);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_TRUE(splinterdb_lookup_found(&result), "k=%d", k);
+         slice value;
+         rc = splinterdb_lookup_result_value(&result, &value);
+         ASSERT_EQUAL(0, rc);
+         snprintf(val, sizeof(val), par_val_fmt, k, k);
+         ASSERT_EQUAL(sizeof(val), slice_length(value), "k=%d", k);
+         ASSERT_EQUAL(
+            0, memcmp(val, slice_data(value), sizeof(val)), "k=%d", k);
+      }
+      splinterdb_lookup_result_deinit(&result);
+
+      splinterdb_stats stats = {.size = sizeof(stats)};
+      rc                     = splinterdb_stats_get(kvsb, &stats);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(SPLINTERDB_STATS_VERSION, stats.version);
+      ASSERT_TRUE(2 * stats.parallel_compactions <= stats.compaction_subranges);
+      if (disabled) {
+         ASSERT_EQUAL(0, stats.parallel_compactions);
+      } else {
+         ASSERT_TRUE(0 < stats.parallel_compactions);
+      }
+   }
+}
+
+/*
+ * Test case to verify lookups and scans once trunk nodes have several
+ * pivots, with keys whose normalized images all tie, so that the search of
+ * the pivot prefixes always falls back to comparing keys.
+ */
+CTEST2(splinterdb_compaction, test_pivot_prefix_search)
+{
+   const int  num_inserts = 500 * 1000;
+   const char pfx_key_fmt[] = "pivotpfx%05x"; // shares its first 8 bytes
+   const char pfx_val_fmt[] = "value-%05x";
+   char       key[TEST_MAX_KEY_SIZE + 1];
+   char       val[sizeof(pfx_val_fmt) + 1];
+
+   data->cfg.use_stats         = TRUE;
+   data->cfg.memtable_capacity = 1 * Mega;
+   splinterdb_close(&data->kvsb);
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb *kvsb = data->kvsb;
+
+   for (int k = 0; k < num_inserts; k++) {
+      snprintf(key, sizeof(key), pfx_key_fmt, k);
+      snprintf(val, sizeof(val), pfx_val_fmt, k);
+      rc = splinterdb_insert(kvsb,
+                             slice_create(TEST_MAX_KEY_SIZE, key),
+                             slice_create(sizeof(val), val));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   splinterdb_stats stats = {.size = sizeof(stats)};
+   rc                     = splinterdb_stats_get(kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(0 < stats.leaf_splits);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(kvsb, &result, 0, NULL);
+   for (int k = 0; k < num_inserts + 100; k += 7) {
+      snprintf(key, sizeof(key), pfx_key_fmt, k);
+      rc = splinterdb_lookup(
+         kvsb, slice_create(TEST_MAX_KEY_SIZE, key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(
+         k < num_inserts, splinterdb_lookup_found(&result), "k=%d", k);
+   }
+   // a proper prefix of every key sorts before all of them
+   rc = splinterdb_lookup(kvsb, slice_create(8, key), &result);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(splinterdb_lookup_found(&result));
+   splinterdb_lookup_result_deinit(&result);
+
+   for (int start = 0; start < num_inserts; start += num_inserts / 7) {
+      snprintf(key, sizeof(key), pfx_key_fmt, start);
+      int num_keys = count_keys(kvsb, slice_create(TEST_MAX_KEY_SIZE, key));
+      ASSERT_EQUAL(num_inserts - start, num_keys);
+   }
+}
+
+/*
+ * ********************************************************************************
+ * Define minions and helper functions here, after all test cases are
+ * enumerated.
+ * ********************************************************************************
+ */
+
+static void
+create_default_cfg(splinterdb_config *out_cfg, data_config *default_data_cfg)
+{
+   *out_cfg = (splinterdb_config){.filename   = TEST_DB_NAME,
+                                  .cache_size = 64 * Mega,
+                                  .disk_size  = 127 * Mega,
+                                  .use_shmem  = FALSE,
+                                  .data_cfg   = default_data_cfg};
+}
+
+/*
+ * Inserts numkeys keys starting from minkey, formatted with TEST_KEY_FMT and
+ * TEST_VAL_FMT.
+ *
+ * Returns: Return code: rc == 0 => success; anything else => failure
+ */
+static int
+insert_keys(splinterdb *kvsb, int minkey, int numkeys)
+{
+   int rc = -1;
+   for (int k = minkey; k < minkey + numkeys; k++) {
+      char key[TEST_INSERT_KEY_LENGTH] = {0};
+      char val[TEST_INSERT_VAL_LENGTH] = {0};
+
+      snprintf(key, sizeof(key), TEST_KEY_FMT, k & 0xffff);
+      snprintf(val, sizeof(val), TEST_VAL_FMT, k & 0xffff);
+
+      rc = splinterdb_insert(
+         kvsb, slice_create(sizeof(key), key), slice_create(sizeof(val), val));
+      if (rc != 0) {
+         return rc;
+      }
+   }
+   return rc;
+}
+
+// Returns the number of keys an iterator from start_key goes through
+static int
+count_keys(splinterdb *kvsb, slice start_key)
+{
+   splinterdb_iterator *it = NULL;
+   int                  rc = splinterdb_iterator_init(kvsb, &it, start_key);
+   ASSERT_EQUAL(0, rc);
+   int num_keys = 0;
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      num_keys++;
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   splinterdb_iterator_deinit(it);
+   return num_keys;
+}
+
+static int
+drop_compaction_filter(const data_config *cfg,
+                       slice              key,
+                       uint64             height,
+                       merge_accumulator *msg)
+{
+   dropping_data_config *dcfg = (dropping_data_config *)cfg;
+   __sync_fetch_and_add(&dcfg->num_calls, 1);
+
+   slice value = merge_accumulator_to_slice(msg);
+   if (4 <= slice_length(value) && memcmp("drop", slice_data(value), 4) == 0) {
+      merge_accumulator_set_class(msg, MESSAGE_TYPE_DELETE);
+      __sync_fetch_and_add(&dcfg->num_dropped, 1);
+   }
+   return 0;
+}
+
+static void *
+write_throttle_insert_thread(void *arg)
+{
+   write_throttle_inserter *inserter = (write_throttle_inserter *)arg;
+   splinterdb_register_thread(inserter->kvsb);
+   inserter->rc = insert_keys(
+      inserter->kvsb, inserter->minkey, inserter->num_keys);
+   splinterdb_deregister_thread(inserter->kvsb);
+   return NULL;
+}
@@ -27,6 +27,7 @@
 #include <stdlib.h> // Needed for system calls; e.g. free
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "splinterdb/splinterdb.h"
 #include "splinterdb/data.h"
@@ -77,11 +78,72 @@ test_two_step_iterator(splinterdb *kvsb,
 static int
 custom_key_comparator(const data_config *cfg, slice key1, slice key2);
 
+static void
+count_lookup_async_callbacks(splinterdb_lookup_async_ctxt *ctxt,
+                             splinterdb_lookup_result     *result,
+                             void                         *arg);
+
+static uint64
+tenant_key_prefix(const data_config *cfg, slice key);
+
+static void
+check_range_deleted(splinterdb *kvsb,
+                    int         num_keys,
+                    int         start_i,
+                    int         end_i,
+                    int         reinserted_i);
+
 typedef struct {
    data_config super;
    uint64      num_comparisons;
 } comparison_counting_data_config;
 
+// Bulk load source of num_keys sorted keys, one of which may be out of order
+#define BULK_LOAD_KEY_LENGTH (9 + 1)
+#define BULK_LOAD_VAL_LENGTH (24 + 1)
+static const char bulk_load_key_fmt[] = "b%08x";
+static const char bulk_load_val_fmt[] = "bulk-load-value-%08x";
+
+typedef struct {
+   int  next_i;
+   int  num_keys;
+   int  out_of_order_i; // position that repeats key 0, or -1
+   char key[BULK_LOAD_KEY_LENGTH];
+   char val[BULK_LOAD_VAL_LENGTH];
+} bulk_load_source_state;
+
+static _Bool
+bulk_load_source(void *arg, slice *key, slice *value);
+
+// A thread scanning one partition, checking that its keys are in order
+#define SCAN_MAX_PARTITIONS (8)
+typedef struct {
+   splinterdb                       *kvsb;
+   const splinterdb_scan_partitions *partitions;
+   uint64                            partition;
+   int                               rc;
+   int                               num_keys;
+   char                              first_key[BULK_LOAD_KEY_LENGTH];
+   char                              last_key[BULK_LOAD_KEY_LENGTH];
+} scan_partition_state;
+
+static int
+scan_partition_check_key(uint64 partition, slice key, slice value, void *arg);
+
+static void *
+scan_partition_thread(void *arg);
+
+// Rewrites keys while a zero-copy result holds a value in place
+typedef struct {
+   splinterdb  *kvsb;
+   int          num_keys;
+   volatile int done;
+   int          rc;
+} zero_copy_overwriter;
+
+static void *
+zero_copy_overwrite_thread(void *arg);
+
 /*
  * Global data declaration macro:
  *
@@ -688,6 +750,148 @@ CTEST2(splinterdb_quick, test_iterator_prev_and_next)
          data->kvsb, start_key, num_inserts, minkey, start_i, hop_amt));
 }
 
+/*
+ * Test case to verify splinterdb_iterator_init_range(). Only even keys are
+ * inserted, and the database is re-opened so that the scans run over
+ * branches of the trunk rather than just the memtable. The end key is
+ * exclusive, whether or not it exists, and the iterator can be walked back
+ * from the end of the range.
+ */
+CTEST2(splinterdb_quick, test_iterator_init_range)
+{
+   const int num_inserts = 5000;
+   int       rc          = insert_keys(data->kvsb, 0, num_inserts, 2);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   // {start, end, first key in range, number of keys in range}
+   const int ranges[][4] = {
+      {0x100, 0x200, 0x100, 0x80},
+      {0x101, 0x301, 0x102, 0x100},
+      {0x2000, 0x2001, 0x2000, 1},
+      {0x2001, 0x2002, 0, 0},
+      {0x300, 0x100, 0, 0},
+      {2 * num_inserts - 2, 3 * num_inserts, 2 * num_inserts - 2, 1},
+   };
+
+   for (int r = 0; r < ARRAY_SIZE(ranges); r++) {
+      char startbuf[TEST_INSERT_KEY_LENGTH];
+      char endbuf[TEST_INSERT_KEY_LENGTH];
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(startbuf, sizeof(startbuf), key_fmt, ranges[r][0]));
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(endbuf, sizeof(endbuf), key_fmt, ranges[r][1]));
+      slice start_key = slice_create(sizeof(startbuf), startbuf);
+      slice end_key   = slice_create(sizeof(endbuf), endbuf);
+
+      splinterdb_iterator *it = NULL;
+      rc = splinterdb_iterator_init_range(data->kvsb, &it, start_key, end_key);
+      ASSERT_EQUAL(0, rc);
+
+      int i = 0;
+      for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+         rc = check_current_tuple(it, ranges[r][2] + 2 * i);
+         ASSERT_EQUAL(0, rc, "range=%d i=%d", r, i);
+         i++;
+      }
+      ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+      ASSERT_EQUAL(ranges[r][3], i, "range=%d", r);
+
+      // Step back from the end to the last key of the range
+      if (ranges[r][3] > 0) {
+         ASSERT_TRUE(splinterdb_iterator_can_prev(it));
+         splinterdb_iterator_prev(it);
+         ASSERT_TRUE(splinterdb_iterator_valid(it));
+         rc = check_current_tuple(it, ranges[r][2] + 2 * (i - 1));
+         ASSERT_EQUAL(0, rc, "range=%d", r);
+      }
+
+      splinterdb_iterator_deinit(it);
+   }
+}
+
+/*
+ * Value projections and key-only scans return the right part of each value,
+ * including for keys overwritten or deleted after they were flushed, whose
+ * older copies the merge skips.
+ */
+CTEST2(splinterdb_quick, test_iterator_projection)
+{
+   const int num_inserts = 1000;
+   int       rc          = insert_keys(data->kvsb, 0, num_inserts, 1);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   // Overwrite every third key and delete every fifth, in the memtable
+   char key[TEST_INSERT_KEY_LENGTH];
+   char val[TEST_INSERT_VAL_LENGTH];
+   for (int i = 0; i < num_inserts; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      if (i % 5 == 0) {
+         rc = splinterdb_delete(data->kvsb, slice_create(sizeof(key), key));
+         ASSERT_EQUAL(0, rc);
+      } else if (i % 3 == 0) {
+         ASSERT_EQUAL(VAL_FMT_LENGTH,
+                      snprintf(val, sizeof(val), "new-%04x", i));
+         rc = splinterdb_insert(data->kvsb,
+                                slice_create(sizeof(key), key),
+                                slice_create(sizeof(val), val));
+         ASSERT_EQUAL(0, rc);
+      }
+   }
+
+   // {offset, length} of each projection, ending with a key-only scan
+   const uint64 projections[][2] = {{0, 3}, {4, 100}, {20, 4}, {0, 0}};
+   for (int p = 0; p < ARRAY_SIZE(projections); p++) {
+      uint64 offset = projections[p][0];
+      uint64 length = projections[p][1];
+
+      splinterdb_iterator *it = NULL;
+      rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+      ASSERT_EQUAL(0, rc);
+      if (length == 0) {
+         splinterdb_iterator_keys_only(it);
+      } else {
+         splinterdb_iterator_project_value(it, offset, length);
+      }
+
+      int i = 0;
+      for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+         if (i % 5 == 0) {
+            i++;
+         }
+         slice curr_key;
+         slice value;
+         splinterdb_iterator_get_current(it, &curr_key, &value);
+         ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+         ASSERT_EQUAL(sizeof(key), slice_length(curr_key));
+         ASSERT_STREQN(key, slice_data(curr_key), sizeof(key), "i=%d", i);
+
+         memset(val, 0, sizeof(val));
+         snprintf(val, sizeof(val), i % 3 == 0 ? "new-%04x" : val_fmt, i);
+         uint64 expected_length = 0;
+         if (offset < sizeof(val)) {
+            expected_length = MIN(length, sizeof(val) - offset);
+         }
+         ASSERT_EQUAL(expected_length, slice_length(value), "p=%d i=%d", p, i);
+         if (expected_length != 0) {
+            int cmp = memcmp(val + offset, slice_data(value), expected_length);
+            ASSERT_EQUAL(0, cmp, "p=%d i=%d", p, i);
+         }
+         i++;
+      }
+      ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+      ASSERT_EQUAL(num_inserts, i, "p=%d", p);
+      splinterdb_iterator_deinit(it);
+   }
+}
+
 /*
  * Test case to verify the interfaces to close() and reopen() a KVS work
  * as expected. After reopening the KVS, we should be able to retrieve data
@@ -728,6 +932,502 @@ CTEST2(splinterdb_quick, test_close_and_reopen)
    splinterdb_lookup_result_deinit(&result);
 }
 
+/*
+ * Test case to verify splinterdb_lookup_batch(). The database is re-opened
+ * before the lookups so that they start from a cold cache, and the batch is
+ * larger than the number of lookups kept in flight at once. Only even keys
+ * are inserted, so that half of the batch is not found.
+ */
+CTEST2(splinterdb_quick, test_lookup_batch)
+{
+   const int num_inserts = 1000;
+   const int num_lookups = 2 * num_inserts;
+   int       rc          = insert_keys(data->kvsb, 0, num_inserts, 2);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char(*keybufs)[TEST_INSERT_KEY_LENGTH] =
+      calloc(num_lookups, TEST_INSERT_KEY_LENGTH);
+   slice                    *keys    = calloc(num_lookups, sizeof(*keys));
+   splinterdb_lookup_result *results = calloc(num_lookups, sizeof(*results));
+   ASSERT_TRUE(keybufs && keys && results);
+
+   for (int i = 0; i < num_lookups; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(keybufs[i], TEST_INSERT_KEY_LENGTH, key_fmt, i));
+      keys[i] = slice_create(TEST_INSERT_KEY_LENGTH, keybufs[i]);
+      splinterdb_lookup_result_init(data->kvsb, &results[i], 0, NULL);
+   }
+
+   rc = splinterdb_lookup_batch(data->kvsb, keys, results, num_lookups);
+   ASSERT_EQUAL(0, rc);
+
+   for (int i = 0; i < num_lookups; i++) {
+      if (i % 2) {
+         ASSERT_FALSE(splinterdb_lookup_found(&results[i]), "i=%d", i);
+      } else {
+         ASSERT_TRUE(splinterdb_lookup_found(&results[i]), "i=%d", i);
+
+         char expected_val[TEST_INSERT_VAL_LENGTH] = {0};
+         ASSERT_EQUAL(
+            VAL_FMT_LENGTH,
+            snprintf(expected_val, sizeof(expected_val), val_fmt, i));
+
+         slice value;
+         rc = splinterdb_lookup_result_value(&results[i], &value);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value));
+         ASSERT_STREQN(expected_val, slice_data(value), slice_length(value));
+      }
+      splinterdb_lookup_result_deinit(&results[i]);
+   }
+
+   free(results);
+   free(keys);
+   free(keybufs);
+}
+
+/*
+ * A zero-copy result reads values that were flushed out of the memtable in
+ * place, and copies those still in the memtable. One result is reused across
+ * lookups of both kinds, including a lookup of a key that was never inserted.
+ */
+CTEST2(splinterdb_quick, test_lookup_zero_copy)
+{
+   const char overwrite_val_fmt[] = "new-%04x";
+   const int  num_inserts          = 1000;
+   int        rc = insert_keys(data->kvsb, 0, num_inserts, 2);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   // Overwrite every tenth key, leaving the new value in the memtable
+   char key[TEST_INSERT_KEY_LENGTH];
+   char val[TEST_INSERT_VAL_LENGTH];
+   for (int i = 0; i < num_inserts; i += 10) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      ASSERT_EQUAL(VAL_FMT_LENGTH,
+                   snprintf(val, sizeof(val), overwrite_val_fmt, i));
+      rc = splinterdb_insert(data->kvsb,
+                             slice_create(sizeof(key), key),
+                             slice_create(sizeof(val), val));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init_zero_copy(data->kvsb, &result);
+   for (int i = 0; i < num_inserts; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      rc = splinterdb_lookup(
+         data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      if (i % 2) {
+         ASSERT_FALSE(splinterdb_lookup_found(&result), "i=%d", i);
+         continue;
+      }
+      ASSERT_TRUE(splinterdb_lookup_found(&result), "i=%d", i);
+
+      char expected_val[TEST_INSERT_VAL_LENGTH] = {0};
+      const char *fmt = i % 10 ? val_fmt : overwrite_val_fmt;
+      ASSERT_EQUAL(VAL_FMT_LENGTH,
+                   snprintf(expected_val, sizeof(expected_val), fmt, i));
+
+      slice value;
+      rc = splinterdb_lookup_result_value(&result, &value);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value));
+      ASSERT_STREQN(expected_val, slice_data(value), slice_length(value));
+   }
+   splinterdb_lookup_result_deinit(&result);
+}
+
+/*
+ * More results than fit in a page's pin count, or in an extent's ref count,
+ * can be held at once on the same few branch pages.
+ */
+CTEST2(splinterdb_quick, test_lookup_zero_copy_many_held)
+{
+   const int num_keys    = 100;
+   const int num_results = 1000;
+   int       rc          = insert_keys(data->kvsb, 0, num_keys, 1);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result *results = calloc(num_results, sizeof(*results));
+   ASSERT_TRUE(results != NULL);
+   char key[TEST_INSERT_KEY_LENGTH];
+   char val[TEST_INSERT_VAL_LENGTH];
+   for (int i = 0; i < num_results; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(key, sizeof(key), key_fmt, i % num_keys));
+      splinterdb_lookup_result_init_zero_copy(data->kvsb, &results[i]);
+      rc = splinterdb_lookup(
+         data->kvsb, slice_create(sizeof(key), key), &results[i]);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_TRUE(splinterdb_lookup_found(&results[i]), "i=%d", i);
+   }
+
+   for (int i = 0; i < num_results; i++) {
+      ASSERT_EQUAL(VAL_FMT_LENGTH,
+                   snprintf(val, sizeof(val), val_fmt, i % num_keys));
+      slice value;
+      rc = splinterdb_lookup_result_value(&results[i], &value);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value));
+      ASSERT_STREQN(val, slice_data(value), slice_length(value));
+      splinterdb_lookup_result_deinit(&results[i]);
+   }
+   free(results);
+}
+
+/*
+ * A value read in place stays intact while another thread rewrites its key
+ * and pushes the rewrites through flushes and compactions, which free the
+ * branch holding the value from the tree without waiting for the result.
+ */
+CTEST2(splinterdb_quick, test_lookup_zero_copy_while_compacting)
+{
+   const int num_keys = 1000;
+   int       rc       = insert_keys(data->kvsb, 0, num_keys, 1);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char key[TEST_INSERT_KEY_LENGTH];
+   char val[TEST_INSERT_VAL_LENGTH];
+   ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, 0));
+   ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, 0));
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init_zero_copy(data->kvsb, &result);
+   rc = splinterdb_lookup(data->kvsb, slice_create(sizeof(key), key), &result);
+   ASSERT_EQUAL(0, rc);
+   slice value;
+   rc = splinterdb_lookup_result_value(&result, &value);
+   ASSERT_EQUAL(0, rc);
+
+   zero_copy_overwriter overwriter = {.kvsb     = data->kvsb,
+                                      .num_keys = num_keys};
+   pthread_t            thread;
+   rc = pthread_create(&thread, NULL, zero_copy_overwrite_thread, &overwriter);
+   ASSERT_EQUAL(0, rc);
+   for (int i = 0; i < 1000 && !overwriter.done; i++) {
+      platform_sleep_ns(1000 * 1000);
+   }
+   ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value));
+   ASSERT_STREQN(val, slice_data(value), slice_length(value));
+   splinterdb_lookup_result_deinit(&result);
+   pthread_join(thread, NULL);
+   ASSERT_EQUAL(0, overwriter.rc);
+
+   splinterdb_lookup_result_init_zero_copy(data->kvsb, &result);
+   rc = splinterdb_lookup(data->kvsb, slice_create(sizeof(key), key), &result);
+   ASSERT_EQUAL(0, rc);
+   rc = splinterdb_lookup_result_value(&result, &value);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_STREQN(val, slice_data(value), slice_length(value));
+   splinterdb_lookup_result_deinit(&result);
+}
+
+/*
+ * Test case to verify splinterdb_lookup_async_start() and splinterdb_poll().
+ * All lookups are started before any is polled for, from a cold cache, and
+ * each must complete exactly once.
+ */
+CTEST2(splinterdb_quick, test_lookup_async)
+{
+   const int num_inserts = 500;
+   const int num_lookups = 2 * num_inserts;
+   int       rc          = insert_keys(data->kvsb, 0, num_inserts, 2);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char(*keybufs)[TEST_INSERT_KEY_LENGTH] =
+      calloc(num_lookups, TEST_INSERT_KEY_LENGTH);
+   splinterdb_lookup_async_ctxt *ctxts = calloc(num_lookups, sizeof(*ctxts));
+   splinterdb_lookup_result     *results =
+      calloc(num_lookups, sizeof(*results));
+   int *num_callbacks = calloc(num_lookups, sizeof(*num_callbacks));
+   ASSERT_TRUE(keybufs && ctxts && results && num_callbacks);
+
+   for (int i = 0; i < num_lookups; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(keybufs[i], TEST_INSERT_KEY_LENGTH, key_fmt, i));
+      splinterdb_lookup_result_init(data->kvsb, &results[i], 0, NULL);
+      rc = splinterdb_lookup_async_start(
+         data->kvsb,
+         &ctxts[i],
+         slice_create(TEST_INSERT_KEY_LENGTH, keybufs[i]),
+         &results[i],
+         count_lookup_async_callbacks,
+         &num_callbacks[i]);
+      ASSERT_EQUAL(0, rc);
+   }
+
+   int num_completed = 0;
+   for (int i = 0; i < num_lookups; i++) {
+      num_completed += num_callbacks[i];
+   }
+   while (num_completed < num_lookups) {
+      num_completed += splinterdb_poll(data->kvsb);
+   }
+   ASSERT_EQUAL(num_lookups, num_completed);
+
+   for (int i = 0; i < num_lookups; i++) {
+      ASSERT_EQUAL(1, num_callbacks[i], "i=%d", i);
+      ASSERT_EQUAL(i % 2 == 0, splinterdb_lookup_found(&results[i]), "i=%d", i);
+      if (i % 2 == 0) {
+         char expected_val[TEST_INSERT_VAL_LENGTH] = {0};
+         ASSERT_EQUAL(
+            VAL_FMT_LENGTH,
+            snprintf(expected_val, sizeof(expected_val), val_fmt, i));
+
+         slice value;
+         rc = splinterdb_lookup_result_value(&results[i], &value);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_STREQN(expected_val, slice_data(value), slice_length(value));
+      }
+      splinterdb_lookup_result_deinit(&results[i]);
+   }
+
+   free(num_callbacks);
+   free(results);
+   free(ctxts);
+   free(keybufs);
+}
+
+/*
+ * Test case to verify splinterdb_write_batch(). The ops are given in
+ * descending key order and repeat some keys, so the batch must be applied
+ * in key order while keeping the last op for each key. A batch with one bad
+ * key must not be applied at all.
+ */
+CTEST2(splinterdb_quick, test_write_batch)
+{
+   const int num_keys = 100;
+   const int num_ops  = 2 * num_keys;
+   char(*keybufs)[TEST_INSERT_KEY_LENGTH] =
+      calloc(num_keys, TEST_INSERT_KEY_LENGTH);
+   char(*valbufs)[TEST_INSERT_VAL_LENGTH] =
+      calloc(num_keys, TEST_INSERT_VAL_LENGTH);
+   splinterdb_write_op *ops = calloc(num_ops, sizeof(*ops));
+   ASSERT_TRUE(keybufs && valbufs && ops);
+
+   for (int i = 0; i < num_keys; i++) {
+      int k = num_keys - 1 - i;
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(keybufs[k], TEST_INSERT_KEY_LENGTH, key_fmt, k));
+      ASSERT_EQUAL(VAL_FMT_LENGTH,
+                   snprintf(valbufs[k], TEST_INSERT_VAL_LENGTH, val_fmt, k));
+      slice key   = slice_create(TEST_INSERT_KEY_LENGTH, keybufs[k]);
+      slice value = slice_create(TEST_INSERT_VAL_LENGTH, valbufs[k]);
+
+      // Every key is inserted; every third one is then deleted, and every
+      // other one is inserted again with a bogus value that is then
+      // overwritten by a later insert.
+      ops[i] = (splinterdb_write_op){
+         .type = SPLINTERDB_WRITE_INSERT, .key = key, .value = value};
+      if (k % 3 == 0) {
+         ops[num_keys + i] = (splinterdb_write_op){
+            .type = SPLINTERDB_WRITE_DELETE, .key = key};
+      } else {
+         ops[i].value      = slice_create(sizeof("bogus"), "bogus");
+         ops[num_keys + i] = (splinterdb_write_op){
+            .type = SPLINTERDB_WRITE_INSERT, .key = key, .value = value};
+      }
+   }
+
+   int rc = splinterdb_write_batch(data->kvsb, ops, num_ops);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int k = 0; k < num_keys; k++) {
+      slice key = slice_create(TEST_INSERT_KEY_LENGTH, keybufs[k]);
+      rc        = splinterdb_lookup(data->kvsb, key, &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(k % 3 != 0, splinterdb_lookup_found(&result), "k=%d", k);
+      if (k % 3 != 0) {
+         slice value;
+         rc = splinterdb_lookup_result_value(&result, &value);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value));
+         ASSERT_STREQN(valbufs[k], slice_data(value), slice_length(value));
+      }
+   }
+
+   // Make one key too large: the whole batch is rejected
+   char too_large_key_data[TEST_MAX_KEY_SIZE + 1];
+   memset(too_large_key_data, 'a', sizeof(too_large_key_data));
+   for (int i = 0; i < num_keys; i++) {
+      ops[i] = (splinterdb_write_op){.type = SPLINTERDB_WRITE_DELETE,
+                                     .key  = ops[i].key};
+   }
+   ops[num_keys - 1].key =
+      slice_create(sizeof(too_large_key_data), too_large_key_data);
+   rc = splinterdb_write_batch(data->kvsb, ops, num_keys);
+   ASSERT_EQUAL(EINVAL, rc);
+
+   for (int k = 1; k < num_keys; k++) {
+      slice key = slice_create(TEST_INSERT_KEY_LENGTH, keybufs[k]);
+      rc        = splinterdb_lookup(data->kvsb, key, &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(k % 3 != 0, splinterdb_lookup_found(&result), "k=%d", k);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   free(ops);
+   free(valbufs);
+   free(keybufs);
+}
+
+/*
+ * Range deletes hide the keys in their range from lookups and iterators,
+ * through compactions and across a close / reopen, without affecting keys
+ * written afterwards.
+ */
+CTEST2(splinterdb_quick, test_delete_range)
+{
+   const int num_keys   = 500;
+   const int start_i    = 100;
+   const int end_i      = 200;
+   const int reinsert_i = 150;
+   char      start_key[TEST_INSERT_KEY_LENGTH];
+   char      end_key[TEST_INSERT_KEY_LENGTH];
+   char      key[TEST_INSERT_KEY_LENGTH];
+   char      val[TEST_INSERT_VAL_LENGTH];
+   int       rc;
+
+   // Range deletes with nothing left to cover are retired to make room
+   for (int i = 0; i < 100; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(start_key, sizeof(start_key), key_fmt, i));
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(end_key, sizeof(end_key), key_fmt, i + 1));
+      rc = splinterdb_delete_range(data->kvsb,
+                                   slice_create(sizeof(start_key), start_key),
+                                   slice_create(sizeof(end_key), end_key));
+      ASSERT_EQUAL(0, rc, "i=%d", i);
+   }
+
+   rc = splinterdb_delete_range(data->kvsb,
+                                slice_create(sizeof(end_key), end_key),
+                                slice_create(sizeof(start_key), start_key));
+   ASSERT_EQUAL(EINVAL, rc);
+
+   for (int i = 0; i < num_keys; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+      rc = splinterdb_insert(data->kvsb,
+                             slice_create(sizeof(key), key),
+                             slice_create(sizeof(val), val));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   ASSERT_EQUAL(KEY_FMT_LENGTH,
+                snprintf(start_key, sizeof(start_key), key_fmt, start_i));
+   ASSERT_EQUAL(KEY_FMT_LENGTH,
+                snprintf(end_key, sizeof(end_key), key_fmt, end_i));
+   rc = splinterdb_delete_range(data->kvsb,
+                                slice_create(sizeof(start_key), start_key),
+                                slice_create(sizeof(end_key), end_key));
+   ASSERT_EQUAL(0, rc);
+
+   ASSERT_EQUAL(KEY_FMT_LENGTH,
+                snprintf(key, sizeof(key), key_fmt, reinsert_i));
+   ASSERT_EQUAL(VAL_FMT_LENGTH,
+                snprintf(val, sizeof(val), val_fmt, reinsert_i));
+   rc = splinterdb_insert(data->kvsb,
+                          slice_create(sizeof(key), key),
+                          slice_create(sizeof(val), val));
+   ASSERT_EQUAL(0, rc);
+   check_range_deleted(data->kvsb, num_keys, start_i, end_i, reinsert_i);
+
+   // Push the range delete through compactions of the branches it covers
+   for (int round = 0; round < 40; round++) {
+      for (int i = 0; i < num_keys; i++) {
+         if (start_i <= i && i < end_i) {
+            continue;
+         }
+         ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+         ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+         rc = splinterdb_insert(data->kvsb,
+                                slice_create(sizeof(key), key),
+                                slice_create(sizeof(val), val));
+         ASSERT_EQUAL(0, rc);
+      }
+      splinterdb_snapshot *snapshot = NULL;
+      rc = splinterdb_snapshot_create(data->kvsb, &snapshot);
+      ASSERT_EQUAL(0, rc);
+      splinterdb_snapshot_release(data->kvsb, snapshot);
+   }
+   check_range_deleted(data->kvsb, num_keys, start_i, end_i, reinsert_i);
+
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   check_range_deleted(data->kvsb, num_keys, start_i, end_i, reinsert_i);
+}
+
+/*
+ * More range deletes than fit in the table at once, each covering keys
+ * already flushed from the memtable, succeed: the ranges of the pending ones
+ * are compacted to make room.
+ */
+CTEST2(splinterdb_quick, test_delete_range_many_covering)
+{
+   const int num_keys = 1000;
+   char      start_key[TEST_INSERT_KEY_LENGTH];
+   char      end_key[TEST_INSERT_KEY_LENGTH];
+   char      key[TEST_INSERT_KEY_LENGTH];
+   char      val[TEST_INSERT_VAL_LENGTH];
+   int       rc;
+
+   for (int i = 0; i < num_keys; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+      rc = splinterdb_insert(data->kvsb,
+                             slice_create(sizeof(key), key),
+                             slice_create(sizeof(val), val));
+      ASSERT_EQUAL(0, rc);
+   }
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   for (int i = 0; i < num_keys; i += 10) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(start_key, sizeof(start_key), key_fmt, i));
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(end_key, sizeof(end_key), key_fmt, i + 5));
+      rc = splinterdb_delete_range(data->kvsb,
+                                   slice_create(sizeof(start_key), start_key),
+                                   slice_create(sizeof(end_key), end_key));
+      ASSERT_EQUAL(0, rc, "i=%d", i);
+   }
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < num_keys; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      rc = splinterdb_lookup(
+         data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(5 <= i % 10, splinterdb_lookup_found(&result), "i=%d", i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+}
+
 /*
  * Regression test for bug where repeating a cycle of insert-close-reopen
  * causes a space leak and eventually hits an assertion
@@ -753,6 +1453,273 @@ CTEST2(splinterdb_quick, test_repeated_insert_close_reopen)
    }
 }
 
+/*
+ * Test case to verify that splinterdb_stats_get() reports the operations
+ * performed on a database created with use_stats.
+ */
+CTEST2(splinterdb_quick, test_stats_get)
+{
+   const int num_inserts = 1000;
+
+   splinterdb_stats stats = {.size = sizeof(stats)};
+   int              rc    = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(SPLINTERDB_STATS_VERSION, stats.version);
+   ASSERT_EQUAL(sizeof(stats), stats.size);
+   ASSERT_EQUAL(0, stats.insertions);
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_stats = TRUE;
+   rc                  = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   rc = insert_keys(data->kvsb, 0, num_inserts, 1);
+   ASSERT_EQUAL(0, rc);
+
+   char                     key[TEST_INSERT_KEY_LENGTH];
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < 2 * num_inserts; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      rc = splinterdb_lookup(
+         data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   rc = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(SPLINTERDB_STATS_VERSION, stats.version);
+   ASSERT_EQUAL(num_inserts, stats.insertions);
+   ASSERT_EQUAL(0, stats.deletions);
+   ASSERT_EQUAL(num_inserts, stats.lookups_found);
+   ASSERT_EQUAL(num_inserts, stats.lookups_not_found);
+
+   ASSERT_EQUAL(num_inserts, stats.insert_latency.count);
+   ASSERT_TRUE(stats.insert_latency.min_ns <= stats.insert_latency.p50_ns);
+   ASSERT_TRUE(stats.insert_latency.p50_ns <= stats.insert_latency.p90_ns);
+   ASSERT_TRUE(stats.insert_latency.p90_ns <= stats.insert_latency.p99_ns);
+   ASSERT_TRUE(stats.insert_latency.p99_ns <= stats.insert_latency.p999_ns);
+   ASSERT_TRUE(stats.insert_latency.p999_ns <= stats.insert_latency.max_ns);
+   ASSERT_EQUAL(0, stats.delete_latency.count);
+   ASSERT_TRUE(stats.cache_hits > 0);
+
+   // A caller built against an older, shorter struct gets nothing past it
+   const uint32 old_size = offsetof(splinterdb_stats, lookups_found);
+   memset(&stats, 0xff, sizeof(stats));
+   stats.size = old_size;
+   rc         = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(old_size, stats.size);
+   ASSERT_EQUAL(num_inserts, stats.insertions);
+   ASSERT_EQUAL(UINT64_MAX, stats.lookups_found);
+
+   stats.size = 0;
+   rc         = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(EINVAL, rc);
+}
+
+/*
+ * Test case to verify that scanning the partitions of a range in parallel
+ * returns each key of the range exactly once, including keys still in the
+ * memtable, and that a scan callback can stop its scan.
+ */
+CTEST2(splinterdb_quick, test_scan_partitions)
+{
+   const int num_keys     = 300 * 1000;
+   const int num_inserted = 1000;
+   int       rc;
+
+   // Small nodes, so that there are pivots to split on
+   splinterdb_close(&data->kvsb);
+   data->cfg.memtable_capacity = 1 * Mega;
+   data->cfg.fanout            = 4;
+   rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   bulk_load_source_state source = {.num_keys       = num_keys,
+                                    .out_of_order_i = -1};
+   rc = splinterdb_bulk_load(data->kvsb, bulk_load_source, &source);
+   ASSERT_EQUAL(0, rc);
+   char key[BULK_LOAD_KEY_LENGTH];
+   char val[BULK_LOAD_VAL_LENGTH];
+   for (int i = num_keys; i < num_keys + num_inserted; i++) {
+      snprintf(key, sizeof(key), bulk_load_key_fmt, i);
+      snprintf(val, sizeof(val), bulk_load_val_fmt, i);
+      rc = splinterdb_insert(data->kvsb,
+                             slice_create(sizeof(key), key),
+                             slice_create(sizeof(val), val));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   splinterdb_scan_partitions *partitions = NULL;
+   rc                                     = splinterdb_scan_partitions_create(
+      data->kvsb, NULL_SLICE, NULL_SLICE, SCAN_MAX_PARTITIONS, &partitions);
+   ASSERT_EQUAL(0, rc);
+   uint64 num_partitions = splinterdb_scan_partitions_count(partitions);
+   ASSERT_TRUE(1 < num_partitions && num_partitions <= SCAN_MAX_PARTITIONS,
+               "num_partitions=%lu",
+               num_partitions);
+
+   scan_partition_state states[SCAN_MAX_PARTITIONS];
+   pthread_t            threads[SCAN_MAX_PARTITIONS];
+   for (uint64 p = 0; p < num_partitions; p++) {
+      states[p] = (scan_partition_state){
+         .kvsb = data->kvsb, .partitions = partitions, .partition = p};
+      rc = pthread_create(&threads[p], NULL, scan_partition_thread, &states[p]);
+      ASSERT_EQUAL(0, rc);
+   }
+   int total = 0;
+   for (uint64 p = 0; p < num_partitions; p++) {
+      pthread_join(threads[p], NULL);
+      ASSERT_EQUAL(0, states[p].rc, "p=%lu", p);
+      total += states[p].num_keys;
+      if (0 < p && 0 < states[p].num_keys) {
+         ASSERT_TRUE(
+            memcmp(states[p - 1].last_key, states[p].first_key, sizeof(key))
+               < 0,
+            "p=%lu",
+            p);
+      }
+   }
+   // The partitions are ordered, so equal counts mean no key is repeated
+   ASSERT_EQUAL(num_keys + num_inserted, total);
+
+   // A callback returning non-zero stops the scan
+   states[0] = (scan_partition_state){.num_keys = -10};
+   rc        = splinterdb_scan_partition(
+      data->kvsb, partitions, 0, scan_partition_check_key, &states[0]);
+   ASSERT_EQUAL(-1, rc);
+   ASSERT_EQUAL(0, states[0].num_keys);
+   rc = splinterdb_scan_partition(data->kvsb,
+                                  partitions,
+                                  num_partitions,
+                                  scan_partition_check_key,
+                                  &states[0]);
+   ASSERT_EQUAL(EINVAL, rc);
+   splinterdb_scan_partitions_destroy(data->kvsb, partitions);
+
+   // Partitions of a bounded range stay within it
+   char end_key[BULK_LOAD_KEY_LENGTH];
+   snprintf(key, sizeof(key), bulk_load_key_fmt, 1000);
+   snprintf(end_key, sizeof(end_key), bulk_load_key_fmt, 101000);
+   slice start = slice_create(sizeof(key), key);
+   slice end   = slice_create(sizeof(end_key), end_key);
+   rc          = splinterdb_scan_partitions_create(
+      data->kvsb, start, end, SCAN_MAX_PARTITIONS, &partitions);
+   ASSERT_EQUAL(0, rc);
+   num_partitions = splinterdb_scan_partitions_count(partitions);
+   total          = 0;
+   for (uint64 p = 0; p < num_partitions; p++) {
+      states[p] = (scan_partition_state){0};
+      rc        = splinterdb_scan_partition(
+         data->kvsb, partitions, p, scan_partition_check_key, &states[p]);
+      ASSERT_EQUAL(0, rc);
+      total += states[p].num_keys;
+   }
+   ASSERT_EQUAL(100000, total);
+   ASSERT_EQUAL(0, memcmp(key, states[0].first_key, sizeof(key)));
+   snprintf(key, sizeof(key), bulk_load_key_fmt, 100999);
+   ASSERT_EQUAL(
+      0, memcmp(key, states[num_partitions - 1].last_key, sizeof(key)));
+   splinterdb_scan_partitions_destroy(data->kvsb, partitions);
+}
+
+/*
+ * Test case to verify that keyspaces keep their keys apart from each other
+ * and from the default keyspace, each with its own data_config, and that
+ * they persist across close and reopen.
+ */
+CTEST2(splinterdb_quick, test_keyspaces)
+{
+   const int   num_inserts = 1000;
+   const char *names[]     = {"first", "second"};
+   splinterdb *keyspaces[ARRAY_SIZE(names)];
+   data_config keyspace_data_cfgs[ARRAY_SIZE(names)];
+   char        key[TEST_INSERT_KEY_LENGTH];
+   char        val[TEST_INSERT_VAL_LENGTH];
+   int         rc;
+
+   // The default keyspace holds keys 0 .. num_inserts - 1, and keyspace k
+   // the next num_inserts keys after those of keyspace k - 1
+   rc = insert_keys(data->kvsb, 0, num_inserts, 1);
+   ASSERT_EQUAL(0, rc);
+   for (int k = 0; k < ARRAY_SIZE(names); k++) {
+      default_data_config_init(TEST_INSERT_KEY_LENGTH, &keyspace_data_cfgs[k]);
+      rc = splinterdb_keyspace_create(
+         data->kvsb, names[k], &keyspace_data_cfgs[k], &keyspaces[k]);
+      ASSERT_EQUAL(0, rc);
+      rc = insert_keys(keyspaces[k], (k + 1) * num_inserts, num_inserts, 1);
+      ASSERT_EQUAL(0, rc);
+   }
+
+   splinterdb *other;
+   rc = splinterdb_keyspace_create(
+      data->kvsb, names[0], &keyspace_data_cfgs[0], &other);
+   ASSERT_EQUAL(EEXIST, rc);
+   rc = splinterdb_keyspace_open(
+      data->kvsb, names[0], &keyspace_data_cfgs[0], &other);
+   ASSERT_EQUAL(EAGAIN, rc);
+   rc = splinterdb_keyspace_open(
+      data->kvsb, "third", &keyspace_data_cfgs[0], &other);
+   ASSERT_EQUAL(ENOENT, rc);
+
+   // Each keyspace enforces its own max_key_size
+   char long_key[TEST_INSERT_KEY_LENGTH + 1] = {0};
+   rc = splinterdb_insert(keyspaces[0],
+                          slice_create(sizeof(long_key), long_key),
+                          slice_create(sizeof(val), val));
+   ASSERT_EQUAL(EINVAL, rc);
+   rc = splinterdb_insert(data->kvsb,
+                          slice_create(sizeof(long_key), long_key),
+                          slice_create(sizeof(val), val));
+   ASSERT_EQUAL(0, rc);
+
+   for (int reopen = 0; reopen < 2; reopen++) {
+      splinterdb *all[] = {data->kvsb, keyspaces[0], keyspaces[1]};
+      for (int k = 0; k < ARRAY_SIZE(all); k++) {
+         int                  i  = k * num_inserts;
+         splinterdb_iterator *it = NULL;
+         rc = splinterdb_iterator_init(all[k], &it, NULL_SLICE);
+         ASSERT_EQUAL(0, rc);
+         for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+            slice curr_key, curr_val;
+            splinterdb_iterator_get_current(it, &curr_key, &curr_val);
+            if (slice_length(curr_key) == sizeof(long_key)) {
+               ASSERT_EQUAL(0, k);
+               continue;
+            }
+            snprintf(key, sizeof(key), key_fmt, i);
+            snprintf(val, sizeof(val), val_fmt, i);
+            ASSERT_EQUAL(sizeof(key), slice_length(curr_key), "k=%d", k);
+            ASSERT_EQUAL(0, memcmp(key, slice_data(curr_key), sizeof(key)));
+            ASSERT_EQUAL(0, memcmp(val, slice_data(curr_val), sizeof(val)));
+            i++;
+         }
+         ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+         ASSERT_EQUAL((k + 1) * num_inserts, i, "k=%d", k);
+         splinterdb_iterator_deinit(it);
+      }
+
+      for (int k = 0; k < ARRAY_SIZE(names); k++) {
+         splinterdb_close(&keyspaces[k]);
+         ASSERT_NULL(keyspaces[k]);
+      }
+      splinterdb_close(&data->kvsb);
+      rc = splinterdb_open(&data->cfg, &data->kvsb);
+      ASSERT_EQUAL(0, rc);
+      for (int k = 0; k < ARRAY_SIZE(names); k++) {
+         rc = splinterdb_keyspace_open(
+            data->kvsb, names[k], &keyspace_data_cfgs[k], &keyspaces[k]);
+         ASSERT_EQUAL(0, rc);
+      }
+   }
+
+   for (int k = 0; k < ARRAY_SIZE(names); k++) {
+      splinterdb_close(&keyspaces[k]);
+   }
+}
+
 // Check that the value-oriented functions work sensibly with a custom
 // data_config
 CTEST2(splinterdb_quick, test_custom_data_config)
@@ -832,6 +1799,11 @@ CTEST2(splinterdb_quick, test_iterator_custom_comparator)
    data->default_data_cfg.super.key_compare = custom_key_comparator;
    data->default_data_cfg.num_comparisons   = 0;
 
+   // The default key_normalize must not order keys past the comparator
+   data_config *data_cfg = &data->default_data_cfg.super;
+   ASSERT_EQUAL(data_cfg->key_normalize(data_cfg, slice_create(1, "a")),
+                data_cfg->key_normalize(data_cfg, slice_create(1, "b")));
+
    int rc = splinterdb_create(&data->cfg, &data->kvsb);
    ASSERT_EQUAL(0, rc);
 
@@ -866,6 +1838,102 @@ CTEST2(splinterdb_quick, test_iterator_custom_comparator)
    }
 }
 
+/*
+ * Test case to verify splinterdb_iterator_init_prefix(). Keys are of the form
+ * "tNN-xxxx", where "tNN-" is the prefix. Tenants are loaded in separate
+ * phases, with a re-open between phases, so that each tenant's keys are held
+ * in only some of the branches of the tree.
+ */
+CTEST2(splinterdb_quick, test_iterator_init_prefix)
+{
+   splinterdb_close(&data->kvsb);
+   data->default_data_cfg.super.key_prefix = tenant_key_prefix;
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   const int num_tenants  = 9;
+   const int keys_per_tnt = 500;
+   char      key[TEST_INSERT_KEY_LENGTH];
+   char      val[TEST_INSERT_VAL_LENGTH];
+   for (int phase = 0; phase < 3; phase++) {
+      for (int i = 0; i < keys_per_tnt; i++) {
+         for (int t = phase; t < num_tenants; t += 3) {
+            ASSERT_EQUAL(KEY_FMT_LENGTH,
+                         snprintf(key, sizeof(key), "t%02d-%04x", t, i));
+            ASSERT_EQUAL(VAL_FMT_LENGTH,
+                         snprintf(val, sizeof(val), val_fmt, i));
+            rc = splinterdb_insert(data->kvsb,
+                                   slice_create(strlen(key), key),
+                                   slice_create(sizeof(val), val));
+            ASSERT_EQUAL(0, rc);
+         }
+      }
+      splinterdb_close(&data->kvsb);
+      rc = splinterdb_open(&data->cfg, &data->kvsb);
+      ASSERT_EQUAL(0, rc);
+   }
+
+   splinterdb_iterator *it = NULL;
+   for (int t = 0; t <= num_tenants; t++) {
+      char prefix[sizeof("tNN-")];
+      ASSERT_EQUAL(4, snprintf(prefix, sizeof(prefix), "t%02d-", t));
+      rc = splinterdb_iterator_init_prefix(
+         data->kvsb, &it, slice_create(strlen(prefix), prefix));
+      ASSERT_EQUAL(0, rc);
+
+      int i = 0;
+      for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+         slice curr_key, curr_val;
+         splinterdb_iterator_get_current(it, &curr_key, &curr_val);
+         ASSERT_EQUAL(KEY_FMT_LENGTH,
+                      snprintf(key, sizeof(key), "t%02d-%04x", t, i));
+         ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+         ASSERT_EQUAL(strlen(key), slice_length(curr_key));
+         ASSERT_STREQN(key, slice_data(curr_key), slice_length(curr_key));
+         ASSERT_STREQN(val, slice_data(curr_val), slice_length(curr_val));
+         i++;
+      }
+      ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+
+      // The last "tenant" was never loaded
+      int expected = t < num_tenants ? keys_per_tnt : 0;
+      ASSERT_EQUAL(expected, i, "t=%d", t);
+      if (expected > 0) {
+         ASSERT_TRUE(splinterdb_iterator_can_prev(it));
+         splinterdb_iterator_prev(it);
+         ASSERT_TRUE(splinterdb_iterator_valid(it));
+      }
+      splinterdb_iterator_deinit(it);
+   }
+
+   // Point lookups still work with filters keyed on prefixes
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int t = 0; t < num_tenants + 1; t++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(key, sizeof(key), "t%02d-%04x", t, t));
+      rc = splinterdb_lookup(
+         data->kvsb, slice_create(strlen(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(t < num_tenants, splinterdb_lookup_found(&result));
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   // A prefix must be a whole prefix
+   rc = splinterdb_iterator_init_prefix(
+      data->kvsb, &it, slice_create(strlen("t01-0"), "t01-0"));
+   ASSERT_EQUAL(EINVAL, rc);
+
+   // The filters on disk are keyed on prefixes: opening without is refused
+   splinterdb_close(&data->kvsb);
+   data->default_data_cfg.super.key_prefix = NULL;
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_NOT_EQUAL(0, rc);
+   data->default_data_cfg.super.key_prefix = tenant_key_prefix;
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+}
+
 /*
  * Test case to verify that iterator interfaces work correctly.
  * Prior to fix for issue #419, this test case would fail with an assertion
@@ -947,7 +2015,7 @@ CTEST2(splinterdb_quick, test_splinterdb_create_w_all_background_threads)
    create_default_cfg(&data->cfg, &data->default_data_cfg.super);
 
    // Task system should be setup with all background threads
-   data->cfg.num_normal_bg_threads   = (MAX_THREADS - 2);
+   data->cfg.num_normal_bg_threads   = (DEFAULT_MAX_THREADS - 2);
    data->cfg.num_memtable_bg_threads = 1;
 
    int rv = splinterdb_create(&data->cfg, &data->kvsb);
@@ -1145,3 +2213,146 @@ custom_key_comparator(const data_config *cfg, slice key1, slice key2)
    ccfg->num_comparisons += 1;
    return r;
 }
+
+// Async lookup callback: counts the completions of one lookup
+static void
+count_lookup_async_callbacks(splinterdb_lookup_async_ctxt *ctxt,
+                             splinterdb_lookup_result     *result,
+                             void                         *arg)
+{
+   int *num_callbacks = (int *)arg;
+   (*num_callbacks)++;
+}
+
+// Prefix extractor for keys "tNN-...": the prefix runs through the first '-'
+static uint64
+tenant_key_prefix(const data_config *cfg, slice key)
+{
+   const char *dash = memchr(slice_data(key), '-', slice_length(key));
+   return dash == NULL ? slice_length(key)
+                       : dash - (const char *)slice_data(key) + 1;
+}
+
+/*
+ * Checks that exactly the keys in [start_i, end_i) other than reinserted_i
+ * are missing from the first num_keys keys, through lookups and an iterator.
+ */
+static void
+check_range_deleted(splinterdb *kvsb,
+                    int         num_keys,
+                    int         start_i,
+                    int         end_i,
+                    int         reinserted_i)
+{
+   char key[TEST_INSERT_KEY_LENGTH];
+   int  rc;
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(kvsb, &result, 0, NULL);
+   for (int i = 0; i < num_keys; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      rc = splinterdb_lookup(kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      bool32 expected = i < start_i || end_i <= i || i == reinserted_i;
+      ASSERT_EQUAL(expected, splinterdb_lookup_found(&result), "i=%d", i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   splinterdb_iterator *it = NULL;
+   rc = splinterdb_iterator_init(kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   int i = 0;
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      if (i == start_i) {
+         i = reinserted_i;
+      } else if (i == reinserted_i + 1) {
+         i = end_i;
+      }
+      check_current_tuple(it, i);
+      i++;
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   ASSERT_EQUAL(num_keys, i);
+   splinterdb_iterator_deinit(it);
+}
+
+// Bulk load source: keys 0 .. num_keys - 1, with key 0 at out_of_order_i
+static _Bool
+bulk_load_source(void *arg, slice *key, slice *value)
+{
+   bulk_load_source_state *state = (bulk_load_source_state *)arg;
+   if (state->next_i == state->num_keys) {
+      return FALSE;
+   }
+   int i = state->next_i == state->out_of_order_i ? 0 : state->next_i;
+   snprintf(state->key, sizeof(state->key), bulk_load_key_fmt, i);
+   snprintf(state->val, sizeof(state->val), bulk_load_val_fmt, i);
+   *key   = slice_create(sizeof(state->key), state->key);
+   *value = slice_create(sizeof(state->val), state->val);
+   state->next_i++;
+   return TRUE;
+}
+
+/*
+ * Scan callback recording the first and last keys of a partition and
+ * checking that keys come in increasing order. Stops the scan with -1 once
+ * num_keys reaches 0 from below.
+ */
+static int
+scan_partition_check_key(uint64 partition, slice key, slice value, void *arg)
+{
+   scan_partition_state *state = (scan_partition_state *)arg;
+   if (slice_length(key) != sizeof(state->last_key)
+       || slice_length(value) != BULK_LOAD_VAL_LENGTH)
+   {
+      return ENOENT;
+   }
+   if (state->num_keys == 0) {
+      memcpy(state->first_key, slice_data(key), sizeof(state->first_key));
+   } else if (memcmp(state->last_key, slice_data(key), sizeof(state->last_key))
+              >= 0)
+   {
+      return ERANGE;
+   }
+   memcpy(state->last_key, slice_data(key), sizeof(state->last_key));
+   state->num_keys++;
+   return state->num_keys == 0 ? -1 : 0;
+}
+
+// Rewrites every key a few times, pushing each round into the trunk
+static void *
+zero_copy_overwrite_thread(void *arg)
+{
+   zero_copy_overwriter *overwriter = (zero_copy_overwriter *)arg;
+   splinterdb_register_thread(overwriter->kvsb);
+   for (int round = 0; round < 4 && overwriter->rc == 0; round++) {
+      overwriter->rc =
+         insert_keys(overwriter->kvsb, 0, overwriter->num_keys, 1);
+      splinterdb_snapshot *snapshot = NULL;
+      if (overwriter->rc == 0) {
+         overwriter->rc =
+            splinterdb_snapshot_create(overwriter->kvsb, &snapshot);
+      }
+      if (overwriter->rc == 0) {
+         splinterdb_snapshot_release(overwriter->kvsb, snapshot);
+      }
+   }
+   overwriter->done = 1;
+   splinterdb_deregister_thread(overwriter->kvsb);
+   return NULL;
+}
+
+static void *
+scan_partition_thread(void *arg)
+{
+   scan_partition_state *state = (scan_partition_state *)arg;
+   splinterdb_register_thread(state->kvsb);
+   state->rc = splinterdb_scan_partition(state->kvsb,
+                                         state->partitions,
+                                         state->partition,
+                                         scan_partition_check_key,
+                                         state);
+   splinterdb_deregister_thread(state->kvsb);
+   return NULL;
+}
+
@@ -0,0 +1,807 @@
+// Copyright 2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * -----------------------------------------------------------------------------
+ * splinterdb_recovery_test.c --
+ *
+ *  Tests of how SplinterDB recovers from a crash by replaying its log on top
+ *  of its last checkpoint. A child process writes to the database and exits
+ *  without closing it; the test then checks what reopening it recovers.
+ * -----------------------------------------------------------------------------
+ */
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "splinterdb/splinterdb.h"
+#include "splinterdb/default_data_config.h"
+#include "unit_tests.h"
+#include "ctest.h" // This is required for all test-case files.
+#include "config.h"
+
+#define TEST_MAX_KEY_SIZE 13
+
+// Hard-coded format strings to generate key and values
+static const char key_fmt[] = "key-%04x";
+static const char val_fmt[] = "val-%04x";
+#define KEY_FMT_LENGTH         (8)
+#define VAL_FMT_LENGTH         (8)
+#define TEST_INSERT_KEY_LENGTH (KEY_FMT_LENGTH + 1)
+#define TEST_INSERT_VAL_LENGTH (VAL_FMT_LENGTH + 1)
+
+// Function Prototypes
+static void
+create_default_cfg(splinterdb_config *out_cfg, data_config *default_data_cfg);
+
+static int
+insert_keys(splinterdb *kvsb, const int minkey, int numkeys, const int incr);
+
+static int
+check_current_tuple(splinterdb_iterator *it, const int expected_i);
+
+static void
+check_range_deleted(splinterdb *kvsb,
+                    int         num_keys,
+                    int         start_i,
+                    int         end_i,
+                    int         reinserted_i);
+
+// A thread inserting num_keys keys, counting those acknowledged in num_acked
+#define LOG_SYNC_NUM_THREADS (4)
+typedef struct {
+   splinterdb   *kvsb;
+   int           first_key;
+   int           num_keys;
+   volatile int *num_acked;
+} log_sync_writer;
+
+static void *
+log_sync_writer_thread(void *arg);
+
+/*
+ * Global data declaration macro:
+ */
+CTEST_DATA(splinterdb_recovery)
+{
+   splinterdb       *kvsb;
+   splinterdb_config cfg;
+   data_config       default_data_cfg;
+};
+
+// Optional setup function for suite, called before every test in suite
+CTEST_SETUP(splinterdb_recovery)
+{
+   default_data_config_init(TEST_MAX_KEY_SIZE, &data->default_data_cfg);
+   create_default_cfg(&data->cfg, &data->default_data_cfg);
+   data->cfg.use_shmem =
+      config_parse_use_shmem(Ctest_argc, (char **)Ctest_argv);
+
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+}
+
+// Optional teardown function for suite, called after every test in suite
+CTEST_TEARDOWN(splinterdb_recovery)
+{
+   if (data->kvsb) {
+      splinterdb_close(&data->kvsb);
+   }
+}
+
+/*
+ * Test case to verify that a write batch is recovered from the log whole or
+ * not at all. A child process writes batches larger than a log page and
+ * exits without closing the database, so the log page it was writing is lost
+ * and the last batch is cut short on disk.
+ */
+CTEST2(splinterdb_recovery, test_write_batch_replay)
+{
+#define WRITE_BATCH_REPLAY_BATCH_SIZE (256)
+   const int batch_size  = WRITE_BATCH_REPLAY_BATCH_SIZE; // > a log page
+   const int num_batches = 30;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log = TRUE;
+   int rc            = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   char  key[TEST_INSERT_KEY_LENGTH];
+   char  val[TEST_INSERT_VAL_LENGTH];
+   pid_t pid = fork();
+   ASSERT_TRUE(pid >= 0);
+   if (pid == 0) {
+      splinterdb_config child_cfg = data->cfg;
+      child_cfg.use_shmem         = FALSE;
+      splinterdb *kvsb;
+      if (splinterdb_open(&child_cfg, &kvsb) != 0) {
+         _exit(1);
+      }
+      char keybufs[WRITE_BATCH_REPLAY_BATCH_SIZE][TEST_INSERT_KEY_LENGTH];
+      char valbufs[WRITE_BATCH_REPLAY_BATCH_SIZE][TEST_INSERT_VAL_LENGTH];
+      splinterdb_write_op ops[WRITE_BATCH_REPLAY_BATCH_SIZE];
+      for (int b = 0; b < num_batches; b++) {
+         for (int j = 0; j < batch_size; j++) {
+            int i = b * batch_size + j;
+            snprintf(keybufs[j], sizeof(keybufs[j]), key_fmt, i);
+            snprintf(valbufs[j], sizeof(valbufs[j]), val_fmt, i);
+            ops[j] = (splinterdb_write_op){
+               .type  = SPLINTERDB_WRITE_INSERT,
+               .key   = slice_create(sizeof(keybufs[j]), keybufs[j]),
+               .value = slice_create(sizeof(valbufs[j]), valbufs[j])};
+         }
+         if (splinterdb_write_batch(kvsb, ops, batch_size)) {
+            _exit(2);
+         }
+      }
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   int num_recovered = 0;
+   for (int b = 0; b < num_batches; b++) {
+      int num_found = 0;
+      for (int j = 0; j < batch_size; j++) {
+         int i = b * batch_size + j;
+         ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+         rc = splinterdb_lookup(
+            data->kvsb, slice_create(sizeof(key), key), &result);
+         ASSERT_EQUAL(0, rc);
+         if (!splinterdb_lookup_found(&result)) {
+            continue;
+         }
+         slice value;
+         rc = splinterdb_lookup_result_value(&result, &value);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+         ASSERT_STREQN(val, slice_data(value), slice_length(value), "i=%d", i);
+         num_found++;
+      }
+      ASSERT_TRUE(num_found == 0 || num_found == batch_size,
+                  "batch %d: %d of %d keys recovered",
+                  b,
+                  num_found,
+                  batch_size);
+      if (num_found != 0) {
+         // the recovered batches are a prefix of those written
+         ASSERT_EQUAL(num_recovered, b);
+         num_recovered++;
+      }
+   }
+   splinterdb_lookup_result_deinit(&result);
+   ASSERT_TRUE(0 < num_recovered);
+}
+
+/*
+ * Test case to verify that a range delete is recovered from the log, in
+ * order with the writes around it. The range spans memtables that were
+ * flushed and the one still taking inserts. A child process then rewrites
+ * the keys outside the range until the range delete is on disk, and exits
+ * without closing the database.
+ */
+CTEST2(splinterdb_recovery, test_delete_range_replay)
+{
+   const int num_keys   = 20 * 1000;
+   const int start_i    = 5 * 1000;
+   const int end_i      = 15 * 1000;
+   const int reinsert_i = 10 * 1000;
+   const int num_rounds = 2;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log           = TRUE;
+   data->cfg.memtable_capacity = 1 * Mega;
+   int rc                      = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   pid_t pid = fork();
+   ASSERT_TRUE(pid >= 0);
+   if (pid == 0) {
+      splinterdb_config child_cfg = data->cfg;
+      child_cfg.use_shmem         = FALSE;
+      splinterdb *kvsb;
+      if (splinterdb_open(&child_cfg, &kvsb) != 0) {
+         _exit(1);
+      }
+      char key[TEST_INSERT_KEY_LENGTH];
+      char val[TEST_INSERT_VAL_LENGTH];
+      for (int round = 0; round <= num_rounds; round++) {
+         for (int i = 0; i < num_keys; i++) {
+            if (round != 0 && start_i <= i && i < end_i) {
+               continue;
+            }
+            snprintf(key, sizeof(key), key_fmt, i);
+            snprintf(val, sizeof(val), val_fmt, i);
+            if (splinterdb_insert(kvsb,
+                                  slice_create(sizeof(key), key),
+                                  slice_create(sizeof(val), val)))
+            {
+               _exit(2);
+            }
+         }
+         if (round != 0) {
+            continue;
+         }
+         char start_key[TEST_INSERT_KEY_LENGTH];
+         char end_key[TEST_INSERT_KEY_LENGTH];
+         snprintf(start_key, sizeof(start_key), key_fmt, start_i);
+         snprintf(end_key, sizeof(end_key), key_fmt, end_i);
+         if (splinterdb_delete_range(
+                kvsb,
+                slice_create(sizeof(start_key), start_key),
+                slice_create(sizeof(end_key), end_key)))
+         {
+            _exit(3);
+         }
+         snprintf(key, sizeof(key), key_fmt, reinsert_i);
+         snprintf(val, sizeof(val), val_fmt, reinsert_i);
+         if (splinterdb_insert(kvsb,
+                               slice_create(sizeof(key), key),
+                               slice_create(sizeof(val), val)))
+         {
+            _exit(4);
+         }
+      }
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   check_range_deleted(data->kvsb, num_keys, start_i, end_i, reinsert_i);
+}
+
+/*
+ * Test case to verify that a database using the log recovers from a crash.
+ * A child process opens the database, overwrites half of its keys and
+ * inserts new ones, and exits without closing it. Log pages are written
+ * back only once full, so the last writes before the crash may be lost, but
+ * what is recovered must be a prefix of the writes.
+ */
+CTEST2(splinterdb_recovery, test_log_replay)
+{
+   const char overwrite_val_fmt[] = "new-%04x";
+   const int  num_inserts          = 2000;
+   const int  first_write          = num_inserts / 2;
+   const int  num_writes           = 20000;
+   const int  max_lost_writes      = 256; // a log page's worth
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log = TRUE;
+   int rc            = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   rc = insert_keys(data->kvsb, 0, num_inserts, 1);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   char  key[TEST_INSERT_KEY_LENGTH];
+   char  val[TEST_INSERT_VAL_LENGTH];
+   pid_t pid = fork();
+   ASSERT_TRUE(pid >= 0);
+   if (pid == 0) {
+      splinterdb_config child_cfg = data->cfg;
+      child_cfg.use_shmem         = FALSE;
+      splinterdb *kvsb;
+      if (splinterdb_open(&child_cfg, &kvsb) != 0) {
+         _exit(1);
+      }
+      for (int i = first_write; i < first_write + num_writes; i++) {
+         snprintf(key, sizeof(key), key_fmt, i);
+         snprintf(val, sizeof(val), overwrite_val_fmt, i);
+         if (splinterdb_insert(kvsb,
+                               slice_create(sizeof(key), key),
+                               slice_create(sizeof(val), val)))
+         {
+            _exit(2);
+         }
+      }
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   int first_lost = first_write + num_writes;
+   for (int i = 0; i < first_write + num_writes; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      rc = splinterdb_lookup(
+         data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      slice value = slice_create(0, NULL);
+      if (splinterdb_lookup_found(&result)) {
+         rc = splinterdb_lookup_result_value(&result, &value);
+         ASSERT_EQUAL(0, rc);
+      }
+
+      if (first_write <= i && i < first_lost) {
+         snprintf(val, sizeof(val), overwrite_val_fmt, i);
+         if (slice_length(value) == sizeof(val)
+             && memcmp(val, slice_data(value), sizeof(val)) == 0)
+         {
+            continue;
+         }
+         // the first write not recovered ends the recovered prefix
+         first_lost = i;
+      }
+      if (num_inserts <= i) {
+         ASSERT_FALSE(splinterdb_lookup_found(&result), "i=%d", i);
+         continue;
+      }
+      ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+      ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value), "i=%d", i);
+      ASSERT_STREQN(val, slice_data(value), slice_length(value), "i=%d", i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+   ASSERT_TRUE(first_write + num_writes - first_lost <= max_lost_writes,
+               "lost %d writes",
+               first_write + num_writes - first_lost);
+}
+
+/*
+ * Test case to verify recovery when the log is truncated by checkpoints taken
+ * while threads insert. With a small log_checkpoint_size, the inserts of a
+ * child process checkpoint many times before it exits without closing the
+ * database. Every acknowledged key must be recovered.
+ */
+CTEST2(splinterdb_recovery, test_log_checkpoint_replay)
+{
+   const int num_threads   = LOG_SYNC_NUM_THREADS;
+   const int keys_per_thr  = 5000;
+   const int min_num_acked = 16000;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log             = TRUE;
+   data->cfg.log_sync            = TRUE;
+   data->cfg.log_checkpoint_size = 128 * KiB;
+   int rc                        = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   volatile int *num_acked = mmap(NULL,
+                                  num_threads * sizeof(*num_acked),
+                                  PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_ANONYMOUS,
+                                  -1,
+                                  0);
+   ASSERT_TRUE(num_acked != MAP_FAILED);
+
+   pid_t pid = fork();
+   ASSERT_TRUE(pid >= 0);
+   if (pid == 0) {
+      splinterdb_config child_cfg = data->cfg;
+      child_cfg.use_shmem         = FALSE;
+      splinterdb *kvsb;
+      if (splinterdb_open(&child_cfg, &kvsb) != 0) {
+         _exit(1);
+      }
+      log_sync_writer writers[LOG_SYNC_NUM_THREADS];
+      pthread_t       threads[LOG_SYNC_NUM_THREADS];
+      for (int t = 0; t < num_threads; t++) {
+         writers[t] = (log_sync_writer){.kvsb      = kvsb,
+                                        .first_key = t * keys_per_thr,
+                                        .num_keys  = keys_per_thr,
+                                        .num_acked = &num_acked[t]};
+         if (pthread_create(
+                &threads[t], NULL, log_sync_writer_thread, &writers[t]))
+         {
+            _exit(2);
+         }
+      }
+      int total;
+      do {
+         total = 0;
+         for (int t = 0; t < num_threads; t++) {
+            total += num_acked[t];
+         }
+      } while (total < min_num_acked);
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char                     key[TEST_INSERT_KEY_LENGTH];
+   char                     val[TEST_INSERT_VAL_LENGTH];
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int t = 0; t < num_threads; t++) {
+      for (int i = t * keys_per_thr; i < t * keys_per_thr + num_acked[t]; i++)
+      {
+         ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+         rc = splinterdb_lookup(
+            data->kvsb, slice_create(sizeof(key), key), &result);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_TRUE(splinterdb_lookup_found(&result), "i=%d", i);
+         slice value;
+         rc = splinterdb_lookup_result_value(&result, &value);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+         ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value), "i=%d", i);
+         ASSERT_STREQN(val, slice_data(value), slice_length(value), "i=%d", i);
+      }
+   }
+   splinterdb_lookup_result_deinit(&result);
+   munmap((void *)num_acked, num_threads * sizeof(*num_acked));
+}
+
+/*
+ * Test case to verify that with log_sync, no acknowledged write is lost in a
+ * crash. Threads of a child process insert keys concurrently, counting each
+ * acknowledged insert in shared memory, and the child exits while they are
+ * still inserting. Every acknowledged key must be recovered.
+ */
+CTEST2(splinterdb_recovery, test_log_sync_replay)
+{
+   const int num_threads   = LOG_SYNC_NUM_THREADS;
+   const int keys_per_thr  = 1000;
+   const int min_num_acked = 2000;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log  = TRUE;
+   data->cfg.log_sync = TRUE;
+   int rc             = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   volatile int *num_acked = mmap(NULL,
+                                  num_threads * sizeof(*num_acked),
+                                  PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_ANONYMOUS,
+                                  -1,
+                                  0);
+   ASSERT_TRUE(num_acked != MAP_FAILED);
+
+   pid_t pid = fork();
+   ASSERT_TRUE(pid >= 0);
+   if (pid == 0) {
+      splinterdb_config child_cfg = data->cfg;
+      child_cfg.use_shmem         = FALSE;
+      splinterdb *kvsb;
+      if (splinterdb_open(&child_cfg, &kvsb) != 0) {
+         _exit(1);
+      }
+      log_sync_writer writers[LOG_SYNC_NUM_THREADS];
+      pthread_t       threads[LOG_SYNC_NUM_THREADS];
+      for (int t = 0; t < num_threads; t++) {
+         writers[t] = (log_sync_writer){.kvsb      = kvsb,
+                                        .first_key = t * keys_per_thr,
+                                        .num_keys  = keys_per_thr,
+                                        .num_acked = &num_acked[t]};
+         if (pthread_create(
+                &threads[t], NULL, log_sync_writer_thread, &writers[t]))
+         {
+            _exit(2);
+         }
+      }
+      int total;
+      do {
+         total = 0;
+         for (int t = 0; t < num_threads; t++) {
+            total += num_acked[t];
+         }
+      } while (total < min_num_acked);
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char                     key[TEST_INSERT_KEY_LENGTH];
+   char                     val[TEST_INSERT_VAL_LENGTH];
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int t = 0; t < num_threads; t++) {
+      for (int i = t * keys_per_thr; i < t * keys_per_thr + num_acked[t]; i++)
+      {
+         ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+         rc = splinterdb_lookup(
+            data->kvsb, slice_create(sizeof(key), key), &result);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_TRUE(splinterdb_lookup_found(&result), "i=%d", i);
+         slice value;
+         rc = splinterdb_lookup_result_value(&result, &value);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+         ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value), "i=%d", i);
+         ASSERT_STREQN(val, slice_data(value), slice_length(value), "i=%d", i);
+      }
+   }
+   splinterdb_lookup_result_deinit(&result);
+   munmap((void *)num_acked, num_threads * sizeof(*num_acked));
+}
+
+/*
+ * Test case to verify that a keyspace recovers from a crash after the
+ * default keyspace has checkpointed, and allocated, since the keyspace's own
+ * last writes. A child process inserts into both and exits without closing
+ * them; the keyspace is only opened again after the default keyspace has
+ * been written to, closed and reopened.
+ */
+CTEST2(splinterdb_recovery, test_keyspace_log_replay)
+{
+   const int num_keyspace_keys = 4000;
+   const int num_default_keys  = 20000; // checkpoints a few times
+   const int max_lost_writes   = 256;   // a log page's worth
+   char      key[TEST_INSERT_KEY_LENGTH];
+   char      val[TEST_INSERT_VAL_LENGTH];
+   int       rc;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log             = TRUE;
+   data->cfg.log_checkpoint_size = 1 * Mega;
+   rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   data_config keyspace_data_cfg;
+   default_data_config_init(TEST_INSERT_KEY_LENGTH, &keyspace_data_cfg);
+   splinterdb *keyspace;
+   rc = splinterdb_keyspace_create(
+      data->kvsb, "logged", &keyspace_data_cfg, &keyspace);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&keyspace);
+   splinterdb_close(&data->kvsb);
+
+   pid_t pid = fork();
+   ASSERT_TRUE(pid >= 0);
+   if (pid == 0) {
+      splinterdb_config child_cfg = data->cfg;
+      child_cfg.use_shmem         = FALSE;
+      splinterdb *kvsb;
+      if (splinterdb_open(&child_cfg, &kvsb) != 0) {
+         _exit(1);
+      }
+      if (splinterdb_keyspace_open(
+             kvsb, "logged", &keyspace_data_cfg, &keyspace))
+      {
+         _exit(2);
+      }
+      // the keyspace logs only after the checkpoints the default one takes
+      if (insert_keys(kvsb, 0, num_default_keys, 1)
+          || insert_keys(keyspace, 0, num_keyspace_keys, 1))
+      {
+         _exit(3);
+      }
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   // allocates the extents of the keyspace's log, unless they are held
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   rc = insert_keys(data->kvsb, num_default_keys, num_default_keys, 1);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   rc = splinterdb_keyspace_open(
+      data->kvsb, "logged", &keyspace_data_cfg, &keyspace);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(keyspace, &result, 0, NULL);
+   int num_found = 0;
+   for (int i = 0; i < num_keyspace_keys; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      rc = splinterdb_lookup(keyspace, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      if (!splinterdb_lookup_found(&result)) {
+         continue;
+      }
+      // what is recovered is a prefix of the writes
+      ASSERT_EQUAL(num_found, i);
+      num_found++;
+      slice value;
+      rc = splinterdb_lookup_result_value(&result, &value);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+      ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value), "i=%d", i);
+      ASSERT_STREQN(val, slice_data(value), slice_length(value), "i=%d", i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+   ASSERT_TRUE(num_keyspace_keys - num_found <= max_lost_writes,
+               "lost %d writes",
+               num_keyspace_keys - num_found);
+
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = num_default_keys; i < 2 * num_default_keys; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      rc = splinterdb_lookup(
+         data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_TRUE(splinterdb_lookup_found(&result), "i=%d", i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+   splinterdb_close(&keyspace);
+}
+
+/*
+ * ********************************************************************************
+ * Define minions and helper functions here, after all test cases are
+ * enumerated.
+ * ********************************************************************************
+ */
+
+static void
+create_default_cfg(splinterdb_config *out_cfg, data_config *default_data_cfg)
+{
+   *out_cfg = (splinterdb_config){.filename   = TEST_DB_NAME,
+                                  .cache_size = 64 * Mega,
+                                  .disk_size  = 127 * Mega,
+                                  .use_shmem  = FALSE,
+                                  .data_cfg   = default_data_cfg};
+}
+
+/*
+ * Helper function to insert n-keys (num_inserts), using pre-formatted
+ * key and value strings. Allows user to specify start value and increment
+ * between keys. This can be used to load either fully sequential keys
+ * or some with defined gaps.
+ *
+ * Parameters:
+ *  kvsb    - SplinterDB handle
+ *  minkey  - Start key to insert
+ *  numkeys - # of keys to insert
+ *  incr    - Increment between keys (default is 1)
+ *
+ * Returns: Return code: rc == 0 => success; anything else => failure
+ */
+static int
+insert_keys(splinterdb *kvsb, const int minkey, int numkeys, const int incr)
+{
+   int rc = -1;
+
+   // Minimally, error check input arguments
+   if (!kvsb || (numkeys <= 0) || (incr < 0))
+      return rc;
+
+   // insert keys forwards, starting from minkey value
+   for (int kctr = minkey; numkeys; kctr += incr, numkeys--) {
+      char key[TEST_INSERT_KEY_LENGTH] = {0};
+      char val[TEST_INSERT_VAL_LENGTH] = {0};
+
+      snprintf(key, sizeof(key), key_fmt, kctr);
+      snprintf(val, sizeof(val), val_fmt, kctr);
+
+      rc = splinterdb_insert(
+         kvsb, slice_create(sizeof(key), key), slice_create(sizeof(val), val));
+      ASSERT_EQUAL(0, rc);
+   }
+   return rc;
+}
+
+/*
+ * Work horse routine to check if the current tuple pointed to by the
+ * iterator is the expected one, as indicated by its index,
+ * expected_i. We use pre-constructed key / value formats to verify
+ * if the current tuple is of the expected format.
+ *
+ * Returns: Return code: rc == 0 => success; anything else => failure
+ */
+static int
+check_current_tuple(splinterdb_iterator *it, const int expected_i)
+{
+   int rc = 0;
+
+   char expected_key[TEST_INSERT_KEY_LENGTH] = {0};
+   char expected_val[TEST_INSERT_VAL_LENGTH] = {0};
+   ASSERT_EQUAL(
+      KEY_FMT_LENGTH,
+      snprintf(expected_key, sizeof(expected_key), key_fmt, expected_i));
+   ASSERT_EQUAL(
+      VAL_FMT_LENGTH,
+      snprintf(expected_val, sizeof(expected_val), val_fmt, expected_i));
+
+   slice key, value;
+
+   splinterdb_iterator_get_current(it, &key, &value);
+
+   ASSERT_EQUAL(TEST_INSERT_KEY_LENGTH, slice_length(key));
+   ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value));
+
+   int key_cmp = memcmp(expected_key, slice_data(key), slice_length(key));
+   int val_cmp = memcmp(expected_val, slice_data(value), slice_length(value));
+   ASSERT_EQUAL(0, key_cmp);
+   ASSERT_EQUAL(0, val_cmp);
+
+   return rc;
+}
+
+/*
+ * Checks that exactly the keys in [start_i, end_i) other than reinserted_i
+ * are missing from the first num_keys keys, through lookups and an iterator.
+ */
+static void
+check_range_deleted(splinterdb *kvsb,
+                    int         num_keys,
+                    int         start_i,
+                    int         end_i,
+                    int         reinserted_i)
+{
+   char key[TEST_INSERT_KEY_LENGTH];
+   int  rc;
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(kvsb, &result, 0, NULL);
+   for (int i = 0; i < num_keys; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      rc = splinterdb_lookup(kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      bool32 expected = i < start_i || end_i <= i || i == reinserted_i;
+      ASSERT_EQUAL(expected, splinterdb_lookup_found(&result), "i=%d", i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   splinterdb_iterator *it = NULL;
+   rc = splinterdb_iterator_init(kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   int i = 0;
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      if (i == start_i) {
+         i = reinserted_i;
+      } else if (i == reinserted_i + 1) {
+         i = end_i;
+      }
+      check_current_tuple(it, i);
+      i++;
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   ASSERT_EQUAL(num_keys, i);
+   splinterdb_iterator_deinit(it);
+}
+
+// Inserts the keys of a log_sync_writer, counting the acknowledged ones
+static void *
+log_sync_writer_thread(void *arg)
+{
+   log_sync_writer *writer = (log_sync_writer *)arg;
+   char             key[TEST_INSERT_KEY_LENGTH];
+   char             val[TEST_INSERT_VAL_LENGTH];
+
+   splinterdb_register_thread(writer->kvsb);
+   for (int i = writer->first_key; i < writer->first_key + writer->num_keys;
+        i++)
+   {
+      snprintf(key, sizeof(key), key_fmt, i);
+      snprintf(val, sizeof(val), val_fmt, i);
+      if (splinterdb_insert(writer->kvsb,
+                            slice_create(sizeof(key), key),
+                            slice_create(sizeof(val), val)))
+      {
+         break;
+      }
+      *writer->num_acked += 1;
+   }
+   splinterdb_deregister_thread(writer->kvsb);
+   return NULL;
+}
@@ -0,0 +1,223 @@
+// Copyright 2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * -----------------------------------------------------------------------------
+ * splinterdb_snapshot_test.c --
+ *
+ *  Tests of point-in-time snapshots, which keep seeing the data they were
+ *  taken over while the live tree takes writes and compacts under them.
+ * -----------------------------------------------------------------------------
+ */
+#include <string.h>
+#include <errno.h>
+
+#include "splinterdb/splinterdb.h"
+#include "splinterdb/default_data_config.h"
+#include "unit_tests.h"
+#include "ctest.h" // This is required for all test-case files.
+#include "config.h"
+
+#define TEST_MAX_KEY_SIZE 13
+
+// Hard-coded format strings to generate key and values
+static const char key_fmt[] = "key-%04x";
+static const char val_fmt[] = "val-%04x";
+#define KEY_FMT_LENGTH         (8)
+#define VAL_FMT_LENGTH         (8)
+#define TEST_INSERT_KEY_LENGTH (KEY_FMT_LENGTH + 1)
+#define TEST_INSERT_VAL_LENGTH (VAL_FMT_LENGTH + 1)
+
+// Function Prototypes
+static void
+create_default_cfg(splinterdb_config *out_cfg, data_config *default_data_cfg);
+
+/*
+ * Global data declaration macro:
+ */
+CTEST_DATA(splinterdb_snapshot)
+{
+   splinterdb       *kvsb;
+   splinterdb_config cfg;
+   data_config       default_data_cfg;
+};
+
+// Optional setup function for suite, called before every test in suite
+CTEST_SETUP(splinterdb_snapshot)
+{
+   default_data_config_init(TEST_MAX_KEY_SIZE, &data->default_data_cfg);
+   create_default_cfg(&data->cfg, &data->default_data_cfg);
+   data->cfg.use_shmem =
+      config_parse_use_shmem(Ctest_argc, (char **)Ctest_argv);
+
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+}
+
+// Optional teardown function for suite, called after every test in suite
+CTEST_TEARDOWN(splinterdb_snapshot)
+{
+   if (data->kvsb) {
+      splinterdb_close(&data->kvsb);
+   }
+}
+
+/*
+ * A snapshot keeps seeing the values it was taken over, while later rounds of
+ * overwrites, deletes and inserts are pushed down the tree and compacted.
+ */
+CTEST2(splinterdb_snapshot, test_snapshot)
+{
+   const int num_keys   = 500;
+   const int num_rounds = 80;
+   char      key[TEST_INSERT_KEY_LENGTH];
+   char      val[TEST_INSERT_VAL_LENGTH];
+   int       rc;
+   for (int i = 0; i < num_keys; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+      rc = splinterdb_insert(data->kvsb,
+                             slice_create(sizeof(key), key),
+                             slice_create(VAL_FMT_LENGTH, val));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   splinterdb_snapshot *snapshot = NULL;
+   rc = splinterdb_snapshot_create(data->kvsb, &snapshot);
+   ASSERT_EQUAL(0, rc);
+
+   // Every round is pushed into the tree by a short-lived snapshot of its own
+   for (int round = 0; round < num_rounds; round++) {
+      for (int i = 0; i < num_keys; i++) {
+         ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+         if (i % 5 == 0) {
+            rc = splinterdb_delete(data->kvsb, slice_create(sizeof(key), key));
+         } else {
+            ASSERT_EQUAL(
+               VAL_FMT_LENGTH,
+               snprintf(val, sizeof(val), "r%02d-%04x", round, i));
+            rc = splinterdb_insert(data->kvsb,
+                                   slice_create(sizeof(key), key),
+                                   slice_create(VAL_FMT_LENGTH, val));
+         }
+         ASSERT_EQUAL(0, rc);
+      }
+      ASSERT_EQUAL(KEY_FMT_LENGTH,
+                   snprintf(key, sizeof(key), key_fmt, num_keys + round));
+      rc = splinterdb_insert(data->kvsb,
+                             slice_create(sizeof(key), key),
+                             slice_create(VAL_FMT_LENGTH, val));
+      ASSERT_EQUAL(0, rc);
+
+      splinterdb_snapshot *round_snapshot = NULL;
+      rc = splinterdb_snapshot_create(data->kvsb, &round_snapshot);
+      ASSERT_EQUAL(0, rc);
+      splinterdb_snapshot_release(data->kvsb, round_snapshot);
+   }
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < num_keys + num_rounds; i++) {
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      rc = splinterdb_snapshot_lookup(
+         data->kvsb, snapshot, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(i < num_keys, splinterdb_lookup_found(&result), "i=%d", i);
+      if (i < num_keys) {
+         slice value;
+         rc = splinterdb_lookup_result_value(&result, &value);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+         ASSERT_STREQN(val, slice_data(value), slice_length(value));
+      }
+
+      // The live tree has moved on
+      rc = splinterdb_lookup(
+         data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(i % 5 != 0 || i >= num_keys,
+                   splinterdb_lookup_found(&result),
+                   "i=%d",
+                   i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   splinterdb_iterator *it = NULL;
+   rc                      = splinterdb_snapshot_iterator_init(
+      data->kvsb, snapshot, &it, NULL_SLICE, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   int i = 0;
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      slice curr_key, curr_val;
+      splinterdb_iterator_get_current(it, &curr_key, &curr_val);
+      ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, i));
+      ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, i));
+      ASSERT_STREQN(key, slice_data(curr_key), slice_length(curr_key));
+      ASSERT_STREQN(val, slice_data(curr_val), slice_length(curr_val));
+      i++;
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   ASSERT_EQUAL(num_keys, i);
+   splinterdb_iterator_deinit(it);
+
+   splinterdb_snapshot_release(data->kvsb, snapshot);
+}
+
+/*
+ * At most 64 snapshots can be live at once. Creating one more fails with
+ * ENOSPC until one of them is released.
+ */
+CTEST2(splinterdb_snapshot, test_snapshot_limit)
+{
+   const int            max_snapshots = 64;
+   splinterdb_snapshot *snapshots[64 + 1];
+   char                 key[TEST_INSERT_KEY_LENGTH];
+   char                 val[TEST_INSERT_VAL_LENGTH];
+   int                  rc;
+
+   ASSERT_EQUAL(KEY_FMT_LENGTH, snprintf(key, sizeof(key), key_fmt, 0));
+   ASSERT_EQUAL(VAL_FMT_LENGTH, snprintf(val, sizeof(val), val_fmt, 0));
+   rc = splinterdb_insert(data->kvsb,
+                          slice_create(sizeof(key), key),
+                          slice_create(VAL_FMT_LENGTH, val));
+   ASSERT_EQUAL(0, rc);
+
+   for (int i = 0; i < max_snapshots; i++) {
+      rc = splinterdb_snapshot_create(data->kvsb, &snapshots[i]);
+      ASSERT_EQUAL(0, rc, "i=%d", i);
+   }
+   rc = splinterdb_snapshot_create(data->kvsb, &snapshots[max_snapshots]);
+   ASSERT_EQUAL(ENOSPC, rc);
+
+   splinterdb_snapshot_release(data->kvsb, snapshots[0]);
+   rc = splinterdb_snapshot_create(data->kvsb, &snapshots[0]);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < max_snapshots; i++) {
+      rc = splinterdb_snapshot_lookup(
+         data->kvsb, snapshots[i], slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_TRUE(splinterdb_lookup_found(&result), "i=%d", i);
+      splinterdb_snapshot_release(data->kvsb, snapshots[i]);
+   }
+   splinterdb_lookup_result_deinit(&result);
+}
+
+/*
+ * ********************************************************************************
+ * Define minions and helper functions here, after all test cases are
+ * enumerated.
+ * ********************************************************************************
+ */
+
+static void
+create_default_cfg(splinterdb_config *out_cfg, data_config *default_data_cfg)
+{
+   *out_cfg = (splinterdb_config){.filename   = TEST_DB_NAME,
+                                  .cache_size = 64 * Mega,
+                                  .disk_size  = 127 * Mega,
+                                  .use_shmem  = FALSE,
+                                  .data_cfg   = default_data_cfg};
+}
@@ -310,7 +310,7 @@ CTEST2(task_system, test_one_thread_using_extern_apis)
 CTEST2(task_system, test_max_threads_using_lower_apis)
 {
    platform_thread new_thread;
-   thread_config   thread_cfg[MAX_THREADS];
+   thread_config   thread_cfg[DEFAULT_MAX_THREADS];
    thread_config  *thread_cfgp = NULL;
    int             tctr        = 0;
    platform_status rc          = STATUS_OK;
@@ -401,7 +401,7 @@ CTEST2(task_system, test_use_all_but_one_threads_for_bg_threads)
    task_system_destroy(data->hid, &data->tasks);
 
    // Consume all-but-one available threads with background threads.
-   rc = create_task_system_with_bg_threads(data, 1, (MAX_THREADS - 3));
+   rc = create_task_system_with_bg_threads(data, 1, (DEFAULT_MAX_THREADS - 3));
    ASSERT_TRUE(SUCCESS(rc));
 
    threadid main_thread_idx = platform_get_tid();
@@ -411,7 +411,7 @@ CTEST2(task_system, test_use_all_but_one_threads_for_bg_threads)
    ZERO_ARRAY(thread_cfg);
    thread_cfg[0].tasks          = data->tasks;
    thread_cfg[0].exp_thread_idx = task_get_max_tid(data->tasks);
-   thread_cfg[0].exp_max_tid    = MAX_THREADS;
+   thread_cfg[0].exp_max_tid    = DEFAULT_MAX_THREADS;
    thread_cfg[0].line           = __LINE__;
 
    platform_thread new_thread[2] = {0};
@@ -474,7 +474,8 @@ create_task_system_without_bg_threads(void *datap)
    rc = task_system_config_init(&data->task_cfg,
                                 TRUE, // use stats
                                 num_bg_threads,
-                                trunk_get_scratch_size());
+                                trunk_get_scratch_size(),
+                                DEFAULT_MAX_THREADS);
    ASSERT_TRUE(SUCCESS(rc));
    rc = task_system_create(data->hid, data->ioh, &data->tasks, &data->task_cfg);
    return rc;
@@ -501,7 +502,8 @@ create_task_system_with_bg_threads(void  *datap,
    rc = task_system_config_init(&data->task_cfg,
                                 TRUE, // use stats
                                 num_bg_threads,
-                                trunk_get_scratch_size());
+                                trunk_get_scratch_size(),
+                                DEFAULT_MAX_THREADS);
    ASSERT_TRUE(SUCCESS(rc));
 
    rc = task_system_create(data->hid, data->ioh, &data->tasks, &data->task_cfg);
@@ -690,14 +692,14 @@ exec_one_of_n_threads(void *arg)
 
    threadid this_threads_index = platform_get_tid();
 
-   ASSERT_TRUE((this_threads_index < MAX_THREADS),
+   ASSERT_TRUE((this_threads_index < DEFAULT_MAX_THREADS),
                "Thread [%lu] Registered thread idx = %lu is invalid.",
                thread_cfg->exp_thread_idx,
                this_threads_index);
 
    // Test case is carefully constructed to fire-up n-threads. Wait for
    // them to all start-up.
-   while (task_get_max_tid(thread_cfg->tasks) < MAX_THREADS) {
+   while (task_get_max_tid(thread_cfg->tasks) < DEFAULT_MAX_THREADS) {
       platform_sleep_ns(USEC_TO_NSEC(100000)); // 100 msec.
    }
 